@@ -3,7 +3,13 @@
 // Produces a single text report listing detected issues per-file.
 //
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_audit.cpp -lparquet -larrow -lzstd -o parquet_audit
+//   g++ -std=gnu++23 -O3 parquet_audit.cpp -lparquet -larrow -lzstd -pthread -o parquet_audit
+//
+// Files are audited on --threads=N workers (default: all cores); the report
+// lists them in argument order whatever N is. --cache=FILE reuses the results of
+// files unchanged since the last run (path+size+mtime, + content hash with --cache-hash).
+
+#include "parquet_audit_pool.h"
 
 #include <parquet/api/reader.h>
 
@@ -141,8 +147,24 @@ struct FileReport
     uint64_t total_price_samples = 0;
     long double sum_qty = 0.0L;
     uint64_t qty_samples = 0;
+
+    string open_error;  // not cached; main prints it in file order
 };
 
+// Fields kept by --cache (file_path is the key); keep in step with FileReport
+template <class F>
+static void audit_fields(FileReport& r, F&& f)
+{
+    f(r.type, r.rows_scanned, r.non_monotonic_ts, r.lastid_lt_firstid, r.id_overlap_count, r.id_gap_count,
+      r.bid_px_count, r.ask_px_count, r.bid_qty_count, r.ask_qty_count,
+      r.has_bid_px_but_zero_count, r.has_ask_px_but_zero_count,
+      r.bid_qty_zero, r.ask_qty_zero, r.bid_px_zero, r.ask_px_zero,
+      r.crossed_book_count, r.price_change_10x_count, r.qty_extreme_deviation_count,
+      r.price_not_div1000_count, r.qty_not_div1e8_count,
+      r.flattened_without_offsets, r.per_row_offsets_mismatch,
+      r.total_price_samples, r.sum_qty, r.qty_samples);
+}
+
 // Helper deciding whether report should be considered "problematic".
 // - By default informational flags (flattened_without_offsets, per_row_offsets_mismatch) are ignored.
 // - If include_info==true, treat informational flags as problems too.
@@ -188,7 +210,7 @@ static FileReport audit_parquet_file(const string& path)
     try {
         reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/true);
     } catch (const exception& e) {
-        cerr << "ERROR: cannot open " << path << " : " << e.what() << "\n";
+        rep.open_error = "cannot open " + path + " : " + e.what();
         return rep;
     }
 
@@ -481,7 +503,7 @@ static void write_report_filtered(const string& outpath, const vector<FileReport
 int main(int argc, char** argv)
 {
     if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " <parquet-file-1> [<parquet-file-2> ...] [--out=report.txt] [--include-info]\n";
+        cerr << "Usage: " << argv[0] << " <parquet-file-1> [<parquet-file-2> ...] [--out=report.txt] [--include-info] [--threads=N] [--cache=FILE [--cache-hash]]\n";
         cerr << "If a directory is passed, use shell expansion: e.g. /path/to/dir/*.parquet or find ... | xargs\n";
         return 1;
     }
@@ -489,6 +511,9 @@ int main(int argc, char** argv)
     vector<string> files;
     string outpath = "parquet_audit_report.txt";
     bool include_info = false;
+    unsigned threads = 0;
+    string cache_path;
+    bool cache_hash = false;
 
     for (int i = 1; i < argc; ++i) {
         string a = argv[i];
@@ -496,6 +521,12 @@ int main(int argc, char** argv)
             outpath = a.substr(6);
         } else if (a == "--include-info") {
             include_info = true;
+        } else if (a.rfind("--threads=", 0) == 0) {
+            threads = (unsigned)stoul(a.substr(10));
+        } else if (a.rfind("--cache=", 0) == 0) {
+            cache_path = a.substr(8);
+        } else if (a == "--cache-hash") {
+            cache_hash = true;
         } else {
             files.push_back(a);
         }
@@ -506,20 +537,33 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    AuditStore<FileReport> store(cache_path, "parquet_audit_new", cache_hash);
+    store.stamp(files, audit_threads(threads));
+
     vector<FileReport> reports;
-    for (const string& f : files) {
-        // If argument is a directory, skip (user should expand), but allow explicit files only
-        if (!file_exists(f)) {
-            cerr << "Skipping missing file: " << f << "\n";
-            continue;
-}
-        cerr << "Auditing: " << f << "\n";
-        try {
-            FileReport r = audit_parquet_file(f);
+    size_t present = 0;
+    audit_files<FileReport>(files, audit_threads(threads),
+        [&](const string& f, FileReport& r) {
+            // If argument is a directory, skip (user should expand), but allow explicit files only
+            if (!file_exists(f)) return false;
+            if (store.get(f, r)) { r.file_path = f; return true; }
+            r = audit_parquet_file(f);
+            return true;
+        },
+        [&](size_t i, FileReport& r, bool ok, const string& err) {
+            if (!ok && err.empty()) { cerr << "Skipping missing file: " << files[i] << "\n"; return; }
+            ++present;
+            cerr << "Auditing: " << files[i] << "\n";
+            if (!ok) { cerr << "ERROR auditing " << files[i] << " : " << err << "\n"; return; }
+            if (!r.open_error.empty()) cerr << "ERROR: " << r.open_error << "\n";
+            else store.put(files[i], r);
             reports.push_back(std::move(r));
-        } catch (const exception& e) {
-            cerr << "ERROR auditing " << f << " : " << e.what() << "\n";
-        }
+        });
+
+    if (store.enabled()) {
+        string err;
+        if (!store.save(&err)) cerr << "WARN: cache " << cache_path << " not saved: " << err << "\n";
+        cerr << "Cache: " << store.hits() << "/" << present << " files reused from " << cache_path << "\n";
     }
 
     write_report_filtered(outpath, reports, include_info);
@@ -0,0 +1,513 @@
+// parquet_audit_pool.h
+// Shared by the parquet_*_audit tools (header only, nothing extra to link):
+//  - audit_files: runs the per-file analysis on all cores with a work-stealing
+//    scheduler and hands results back on the calling thread in input order,
+//    so progress lines and NDJSON output stay the same as a serial run.
+//  - Welford with merge() and audit_reduce for the cross-file statistics pass.
+//  - AuditStore: --cache=FILE keeps per-file results between runs.
+//  - audit_footer: --fast pre-check from the footer and column statistics only.
+//
+// Memory: a worker holds one file at a time (the tool's analyze function reads
+// row group by row group); a result slot is released as soon as it has been
+// handed back.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+#include <parquet/schema.h>
+#include <parquet/statistics.h>
+
+// ---------- Welford ----------
+
+// Welford online mean+variance accumulator
+struct Welford {
+    long double mean = 0.0L;
+    long double m2 = 0.0L;
+    uint64_t n = 0;
+    void add(long double x) {
+        ++n;
+        long double delta = x - mean;
+        mean += delta / (long double)n;
+        long double delta2 = x - mean;
+        m2 += delta * delta2;
+    }
+    // Chan et al. pairwise combination: *this becomes the accumulator of both inputs
+    void merge(const Welford& o) {
+        if (o.n == 0) return;
+        if (n == 0) { *this = o; return; }
+        const long double na = (long double)n, nb = (long double)o.n, nt = na + nb;
+        const long double delta = o.mean - mean;
+        mean += delta * nb / nt;
+        m2 += o.m2 + delta * delta * na * nb / nt;
+        n += o.n;
+    }
+    long double variance() const { return (n > 1) ? (m2 / (long double)(n - 1)) : 0.0L; }
+    long double stddev() const { return std::sqrt((double)variance()); }
+};
+
+// ---------- scheduler ----------
+
+// --threads=N, 0 = all cores
+inline unsigned audit_threads(unsigned requested) {
+    if (requested) return requested;
+    const unsigned hw = std::thread::hardware_concurrency();
+    return hw ? hw : 1;
+}
+
+// Calls fn(i) for every i in [0, n) on `threads` workers. Indices are dealt
+// round-robin so all workers start near the front; a worker takes from the
+// front of its own deque and, once empty, steals the back half of the fullest
+// other deque, which evens out files of very different sizes.
+template <class Fn>
+void audit_parallel_for(size_t n, unsigned threads, Fn&& fn) {
+    threads = (unsigned)std::max<size_t>(1, std::min<size_t>(threads, n));
+    if (threads <= 1) {
+        for (size_t i = 0; i < n; ++i) fn(i);
+        return;
+    }
+
+    struct Queue { std::mutex m; std::deque<size_t> q; };
+    std::vector<Queue> qs(threads);
+    for (size_t i = 0; i < n; ++i) qs[i % threads].q.push_back(i);
+
+    auto take = [&](unsigned w, size_t& i) -> bool {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lk(qs[w].m);
+                if (!qs[w].q.empty()) { i = qs[w].q.front(); qs[w].q.pop_front(); return true; }
+            }
+            unsigned victim = w;
+            size_t most = 0;
+            for (unsigned v = 0; v < threads; ++v) {
+                if (v == w) continue;
+                std::lock_guard<std::mutex> lk(qs[v].m);
+                if (qs[v].q.size() > most) { most = qs[v].q.size(); victim = v; }
+            }
+            if (victim == w) return false;   // nothing left anywhere: work is never added
+            std::scoped_lock lk(qs[w].m, qs[victim].m);
+            auto& from = qs[victim].q;
+            const size_t k = (from.size() + 1) / 2;
+            qs[w].q.insert(qs[w].q.end(), from.end() - (std::ptrdiff_t)k, from.end());
+            from.erase(from.end() - (std::ptrdiff_t)k, from.end());
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads);
+    for (unsigned w = 0; w < threads; ++w) {
+        pool.emplace_back([&, w] {
+            size_t i;
+            while (take(w, i)) fn(i);
+        });
+    }
+    for (auto& t : pool) t.join();
+}
+
+// Analyzes every file on the workers with analyze(path, Result&) -> bool and
+// calls done(i, Result&, ok, err) on the calling thread in index order, as soon
+// as files 0..i are finished. An exception from analyze counts as a failure
+// with err = what().
+template <class Result, class Analyze, class Done>
+void audit_files(const std::vector<std::string>& files, unsigned threads, Analyze&& analyze, Done&& done) {
+    struct Slot {
+        std::optional<Result> r;
+        bool ok = false;
+        std::string err;
+        bool ready = false;
+    };
+    std::vector<Slot> slots(files.size());
+    std::mutex m;
+    std::condition_variable cv;
+
+    auto work = [&](size_t i) {
+        std::optional<Result> r(std::in_place);
+        bool ok = false;
+        std::string err;
+        try {
+            ok = analyze(files[i], *r);
+        } catch (const std::exception& e) {
+            ok = false;
+            err = e.what();
+        } catch (...) {
+            ok = false;
+            err = "unknown exception";
+        }
+        std::lock_guard<std::mutex> lk(m);
+        slots[i].r = std::move(r);
+        slots[i].ok = ok;
+        slots[i].err = std::move(err);
+        slots[i].ready = true;
+        cv.notify_one();
+    };
+
+    std::thread runner([&] { audit_parallel_for(files.size(), threads, work); });
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        Slot* s;
+        {
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait(lk, [&] { return slots[i].ready; });
+            s = &slots[i];
+        }
+        // the slot is no longer touched by the workers once ready
+        done(i, *s->r, s->ok, s->err);
+        s->r.reset();
+    }
+    runner.join();
+}
+
+// ---------- parallel reduce ----------
+
+// Folds items [0, n) into one Acc (default-constructible, with merge(const Acc&)).
+// Fixed-size leaves are accumulated with add(Acc&, i) on the workers, then
+// merged pairwise level by level; the leaf size and pairing do not depend on
+// the thread count, so the result is the same for every --threads.
+template <class Acc, class Add>
+Acc audit_reduce(size_t n, unsigned threads, Add&& add) {
+    constexpr size_t LEAF = 4096;
+    const size_t leaves = (n + LEAF - 1) / LEAF;
+    if (leaves == 0) return Acc{};
+
+    std::vector<Acc> part(leaves);
+    audit_parallel_for(leaves, threads, [&](size_t l) {
+        const size_t end = std::min(n, (l + 1) * LEAF);
+        for (size_t i = l * LEAF; i < end; ++i) add(part[l], i);
+    });
+    for (size_t width = 1; width < leaves; width *= 2) {
+        const size_t pairs = (leaves + 2 * width - 1) / (2 * width);
+        audit_parallel_for(pairs, threads, [&](size_t p) {
+            const size_t a = p * 2 * width, b = a + width;
+            if (b < leaves) part[a].merge(part[b]);
+        });
+    }
+    return std::move(part[0]);
+}
+
+// ---------- persistent result store ----------
+
+// 64-bit hash of the whole file (8-byte words, FNV-style multiply + xorshift)
+inline uint64_t audit_file_hash(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return 0;
+    std::vector<char> buf(1 << 20);
+    uint64_t h = 1469598103934665603ULL;
+    while (in) {
+        in.read(buf.data(), (std::streamsize)buf.size());
+        const size_t n = (size_t)in.gcount();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, buf.data() + i, 8);
+            h = (h ^ w) * 1099511628211ULL;
+            h ^= h >> 29;
+        }
+        for (; i < n; ++i) h = (h ^ (unsigned char)buf[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// --cache=FILE: results of earlier runs keyed by absolute path + size + mtime
+// (+ a hash of the whole file with --cache-hash), so a rerun analyzes only new
+// or changed files and the outlier pass / output run on the cached metrics.
+// Failed files are not stored. The tool lists the stored Metric fields in
+//   template <class F> void audit_fields(Metric& m, F&& f) { f(m.a, m.b, ...); }
+// (arithmetic and std::string fields); a store written by another tool or with
+// a different field list is ignored and rewritten. With an empty path the
+// store does nothing.
+template <class Metric>
+class AuditStore {
+public:
+    AuditStore(std::string path, std::string tool, bool use_hash)
+    : path_(std::move(path)), tool_(std::move(tool)), use_hash_(use_hash) { if (enabled()) load(); }
+
+    bool enabled() const { return !path_.empty(); }
+    uint64_t loaded() const { return entries_.size(); }
+    uint64_t hits() const { return hits_; }
+
+    // size / mtime (/ hash) of this run's files; hashing runs on the workers
+    void stamp(const std::vector<std::string>& files, unsigned threads) {
+        if (!enabled()) return;
+        std::vector<Stamp> st(files.size());
+        audit_parallel_for(files.size(), threads, [&](size_t i) {
+            std::error_code ec;
+            st[i].key = std::filesystem::absolute(files[i], ec).lexically_normal().string();
+            if (ec) st[i].key = files[i];
+            st[i].size = (uint64_t)std::filesystem::file_size(files[i], ec);
+            if (ec) { st[i].ok = false; return; }
+            st[i].mtime = (int64_t)std::filesystem::last_write_time(files[i], ec).time_since_epoch().count();
+            if (ec) { st[i].ok = false; return; }
+            if (use_hash_) st[i].hash = audit_file_hash(files[i]);
+        });
+        for (size_t i = 0; i < files.size(); ++i) cur_.emplace(files[i], std::move(st[i]));
+    }
+
+    // Cached result for an unchanged file; safe to call from the workers
+    // (entries_ is not modified until save())
+    bool get(const std::string& file, Metric& out) const {
+        if (!enabled()) return false;
+        auto c = cur_.find(file);
+        if (c == cur_.end() || !c->second.ok) return false;
+        auto e = entries_.find(c->second.key);
+        if (e == entries_.end() || !same(e->second, c->second)) return false;
+        Reader rd{e->second.blob.data(), e->second.blob.data() + e->second.blob.size()};
+        audit_fields(out, rd);
+        if (!rd.ok || rd.p != rd.end) return false;
+        ++hits_;
+        return true;
+    }
+
+    // Record a fresh result (calling thread only); kept apart from entries_,
+    // which the workers may be reading, until save()
+    void put(const std::string& file, const Metric& m) {
+        if (!enabled()) return;
+        auto c = cur_.find(file);
+        if (c == cur_.end() || !c->second.ok) return;
+        auto old = entries_.find(c->second.key);
+        if (old != entries_.end() && same(old->second, c->second)) return;   // came from the store
+        Entry e{c->second.size, c->second.mtime, c->second.hash, {}};
+        Writer wr{e.blob};
+        audit_fields(const_cast<Metric&>(m), wr);
+        fresh_[c->second.key] = std::move(e);
+        dirty_ = true;
+    }
+
+    // Rewrites the store (tmp + rename) if anything changed; entries of files
+    // that no longer exist are dropped. Call after audit_files has returned.
+    bool save(std::string* err = nullptr) {
+        if (!enabled() || !dirty_) return true;
+        for (auto& [key, e] : fresh_) entries_[key] = std::move(e);
+        fresh_.clear();
+        const std::string tmp = path_ + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            std::string hdr(MAGIC, sizeof(MAGIC));
+            put_str(hdr, tool_);
+            put_pod(hdr, signature());
+            std::string body;
+            uint64_t count = 0;
+            for (const auto& [key, e] : entries_) {
+                std::error_code ec;
+                if (!std::filesystem::exists(key, ec)) continue;
+                put_str(body, key);
+                put_pod(body, e.size);
+                put_pod(body, e.mtime);
+                put_pod(body, e.hash);
+                put_str(body, e.blob);
+                ++count;
+            }
+            put_pod(hdr, count);
+            out.write(hdr.data(), (std::streamsize)hdr.size());
+            out.write(body.data(), (std::streamsize)body.size());
+            if (!out) { if (err) *err = "write failed: " + tmp; return false; }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path_, ec);
+        if (ec) { if (err) *err = ec.message(); return false; }
+        dirty_ = false;
+        return true;
+    }
+
+private:
+    static constexpr char MAGIC[8] = {'P', 'Q', 'A', 'U', 'D', 'I', 'T', '1'};
+
+    struct Stamp { std::string key; uint64_t size = 0; int64_t mtime = 0; uint64_t hash = 0; bool ok = true; };
+    struct Entry { uint64_t size = 0; int64_t mtime = 0; uint64_t hash = 0; std::string blob; };
+
+    struct Writer {
+        std::string& out;
+        template <class... T> void operator()(T&... v) { (one(v), ...); }
+        void one(const std::string& v) { put_str(out, v); }
+        template <class T> void one(const T& v) {
+            static_assert(std::is_arithmetic_v<T>, "audit_fields: arithmetic or std::string fields only");
+            put_pod(out, v);
+        }
+    };
+    struct Reader {
+        const char* p;
+        const char* end;
+        bool ok = true;
+        template <class... T> void operator()(T&... v) { (one(v), ...); }
+        void one(std::string& v) { ok = ok && get_str(p, end, v); }
+        template <class T> void one(T& v) { ok = ok && get_pod(p, end, v); }
+    };
+    // field count, sizes and kinds of audit_fields: changes when the tool's list does
+    struct Signer {
+        uint64_t h = 1469598103934665603ULL;
+        template <class... T> void operator()(T&... v) { (one(v), ...); }
+        template <class T> void one(const T&) {
+            const uint64_t kind = std::is_same_v<T, std::string> ? 3 : std::is_floating_point_v<T> ? 2 : 1;
+            h = (h ^ (sizeof(T) << 2 | kind)) * 1099511628211ULL;
+        }
+    };
+
+    template <class T> static void put_pod(std::string& out, const T& v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+    static void put_str(std::string& out, const std::string& v) {
+        put_pod(out, (uint32_t)v.size());
+        out.append(v);
+    }
+    template <class T> static bool get_pod(const char*& p, const char* end, T& v) {
+        if ((size_t)(end - p) < sizeof(T)) return false;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+    static bool get_str(const char*& p, const char* end, std::string& v) {
+        uint32_t n;
+        if (!get_pod(p, end, n) || (size_t)(end - p) < n) return false;
+        v.assign(p, n);
+        p += n;
+        return true;
+    }
+
+    static uint64_t signature() {
+        Metric m{};
+        Signer s;
+        audit_fields(m, s);
+        return s.h;
+    }
+
+    bool same(const Entry& e, const Stamp& s) const {
+        return e.size == s.size && e.mtime == s.mtime && (!use_hash_ || e.hash == s.hash);
+    }
+
+    void load() {
+        std::ifstream in(path_, std::ios::binary);
+        if (!in) return;
+        const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const char* p = data.data();
+        const char* end = p + data.size();
+        std::string tool;
+        uint64_t sig = 0, count = 0;
+        if ((size_t)(end - p) < sizeof(MAGIC) || std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0) return;
+        p += sizeof(MAGIC);
+        if (!get_str(p, end, tool) || tool != tool_ || !get_pod(p, end, sig) || sig != signature()
+            || !get_pod(p, end, count)) return;
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string key;
+            Entry e;
+            if (!get_str(p, end, key) || !get_pod(p, end, e.size) || !get_pod(p, end, e.mtime)
+                || !get_pod(p, end, e.hash) || !get_str(p, end, e.blob)) {
+                entries_.clear();   // truncated: start over
+                return;
+            }
+            entries_[std::move(key)] = std::move(e);
+        }
+    }
+
+    std::string path_, tool_;
+    bool use_hash_ = false;
+    bool dirty_ = false;
+    std::unordered_map<std::string, Entry> entries_;   // loaded; read by the workers
+    std::unordered_map<std::string, Entry> fresh_;     // put() during the run
+    std::unordered_map<std::string, Stamp> cur_;
+    mutable std::atomic<uint64_t> hits_{0};
+};
+
+// ---------- footer pre-check (--fast) ----------
+
+// One INT64 leaf as seen by the footer, aggregated over row groups
+struct FooterColumn {
+    bool present = false;
+    bool nested = false;        // inside a list: values counts elements, not rows
+    int64_t values = 0;         // column-chunk num_values
+    int64_t nulls = 0;
+    int64_t min = std::numeric_limits<int64_t>::max();
+    int64_t max = std::numeric_limits<int64_t>::min();
+};
+
+struct FooterScan {
+    int64_t meta_rows = 0;
+    int row_groups = 0;
+    std::vector<FooterColumn> cols;         // one per requested column
+    std::vector<std::string> suspects;      // why the footer cannot clear the file
+};
+
+// Reads only the footer of `path` (no page is fetched or decoded) and checks
+// what the row-group metadata can answer: row counts against meta_rows, small
+// files (< small_rows), and for each requested column (first name found wins)
+// presence, INT64 type, min/max statistics, null counts and, for flat columns,
+// one value per row; cols[ts_col] must not step back across row-group
+// boundaries. Anything else (order inside a row group, duplicates, zeros) needs
+// the full decode, which is what a non-empty `suspects` asks the caller for.
+// Throws like ParquetFileReader::OpenFile when the footer is unreadable.
+inline void audit_footer(const std::string& path, const std::vector<std::vector<std::string>>& cols,
+                         int ts_col, int64_t small_rows, FooterScan& out) {
+    out = FooterScan();
+    auto md = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false)->metadata();
+    const parquet::SchemaDescriptor* schema = md->schema();
+    out.meta_rows = md->num_rows();
+    out.row_groups = md->num_row_groups();
+    if (out.meta_rows == 0) out.suspects.push_back("no rows");
+    else if (out.meta_rows < small_rows) out.suspects.push_back("small file");
+
+    std::vector<int> idx(cols.size(), -1);
+    out.cols.resize(cols.size());
+    for (size_t c = 0; c < cols.size(); ++c) {
+        for (const std::string& name : cols[c]) {
+            for (int i = 0; i < schema->num_columns() && idx[c] < 0; ++i)
+                if (schema->Column(i)->path()->ToDotString() == name) idx[c] = i;
+            if (idx[c] >= 0) break;
+        }
+        if (idx[c] < 0) { out.suspects.push_back("no column " + cols[c].front()); continue; }
+        const parquet::ColumnDescriptor* d = schema->Column(idx[c]);
+        if (d->physical_type() != parquet::Type::INT64) { out.suspects.push_back(cols[c].front() + " is not INT64"); idx[c] = -1; continue; }
+        out.cols[c].present = true;
+        out.cols[c].nested = d->max_repetition_level() > 0;
+    }
+
+    int64_t rows = 0, prev_ts_max = 0;
+    bool have_ts = false;
+    for (int rg = 0; rg < out.row_groups; ++rg) {
+        auto rgm = md->RowGroup(rg);
+        const int64_t rg_rows = rgm->num_rows();
+        rows += rg_rows;
+        if (rg_rows == 0) continue;
+        for (size_t c = 0; c < cols.size(); ++c) {
+            if (idx[c] < 0) continue;
+            FooterColumn& fc = out.cols[c];
+            const std::string& name = cols[c].front();
+            auto cc = rgm->ColumnChunk(idx[c]);
+            fc.values += cc->num_values();
+            if (!fc.nested && cc->num_values() != rg_rows) out.suspects.push_back(name + " values != rows in row group " + std::to_string(rg));
+            auto st = cc->is_stats_set() ? std::dynamic_pointer_cast<parquet::Int64Statistics>(cc->statistics()) : nullptr;
+            if (!st || !st->HasNullCount() || (!st->HasMinMax() && st->num_values() > 0)) {
+                out.suspects.push_back("no statistics for " + name + " in row group " + std::to_string(rg));
+                continue;
+            }
+            fc.nulls += st->null_count();
+            if (!st->HasMinMax()) continue;
+            fc.min = std::min(fc.min, st->min());
+            fc.max = std::max(fc.max, st->max());
+            if ((int)c != ts_col) continue;
+            if (have_ts && st->min() < prev_ts_max) out.suspects.push_back("ts steps back at row group " + std::to_string(rg));
+            prev_ts_max = st->max();
+            have_ts = true;
+        }
+    }
+    if (rows != out.meta_rows) out.suspects.push_back("row-group rows != meta_rows");
+    for (size_t c = 0; c < cols.size(); ++c)
+        if (!out.cols[c].nested && out.cols[c].nulls > 0) out.suspects.push_back(cols[c].front() + " has nulls");
+}
@@ -0,0 +1,166 @@
+// parquet_bookckpt.cpp
+// Build / refresh <depth file>.parquet.book order-book checkpoint sidecars used
+// by ShardedDB::book_at (parquet_reader --book=N --book-at=SEC).
+// Build:
+//   g++ -std=gnu++23 -O3 parquet_bookckpt.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_bookckpt
+//
+// Usage:
+//   ./parquet_bookckpt <root | depth.parquet>... [--every=SEC] [--every-events=N] [--reset]
+//                      [--force] [--verify=K] [--debug]
+// Directories are walked recursively for depth files; sidecars already matching
+// their file's size and mtime are kept unless --force. --verify=K compares the
+// book at K random times with and without checkpoints.
+
+#include "parquet_reader_lib.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+#include <parquet/statistics.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static bool is_depth_file(const fs::path& p) {
+  return p.extension() == ".parquet" && p.filename().string().find("_depth_") != string::npos;
+}
+
+// [min ts, max ts] from the row-group statistics
+static bool ts_range(const string& path, int64_t& lo, int64_t& hi) {
+  auto md = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false)->metadata();
+  const int col = md->schema()->ColumnIndex("ts");
+  if (col < 0) return false;
+  bool any = false;
+  for (int r = 0; r < md->num_row_groups(); ++r) {
+    auto st = md->RowGroup(r)->ColumnChunk(col)->statistics();
+    auto s = dynamic_pointer_cast<parquet::Int64Statistics>(st);
+    if (!s || !s->HasMinMax()) return false;
+    lo = any ? min(lo, s->min()) : s->min();
+    hi = any ? max(hi, s->max()) : s->max();
+    any = true;
+  }
+  return any;
+}
+
+static bool same_book(const OrderBook& a, const OrderBook& b) {
+  BookSnapshot x, y;
+  a.top(SIZE_MAX, x);
+  b.top(SIZE_MAX, y);
+  auto eq = [](const vector<BookLevel>& p, const vector<BookLevel>& q) {
+    if (p.size() != q.size()) return false;
+    for (size_t i = 0; i < p.size(); ++i)
+      if (p[i].px != q[i].px || p[i].qty != q[i].qty) return false;
+    return true;
+  };
+  return x.lastId == y.lastId && eq(x.asks, y.asks) && eq(x.bids, y.bids);
+}
+
+int main(int argc, char** argv) {
+  vector<string> inputs;
+  BookCheckpoints spec;
+  bool force = false, debug = false;
+  int verify = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    const string a = argv[i];
+    if (a.rfind("--every=",0)==0) {
+      const double v = stod(a.substr(8));
+      if (v < 0) { cerr << "ERROR: --every must be >= 0\n"; return 1; }
+      spec.every_ns = static_cast<int64_t>(v * 1e9);
+    } else if (a.rfind("--every-events=",0)==0) {
+      const long long v = stoll(a.substr(15));
+      if (v < 0) { cerr << "ERROR: --every-events must be >= 0\n"; return 1; }
+      spec.every_events = static_cast<uint64_t>(v);
+    } else if (a=="--reset") {
+      spec.on_gap = GapPolicy::Reset;
+    } else if (a=="--force") {
+      force = true;
+    } else if (a.rfind("--verify=",0)==0) {
+      verify = stoi(a.substr(9));
+      if (verify < 0) { cerr << "ERROR: --verify must be >= 0\n"; return 1; }
+    } else if (a=="--debug") {
+      debug = true;
+    } else if (a.rfind("--",0)==0) {
+      cerr << "ERROR: unknown option " << a << "\n"; return 1;
+    } else {
+      inputs.push_back(a);
+    }
+  }
+  if (spec.every_ns <= 0 && spec.every_events == 0) { cerr << "ERROR: --every or --every-events must be > 0\n"; return 1; }
+  if (inputs.empty()) {
+    cerr << "Usage: " << argv[0] << " <root | depth.parquet>... [--every=SEC] [--every-events=N] [--reset] [--force] [--verify=K] [--debug]\n"
+         << "        [--every=SEC]        (default: 60; checkpoint when SEC passed since the last one, 0 = off)\n"
+         << "        [--every-events=N]   (default: 0 = off; checkpoint every N events)\n"
+         << "        [--reset]            (book clears on an update-id gap; must match the reader's --book-reset)\n"
+         << "        [--force]            (rebuild sidecars that are still fresh)\n"
+         << "        [--verify=K]         (compare the book at K random times with and without checkpoints)\n"
+         << "        [--debug]            (one line per file)\n";
+    return 1;
+  }
+
+  // ---------- collect depth files ----------
+  vector<string> files;
+  for (const string& in : inputs) {
+    error_code ec;
+    if (fs::is_directory(in, ec)) {
+      for (fs::recursive_directory_iterator it(in, fs::directory_options::skip_permission_denied, ec), end;
+           !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && is_depth_file(it->path())) files.push_back(it->path().string());
+      }
+      if (ec) cerr << "WARN: walk " << in << " : " << ec.message() << "\n";
+    } else if (fs::is_regular_file(in, ec)) {
+      files.push_back(in);
+    } else {
+      cerr << "WARN: not found: " << in << "\n";
+    }
+  }
+
+  // ---------- build ----------
+  uint64_t built = 0, fresh = 0, failed = 0, checked = 0, mismatched = 0;
+  mt19937_64 rng(42);
+  for (const string& f : files) {
+    if (!force && ShardedDB::book_checkpoints_fresh(f)) {
+      ++fresh;
+      if (debug) cerr << "[debug] fresh " << f << "\n";
+    } else {
+      string err;
+      if (!ShardedDB::build_book_checkpoints(f, spec, &err)) {
+        ++failed;
+        cerr << "WARN: " << f << " : " << err << "\n";
+        continue;
+      }
+      ++built;
+      if (debug) cerr << "[debug] built " << f << "\n";
+    }
+
+    // ---------- verify ----------
+    int64_t lo = 0, hi = 0;
+    if (verify == 0) continue;
+    if (!ts_range(f, lo, hi)) { cerr << "WARN: " << f << " : no ts statistics, not verified\n"; continue; }
+    uniform_int_distribution<int64_t> pick(lo - 1, hi);
+    for (int k = 0; k < verify; ++k) {
+      const int64_t t = pick(rng);
+      auto fast = ShardedDB::book_at_file(f, t, spec.on_gap, true);
+      auto slow = ShardedDB::book_at_file(f, t, spec.on_gap, false);
+      ++checked;
+      if (!same_book(*fast, *slow)) {
+        ++mismatched;
+        cerr << "WARN: " << f << " : checkpointed book differs at ts=" << t << "\n";
+      }
+    }
+  }
+
+  cerr << "bookckpt: files=" << files.size() << " built=" << built << " fresh=" << fresh
+       << " failed=" << failed;
+  if (verify) cerr << " verified=" << checked << " mismatched=" << mismatched;
+  cerr << "\n";
+  return (failed || mismatched) ? 2 : 0;
+}
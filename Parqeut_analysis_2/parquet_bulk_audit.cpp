@@ -1,10 +1,10 @@
 // parquet_bulk_audit.cpp
 // Scan a directory of parquet files and detect anomalies.
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_bulk_audit.cpp -lparquet -larrow -lzstd -o parquet_bulk_audit
+//   g++ -std=gnu++23 -O3 parquet_bulk_audit.cpp -lparquet -larrow -lzstd -pthread -o parquet_bulk_audit
 //
 // Usage:
-//   ./parquet_bulk_audit /path/to/parquet_dir anomalies.ndjson
+//   ./parquet_bulk_audit /path/to/parquet_dir anomalies.ndjson [--threads=N] [--cache=FILE [--cache-hash]] [--fast]
 //
 // Output:
 //   anomalies.ndjson  -- one JSON object per parquet file with metrics + anomalies array.
@@ -13,6 +13,14 @@
 // - Uses parquet C++ API (libparquet / libarrow).
 // - Focuses on common numeric columns: ts, px, qty, tradeId, isMarket.
 // - Flags both explicit anomalies (missing rows, nulls, dup tradeId, non-monotonic ts) and statistical outliers.
+// - Files are analyzed on --threads workers (default: all cores); output order does not depend on N.
+// - --cache=FILE keeps each file's metrics keyed by path+size+mtime (+ content hash with --cache-hash);
+//   a rerun analyzes only new/changed files, outliers and NDJSON are recomputed from all metrics.
+// - --fast reads only footers: files whose row counts, null counts and ts/px/qty/tradeId statistics
+//   look clean are reported from those ("footer_only":true; gap, order, average and dup_tradeid
+//   fields are null, no outlier tests), the rest are decoded as usual.
+
+#include "parquet_audit_pool.h"
 
 #include <parquet/api/reader.h>
 
@@ -20,6 +28,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <unordered_set>
@@ -57,22 +66,6 @@ static void read_i64_column(parquet::RowGroupReader& rg, int col_idx, vector<int
     if (done != rows) out.resize(done);
 }
 
-// Welford online mean+variance accumulator
-struct Welford {
-    long double mean = 0.0L;
-    long double m2 = 0.0L;
-    uint64_t n = 0;
-    void add(long double x) {
-        ++n;
-        long double delta = x - mean;
-        mean += delta / (long double)n;
-        long double delta2 = x - mean;
-        m2 += delta * delta2;
-    }
-    long double variance() const { return (n > 1) ? (m2 / (long double)(n - 1)) : 0.0L; }
-    long double stddev() const { return sqrt((double)variance()); }
-};
-
 // Per-file metrics container
 struct FileMetric {
     string path;
@@ -113,8 +106,61 @@ struct FileMetric {
     // additional
     uint64_t ts_samples = 0;
     long double gap_mean = 0.0L; // computed via Welford
+
+    // --fast (not cached)
+    bool footer_only = false;   // filled by footer_file, nothing decoded
+    string escalated;           // why the footer did not clear the file
 };
 
+// Fields kept by --cache (path is the key); keep in step with FileMetric
+template <class F>
+static void audit_fields(FileMetric& m, F&& f)
+{
+    f(m.meta_rows, m.rows_scanned, m.row_groups,
+      m.has_ts, m.ts_min, m.ts_max, m.max_gap_ns, m.gaps_gt_100ms, m.gaps_gt_1s, m.non_monotonic_ts,
+      m.has_px, m.px_min, m.px_max, m.px_avg, m.px_zero_count,
+      m.has_qty, m.qty_min, m.qty_max, m.qty_avg, m.qty_zero_count,
+      m.has_tradeId, m.dup_tradeid, m.tradeid_min, m.tradeid_max,
+      m.null_ts, m.null_px, m.null_qty, m.null_tradeId,
+      m.ts_samples, m.gap_mean);
+}
+
+// --fast: fills `out` from the footer and column statistics alone (nothing is
+// decoded) when they show nothing suspect; otherwise returns false with the
+// reason in `why` and the caller runs analyze_file. Gap, order, average and
+// duplicate fields are not evaluated for such files (null in the NDJSON).
+static bool footer_file(const string& path, FileMetric& out, string& why)
+{
+    out = FileMetric();
+    out.path = path;
+    FooterScan ft;
+    try {
+        audit_footer(path, {{"ts"}, {"px"}, {"qty"}, {"tradeId"}}, 0, 100, ft);
+    } catch (const exception& e) {
+        why = e.what();
+        return false;
+    }
+    const FooterColumn &ts = ft.cols[0], &px = ft.cols[1], &qty = ft.cols[2], &tid = ft.cols[3];
+    if (ft.suspects.empty()) {
+        // span != rows => a gap or a duplicate; span == rows does not rule out a duplicate paired
+        // with a gap (1,2,2,4), so dup_tradeid stays unknown for footer-only files
+        if ((uint64_t)(tid.max - tid.min) + 1 != (uint64_t)ft.meta_rows) ft.suspects.push_back("tradeId span != rows");
+        if (px.min <= 0) ft.suspects.push_back("px min <= 0");
+        if (qty.min <= 0) ft.suspects.push_back("qty min <= 0");
+    }
+    if (!ft.suspects.empty()) { why = ft.suspects.front(); return false; }
+
+    out.footer_only = true;
+    out.meta_rows = out.rows_scanned = ft.meta_rows;
+    out.row_groups = ft.row_groups;
+    out.has_ts = out.has_px = out.has_qty = out.has_tradeId = true;
+    out.ts_min = ts.min; out.ts_max = ts.max; out.ts_samples = (uint64_t)ft.meta_rows;
+    out.px_min = px.min; out.px_max = px.max;
+    out.qty_min = qty.min; out.qty_max = qty.max;
+    out.tradeid_min = (uint64_t)tid.min; out.tradeid_max = (uint64_t)tid.max;
+    return true;
+}
+
 // Reads single file and fills FileMetric
 static bool analyze_file(const string& path, FileMetric& out)
 {
@@ -281,22 +327,64 @@ static bool analyze_file(const string& path, FileMetric& out)
 
         return true;
     } catch (const exception& e) {
-        cerr << "ERROR: open/read failed for " << path << " : " << e.what() << "\n";
-        return false;
+        // printed by the done callback, in file order
+        throw runtime_error("open/read failed for " + path + " : " + e.what());
     }
 }
 
+// Per-worker accumulators of the cross-file statistics, combined with Welford::merge
+struct GlobalStats {
+    Welford rows_ratio;    // rows_scanned / meta_rows
+    Welford max_gap;       // max_gap_ns
+    Welford gap_mean;      // gap_mean
+    Welford px_avg;
+    Welford qty_avg;
+    Welford gaps_gt1s;
+
+    void add(const FileMetric& m) {
+        if (m.footer_only) return;   // --fast: no gaps/averages to compare
+        long double ratio = (m.meta_rows > 0) ? ((long double)m.rows_scanned / (long double)m.meta_rows) : 0.0L;
+        rows_ratio.add(ratio);
+        max_gap.add((long double)m.max_gap_ns);
+        gap_mean.add(m.gap_mean);
+        px_avg.add(m.px_avg);
+        qty_avg.add(m.qty_avg);
+        gaps_gt1s.add((long double)m.gaps_gt_1s);
+    }
+    void merge(const GlobalStats& o) {
+        rows_ratio.merge(o.rows_ratio);
+        max_gap.merge(o.max_gap);
+        gap_mean.merge(o.gap_mean);
+        px_avg.merge(o.px_avg);
+        qty_avg.merge(o.qty_avg);
+        gaps_gt1s.merge(o.gaps_gt1s);
+    }
+};
+
 // ---------- main: directory scan, two-pass outlier detection, output NDJSON ----------
 
 int main(int argc, char** argv)
 {
     if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " /path/to/parquet_dir output.ndjson\n";
+        cerr << "Usage: " << argv[0] << " /path/to/parquet_dir output.ndjson [--threads=N] [--cache=FILE [--cache-hash]] [--fast]\n";
         return 1;
     }
 
     string dir = argv[1];
     string out_path = argv[2];
+    unsigned threads = 0;
+    string cache_path;
+    bool cache_hash = false;
+    bool fast = false;
+    for (int i = 3; i < argc; ++i) {
+        string a = argv[i];
+        if (a.rfind("--threads=", 0) == 0) threads = (unsigned)stoul(a.substr(10));
+        else if (a.rfind("--cache=", 0) == 0) cache_path = a.substr(8);
+        else if (a == "--cache-hash") cache_hash = true;
+        else if (a == "--fast") fast = true;
+        else { cerr << "Unknown option " << a << "\n"; return 1; }
+    }
+    threads = audit_threads(threads);
 
     vector<string> files;
     for (auto &p : fs::directory_iterator(dir)) {
@@ -310,41 +398,49 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    // First pass: collect metrics per file
+    // First pass: collect metrics per file (in parallel, reported in file order)
     vector<FileMetric> metrics;
     metrics.reserve(files.size());
-    cerr << "Scanning " << files.size() << " files...\n";
-    uint64_t idx = 0;
-    for (auto &f : files) {
-        ++idx;
-        cerr << "[" << idx << "/" << files.size() << "] " << f << " ... " << flush;
-        FileMetric fm;
-        bool ok = analyze_file(f, fm);
-        if (ok) {
-            metrics.push_back(std::move(fm));
-            cerr << "ok (rows=" << metrics.back().rows_scanned << ")\n";
-        } else {
-            cerr << "failed\n";
-        }
+    cerr << "Scanning " << files.size() << " files on " << threads << " threads...\n";
+    AuditStore<FileMetric> store(cache_path, "parquet_bulk_audit", cache_hash);
+    store.stamp(files, threads);
+    size_t footer_only = 0;
+    audit_files<FileMetric>(files, threads,
+        [&](const string& f, FileMetric& fm) {
+            if (store.get(f, fm)) { fm.path = f; return true; }
+            string why;
+            if (fast && footer_file(f, fm, why)) return true;
+            const bool ok = analyze_file(f, fm);
+            fm.escalated = why;
+            return ok;
+        },
+        [&](size_t i, FileMetric& fm, bool ok, const string& err) {
+            cerr << "[" << (i + 1) << "/" << files.size() << "] " << files[i] << " ... ";
+            if (ok) {
+                if (fm.footer_only) ++footer_only;
+                else store.put(files[i], fm);
+                metrics.push_back(std::move(fm));
+                const FileMetric& m = metrics.back();
+                cerr << "ok (rows=" << m.rows_scanned << ")";
+                if (m.footer_only) cerr << " footer only";
+                else if (!m.escalated.empty()) cerr << " escalated: " << m.escalated;
+                cerr << "\n";
+            } else {
+                if (!err.empty()) cerr << "ERROR: " << err << "\n";
+                cerr << "failed\n";
+            }
+        });
+
+    if (store.enabled()) {
+        string err;
+        if (!store.save(&err)) cerr << "WARN: cache " << cache_path << " not saved: " << err << "\n";
+        cerr << "Cache: " << store.hits() << "/" << files.size() << " files reused from " << cache_path << "\n";
     }
+    if (fast) cerr << "Fast: " << footer_only << "/" << files.size() << " files cleared from footers, the rest decoded\n";
 
     // Compute global statistics (mean/std) for several numeric metrics using Welford
-    Welford w_rows_ratio;    // rows_scanned / meta_rows
-    Welford w_max_gap;       // max_gap_ns
-    Welford w_gap_mean;      // gap_mean
-    Welford w_px_avg;
-    Welford w_qty_avg;
-    Welford w_gaps_gt1s;
-
-    for (auto &m : metrics) {
-        long double ratio = (m.meta_rows > 0) ? ((long double)m.rows_scanned / (long double)m.meta_rows) : 0.0L;
-        w_rows_ratio.add(ratio);
-        w_max_gap.add((long double)m.max_gap_ns);
-        w_gap_mean.add(m.gap_mean);
-        w_px_avg.add(m.px_avg);
-        w_qty_avg.add(m.qty_avg);
-        w_gaps_gt1s.add((long double)m.gaps_gt_1s);
-    }
+    const GlobalStats g = audit_reduce<GlobalStats>(metrics.size(), threads,
+        [&](GlobalStats& acc, size_t i) { acc.add(metrics[i]); });
 
     // thresholds for z-scores to consider outlier
     const long double Z_THRESH = 3.0L;
@@ -378,23 +474,23 @@ int main(int argc, char** argv)
         // statistical outliers (z-score)
         auto zscore = [&](const Welford &w, long double val) -> long double {
             long double sd = w.stddev();
-            if (sd <= 0.0L) return 0.0L;
+            if (sd <= 0.0L || m.footer_only) return 0.0L;
             return fabsl((val - w.mean) / sd);
         };
 
-        long double z_rows = (m.meta_rows>0) ? zscore(w_rows_ratio, ((long double)m.rows_scanned/(long double)m.meta_rows)) : 0.0L;
+        long double z_rows = (m.meta_rows>0) ? zscore(g.rows_ratio, ((long double)m.rows_scanned/(long double)m.meta_rows)) : 0.0L;
         if (z_rows > Z_THRESH) anomalies.push_back("rows_ratio statistical_outlier");
 
-        long double z_gap = zscore(w_max_gap, (long double)m.max_gap_ns);
+        long double z_gap = zscore(g.max_gap, (long double)m.max_gap_ns);
         if (z_gap > Z_THRESH) anomalies.push_back("max_gap_ns statistical_outlier");
 
-        long double z_gapmean = zscore(w_gap_mean, (long double)m.gap_mean);
+        long double z_gapmean = zscore(g.gap_mean, (long double)m.gap_mean);
         if (z_gapmean > Z_THRESH) anomalies.push_back("gap_mean statistical_outlier");
 
-        long double z_px = zscore(w_px_avg, (long double)m.px_avg);
+        long double z_px = zscore(g.px_avg, (long double)m.px_avg);
         if (m.has_px && z_px > Z_THRESH) anomalies.push_back("px_avg statistical_outlier");
 
-        long double z_qty = zscore(w_qty_avg, (long double)m.qty_avg);
+        long double z_qty = zscore(g.qty_avg, (long double)m.qty_avg);
         if (m.has_qty && z_qty > Z_THRESH) anomalies.push_back("qty_avg statistical_outlier");
 
         // small-file heuristic: meta_rows very small (e.g., less than 100)
@@ -407,27 +503,33 @@ int main(int argc, char** argv)
         o << ",\"meta_rows\":" << m.meta_rows;
         o << ",\"rows_scanned\":" << m.rows_scanned;
         o << ",\"row_groups\":" << m.row_groups;
+        if (m.footer_only) o << ",\"footer_only\":true";
+        // footer_only: row order, gaps, averages and duplicates are not evaluated => null
+        auto unk = [&](const auto& v) { if (m.footer_only) o << "null"; else o << v; };
         if (m.has_ts) {
             o << ",\"ts_min\":" << m.ts_min << ",\"ts_max\":" << m.ts_max;
-            o << ",\"max_gap_ns\":" << m.max_gap_ns;
-            o << ",\"gap_mean\":" << fixed << setprecision(3) << (double)m.gap_mean;
-            o << ",\"gaps_gt_100ms\":" << m.gaps_gt_100ms << ",\"gaps_gt_1s\":" << m.gaps_gt_1s;
-            o << ",\"non_monotonic_ts\":" << m.non_monotonic_ts;
+            o << ",\"max_gap_ns\":"; unk(m.max_gap_ns);
+            o << ",\"gap_mean\":" << fixed << setprecision(3); unk((double)m.gap_mean);
+            o << ",\"gaps_gt_100ms\":"; unk(m.gaps_gt_100ms);
+            o << ",\"gaps_gt_1s\":"; unk(m.gaps_gt_1s);
+            o << ",\"non_monotonic_ts\":"; unk(m.non_monotonic_ts);
         } else {
             o << ",\"ts_present\":false";
         }
         if (m.has_px) {
-            o << ",\"px_min\":" << m.px_min << ",\"px_max\":" << m.px_max << ",\"px_avg\":" << fixed << setprecision(6) << (double)m.px_avg << ",\"px_zero_count\":" << m.px_zero_count;
+            o << ",\"px_min\":" << m.px_min << ",\"px_max\":" << m.px_max << ",\"px_avg\":" << fixed << setprecision(6); unk((double)m.px_avg);
+            o << ",\"px_zero_count\":" << m.px_zero_count;   // footer: px min > 0 => 0
         } else {
             o << ",\"px_present\":false";
         }
         if (m.has_qty) {
-            o << ",\"qty_min\":" << m.qty_min << ",\"qty_max\":" << m.qty_max << ",\"qty_avg\":" << fixed << setprecision(6) << (double)m.qty_avg << ",\"qty_zero_count\":" << m.qty_zero_count;
+            o << ",\"qty_min\":" << m.qty_min << ",\"qty_max\":" << m.qty_max << ",\"qty_avg\":" << fixed << setprecision(6); unk((double)m.qty_avg);
+            o << ",\"qty_zero_count\":" << m.qty_zero_count;   // footer: qty min > 0 => 0
         } else {
             o << ",\"qty_present\":false";
         }
         if (m.has_tradeId) {
-            o << ",\"tradeId_min\":" << (m.tradeid_min==numeric_limits<uint64_t>::max()?0:m.tradeid_min) << ",\"tradeId_max\":" << m.tradeid_max << ",\"dup_tradeid\":" << m.dup_tradeid;
+            o << ",\"tradeId_min\":" << (m.tradeid_min==numeric_limits<uint64_t>::max()?0:m.tradeid_min) << ",\"tradeId_max\":" << m.tradeid_max << ",\"dup_tradeid\":"; unk(m.dup_tradeid);
         } else {
             o << ",\"tradeId_present\":false";
         }
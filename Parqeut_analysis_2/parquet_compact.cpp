@@ -0,0 +1,605 @@
+// parquet_compact.cpp
+// Rewrite shards of the strict layout (<root>/<kind>_<market>/<SYMB>/<Y>/<M>/)
+// sorted by ts, with a target row-group size, statistics, page indexes and
+// sorting_columns, and a per-column encoding: DELTA_BINARY_PACKED for ts, ids
+// and times; for the other int64 leaves (px, qty) whichever of dictionary and
+// BYTE_STREAM_SPLIT compresses a sample smaller.
+// Small day files of a finished month can be merged into
+// bn_<kind>_<market>_<SYMB>_<Y>_<M>.parquet, which records the days it holds
+// and which ShardedDB reads in place of those day files (day files added later
+// are read next to it and folded into it on the next run).
+// Build:
+//   g++ -std=gnu++23 -O3 parquet_compact.cpp -lparquet -larrow -lzstd -o parquet_compact
+//
+// Usage:
+//   ./parquet_compact <root> [--kind=top|trade|depth] [--market=spot|fut] [--symb=SYMB]
+//                     [--rg-rows=N] [--merge-month-mb=N] [--keep-days] [--force]
+//                     [--no-verify] [--dry-run] [--debug]
+
+#include <arrow/api.h>
+#include <arrow/compute/api_vector.h>
+#include <arrow/io/file.h>
+#include <arrow/io/memory.h>
+#include <parquet/api/reader.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/schema.h>
+#include <parquet/arrow/writer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const char* const MARKER_KEY = "parquet_compact";        // file key-value metadata
+static const char* const DAYS_KEY   = "parquet_compact_days";   // month file: merged days, "1,2,5"
+
+struct Opts {
+  string root;
+  optional<string> kind, market, symb;
+  int64_t rg_rows = 131072;
+  uint64_t merge_month_bytes = 0;   // 0 => never start a month file
+  bool keep_days = false;
+  bool force = false;
+  bool verify = true;
+  bool dry_run = false;
+  bool debug = false;
+};
+
+struct Totals {
+  uint64_t months_merged = 0, days_merged = 0, rewritten = 0, skipped = 0, failed = 0;
+  uint64_t bytes_in = 0, bytes_out = 0;
+};
+
+static void arrow_ok(const arrow::Status& st, const char* what) {
+  if (!st.ok()) throw runtime_error(string(what) + ": " + st.ToString());
+}
+
+template <class T>
+static T arrow_val(arrow::Result<T> r, const char* what) {
+  arrow_ok(r.status(), what);
+  return r.MoveValueUnsafe();
+}
+
+static bool all_digits(const string& s) {
+  return !s.empty() && all_of(s.begin(), s.end(), [](unsigned char c){ return isdigit(c); });
+}
+
+static int64_t utc_start_ns(int y, int m, int d) {
+  tm t{}; t.tm_year = y - 1900; t.tm_mon = m - 1; t.tm_mday = d;
+  return static_cast<int64_t>(timegm(&t)) * 1'000'000'000LL;
+}
+
+// ---------- layout ----------
+
+struct Shard {
+  string path;
+  int day = 0;          // 0 => the month file
+  uint64_t bytes = 0;
+  int64_t mtime = 0;
+};
+
+struct MonthDir {
+  string dir, kind, mkt, symb;
+  int y = 0, m = 0;
+  vector<Shard> days;   // ascending day
+  optional<Shard> month;
+};
+
+static vector<MonthDir> find_months(const Opts& o) {
+  vector<MonthDir> out;
+  auto subdirs = [](const fs::path& p) {
+    vector<fs::path> v;
+    error_code ec;
+    for (const auto& e : fs::directory_iterator(p, ec)) {
+      error_code dec;
+      if (e.is_directory(dec)) v.push_back(e.path());
+    }
+    sort(v.begin(), v.end());
+    return v;
+  };
+
+  for (const fs::path& kd : subdirs(o.root)) {
+    const string kname = kd.filename().string();          // <kind>_<market>
+    const size_t us = kname.find('_');
+    if (us == string::npos) continue;
+    const string kind = kname.substr(0, us), mkt = kname.substr(us + 1);
+    if (kind != "top" && kind != "trade" && kind != "depth") continue;
+    if (mkt != "spot" && mkt != "fut") continue;
+    if ((o.kind && *o.kind != kind) || (o.market && *o.market != mkt)) continue;
+
+    for (const fs::path& sd : subdirs(kd)) {
+      const string symb = sd.filename().string();
+      if (o.symb && *o.symb != symb) continue;
+      for (const fs::path& yd : subdirs(sd)) {
+        if (!all_digits(yd.filename().string())) continue;
+        for (const fs::path& md : subdirs(yd)) {
+          if (!all_digits(md.filename().string())) continue;
+
+          MonthDir d;
+          d.dir = md.string(); d.kind = kind; d.mkt = mkt; d.symb = symb;
+          d.y = stoi(yd.filename().string()); d.m = stoi(md.filename().string());
+          const string stem = "bn_" + kind + '_' + mkt + '_' + symb + '_' + to_string(d.y) + '_' + to_string(d.m);
+
+          error_code ec;
+          for (const auto& e : fs::directory_iterator(md, ec)) {
+            error_code fec;
+            if (!e.is_regular_file(fec)) continue;
+            const string name = e.path().filename().string();
+            Shard s{e.path().string(), 0, static_cast<uint64_t>(e.file_size(fec)),
+                    static_cast<int64_t>(e.last_write_time(fec).time_since_epoch().count())};
+            if (name == stem + ".parquet") { d.month = s; continue; }
+            if (name.size() <= stem.size() + 9 || name.compare(0, stem.size() + 1, stem + "_") != 0) continue;
+            if (name.compare(name.size() - 8, 8, ".parquet") != 0) continue;
+            const string dd = name.substr(stem.size() + 1, name.size() - stem.size() - 9);
+            if (dd.size() > 2 || !all_digits(dd)) continue;
+            s.day = stoi(dd);
+            if (s.day >= 1) d.days.push_back(s);
+          }
+          sort(d.days.begin(), d.days.end(), [](const Shard& a, const Shard& b){ return a.day < b.day; });
+          if (d.month || !d.days.empty()) out.push_back(move(d));
+        }
+      }
+    }
+  }
+  return out;
+}
+
+// ---------- read ----------
+
+struct Input {
+  string path;
+  int day = 0;
+  shared_ptr<arrow::Table> table;
+  shared_ptr<parquet::FileMetaData> md;
+};
+
+// Footer only (row count, key-value metadata): no page is read
+static Input open_input(const Shard& s) {
+  Input in{s.path, s.day, nullptr, nullptr};
+  in.md = parquet::ParquetFileReader::OpenFile(s.path, /*memory_map=*/false)->metadata();
+  return in;
+}
+
+// Decodes the rows of an input
+static void load_table(Input& in) {
+  auto file = arrow_val(arrow::io::ReadableFile::Open(in.path), "open");
+  auto rd = arrow_val(parquet::arrow::OpenFile(file, arrow::default_memory_pool()), "open parquet");
+  in.md = rd->parquet_reader()->metadata();
+  in.table = arrow_val(rd->ReadTable(), "read");
+}
+
+static Input read_input(const Shard& s) {
+  Input in{s.path, s.day, nullptr, nullptr};
+  load_table(in);
+  return in;
+}
+
+static string kv_of(const parquet::FileMetaData& md, const char* key) {
+  auto kv = md.key_value_metadata();
+  if (!kv) return {};
+  auto v = kv->Get(key);
+  return v.ok() ? *v : string();
+}
+
+static string marker_of(const parquet::FileMetaData& md) { return kv_of(md, MARKER_KEY); }
+
+// Bit d set => day d is in the month file; 0 => not recorded (older month file)
+static uint32_t days_of(const parquet::FileMetaData& md) {
+  uint32_t days = 0;
+  const string v = kv_of(md, DAYS_KEY);
+  size_t i = 0;
+  while (i < v.size()) {
+    size_t j = v.find(',', i);
+    if (j == string::npos) j = v.size();
+    const string tok = v.substr(i, j - i);
+    if (all_digits(tok) && tok.size() <= 2 && stoi(tok) >= 1 && stoi(tok) <= 31) days |= 1u << stoi(tok);
+    i = j + 1;
+  }
+  return days;
+}
+
+static string days_value(uint32_t days) {
+  string v;
+  for (int d = 1; d <= 31; ++d)
+    if (days & (1u << d)) v += (v.empty() ? "" : ",") + to_string(d);
+  return v;
+}
+
+// Leaf paths + physical types: ShardedDB resolves columns by these
+static string leaf_signature(const parquet::SchemaDescriptor& sd) {
+  string sig;
+  for (int i = 0; i < sd.num_columns(); ++i)
+    sig += sd.Column(i)->path()->ToDotString() + ':' + to_string(sd.Column(i)->physical_type()) + ';';
+  return sig;
+}
+
+// ts as one vector; false when missing, not int64 or with nulls
+static bool ts_values(const arrow::Table& t, vector<int64_t>& out) {
+  auto col = t.GetColumnByName("ts");
+  if (!col || col->type()->id() != arrow::Type::INT64) return false;
+  out.clear();
+  out.reserve(static_cast<size_t>(t.num_rows()));
+  for (const auto& ch : col->chunks()) {
+    if (ch->null_count() != 0) return false;
+    const auto& a = static_cast<const arrow::Int64Array&>(*ch);
+    out.insert(out.end(), a.raw_values(), a.raw_values() + a.length());
+  }
+  return true;
+}
+
+// Stable sort by ts (file order kept among equal ts)
+static shared_ptr<arrow::Table> sort_by_ts(const shared_ptr<arrow::Table>& t, const vector<int64_t>& ts) {
+  if (is_sorted(ts.begin(), ts.end())) return t;
+  vector<int64_t> idx(ts.size());
+  iota(idx.begin(), idx.end(), 0);
+  stable_sort(idx.begin(), idx.end(), [&](int64_t a, int64_t b){ return ts[a] < ts[b]; });
+  arrow::Int64Builder b;
+  arrow_ok(b.AppendValues(idx), "sort indices");
+  auto indices = arrow_val(b.Finish(), "sort indices");
+  return arrow_val(arrow::compute::Take(t, indices), "take").table();
+}
+
+// ---------- write ----------
+
+enum class LeafEnc { Default, Delta, Dict, Split };
+
+// ts, *Id and *Time leaves: monotonic-ish integers
+static bool delta_leaf(const string& leaf) {
+  auto ends = [&](const char* s) {
+    const size_t n = strlen(s);
+    return leaf.size() >= n && leaf.compare(leaf.size() - n, n, s) == 0;
+  };
+  return leaf == "ts" || ends("Id") || ends("id") || ends("Time");
+}
+
+struct WritePlan {
+  shared_ptr<parquet::SchemaDescriptor> schema;   // as written
+  vector<LeafEnc> enc;                            // per leaf
+  parquet::Compression::type codec = parquet::Compression::ZSTD;
+  int ts_leaf = -1;
+};
+
+static shared_ptr<parquet::WriterProperties> writer_props(const WritePlan& p, int64_t rg_rows) {
+  parquet::WriterProperties::Builder b;
+  b.compression(p.codec)
+   ->max_row_group_length(rg_rows)
+   ->enable_statistics()
+   ->enable_write_page_index();
+  if (p.ts_leaf >= 0) b.set_sorting_columns({parquet::SortingColumn{p.ts_leaf, false, false}});
+  for (int i = 0; p.schema && i < p.schema->num_columns(); ++i) {
+    const auto path = p.schema->Column(i)->path();
+    switch (p.enc[i]) {
+      case LeafEnc::Delta: b.disable_dictionary(path)->encoding(path, parquet::Encoding::DELTA_BINARY_PACKED); break;
+      case LeafEnc::Split: b.disable_dictionary(path)->encoding(path, parquet::Encoding::BYTE_STREAM_SPLIT); break;
+      case LeafEnc::Dict:  b.enable_dictionary(path); break;
+      case LeafEnc::Default: break;
+    }
+  }
+  return b.build();
+}
+
+static shared_ptr<parquet::ArrowWriterProperties> arrow_props() {
+  return parquet::ArrowWriterProperties::Builder().store_schema()->build();
+}
+
+// Compressed bytes per leaf of t written with p (in memory)
+static vector<int64_t> trial_sizes(const arrow::Table& t, const WritePlan& p) {
+  auto sink = arrow_val(arrow::io::BufferOutputStream::Create(), "trial sink");
+  arrow_ok(parquet::arrow::WriteTable(t, arrow::default_memory_pool(), sink, t.num_rows() + 1,
+                                      writer_props(p, t.num_rows() + 1), arrow_props()), "trial write");
+  auto buf = arrow_val(sink->Finish(), "trial finish");
+  auto rd = parquet::ParquetFileReader::Open(make_shared<arrow::io::BufferReader>(buf));
+  auto md = rd->metadata();
+  vector<int64_t> sz(static_cast<size_t>(md->num_columns()), 0);
+  for (int rg = 0; rg < md->num_row_groups(); ++rg)
+    for (int c = 0; c < md->num_columns(); ++c) sz[c] += md->RowGroup(rg)->ColumnChunk(c)->total_compressed_size();
+  return sz;
+}
+
+static WritePlan plan_write(const arrow::Table& t, const Input& first) {
+  WritePlan p;
+  auto wp = writer_props(p, 1);   // default properties, for the schema conversion only
+  arrow_ok(parquet::arrow::ToParquetSchema(t.schema().get(), *wp, *arrow_props(), &p.schema), "schema");
+  if (first.md->num_row_groups() > 0 && first.md->num_columns() > 0)
+    p.codec = first.md->RowGroup(0)->ColumnChunk(0)->compression();
+
+  const int n = p.schema->num_columns();
+  p.enc.assign(static_cast<size_t>(n), LeafEnc::Default);
+  vector<int> trial;
+  for (int i = 0; i < n; ++i) {
+    const parquet::ColumnDescriptor* c = p.schema->Column(i);
+    if (c->physical_type() != parquet::Type::INT64) continue;
+    const string leaf = c->path()->ToDotVector().back();
+    if (c->path()->ToDotString() == "ts") p.ts_leaf = i;
+    if (delta_leaf(leaf)) p.enc[i] = LeafEnc::Delta;
+    else trial.push_back(i);
+  }
+  if (trial.empty() || t.num_rows() == 0) return p;
+
+  // px/qty: dictionary vs BYTE_STREAM_SPLIT on a middle slice, after compression
+  const int64_t len = min<int64_t>(t.num_rows(), 65536);
+  const auto sample = t.Slice((t.num_rows() - len) / 2, len);
+  WritePlan dict = p, split = p;
+  for (int i : trial) { dict.enc[i] = LeafEnc::Dict; split.enc[i] = LeafEnc::Split; }
+  const vector<int64_t> sd = trial_sizes(*sample, dict), ss = trial_sizes(*sample, split);
+  for (int i : trial) p.enc[i] = (ss[i] < sd[i]) ? LeafEnc::Split : LeafEnc::Dict;
+  return p;
+}
+
+static const char* enc_name(LeafEnc e) {
+  switch (e) {
+    case LeafEnc::Delta: return "delta";
+    case LeafEnc::Dict:  return "dict";
+    case LeafEnc::Split: return "split";
+    default:             return "default";
+  }
+}
+
+// Sorted, re-encoded copy of the inputs at out_path (tmp + rename); bytes written.
+// days != 0 => out_path is a month file holding those days (DAYS_KEY)
+static uint64_t write_compacted(const vector<Input>& ins, const string& out_path, const Opts& o,
+                                uint32_t days = 0) {
+  const string sig = leaf_signature(*ins.front().md->schema());
+  vector<shared_ptr<arrow::Table>> tables;
+  for (const Input& in : ins) {
+    if (leaf_signature(*in.md->schema()) != sig || !in.table->schema()->Equals(*ins.front().table->schema(), false))
+      throw runtime_error("schema differs: " + in.path);
+    tables.push_back(in.table);
+  }
+  shared_ptr<arrow::Table> t = tables.size() == 1 ? tables.front()
+                                                  : arrow_val(arrow::ConcatenateTables(tables), "concatenate");
+  vector<int64_t> ts;
+  if (!ts_values(*t, ts)) throw runtime_error("ts missing, not int64 or has nulls");
+  t = sort_by_ts(t, ts);
+
+  auto kv = t->schema()->metadata() ? t->schema()->metadata()->Copy() : make_shared<arrow::KeyValueMetadata>();
+  arrow_ok(kv->Set(MARKER_KEY, "rg_rows=" + to_string(o.rg_rows)), "metadata");
+  if (days) arrow_ok(kv->Set(DAYS_KEY, days_value(days)), "metadata");
+  t = t->ReplaceSchemaMetadata(kv);
+
+  const WritePlan p = plan_write(*t, ins.front());
+  if (o.debug) {
+    cerr << "[debug] " << out_path << " rows=" << t->num_rows() << " enc:";
+    for (int i = 0; i < p.schema->num_columns(); ++i)
+      if (p.enc[i] != LeafEnc::Default) cerr << ' ' << p.schema->Column(i)->path()->ToDotString() << '=' << enc_name(p.enc[i]);
+    cerr << "\n";
+  }
+
+  const string tmp = out_path + ".tmp" + to_string(::getpid());
+  try {
+    {
+      auto sink = arrow_val(arrow::io::FileOutputStream::Open(tmp), "create");
+      arrow_ok(parquet::arrow::WriteTable(*t, arrow::default_memory_pool(), sink, o.rg_rows,
+                                          writer_props(p, o.rg_rows), arrow_props()), "write");
+      arrow_ok(sink->Close(), "close");
+    }
+
+    // what ShardedDB sees must not change: same leaves, same rows
+    Input back = read_input(Shard{tmp, 0, 0});
+    if (leaf_signature(*back.md->schema()) != sig) throw runtime_error("written schema differs from input");
+    if (back.md->num_rows() != t->num_rows()) throw runtime_error("written row count differs");
+    if (o.verify && !back.table->Equals(*t, false)) throw runtime_error("written rows differ (verify)");
+
+    error_code ec;
+    const uint64_t bytes = static_cast<uint64_t>(fs::file_size(tmp, ec));
+    fs::rename(tmp, out_path);
+    fs::remove(out_path + ".tsidx", ec);   // stale now; parquet_tsidx rebuilds it
+    return bytes;
+  } catch (...) {
+    error_code ec;
+    fs::remove(tmp, ec);
+    throw;
+  }
+}
+
+// ---------- per month ----------
+
+// Every row of a day file inside its UTC day (false when ts cannot be read):
+// merging cannot move rows between query windows
+static bool within_day(const MonthDir& d, const Input& in) {
+  vector<int64_t> ts;
+  if (!ts_values(*in.table, ts)) return false;   // ts unreadable (partly filled): keep the file out
+  if (ts.empty()) return true;
+  const int64_t lo = utc_start_ns(d.y, d.m, in.day), hi = lo + 86'400'000'000'000LL;
+  const auto [mn, mx] = minmax_element(ts.begin(), ts.end());
+  return *mn >= lo && *mx < hi;
+}
+
+// Days of the month that have rows in t (older month files: what they hold)
+static uint32_t days_in(const MonthDir& d, const arrow::Table& t) {
+  vector<int64_t> ts;
+  if (!ts_values(t, ts)) return 0;
+  const int64_t lo = utc_start_ns(d.y, d.m, 1);
+  uint32_t days = 0;
+  for (int64_t v : ts) {
+    const int64_t day = v < lo ? 0 : (v - lo) / 86'400'000'000'000LL + 1;
+    if (day >= 1 && day <= 31) days |= 1u << day;
+  }
+  return days;
+}
+
+static void compact_month(const MonthDir& d, const Opts& o, Totals& tot) {
+  const string month_path = d.dir + "/bn_" + d.kind + '_' + d.mkt + '_' + d.symb + '_'
+                          + to_string(d.y) + '_' + to_string(d.m) + ".parquet";
+  uint64_t day_bytes = 0;
+  for (const Shard& s : d.days) day_bytes += s.bytes;
+
+  // merge: an existing month file takes new day files; else small, finished months
+  const int64_t month_end = d.m == 12 ? utc_start_ns(d.y + 1, 1, 1) : utc_start_ns(d.y, d.m + 1, 1);
+  const int64_t now_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+  bool merge = d.month.has_value()
+            || (o.merge_month_bytes > 0 && d.days.size() > 1 && day_bytes < o.merge_month_bytes && month_end <= now_ns);
+
+  if (merge) {
+    try {
+      const string marker = "rg_rows=" + to_string(o.rg_rows);
+      vector<Shard> days = d.days;   // not yet in the month file
+      uint32_t day_bits = 0, recorded = 0;
+      optional<Input> month;
+      // without DAYS_KEY (older month file): the days of its rows and the day
+      // files not newer than it (same rule as ShardedDB)
+      auto merged = [&](const Shard& s) {
+        return recorded ? (recorded & (1u << s.day)) != 0 : s.mtime <= d.month->mtime;
+      };
+      if (d.month) {
+        // footer first: an up-to-date month file is skipped without decoding it
+        month = open_input(*d.month);
+        recorded = days_of(*month->md);
+        erase_if(days, merged);
+        if (days.empty() && recorded && !o.force && marker_of(*month->md) == marker) {
+          ++tot.skipped;
+          return;
+        }
+      }
+      // a day file with rows outside its day stays out: merging would move them between query windows
+      vector<Input> ins;
+      vector<Shard> taken;
+      for (const Shard& s : days) {
+        Input in = read_input(s);
+        if (!within_day(d, in)) {
+          if (d.month) {
+            // kept as a day file; not in DAYS_KEY, so ShardedDB still reads it next to the month file
+            cerr << "keep " << s.path << " (ts unreadable or outside its day)\n";
+            continue;
+          }
+          if (o.debug) cerr << "[debug] not merged, ts unreadable or outside its day: " << s.path << "\n";
+          merge = false;
+          break;
+        }
+        day_bits |= 1u << s.day;
+        ins.push_back(move(in));
+        taken.push_back(s);
+      }
+      days = move(taken);
+      if (merge && month) {
+        if (days.empty() && recorded && !o.force && marker_of(*month->md) == marker) {
+          ++tot.skipped;
+          return;
+        }
+        load_table(*month);
+        day_bits |= recorded ? recorded : days_in(d, *month->table);
+        for (const Shard& s : d.days)
+          if (merged(s)) day_bits |= 1u << s.day;
+        ins.insert(ins.begin(), move(*month));
+      }
+      if (merge) {
+        cerr << (o.dry_run ? "would merge " : "merge ") << d.dir << " days=" << days.size()
+             << (d.month ? " +month" : "") << " -> " << month_path << "\n";
+        if (o.dry_run) return;
+
+        uint64_t in_bytes = d.month ? d.month->bytes : 0;
+        for (const Shard& s : days) in_bytes += s.bytes;
+        tot.bytes_in += in_bytes;
+        tot.bytes_out += write_compacted(ins, month_path, o, day_bits);
+        ++tot.months_merged;
+        tot.days_merged += days.size();
+        // the month file now shadows these day files (ShardedDB reads it instead)
+        if (!o.keep_days) {
+          for (const Shard& s : days) {
+            error_code ec;
+            fs::remove(s.path, ec);
+            fs::remove(s.path + ".tsidx", ec);
+          }
+        }
+        return;
+      }
+    } catch (const exception& e) {
+      ++tot.failed;
+      cerr << "WARN: " << d.dir << " : " << e.what() << "\n";
+      return;
+    }
+  }
+
+  for (const Shard& s : d.days) {
+    try {
+      Input in = open_input(s);
+      if (in.md->num_rows() == 0
+          || (!o.force && marker_of(*in.md) == "rg_rows=" + to_string(o.rg_rows))) {
+        ++tot.skipped;
+        continue;
+      }
+      load_table(in);
+      cerr << (o.dry_run ? "would rewrite " : "rewrite ") << s.path << "\n";
+      if (o.dry_run) continue;
+      tot.bytes_in += s.bytes;
+      tot.bytes_out += write_compacted({in}, s.path, o);
+      ++tot.rewritten;
+    } catch (const exception& e) {
+      ++tot.failed;
+      cerr << "WARN: " << s.path << " : " << e.what() << "\n";
+    }
+  }
+}
+
+// ==================== main ====================
+
+int main(int argc, char** argv) {
+  Opts o;
+  for (int i = 1; i < argc; ++i) {
+    const string a = argv[i];
+    if (a.rfind("--kind=",0)==0) {
+      o.kind = a.substr(7);
+    } else if (a.rfind("--market=",0)==0) {
+      o.market = a.substr(9);
+    } else if (a.rfind("--symb=",0)==0) {
+      o.symb = a.substr(7);
+    } else if (a.rfind("--rg-rows=",0)==0) {
+      o.rg_rows = stoll(a.substr(10));
+      if (o.rg_rows <= 0) { cerr << "ERROR: --rg-rows must be > 0\n"; return 1; }
+    } else if (a.rfind("--merge-month-mb=",0)==0) {
+      const long long v = stoll(a.substr(17));
+      o.merge_month_bytes = v > 0 ? static_cast<uint64_t>(v) << 20 : 0;
+    } else if (a=="--keep-days") {
+      o.keep_days = true;
+    } else if (a=="--force") {
+      o.force = true;
+    } else if (a=="--no-verify") {
+      o.verify = false;
+    } else if (a=="--dry-run") {
+      o.dry_run = true;
+    } else if (a=="--debug") {
+      o.debug = true;
+    } else if (a.rfind("--",0)==0) {
+      cerr << "ERROR: unknown option " << a << "\n"; return 1;
+    } else if (o.root.empty()) {
+      o.root = a;
+    } else {
+      cerr << "ERROR: one root only\n"; return 1;
+    }
+  }
+  if (o.root.empty()) {
+    cerr << "Usage: " << argv[0] << " <root> [options]\n"
+         << "        [--kind=top|trade|depth] [--market=spot|fut] [--symb=SYMB]  (default: all)\n"
+         << "        [--rg-rows=N]          (default: 131072; rows per row group)\n"
+         << "        [--merge-month-mb=N]   (default: 0 = off; merge a finished month's day files below N MB into one month file)\n"
+         << "        [--keep-days]          (keep merged day files; the month file records its days, so ShardedDB and later runs skip them)\n"
+         << "        [--force]              (rewrite files already compacted with the same --rg-rows)\n"
+         << "        [--no-verify]          (skip reading back and comparing every written row)\n"
+         << "        [--dry-run]            (print what would be rewritten / merged)\n"
+         << "        [--debug]              (chosen encodings per file)\n";
+    return 1;
+  }
+
+  Totals tot;
+  for (const MonthDir& d : find_months(o)) compact_month(d, o, tot);
+
+  cerr << "compact: months_merged=" << tot.months_merged << " days_merged=" << tot.days_merged
+       << " rewritten=" << tot.rewritten << " skipped=" << tot.skipped << " failed=" << tot.failed
+       << " bytes_in=" << tot.bytes_in << " bytes_out=" << tot.bytes_out << "\n";
+  return tot.failed ? 2 : 0;
+}
@@ -1,10 +1,17 @@
 // parquet_bulk_audit_depth.cpp
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_bulk_audit_depth.cpp -lparquet -larrow -lzstd -o parquet_bulk_audit_depth
+//   g++ -std=gnu++23 -O3 parquet_bulk_audit_depth.cpp -lparquet -larrow -lzstd -pthread -o parquet_bulk_audit_depth
 //
 // Usage:
 //   ./parquet_bulk_audit_depth /path/to/parquets anomalies_depth.ndjson
 //   ./parquet_bulk_audit_depth /path/to/parquets anomalies_depth_all.ndjson --all   # to write all files
+//   [--threads=N]  analyze files on N workers (default: all cores); output order does not depend on N
+//   [--cache=FILE [--cache-hash]]  reuse metrics of unchanged files (path+size+mtime, + content hash);
+//                  the NDJSON is regenerated from all metrics
+//   [--fast]       footer-only pre-check: files whose row counts, scalar null counts and ts order
+//                  across row groups look clean are reported from the footer ("footer_only":true;
+//                  gaps, id continuity and the bid/ask zero/per-row rules need a decode: their
+//                  fields are null); only suspect files are decoded
 //
 // Notes:
 // - Focus on depth-style parquet containing columns:
@@ -13,12 +20,15 @@
 // - If bid/ask are flattened (repeated physical values) without offsets, we will compute global stats
 //   but won't be able to map per-row arrays to rows. The tool will flag that as informational anomaly.
 
+#include "parquet_audit_pool.h"
+
 #include <parquet/api/reader.h>
 
 #include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <unordered_set>
@@ -54,22 +64,6 @@ static void read_i64_column(parquet::RowGroupReader& rg, int col_idx, vector<int
     if (done != rows) out.resize(done);
 }
 
-// Accumulators
-struct Welford {
-    long double mean = 0.0L;
-    long double m2 = 0.0L;
-    uint64_t n = 0;
-    void add(long double x) {
-        ++n;
-        long double delta = x - mean;
-        mean += delta / (long double)n;
-        long double delta2 = x - mean;
-        m2 += delta * delta2;
-    }
-    long double variance() const { return (n > 1) ? (m2 / (long double)(n - 1)) : 0.0L; }
-    long double stddev() const { return sqrt((double)variance()); }
-};
-
 struct FileMetric {
     string path;
     int64_t meta_rows = 0;
@@ -134,8 +128,64 @@ struct FileMetric {
     uint64_t null_firstId = 0;
     uint64_t null_lastId = 0;
     uint64_t null_eventTime = 0;
+
+    // --fast (not cached)
+    bool footer_only = false;   // filled by footer_depth_file, nothing decoded
+    string escalated;           // why the footer did not clear the file
 };
 
+// Fields kept by --cache (path is the key); keep in step with FileMetric
+template <class F>
+static void audit_fields(FileMetric& m, F&& f)
+{
+    f(m.meta_rows, m.rows_scanned, m.row_groups,
+      m.has_ts, m.ts_min, m.ts_max, m.max_gap_ns, m.gaps_gt_100ms, m.gaps_gt_1s, m.non_monotonic_ts,
+      m.has_firstId, m.has_lastId, m.prev_lastId, m.id_overlap_count, m.id_gap_count, m.last_lt_first_count,
+      m.has_eventTime,
+      m.has_bid_px, m.bid_px_count, m.bid_px_min, m.bid_px_max, m.bid_px_avg, m.bid_px_zero,
+      m.has_bid_qty, m.bid_qty_count, m.bid_qty_min, m.bid_qty_max, m.bid_qty_avg, m.bid_qty_zero,
+      m.has_ask_px, m.ask_px_count, m.ask_px_min, m.ask_px_max, m.ask_px_avg, m.ask_px_zero,
+      m.has_ask_qty, m.ask_qty_count, m.ask_qty_min, m.ask_qty_max, m.ask_qty_avg, m.ask_qty_zero,
+      m.bid_per_row, m.ask_per_row,
+      m.null_ts, m.null_firstId, m.null_lastId, m.null_eventTime);
+}
+
+// --fast: fills `out` from the footer and column statistics alone when they show
+// nothing suspect; otherwise returns false with the reason in `why`. bid/ask
+// counts are the footer's element counts; gap, id and zero counts are not
+// evaluated (null in the NDJSON).
+static bool footer_depth_file(const string& path, FileMetric& out, string& why)
+{
+    out = FileMetric();
+    out.path = path;
+    FooterScan ft;
+    try {
+        audit_footer(path, {{"ts"}, {"firstId"}, {"lastId"}, {"eventTime"},
+                            {"bid.list.element.px", "bid_px"}, {"bid.list.element.qty", "bid_qty"},
+                            {"ask.list.element.px", "ask_px"}, {"ask.list.element.qty", "ask_qty"}},
+                     0, 10, ft);
+    } catch (const exception& e) {
+        why = e.what();
+        return false;
+    }
+    const FooterColumn &ts = ft.cols[0], &bp = ft.cols[4], &bq = ft.cols[5], &ap = ft.cols[6], &aq = ft.cols[7];
+    if (ft.suspects.empty() && (bp.values == bp.nulls || bq.values == bq.nulls || ap.values == ap.nulls || aq.values == aq.nulls))
+        ft.suspects.push_back("bid/ask without values");
+    if (!ft.suspects.empty()) { why = ft.suspects.front(); return false; }
+
+    out.footer_only = true;
+    out.meta_rows = out.rows_scanned = ft.meta_rows;
+    out.row_groups = ft.row_groups;
+    out.has_ts = out.has_firstId = out.has_lastId = out.has_eventTime = true;
+    out.has_bid_px = out.has_bid_qty = out.has_ask_px = out.has_ask_qty = true;
+    out.ts_min = ts.min; out.ts_max = ts.max;
+    out.bid_px_count = (uint64_t)(bp.values - bp.nulls); out.bid_px_min = bp.min; out.bid_px_max = bp.max;
+    out.bid_qty_count = (uint64_t)(bq.values - bq.nulls); out.bid_qty_min = bq.min; out.bid_qty_max = bq.max;
+    out.ask_px_count = (uint64_t)(ap.values - ap.nulls); out.ask_px_min = ap.min; out.ask_px_max = ap.max;
+    out.ask_qty_count = (uint64_t)(aq.values - aq.nulls); out.ask_qty_min = aq.min; out.ask_qty_max = aq.max;
+    return true;
+}
+
 static bool analyze_depth_file(const string& path, FileMetric& out)
 {
     out = FileMetric();
@@ -352,15 +402,15 @@ static bool analyze_depth_file(const string& path, FileMetric& out)
 
         return true;
     } catch (const exception& e) {
-        cerr << "ERROR: open/read failed for " << path << " : " << e.what() << "\n";
-        return false;
+        // printed by the done callback, in file order
+        throw runtime_error("open/read failed for " + path + " : " + e.what());
     }
 }
 
 int main(int argc, char** argv)
 {
     if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " /path/to/parquet_dir output.ndjson [--all]\n";
+        cerr << "Usage: " << argv[0] << " /path/to/parquet_dir output.ndjson [--all] [--threads=N] [--cache=FILE [--cache-hash]] [--fast]\n";
         return 1;
     }
 
@@ -380,7 +430,20 @@ int main(int argc, char** argv)
     string dir = argv[1];
     string out_path = argv[2];
     bool write_all = false;
-    if (argc >= 4 && string(argv[3]) == "--all") write_all = true;
+    unsigned threads = 0;
+    string cache_path;
+    bool cache_hash = false;
+    bool fast = false;
+    for (int i = 3; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--all") write_all = true;
+        else if (a.rfind("--threads=", 0) == 0) threads = (unsigned)stoul(a.substr(10));
+        else if (a.rfind("--cache=", 0) == 0) cache_path = a.substr(8);
+        else if (a == "--cache-hash") cache_hash = true;
+        else if (a == "--fast") fast = true;
+        else { cerr << "Unknown option " << a << "\n"; return 1; }
+    }
+    threads = audit_threads(threads);
 
     vector<string> files;
     for (auto &p : fs::directory_iterator(dir)) {
@@ -398,14 +461,33 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    uint64_t idx = 0;
-    for (auto &f : files) {
-        ++idx;
-        cerr << "[" << idx << "/" << files.size() << "] " << f << " ... " << flush;
-        FileMetric m;
-        bool ok = analyze_depth_file(f, m);
-        if (!ok) { cerr << "failed\n"; continue; }
-        cerr << "ok (rows=" << m.rows_scanned << ")\n";
+    // files are analyzed in parallel; anomalies are decided and written here in file order
+    cerr << "Scanning " << files.size() << " files on " << threads << " threads...\n";
+    AuditStore<FileMetric> store(cache_path, "parquet_depth_audit", cache_hash);
+    store.stamp(files, threads);
+    size_t footer_only = 0;
+    audit_files<FileMetric>(files, threads,
+                            [&](const string& f, FileMetric& m) {
+        if (store.get(f, m)) { m.path = f; return true; }
+        string why;
+        if (fast && footer_depth_file(f, m, why)) return true;
+        const bool ok = analyze_depth_file(f, m);
+        m.escalated = why;
+        return ok;
+    },
+                            [&](size_t i, FileMetric& m, bool ok, const string& err) {
+        cerr << "[" << (i + 1) << "/" << files.size() << "] " << files[i] << " ... ";
+        if (!ok) {
+            if (!err.empty()) cerr << "ERROR: " << err << "\n";
+            cerr << "failed\n";
+            return;
+        }
+        cerr << "ok (rows=" << m.rows_scanned << ")";
+        if (m.footer_only) cerr << " footer only";
+        else if (!m.escalated.empty()) cerr << " escalated: " << m.escalated;
+        cerr << "\n";
+        if (m.footer_only) ++footer_only;
+        else store.put(files[i], m);
 
         // detect anomalies for depth files
         vector<string> anomalies;
@@ -425,36 +507,39 @@ int main(int argc, char** argv)
         if (m.has_bid_qty && m.bid_qty_count == 0) anomalies.push_back("has_bid_qty but bid_qty_count==0");
         if (m.has_ask_qty && m.ask_qty_count == 0) anomalies.push_back("has_ask_qty but ask_qty_count==0");
 
-        // too many zero quantities or zero prices (heuristic: >10% zeros)
-        auto pct = [](uint64_t zero, uint64_t total)->double {
-            if (total==0) return 0.0;
-            return (100.0 * (double)zero) / (double)total;
-        };
-        if (m.bid_qty_count>0 && pct(m.bid_qty_zero, m.bid_qty_count) > 10.0) anomalies.push_back("high_fraction_bid_qty_zero");
-        if (m.ask_qty_count>0 && pct(m.ask_qty_zero, m.ask_qty_count) > 10.0) anomalies.push_back("high_fraction_ask_qty_zero");
-        if (m.bid_px_count>0 && pct(m.bid_px_zero, m.bid_px_count) > 10.0) anomalies.push_back("high_fraction_bid_px_zero");
-        if (m.ask_px_count>0 && pct(m.ask_px_zero, m.ask_px_count) > 10.0) anomalies.push_back("high_fraction_ask_px_zero");
-
-        // check per-row consistency: if bid_per_row true, ensure counts match rows_scanned
-        if (m.bid_per_row && (int64_t)m.bid_px_count != m.rows_scanned && (int64_t)m.bid_qty_count != m.rows_scanned) {
-            // if either px or qty per-row count != rows_scanned -> inconsistent
-            anomalies.push_back("per-row bid counts mismatch rows_scanned");
-        }
-        if (m.ask_per_row && (int64_t)m.ask_px_count != m.rows_scanned && (int64_t)m.ask_qty_count != m.rows_scanned) {
-            anomalies.push_back("per-row ask counts mismatch rows_scanned");
-        }
+        // zero fractions and per-row layout need the decoded values (not for footer_only files)
+        if (!m.footer_only) {
+            // too many zero quantities or zero prices (heuristic: >10% zeros)
+            auto pct = [](uint64_t zero, uint64_t total)->double {
+                if (total==0) return 0.0;
+                return (100.0 * (double)zero) / (double)total;
+            };
+            if (m.bid_qty_count>0 && pct(m.bid_qty_zero, m.bid_qty_count) > 10.0) anomalies.push_back("high_fraction_bid_qty_zero");
+            if (m.ask_qty_count>0 && pct(m.ask_qty_zero, m.ask_qty_count) > 10.0) anomalies.push_back("high_fraction_ask_qty_zero");
+            if (m.bid_px_count>0 && pct(m.bid_px_zero, m.bid_px_count) > 10.0) anomalies.push_back("high_fraction_bid_px_zero");
+            if (m.ask_px_count>0 && pct(m.ask_px_zero, m.ask_px_count) > 10.0) anomalies.push_back("high_fraction_ask_px_zero");
+
+            // check per-row consistency: if bid_per_row true, ensure counts match rows_scanned
+            if (m.bid_per_row && (int64_t)m.bid_px_count != m.rows_scanned && (int64_t)m.bid_qty_count != m.rows_scanned) {
+                // if either px or qty per-row count != rows_scanned -> inconsistent
+                anomalies.push_back("per-row bid counts mismatch rows_scanned");
+            }
+            if (m.ask_per_row && (int64_t)m.ask_px_count != m.rows_scanned && (int64_t)m.ask_qty_count != m.rows_scanned) {
+                anomalies.push_back("per-row ask counts mismatch rows_scanned");
+            }
 
-        // If flattened arrays exist but we couldn't map to per-row, mark informational anomaly
-        if ((m.has_bid_px && !m.bid_per_row && m.bid_px_count>0) || (m.has_bid_qty && !m.bid_per_row && m.bid_qty_count>0)
-         || (m.has_ask_px && !m.ask_per_row && m.ask_px_count>0) || (m.has_ask_qty && !m.ask_per_row && m.ask_qty_count>0)) {
-            anomalies.push_back("flattened_bid_or_ask_arrays_without_offsets (informational)");
+            // If flattened arrays exist but we couldn't map to per-row, mark informational anomaly
+            if ((m.has_bid_px && !m.bid_per_row && m.bid_px_count>0) || (m.has_bid_qty && !m.bid_per_row && m.bid_qty_count>0)
+             || (m.has_ask_px && !m.ask_per_row && m.ask_px_count>0) || (m.has_ask_qty && !m.ask_per_row && m.ask_qty_count>0)) {
+                anomalies.push_back("flattened_bid_or_ask_arrays_without_offsets (informational)");
+            }
         }
 
         // small-file heuristic
         if (m.meta_rows > 0 && m.meta_rows < 10) anomalies.push_back("meta_rows < 10 (very small depth file)");
 
         // If no anomalies and not writing all, skip
-        if (anomalies.empty() && !write_all) continue;
+        if (anomalies.empty() && !write_all) return;
 
         // compose JSON
         ostringstream o;
@@ -463,19 +548,30 @@ int main(int argc, char** argv)
         o << ",\"meta_rows\":" << m.meta_rows;
         o << ",\"rows_scanned\":" << m.rows_scanned;
         o << ",\"row_groups\":" << m.row_groups;
+        if (m.footer_only) o << ",\"footer_only\":true";
+        // footer_only: row order, gaps, id continuity, averages and zeros are not evaluated => null
+        auto unk = [&](const auto& v) { if (m.footer_only) o << "null"; else o << v; };
         if (m.has_ts) {
-            o << ",\"ts_min\":" << m.ts_min << ",\"ts_max\":" << m.ts_max << ",\"max_gap_ns\":" << m.max_gap_ns;
-            o << ",\"gaps_gt_100ms\":" << m.gaps_gt_100ms << ",\"gaps_gt_1s\":" << m.gaps_gt_1s << ",\"non_monotonic_ts\":" << m.non_monotonic_ts;
+            o << ",\"ts_min\":" << m.ts_min << ",\"ts_max\":" << m.ts_max << ",\"max_gap_ns\":"; unk(m.max_gap_ns);
+            o << ",\"gaps_gt_100ms\":"; unk(m.gaps_gt_100ms);
+            o << ",\"gaps_gt_1s\":"; unk(m.gaps_gt_1s);
+            o << ",\"non_monotonic_ts\":"; unk(m.non_monotonic_ts);
         } else o << ",\"ts_present\":false";
         if (m.has_firstId && m.has_lastId) {
-            o << ",\"id_overlap_count\":" << m.id_overlap_count << ",\"id_gap_count\":" << m.id_gap_count << ",\"last_lt_first_count\":" << m.last_lt_first_count;
+            o << ",\"id_overlap_count\":"; unk(m.id_overlap_count);
+            o << ",\"id_gap_count\":"; unk(m.id_gap_count);
+            o << ",\"last_lt_first_count\":"; unk(m.last_lt_first_count);
         } else o << ",\"ids_present\":false";
 
         // bid/ask summary
-        o << ",\"bid_px_count\":" << m.bid_px_count << ",\"bid_px_min\":" << m.bid_px_min << ",\"bid_px_max\":" << m.bid_px_max << ",\"bid_px_avg\":" << fixed << setprecision(6) << (double)m.bid_px_avg << ",\"bid_px_zero\":" << m.bid_px_zero;
-        o << ",\"bid_qty_count\":" << m.bid_qty_count << ",\"bid_qty_min\":" << m.bid_qty_min << ",\"bid_qty_max\":" << m.bid_qty_max << ",\"bid_qty_avg\":" << fixed << setprecision(6) << (double)m.bid_qty_avg << ",\"bid_qty_zero\":" << m.bid_qty_zero;
-        o << ",\"ask_px_count\":" << m.ask_px_count << ",\"ask_px_min\":" << m.ask_px_min << ",\"ask_px_max\":" << m.ask_px_max << ",\"ask_px_avg\":" << fixed << setprecision(6) << (double)m.ask_px_avg << ",\"ask_px_zero\":" << m.ask_px_zero;
-        o << ",\"ask_qty_count\":" << m.ask_qty_count << ",\"ask_qty_min\":" << m.ask_qty_min << ",\"ask_qty_max\":" << m.ask_qty_max << ",\"ask_qty_avg\":" << fixed << setprecision(6) << (double)m.ask_qty_avg << ",\"ask_qty_zero\":" << m.ask_qty_zero;
+        o << ",\"bid_px_count\":" << m.bid_px_count << ",\"bid_px_min\":" << m.bid_px_min << ",\"bid_px_max\":" << m.bid_px_max << ",\"bid_px_avg\":" << fixed << setprecision(6); unk((double)m.bid_px_avg);
+        o << ",\"bid_px_zero\":"; unk(m.bid_px_zero);
+        o << ",\"bid_qty_count\":" << m.bid_qty_count << ",\"bid_qty_min\":" << m.bid_qty_min << ",\"bid_qty_max\":" << m.bid_qty_max << ",\"bid_qty_avg\":" << fixed << setprecision(6); unk((double)m.bid_qty_avg);
+        o << ",\"bid_qty_zero\":"; unk(m.bid_qty_zero);
+        o << ",\"ask_px_count\":" << m.ask_px_count << ",\"ask_px_min\":" << m.ask_px_min << ",\"ask_px_max\":" << m.ask_px_max << ",\"ask_px_avg\":" << fixed << setprecision(6); unk((double)m.ask_px_avg);
+        o << ",\"ask_px_zero\":"; unk(m.ask_px_zero);
+        o << ",\"ask_qty_count\":" << m.ask_qty_count << ",\"ask_qty_min\":" << m.ask_qty_min << ",\"ask_qty_max\":" << m.ask_qty_max << ",\"ask_qty_avg\":" << fixed << setprecision(6); unk((double)m.ask_qty_avg);
+        o << ",\"ask_qty_zero\":"; unk(m.ask_qty_zero);
 
         o << ",\"null_counts\":{";
         bool firstnc = true;
@@ -494,7 +590,13 @@ int main(int argc, char** argv)
         o << "\n";
 
         fout << o.str();
+    });
+    if (store.enabled()) {
+        string err;
+        if (!store.save(&err)) cerr << "WARN: cache " << cache_path << " not saved: " << err << "\n";
+        cerr << "Cache: " << store.hits() << "/" << files.size() << " files reused from " << cache_path << "\n";
     }
+    if (fast) cerr << "Fast: " << footer_only << "/" << files.size() << " files cleared from footers, the rest decoded\n";
 
     fout.close();
     cerr << "Scan complete. Results: " << out_path << (write_all ? " (all files)" : " (only anomalous files)") << "\n";
@@ -7,11 +7,17 @@
 
 #include <arrow/api.h>
 #include <arrow/io/api.h>
+#include <arrow/io/stdio.h>
+#include <arrow/ipc/api.h>
 #include <parquet/api/reader.h>
 
 #include <cctype>
+#include <cerrno>
+#include <charconv>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <filesystem>
 #include <iomanip>
@@ -21,9 +27,15 @@
 #include <regex>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <cmath>   // for std::llround
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <algorithm>
+#include <bit>
 #include <fstream>
 #include <chrono>  // perf timing
 
@@ -36,23 +48,7 @@
 using namespace std;
 namespace fs = std::filesystem;
 
-// ---------- OS + prefetch helpers (Linux) ----------
-
-static inline void prefetch_path(const std::string& path) {
-#if defined(__linux__)
-  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
-  if (fd < 0) return;
-  struct stat st{};
-  if (::fstat(fd, &st) == 0 && st.st_size > 0) {
-    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
-    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
-    readahead(fd, 0, static_cast<size_t>(st.st_size));
-  }
-  ::close(fd);
-#else
-  (void)path;
-#endif
-}
+// ---------- OS helpers (Linux) ----------
 
 static std::string detect_os_pretty() {
 #if defined(__linux__)
@@ -157,42 +153,173 @@ struct PrintCfg {
   bool header = false;                 // print header row
 };
 
-static void print_ts_fmt(ostream& os, int64_t ns, TsFormat fmt) {
+// ---------- fast text output ----------
+// Rows are formatted with integer arithmetic + to_chars into either a std::string
+// (gap mode keeps lazy per-row strings) or OutBuf, which owns stdout.
+
+class OutBuf {
+public:
+  explicit OutBuf(int fd = 1, size_t cap = size_t(1) << 20)
+    : fd_(fd), cap_(cap), buf_(new char[cap]) {}
+  ~OutBuf() { flush(); }
+  OutBuf(const OutBuf&) = delete;
+  OutBuf& operator=(const OutBuf&) = delete;
+
+  void append(const char* p, size_t n) {
+    if (len_ + n > cap_) {
+      flush();
+      if (n > cap_) { write_all(p, n); return; }
+    }
+    memcpy(buf_.get() + len_, p, n); len_ += n;
+  }
+  void push_back(char c) { if (len_ == cap_) flush(); buf_[len_++] = c; }
+  void flush() { write_all(buf_.get(), len_); len_ = 0; }
+  bool ok() const { return !failed_; }
+
+  OutBuf& operator<<(char c) { push_back(c); return *this; }
+  OutBuf& operator<<(const char* s) { append(s, strlen(s)); return *this; }
+  OutBuf& operator<<(const string& s) { append(s.data(), s.size()); return *this; }
+  template <class T> requires (is_integral_v<T> && !is_same_v<T, char> && !is_same_v<T, bool>)
+  OutBuf& operator<<(T v) {
+    char b[24]; auto r = to_chars(b, b + sizeof(b), v);
+    append(b, size_t(r.ptr - b)); return *this;
+  }
+
+private:
+  void write_all(const char* p, size_t n) {
+    while (n > 0 && !failed_) {
+      ssize_t w = ::write(fd_, p, n);
+      if (w < 0) { if (errno == EINTR) continue; failed_ = true; break; }
+      p += w; n -= size_t(w);
+    }
+  }
+
+  int fd_;
+  size_t cap_;
+  unique_ptr<char[]> buf_;
+  size_t len_ = 0;
+  bool failed_ = false;
+};
+
+template <class Out, class T>
+static inline void put_int(Out& os, T v) {
+  char b[24]; auto r = to_chars(b, b + sizeof(b), v);
+  os.append(b, size_t(r.ptr - b));
+}
+
+// zero-padded, exactly `width` digits
+template <class Out>
+static inline void put_padded(Out& os, uint64_t v, int width) {
+  char b[24];
+  for (int k = width - 1; k >= 0; --k) { b[k] = char('0' + v % 10); v /= 10; }
+  os.append(b, size_t(width));
+}
+
+static constexpr uint64_t kPow10[20] = {
+  1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+  100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+  10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+  100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull };
+
+// Reference path: long double division printed as "%.*Lf" (what ostream << fixed does).
+template <class Out>
+static void put_fixed_slow(Out& os, int64_t raw, int scale_digits, int precision) {
+  const long double d = scale_digits == 9 ? 1'000'000'000.0L : 1'0000'0000.0L;
+  char b[128];
+  int n = snprintf(b, sizeof(b), "%.*Lf", precision, static_cast<long double>(raw) / d);
+  if (n >= 0 && size_t(n) < sizeof(b)) { os.append(b, size_t(n)); return; }
+  vector<char> big(size_t(n) + 1);
+  snprintf(big.data(), big.size(), "%.*Lf", precision, static_cast<long double>(raw) / d);
+  os.append(big.data(), size_t(n));
+}
+
+// raw / 10^scale_digits printed with `precision` decimals, byte-identical to the
+// long double path. The integer path is taken only where that path is provably
+// exact: no rounding tie (a tie's outcome depends on the binary rounding of the
+// quotient) and, for extra zero digits, |raw| small enough that the long double
+// error stays under half an ulp of the output.
+template <class Out>
+static void put_fixed(Out& os, int64_t raw, int scale_digits, int precision) {
+  const int D = scale_digits, p = precision;
+  if (raw == numeric_limits<int64_t>::min() || p < 0 || p > 18) return put_fixed_slow(os, raw, D, p);
+  const bool neg = raw < 0;
+  const uint64_t u = neg ? uint64_t(-raw) : uint64_t(raw);
+  if (p > D && u >= (uint64_t(1) << 63) / kPow10[p - D]) return put_fixed_slow(os, raw, D, p);
+
+  uint64_t ip = u / kPow10[D], frac = u % kPow10[D];
+  int fdig = D;
+  if (p < D) {
+    const uint64_t div = kPow10[D - p], rem = frac % div;
+    frac /= div;
+    if (rem == div / 2) return put_fixed_slow(os, raw, D, p);
+    if (rem > div / 2 && ++frac == kPow10[p]) { frac = 0; ++ip; }
+    fdig = p;
+  }
+
+  char b[48]; char* e = b;
+  if (neg) *e++ = '-';
+  e = to_chars(e, b + sizeof(b), ip).ptr;
+  if (p > 0) {
+    *e++ = '.';
+    for (int k = fdig - 1; k >= 0; --k) { e[k] = char('0' + frac % 10); frac /= 10; }
+    e += fdig;
+    for (int k = fdig; k < p; ++k) *e++ = '0';
+  }
+  os.append(b, size_t(e - b));
+}
+
+// ISO ms timestamps: "YYYY-MM-DDTHH:MM:SS." is cached per second, so only the
+// millisecond digits are formatted per row.
+template <class Out>
+static void put_iso_ms(Out& os, int64_t ns) {
+  static thread_local int64_t cached_sec = -1;
+  static thread_local char pre[32];
+  static thread_local size_t pre_len = 0;
+  if (ns < 0) { const string s = iso_from_ns_ms(ns); os.append(s.data(), s.size()); return; }
+  const int64_t sec = ns / 1'000'000'000LL;
+  if (sec != cached_sec) {
+    const string s = iso_from_ns_ms(sec * 1'000'000'000LL);   // "...SS.000Z"
+    pre_len = min(s.size() - 4, sizeof(pre));
+    memcpy(pre, s.data(), pre_len);
+    cached_sec = sec;
+  }
+  os.append(pre, pre_len);
+  put_padded(os, uint64_t((ns / 1'000'000LL) % 1000), 3);
+  os.push_back('Z');
+}
+
+template <class Out>
+static void print_ts_fmt(Out& os, int64_t ns, TsFormat fmt) {
   if (fmt == TsFormat::Human) {
-    os << iso_from_ns_ms(ns);
+    put_iso_ms(os, ns);
   } else {
-    os << ns; // raw nanoseconds
+    put_int(os, ns); // raw nanoseconds
   }
 }
 
-static void print_scaled1e8_fixed(ostream& os, int64_t raw, int precision) {
-  std::ios::fmtflags f = os.flags();
-  auto p = os.precision();
-  os.setf(std::ios::fixed);
-  os << setprecision(precision) << (static_cast<long double>(raw) / 1'0000'0000.0L);
-  os.flags(f);
-  os.precision(p);
+template <class Out>
+static inline void print_scaled1e8_fixed(Out& os, int64_t raw, int precision) {
+  put_fixed(os, raw, 8, precision);
 }
 
-static inline void print_px_val(ostream& os, int64_t raw, const PrintCfg& pcfg) {
+template <class Out>
+static inline void print_px_val(Out& os, int64_t raw, const PrintCfg& pcfg) {
   if (pcfg.pxqty_double && !pcfg.raw_override) print_scaled1e8_fixed(os, raw, pcfg.precision_px);
-  else os << raw;
+  else put_int(os, raw);
 }
-static inline void print_qty_val(ostream& os, int64_t raw, const PrintCfg& pcfg) {
+template <class Out>
+static inline void print_qty_val(Out& os, int64_t raw, const PrintCfg& pcfg) {
   if (pcfg.pxqty_double && !pcfg.raw_override) print_scaled1e8_fixed(os, raw, pcfg.precision_qty);
-  else os << raw;
+  else put_int(os, raw);
 }
 
-static inline void print_gap_s_ms(ostream& os, int64_t dt_ns) {
-  std::ios::fmtflags f = os.flags();
-  auto p = os.precision();
-  os.setf(std::ios::fixed);
-  os << setprecision(3) << (static_cast<long double>(dt_ns) / 1'000'000'000.0L);
-  os.flags(f);
-  os.precision(p);
+template <class Out>
+static inline void print_gap_s_ms(Out& os, int64_t dt_ns) {
+  put_fixed(os, dt_ns, 9, 3);
 }
 
-static inline void print_prefix(ostream& os,
+template <class Out>
+static inline void print_prefix(Out& os,
                                 const PrintCfg& pcfg,
                                 const string* /*filename1_opt*/,
                                 const string* /*filename2_opt*/,
@@ -202,21 +329,14 @@ static inline void print_prefix(ostream& os,
   bool need_idx = (pcfg.idx_mode != IdxMode::None);
   if (!need_idx) return;
 
-  bool first = true;
-  auto put = [&](const string& s){
-    if (!first) os << " ;";
-    os << s;
-    first = false;
-  };
-
   if (pcfg.idx_mode == IdxMode::Raw && idx1.has_value() && idx2.has_value()) {
-    put(to_string(*idx1) + "," + to_string(*idx2));
+    put_int(os, *idx1); os.push_back(','); put_int(os, *idx2);
   } else if (idx1.has_value()) {
-    put(to_string(*idx1));
+    put_int(os, *idx1);
   } else {
-    put("-");
+    os.push_back('-');
   }
-  os << " ;";
+  os.append(" ;", 2);
 }
 
 // ---------- file-open printer with raw idx + perf (M rec/s) ----------
@@ -276,6 +396,69 @@ struct FnPrinter {
   }
 };
 
+// ---------- scan counters (debug / --stats-json) ----------
+
+static void print_prefetch_stats(const char* kind, const ScanStats& st) {
+  if (!(st.prefetch_ready || st.prefetch_waits || st.prefetch_missed)) return;
+  cerr << "[debug] " << kind << " prefetch: ready=" << st.prefetch_ready
+       << " waits=" << st.prefetch_waits << " wait_ms=" << st.prefetch_wait_ns / 1000000
+       << " missed=" << st.prefetch_missed << " bytes=" << st.prefetch_bytes << "\n";
+}
+
+static void print_scan_stats(const char* kind, const ScanStats& st) {
+  cerr << "[debug] " << kind << " row groups: decoded=" << st.row_groups_decoded
+       << " skipped=" << st.row_groups_skipped
+       << " rows_skipped_by_page_index=" << st.rows_skipped_by_page_index << "\n";
+  if (st.files_skipped_by_index || st.rows_skipped_by_index)
+    cerr << "[debug] " << kind << " tsidx: files_skipped=" << st.files_skipped_by_index
+         << " rows_skipped=" << st.rows_skipped_by_index << "\n";
+  cerr << "[debug] " << kind << " buffers: allocs=" << st.buffer_allocs
+       << " peak_bytes=" << st.buffer_peak_bytes << "\n";
+  cerr << "[debug] " << kind << " io: files=" << st.files_opened << " bytes_read=" << st.bytes_read
+       << " rows_emitted=" << st.rows_emitted << "\n";
+  cerr << "[debug] " << kind << " time_ms: open=" << st.open_ns / 1000000
+       << " metadata=" << st.metadata_ns / 1000000 << " decode=" << st.decode_ns / 1000000
+       << " filter=" << st.filter_ns / 1000000 << " consumer=" << st.consumer_ns / 1000000 << "\n";
+  print_prefetch_stats(kind, st);
+  if (st.cache_columns_hit || st.cache_columns_stored)
+    cerr << "[debug] " << kind << " column cache: hit=" << st.cache_columns_hit
+         << " stored=" << st.cache_columns_stored << "\n";
+}
+
+// One JSON object per run (path "-" => stderr), for nightly comparisons
+static void write_stats_json(const string& path, const char* kind, const ScanStats& st, uint64_t wall_ns) {
+  ostringstream js;
+  js << "{\"reader\":\"" << kind << "\""
+     << ",\"wall_ns\":" << wall_ns
+     << ",\"files_opened\":" << st.files_opened
+     << ",\"bytes_read\":" << st.bytes_read
+     << ",\"rows_emitted\":" << st.rows_emitted
+     << ",\"row_groups_scanned\":" << st.row_groups_decoded + st.row_groups_skipped
+     << ",\"row_groups_decoded\":" << st.row_groups_decoded
+     << ",\"row_groups_skipped\":" << st.row_groups_skipped
+     << ",\"rows_skipped_by_page_index\":" << st.rows_skipped_by_page_index
+     << ",\"files_skipped_by_index\":" << st.files_skipped_by_index
+     << ",\"rows_skipped_by_index\":" << st.rows_skipped_by_index
+     << ",\"open_ns\":" << st.open_ns
+     << ",\"metadata_ns\":" << st.metadata_ns
+     << ",\"decode_ns\":" << st.decode_ns
+     << ",\"filter_ns\":" << st.filter_ns
+     << ",\"consumer_ns\":" << st.consumer_ns
+     << ",\"buffer_allocs\":" << st.buffer_allocs
+     << ",\"buffer_peak_bytes\":" << st.buffer_peak_bytes
+     << ",\"prefetch_ready\":" << st.prefetch_ready
+     << ",\"prefetch_waits\":" << st.prefetch_waits
+     << ",\"prefetch_wait_ns\":" << st.prefetch_wait_ns
+     << ",\"prefetch_missed\":" << st.prefetch_missed
+     << ",\"prefetch_bytes\":" << st.prefetch_bytes
+     << ",\"cache_columns_hit\":" << st.cache_columns_hit
+     << ",\"cache_columns_stored\":" << st.cache_columns_stored
+     << "}\n";
+  if (path == "-") { cerr << js.str(); return; }
+  ofstream f(path, ios::trunc);
+  if (!(f << js.str())) cerr << "WARN: cannot write stats to " << path << "\n";
+}
+
 // ---------- parse TYPE ----------
 
 struct ParsedType {
@@ -366,6 +549,56 @@ static TradeSelect make_trade_select_from_csv(const string& csv)
   return sel;
 }
 
+// ---------- --where=EXPR -> Predicate ----------
+// EXPR := TERM ('||' TERM)* ; TERM := CMP ('&&' CMP)* ; CMP := col[-col2] OP int
+// OP: < <= > >= == != ; columns by file name (qty, isMarket, ask_px, ...), raw stored values
+
+static string trim_ws(string s) {
+  size_t a = s.find_first_not_of(" \t"), b = s.find_last_not_of(" \t");
+  return a==string::npos ? string() : s.substr(a, b-a+1);
+}
+
+static vector<string> split_on(const string& s, const string& sep) {
+  vector<string> v; size_t pos = 0;
+  for (size_t f; (f = s.find(sep, pos)) != string::npos; pos = f + sep.size()) v.push_back(s.substr(pos, f-pos));
+  v.push_back(s.substr(pos));
+  return v;
+}
+
+static Predicate parse_where_cmp(const string& in) {
+  static const pair<const char*, Predicate::Op> ops[] = {
+    {"<=",Predicate::Op::Le}, {">=",Predicate::Op::Ge}, {"==",Predicate::Op::Eq}, {"!=",Predicate::Op::Ne},
+    {"<",Predicate::Op::Lt},  {">",Predicate::Op::Gt},
+  };
+  for (const auto& [tok, op] : ops) {
+    size_t at = in.find(tok);
+    if (at == string::npos) continue;
+    string lhs = trim_ws(in.substr(0, at));
+    string rhs = trim_ws(in.substr(at + strlen(tok)));
+    if (lhs.empty() || rhs.empty()) break;
+    int64_t v = 0;
+    try { size_t used = 0; v = stoll(rhs, &used); if (used != rhs.size()) throw 0; }
+    catch (...) { throw runtime_error("--where: bad number '" + rhs + "'"); }
+    size_t minus = lhs.find('-');
+    if (minus == string::npos) return Predicate::cmp(lhs, op, v);
+    return Predicate::diff(trim_ws(lhs.substr(0, minus)), trim_ws(lhs.substr(minus + 1)), op, v);
+  }
+  throw runtime_error("--where: cannot parse '" + in + "'");
+}
+
+static Predicate parse_where(const string& expr) {
+  optional<Predicate> any;
+  for (const string& term : split_on(expr, "||")) {
+    optional<Predicate> all;
+    for (const string& c : split_on(term, "&&")) {
+      Predicate p = parse_where_cmp(trim_ws(c));
+      all = all ? (*all && p) : p;
+    }
+    any = any ? (*any || *all) : *all;
+  }
+  return *any;
+}
+
 // ---------- Parquet (px) helpers ----------
 
 static int find_col_idx(const parquet::SchemaDescriptor* schema, const string& name) {
@@ -417,18 +650,26 @@ static vector<PxFile> list_px_months(const string& root, const string& symb, con
 
 // ----- helpers to render rows to strings -----
 
-static string render_px_row_content(int64_t ts, int64_t ap, int64_t bp,
-                                    bool need_ts, bool need_ask, bool need_bid,
-                                    const PrintCfg& pcfg)
+template <class Out>
+static void put_px_row_content(Out& os, int64_t ts, int64_t ap, int64_t bp,
+                               bool need_ts, bool need_ask, bool need_bid,
+                               const PrintCfg& pcfg)
 {
-  ostringstream os;
   bool first = true;
-  auto put_sep = [&]{ if (!first) os<<';'; first=false; };
+  auto put_sep = [&]{ if (!first) os.push_back(';'); first=false; };
 
   if (need_ts) { put_sep(); print_ts_fmt(os, ts, pcfg.ts_fmt); }
   if (need_ask){ put_sep(); print_px_val(os, ap, pcfg); }
   if (need_bid){ put_sep(); print_px_val(os, bp, pcfg); }
-  return os.str();
+}
+
+static string render_px_row_content(int64_t ts, int64_t ap, int64_t bp,
+                                    bool need_ts, bool need_ask, bool need_bid,
+                                    const PrintCfg& pcfg)
+{
+  string s;
+  put_px_row_content(s, ts, ap, bp, need_ts, need_ask, need_bid, pcfg);
+  return s;
 }
 
 // Build header strings
@@ -438,6 +679,445 @@ static string header_from_names(const vector<string>& names) {
   return os.str();
 }
 
+// ==================== binary column output (--format=arrow|npy|raw) ====================
+// Same rows and columns as the text output, but values as stored: ts in ns, px/qty as
+// 1e8-scaled int64, isMarket as uint8. A depth side is a flat values column per field
+// plus one shared offsets column (npy/raw) or list<int64> columns (arrow).
+
+enum class OutFormat { Text, Arrow, Npy, Raw };
+
+enum class BinType { I64, U8, ListI64 };
+
+struct BinCol {
+  const char* name;
+  BinType type;
+  const void* data;                 // I64/ListI64: int64 values, U8: bytes
+  const uint32_t* off = nullptr;    // ListI64: n+1 offsets into data
+  const char* off_name = nullptr;   // ListI64: offsets column of this side (npy/raw)
+};
+
+static inline void bin_i64(vector<BinCol>& c, const char* name, const int64_t* p) {
+  if (p) c.push_back({name, BinType::I64, p});
+}
+static inline void bin_u8(vector<BinCol>& c, const char* name, const uint8_t* p) {
+  if (p) c.push_back({name, BinType::U8, p});
+}
+static inline void bin_list(vector<BinCol>& c, const char* name, const char* off_name,
+                            const uint32_t* off, const int64_t* p) {
+  if (off && p) c.push_back({name, BinType::ListI64, p, off, off_name});
+}
+
+class ColumnWriter {
+public:
+  virtual ~ColumnWriter() = default;
+  // rows == nullptr: all n rows of the batch, otherwise only these (ascending)
+  virtual void write(const vector<BinCol>& cols, size_t n, const vector<uint32_t>* rows) = 0;
+  virtual void close() = 0;
+
+protected:
+  // the first batch fixes the layout; readers keep it, but a mismatch must not corrupt output
+  void check_layout(const vector<BinCol>& cols) {
+    if (layout_.empty()) {
+      for (const BinCol& c : cols) layout_.emplace_back(c.name, c.type);
+      return;
+    }
+    bool same = layout_.size() == cols.size();
+    for (size_t k = 0; same && k < cols.size(); ++k)
+      same = layout_[k].first == cols[k].name && layout_[k].second == cols[k].type;
+    if (!same) throw runtime_error("column layout changed between batches");
+  }
+
+  vector<pair<string, BinType>> layout_;
+};
+
+// One file per column: <dir>/<name>.npy (NumPy 1.0 format, 1-D, shape patched on
+// close) or, for raw, headerless <dir>/<name>.bin plus <dir>/columns.txt listing
+// "name dtype count". Offsets columns hold count+1 int64 entries starting at 0.
+class ColumnFilesWriter : public ColumnWriter {
+public:
+  ColumnFilesWriter(string dir, bool npy) : dir_(std::move(dir)), npy_(npy) {
+    static_assert(std::endian::native == std::endian::little, "npy/raw output is written as little-endian");
+    fs::create_directories(dir_);
+  }
+  ~ColumnFilesWriter() override {
+    for (auto& f : files_) { f.buf.reset(); if (f.fd >= 0) ::close(f.fd); }
+  }
+
+  void write(const vector<BinCol>& cols, size_t n, const vector<uint32_t>* rows) override {
+    const bool first = layout_.empty();
+    check_layout(cols);
+    if (first) open(cols);
+    for (size_t k = 0; k < cols.size(); ++k) {
+      const BinCol& c = cols[k];
+      File& f = files_[slots_[k].file];
+      if (c.type == BinType::U8) { put_rows(f, static_cast<const uint8_t*>(c.data), n, rows); continue; }
+      const int64_t* p = static_cast<const int64_t*>(c.data);
+      if (c.type == BinType::I64) { put_rows(f, p, n, rows); continue; }
+
+      // list: offsets (once per side), then the values of the kept rows
+      if (slots_[k].off_file >= 0) {
+        File& o = files_[slots_[k].off_file];
+        const size_t m = rows ? rows->size() : n;
+        for (size_t j = 0; j < m; ++j) {
+          const size_t i = rows ? (*rows)[j] : j;
+          o.end += int64_t(c.off[i + 1] - c.off[i]);
+          put(o, &o.end, 1);
+        }
+      }
+      if (!rows) put(f, p + c.off[0], c.off[n] - c.off[0]);
+      else for (uint32_t i : *rows) put(f, p + c.off[i], c.off[i + 1] - c.off[i]);
+    }
+  }
+
+  void close() override {
+    string manifest;
+    for (auto& f : files_) {
+      f.buf->flush();
+      if (!f.buf->ok()) throw runtime_error("write failed: " + f.path);
+      if (npy_) {
+        const string h = npy_header(f.dtype, f.count);
+        if (::pwrite(f.fd, h.data(), h.size(), 0) != ssize_t(h.size())) throw runtime_error("write failed: " + f.path);
+      }
+      manifest += f.name + ' ' + f.dtype + ' ' + to_string(f.count) + '\n';
+    }
+    if (!npy_) {
+      ofstream m(fs::path(dir_) / "columns.txt", ios::binary | ios::trunc);
+      m << manifest;
+      if (!m) throw runtime_error("write failed: " + (fs::path(dir_) / "columns.txt").string());
+    }
+  }
+
+private:
+  struct File {
+    string name, path;
+    const char* dtype;
+    int fd = -1;
+    unique_ptr<OutBuf> buf;
+    uint64_t count = 0;
+    int64_t end = 0;   // offsets: running total
+  };
+  struct Slot { size_t file; int off_file = -1; };
+
+  static constexpr size_t kNpyHeader = 128;   // 64-byte aligned, room for any shape
+
+  static string npy_header(const char* dtype, uint64_t count) {
+    string d = string("{'descr': '") + dtype + "', 'fortran_order': False, 'shape': (" + to_string(count) + ",), }";
+    d.resize(kNpyHeader - 11, ' ');
+    d += '\n';
+    string h("\x93NUMPY\x01\x00", 8);
+    h += char((kNpyHeader - 10) & 0xff);
+    h += char((kNpyHeader - 10) >> 8);
+    return h + d;
+  }
+
+  size_t add_file(const string& name, const char* dtype) {
+    File f;
+    f.name = name; f.dtype = dtype;
+    f.path = (fs::path(dir_) / (name + (npy_ ? ".npy" : ".bin"))).string();
+    f.fd = ::open(f.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (f.fd < 0) throw runtime_error("cannot create " + f.path + ": " + strerror(errno));
+    f.buf = make_unique<OutBuf>(f.fd);
+    if (npy_) { const string h = npy_header(dtype, 0); f.buf->append(h.data(), h.size()); }
+    files_.push_back(std::move(f));
+    return files_.size() - 1;
+  }
+
+  void open(const vector<BinCol>& cols) {
+    vector<string> sides;
+    for (const BinCol& c : cols) {
+      Slot s;
+      if (c.type == BinType::ListI64 && find(sides.begin(), sides.end(), c.off_name) == sides.end()) {
+        sides.push_back(c.off_name);
+        s.off_file = int(add_file(c.off_name, "<i8"));
+        File& o = files_[size_t(s.off_file)];
+        put(o, &o.end, 1);   // leading 0
+      }
+      s.file = add_file(c.name, c.type == BinType::U8 ? "|u1" : "<i8");
+      slots_.push_back(s);
+    }
+  }
+
+  template <class T>
+  static void put(File& f, const T* p, size_t k) {
+    f.buf->append(reinterpret_cast<const char*>(p), k * sizeof(T));
+    f.count += k;
+  }
+  template <class T>
+  static void put_rows(File& f, const T* p, size_t n, const vector<uint32_t>* rows) {
+    if (!rows) { put(f, p, n); return; }
+    for (uint32_t i : *rows) put(f, p + i, 1);
+  }
+
+  string dir_;
+  bool npy_;
+  vector<File> files_;
+  vector<Slot> slots_;
+};
+
+static void arrow_ok(const arrow::Status& st) {
+  if (!st.ok()) throw runtime_error(st.ToString());
+}
+template <class T>
+static T arrow_val(arrow::Result<T> r) {
+  arrow_ok(r.status());
+  return std::move(r).ValueUnsafe();
+}
+
+// Arrow IPC: file format at `path` (mmap with arrow::ipc::RecordBatchFileReader),
+// or the stream format on stdout when path is empty. One record batch per reader
+// batch; unsampled int64 columns are handed over without a copy.
+class ArrowColumnWriter : public ColumnWriter {
+public:
+  explicit ArrowColumnWriter(string path) : path_(std::move(path)) {}
+
+  void write(const vector<BinCol>& cols, size_t n, const vector<uint32_t>* rows) override {
+    const bool first = layout_.empty();
+    check_layout(cols);
+    if (first) open(cols);
+    const size_t m = rows ? rows->size() : n;
+    vector<shared_ptr<arrow::Array>> arrays;
+    arrays.reserve(cols.size());
+    for (const BinCol& c : cols) arrays.push_back(make_array(c, n, rows));
+    auto rb = arrow::RecordBatch::Make(schema_, int64_t(m), std::move(arrays));
+    arrow_ok(writer_->WriteRecordBatch(*rb));
+  }
+
+  void close() override {
+    if (!writer_) open({});   // no rows: still a valid (empty) file
+    arrow_ok(writer_->Close());
+    arrow_ok(sink_->Close());
+  }
+
+private:
+  void open(const vector<BinCol>& cols) {
+    arrow::FieldVector fields;
+    for (const BinCol& c : cols) {
+      auto t = c.type == BinType::I64 ? arrow::int64()
+             : c.type == BinType::U8  ? arrow::uint8()
+             : arrow::list(arrow::int64());
+      fields.push_back(arrow::field(c.name, t, /*nullable=*/false));
+    }
+    schema_ = arrow::schema(std::move(fields));
+    if (path_.empty()) {
+      sink_ = make_shared<arrow::io::StdoutStream>();
+      writer_ = arrow_val(arrow::ipc::MakeStreamWriter(sink_, schema_));
+    } else {
+      sink_ = arrow_val(arrow::io::FileOutputStream::Open(path_));
+      writer_ = arrow_val(arrow::ipc::MakeFileWriter(sink_, schema_));
+    }
+  }
+
+  template <class T>
+  static shared_ptr<arrow::Buffer> values(const T* p, size_t n, const vector<uint32_t>* rows) {
+    if (!rows) return make_shared<arrow::Buffer>(reinterpret_cast<const uint8_t*>(p), int64_t(n * sizeof(T)));
+    shared_ptr<arrow::Buffer> b = arrow_val(arrow::AllocateBuffer(int64_t(rows->size() * sizeof(T))));
+    T* out = reinterpret_cast<T*>(b->mutable_data());
+    for (uint32_t i : *rows) *out++ = p[i];
+    return b;
+  }
+
+  static shared_ptr<arrow::Array> make_array(const BinCol& c, size_t n, const vector<uint32_t>* rows) {
+    const size_t m = rows ? rows->size() : n;
+    if (c.type == BinType::I64)
+      return arrow::MakeArray(arrow::ArrayData::Make(arrow::int64(), int64_t(m),
+                              {nullptr, values(static_cast<const int64_t*>(c.data), n, rows)}, 0));
+    if (c.type == BinType::U8)
+      return arrow::MakeArray(arrow::ArrayData::Make(arrow::uint8(), int64_t(m),
+                              {nullptr, values(static_cast<const uint8_t*>(c.data), n, rows)}, 0));
+
+    const int64_t* p = static_cast<const int64_t*>(c.data);
+    shared_ptr<arrow::Buffer> offs = arrow_val(arrow::AllocateBuffer(int64_t((m + 1) * sizeof(int32_t))));
+    int32_t* o = reinterpret_cast<int32_t*>(offs->mutable_data());
+    shared_ptr<arrow::Buffer> vals;
+    o[0] = 0;
+    if (!rows) {
+      for (size_t i = 0; i < n; ++i) o[i + 1] = int32_t(c.off[i + 1] - c.off[0]);
+      vals = make_shared<arrow::Buffer>(reinterpret_cast<const uint8_t*>(p + c.off[0]),
+                                        int64_t((c.off[n] - c.off[0]) * sizeof(int64_t)));
+    } else {
+      size_t total = 0;
+      for (size_t j = 0; j < m; ++j) { const uint32_t i = (*rows)[j]; total += c.off[i + 1] - c.off[i]; o[j + 1] = int32_t(total); }
+      vals = arrow_val(arrow::AllocateBuffer(int64_t(total * sizeof(int64_t))));
+      int64_t* v = reinterpret_cast<int64_t*>(vals->mutable_data());
+      for (uint32_t i : *rows) v = copy(p + c.off[i], p + c.off[i + 1], v);
+    }
+    auto child = arrow::ArrayData::Make(arrow::int64(), int64_t(o[m]), {nullptr, vals}, 0);
+    return arrow::MakeArray(arrow::ArrayData::Make(arrow::list(arrow::int64()), int64_t(m),
+                                                   {nullptr, offs}, {child}, 0));
+  }
+
+  string path_;
+  shared_ptr<arrow::Schema> schema_;
+  shared_ptr<arrow::io::OutputStream> sink_;
+  shared_ptr<arrow::ipc::RecordBatchWriter> writer_;
+};
+
+static unique_ptr<ColumnWriter> make_column_writer(OutFormat f, const string& path) {
+  if (f == OutFormat::Arrow) return make_unique<ArrowColumnWriter>(path);
+  return make_unique<ColumnFilesWriter>(path, f == OutFormat::Npy);
+}
+
+// Drains a reader: next() advances it, bind(cols) lists the current batch's columns
+// and returns its row count. seen_every keeps every Nth row, as in text mode.
+template <class Next, class Bind>
+static void write_columns(ColumnWriter& w, Next next, Bind bind, uint64_t seen_every) {
+  vector<BinCol> cols;
+  vector<uint32_t> keep;
+  uint64_t seen = 0;
+  while (next()) {
+    cols.clear();
+    const size_t n = bind(cols);
+    const vector<uint32_t>* rows = nullptr;
+    if (seen_every > 1) {
+      keep.clear();
+      for (size_t i = 0; i < n; ++i) if (++seen % seen_every == 0) keep.push_back(uint32_t(i));
+      rows = &keep;
+    }
+    w.write(cols, n, rows);
+  }
+  w.close();
+}
+
+// ==================== px direct: per-file partitions (--threads) ====================
+// Each worker scans one month file on its own. Plain mode renders the sampled rows;
+// gap mode keeps only the gaps inside the file plus its first and last rows. The
+// stitch pass walks files in order, adds the global idx and the gaps across file
+// edges, so the output is the serial one.
+
+struct PxPart {
+  string error;                  // printed in file order, as the serial scan does
+  bool opened = false;
+  exception_ptr fail;            // decode error: rethrown by the stitch pass
+  uint64_t rows = 0;             // rows in the window
+
+  // plain mode: "content\n" per printed row; ends/raw idx only kept when idx is printed
+  string text;
+  vector<size_t> line_end;
+  vector<uint64_t> line_raw;     // local raw idx (1-based)
+
+  // gap mode
+  int64_t first_ts = 0, last_ts = 0;
+  string first_str, last_str;
+  struct Gap { uint64_t raw1, raw2; int64_t dt; string prev, cur; };
+  vector<Gap> gaps;              // raw1/raw2 local
+};
+
+static PxPart scan_px_part(const string& path, int64_t start_ns, int64_t end_ns, uint64_t seen_every,
+                           bool print_ts, bool need_ask, bool need_bid, const PrintCfg& pcfg)
+{
+  PxPart p;
+  std::unique_ptr<parquet::ParquetFileReader> reader;
+  try {
+    reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/true);
+  } catch (const std::exception& e) {
+    p.error = "ERROR(px): open failed: " + path + " : " + e.what() + "\n";
+    return p;
+  }
+  p.opened = true;
+  auto md = reader->metadata();
+  auto schema = md->schema();
+  int ts_i  = find_col_idx(schema, "ts");
+  int bp_i  = find_col_idx(schema, "bid_px");
+  int ap_i  = find_col_idx(schema, "ask_px");
+  if (ts_i<0 || bp_i<0 || ap_i<0) { p.error = "ERROR(px): missing ts/bid_px/ask_px in " + path + "\n"; return p; }
+
+  const bool gap_mode = pcfg.gap_ns.has_value();
+  const bool need_idx = pcfg.idx_mode != IdxMode::None;
+  vector<int64_t> v_ts, v_bp, v_ap;
+  int64_t prev_ts = 0;
+  bool prev_str_ready = false;
+  string prev_str;
+  try {
+    for (int rg=0; rg<md->num_row_groups(); ++rg) {
+      auto rg_reader = reader->RowGroup(rg);
+      read_i64_column(*rg_reader, ts_i, v_ts);
+      read_i64_column(*rg_reader, bp_i, v_bp);
+      read_i64_column(*rg_reader, ap_i, v_ap);
+      auto render = [&](size_t i){ return render_px_row_content(v_ts[i], v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg); };
+
+      size_t n = v_ts.size(), prev_i = 0;
+      uint64_t raw_idx_local = 0;   // serial scan samples per row group
+      for (size_t i=0;i<n;++i) {
+        int64_t t = v_ts[i];
+        if (t < start_ns || t >= end_ns) continue;
+        ++p.rows;
+        if (!gap_mode) {
+          if (++raw_idx_local % seen_every != 0) continue;
+          put_px_row_content(p.text, t, v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
+          p.text.push_back('\n');
+          if (need_idx) { p.line_end.push_back(p.text.size()); p.line_raw.push_back(p.rows); }
+          continue;
+        }
+        if (p.rows == 1) {
+          p.first_ts = t; p.first_str = render(i);
+          prev_str = p.first_str; prev_str_ready = true;
+        } else {
+          if (t - prev_ts >= *pcfg.gap_ns) {
+            if (!prev_str_ready) { prev_str = render(prev_i); prev_str_ready = true; }
+            p.gaps.push_back({p.rows - 1, p.rows, t - prev_ts, prev_str, render(i)});
+          }
+          prev_str_ready = false;
+        }
+        prev_ts = t; prev_i = i;
+      }
+      if (gap_mode && p.rows > 0 && !prev_str_ready) { prev_str = render(prev_i); prev_str_ready = true; }
+    }
+  } catch (...) {
+    p.fail = current_exception();
+  }
+  p.last_ts = prev_ts;
+  p.last_str = std::move(prev_str);
+  return p;
+}
+
+// work(i) runs on `threads` workers, at most `ahead` items past the one being
+// consumed; consume(i, result) is called on this thread in index order.
+template <class R, class Work, class Consume>
+static void ordered_parallel(size_t n, unsigned threads, size_t ahead, Work work, Consume consume)
+{
+  vector<optional<R>> slots(n);
+  mutex mu;
+  condition_variable cv_ready, cv_space;
+  size_t next = 0, consumed = 0;
+  bool stop = false;
+
+  auto worker = [&]{
+    for (;;) {
+      size_t i;
+      {
+        unique_lock<mutex> lk(mu);
+        cv_space.wait(lk, [&]{ return stop || next >= n || next < consumed + ahead; });
+        if (stop || next >= n) return;
+        i = next++;
+      }
+      R r = work(i);
+      { lock_guard<mutex> lk(mu); slots[i] = std::move(r); }
+      cv_ready.notify_all();
+    }
+  };
+  vector<jthread> pool;
+  for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker);
+
+  try {
+    for (size_t i = 0; i < n; ++i) {
+      R r;
+      {
+        unique_lock<mutex> lk(mu);
+        cv_ready.wait(lk, [&]{ return slots[i].has_value(); });
+        r = std::move(*slots[i]);
+        slots[i].reset();
+        consumed = i + 1;
+      }
+      cv_space.notify_all();
+      consume(i, r);
+    }
+  } catch (...) {
+    { lock_guard<mutex> lk(mu); stop = true; }
+    cv_space.notify_all();
+    throw;
+  }
+}
+
 // ==================== px direct (lazy strings in gap mode) ====================
 static int dump_px_direct(const string& root,
                           const string& symb,
@@ -448,7 +1128,10 @@ static int dump_px_direct(const string& root,
                           bool debug,
                           const TopSelect& sel_from_csv,
                           const PrintCfg& pcfg,
-                          bool prefetch)
+                          bool prefetch,
+                          const PrefetchConfig& prefetch_cfg,
+                          const ParallelScan& par,
+                          OutBuf& out)
 {
   TopSelect sel = sel_from_csv;
   bool print_ts  = sel.ts;
@@ -479,7 +1162,7 @@ static int dump_px_direct(const string& root,
     };
     if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
     else { add_cols(""); }
-    cout << header_from_names(names) << '\n';
+    out << header_from_names(names) << '\n';
   }
 
   uint64_t printed_idx = 0;
@@ -496,11 +1179,79 @@ static int dump_px_direct(const string& root,
 
   FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
+  if (par.workers > 0 && files.size() > 1) {
+    ordered_parallel<PxPart>(files.size(), par.workers, par.files_ahead,
+      [&](size_t fi){ return scan_px_part(files[fi].path, start_ns, end_ns, seen_every, print_ts, need_ask, need_bid, pcfg); },
+      [&](size_t fi, PxPart& p){
+        if (p.opened && pcfg.print_fn) fnp.open(fs::path(files[fi].path).filename().string(), raw_idx_global);
+        if (!p.error.empty()) { cerr << p.error; return; }
+        // a decode error surfaces after the rows the serial scan printed before it
+        auto finish = [&]{ if (p.fail) rethrow_exception(p.fail); };
+        const uint64_t base = raw_idx_global;
+        raw_idx_global += p.rows;
+
+        if (!gap_mode) {
+          if (pcfg.idx_mode == IdxMode::None) { out << p.text; finish(); return; }
+          size_t from = 0;
+          for (size_t k = 0; k < p.line_end.size(); ++k) {
+            ++printed_idx;
+            optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) : optional<uint64_t>(base + p.line_raw[k]));
+            print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+            out.append(p.text.data() + from, p.line_end[k] - from);
+            from = p.line_end[k];
+          }
+          finish();
+          return;
+        }
+
+        if (p.rows == 0) { finish(); return; }
+        auto put_edge = [&](uint64_t raw1, uint64_t raw2, const string& a, const string& b, int64_t dt){
+          ++printed_idx;
+          optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
+          optional<uint64_t> r1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw1) : nullopt;
+          optional<uint64_t> r2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw2) : nullopt;
+          print_prefix(out, pcfg, nullptr, nullptr, printed_idx_opt.has_value()? printed_idx_opt : r1, r2);
+          out << a << ';' << b << ';';
+          print_gap_s_ms(out, dt);
+          out << '\n';
+        };
+        if (!have_prev) put_edge(base + 1, base + 1, p.first_str, p.first_str, 0);              // FIRST edge
+        else if (p.first_ts - prev_ts >= *pcfg.gap_ns)                                            // across the file edge
+          put_edge(prev_raw_idx, base + 1, prev_str, p.first_str, p.first_ts - prev_ts);
+        for (const PxPart::Gap& g : p.gaps) put_edge(base + g.raw1, base + g.raw2, g.prev, g.cur, g.dt);
+        have_prev = true;
+        prev_ts = p.last_ts;
+        prev_raw_idx = base + p.rows;
+        prev_str = std::move(p.last_str);
+        finish();
+      });
+
+    if (gap_mode && have_prev) {
+      ++printed_idx;
+      optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
+      optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
+      print_prefix(out, pcfg, nullptr, nullptr,
+                   printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
+      out << prev_str << ';' << prev_str << ';';
+      print_gap_s_ms(out, 0);
+      out << '\n';
+    }
+    fnp.finish(raw_idx_global);
+    return 0;
+  }
+
+  // next files warmed on a background thread
+  unique_ptr<FilePrefetcher> pf;
+  if (prefetch && files.size() > 1) {
+    vector<string> paths;
+    for (auto& f: files) paths.push_back(f.path);
+    pf = make_unique<FilePrefetcher>(move(paths), prefetch_cfg);
+  }
+
   for (size_t fi=0; fi<files.size(); ++fi) {
     const auto& f = files[fi];
 
-    if (prefetch && fi + 1 < files.size())
-      prefetch_path(files[fi + 1].path);
+    if (pf) pf->reached(fi);
 
     std::unique_ptr<parquet::ParquetFileReader> reader;
     try {
@@ -534,12 +1285,12 @@ static int dump_px_direct(const string& root,
           ++raw_idx_local; ++raw_idx_global;
           if (raw_idx_local % seen_every != 0) continue;
 
-          string content = render_px_row_content(t, v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx_global) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << content << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          put_px_row_content(out, t, v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
+          out << '\n';
         }
       } else {
         // GAP MODE (lazy string building) + FIRST print
@@ -555,12 +1306,12 @@ static int dump_px_direct(const string& root,
             ++printed_idx;
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx_global) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw_same,
                          raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
+            out << first_line << ';' << first_line << ';';
+            print_gap_s_ms(out, 0);
+            out << '\n';
 
             have_prev = true;
             prev_ts = t;
@@ -583,11 +1334,11 @@ static int dump_px_direct(const string& root,
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
             optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx_global) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
+            out << prev_str << ';' << cur << ';';
+            print_gap_s_ms(out, t - prev_ts);
+            out << '\n';
           }
 
           // Move window to current row (do NOT render yet)
@@ -612,14 +1363,15 @@ static int dump_px_direct(const string& root,
     ++printed_idx;
     optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
     optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-    print_prefix(cout, pcfg, nullptr, nullptr,
+    print_prefix(out, pcfg, nullptr, nullptr,
                  printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-    cout << prev_str << ';' << prev_str << ';';
-    print_gap_s_ms(cout, 0);
-    cout << '\n';
+    out << prev_str << ';' << prev_str << ';';
+    print_gap_s_ms(out, 0);
+    out << '\n';
   }
 
   fnp.finish(raw_idx_global);
+  if (debug && pf) print_prefetch_stats("px", pf->stats());
   return 0;
 }
 
@@ -629,7 +1381,7 @@ int main(int argc, char** argv)
 {
   if (argc < 4) {
     cerr << "Usage: " << argv[0]
-         << " <root> <symb> <type: top|trade|depth or top_fut|top_spot|trade_fut|trade_spot|depth_fut|depth_spot>\n"
+         << " <root> <symb | symb1,symb2,... (top: ts-merged)> <type: top|trade|depth or top_fut|top_spot|trade_fut|trade_spot|depth_fut|depth_spot>\n"
          << "        [--sampling=px|100ms|1s|60s] [--start=SEC] [--end=SEC]\n"
          << "        [--gap=SEC]                (default: off; in gap mode a 'gap' column with seconds.mmm is appended)\n"
          << "        [--header]                 (default: off)\n"
@@ -638,9 +1390,33 @@ int main(int argc, char** argv)
          << "        [--precision-px=N]         (default: 8)\n"
          << "        [--precision-qty=N]        (default: 8)\n"
          << "        [--print-fn]               (stderr: file switch + raw idx + M rec/s)\n"
-         << "        [--prefetch]               (Linux: readahead next file)\n"
+         << "        [--prefetch]               (background thread reads the next files ahead)\n"
+         << "        [--prefetch-files=N]       (default: 2; with --prefetch, files ahead of the current one)\n"
+         << "        [--prefetch-mb=N]          (default: 256; with --prefetch, cap on bytes read ahead)\n"
+         << "        [--prefetch-mem]           (with --prefetch: read files into memory, not just the page cache)\n"
+         << "        [--catalog]                (discover files via <root>/.parquet_catalog)\n"
+         << "        [--tsidx]                  (use fresh <file>.tsidx sidecars from parquet_tsidx to skip files/rows)\n"
+         << "        [--assume-sorted]          (trust ts order; skip per-row-group is_sorted check)\n"
+         << "        [--threads=N]              (default: 0 = serial; N workers decode files ahead; --sampling=px: N workers scan files, gaps stitched in order)\n"
+         << "        [--files-ahead=N]          (default: 4; with --threads)\n"
+         << "        [--budget-mb=N]            (default: 512; decoded read-ahead cap, with --threads)\n"
+         << "        [--io=buffered|mmap|pread] (default: buffered; how ShardedDB readers open files)\n"
+         << "        [--pread-kb=N]             (default: 1024; read size with --io=pread)\n"
+         << "        [--cache-dir=DIR]          (top/trade: keep decoded columns of read files in DIR, mmap'd on reuse)\n"
+         << "        [--cache-mb=N]             (default: 4096; --cache-dir size cap, least recently used evicted)\n"
+         << "        [--bar=SEC]                (top/trade: time bars from raw ticks; top keeps the sampled-file columns)\n"
+         << "        [--book=N]                 (depth: rebuild the L2 book from the deltas, top N levels per event)\n"
+         << "        [--book-reset]             (with --book: clear the book on an update-id gap)\n"
+         << "        [--book-at=SEC]            (with --book: one line, the book after the last event with ts <= SEC; uses <file>.book checkpoints)\n"
+         << "        [--asof]                   (several top symbols: every symbol's last quote per event)\n"
+         << "        [--grid=SEC]               (with --asof: one snapshot per grid point instead)\n"
+         << "        [--max-age=SEC]            (with --asof: older quotes print as empty fields)\n"
+         << "        [--where=EXPR]             (top/trade row filter, e.g. 'qty>100000000&&isMarket==1', 'ask_px-bid_px>5')\n"
          << "        [--idx=printed|raw|none]   (default: none)\n"
          << "        [--seen_every=N]           (default: 1)\n"
+         << "        [--stats-json[=PATH]]      (reader counters + timings as JSON at exit; default PATH '-' = stderr)\n"
+         << "        [--format=text|arrow|npy|raw] (default: text; binary = selected columns as stored int64, no --gap/--asof)\n"
+         << "        [--out=PATH]               (arrow: IPC file, default IPC stream on stdout; npy/raw: directory, one file per column)\n"
          << "        [--debug] [columns_csv]\n"
          << "Defaults:\n"
          << "  window [2023-01-01, 2036-01-01)\n"
@@ -665,7 +1441,24 @@ int main(int argc, char** argv)
   optional<string> sampling;
   bool debug=false;
   bool prefetch=false;
+  PrefetchConfig prefetch_cfg{};
+  bool assume_sorted=false;
+  bool catalog=false;
+  bool tsidx=false;
+  bool asof=false;
+  optional<Predicate> where;
+  int64_t bar_ns = 0;
+  size_t book_levels = 0;
+  GapPolicy book_gap = GapPolicy::Continue;
+  optional<int64_t> book_at_ns;
+  AsofSpec asof_spec{};
+  ParallelScan par{};
+  IoConfig io{};
+  ColumnCache cache{};
   uint64_t seen_every = 1;
+  optional<string> stats_json;
+  OutFormat out_fmt = OutFormat::Text;
+  string out_path;
   string columns_csv;
 
   PrintCfg pcfg;
@@ -699,12 +1492,80 @@ int main(int argc, char** argv)
       pcfg.print_fn = true;
     } else if (a=="--prefetch") {
       prefetch = true;
+    } else if (a.rfind("--prefetch-files=",0)==0) {
+      int v = stoi(a.substr(17)); prefetch_cfg.files_ahead = v > 0 ? static_cast<size_t>(v) : 1;
+    } else if (a.rfind("--prefetch-mb=",0)==0) {
+      long long v = stoll(a.substr(14)); prefetch_cfg.byte_budget = v > 0 ? static_cast<size_t>(v) << 20 : 0;
+    } else if (a=="--prefetch-mem") {
+      prefetch_cfg.into_memory = true;
+    } else if (a.rfind("--where=",0)==0) {
+      try { where = parse_where(a.substr(8)); }
+      catch (const exception& e) { cerr << "ERROR: " << e.what() << "\n"; return 1; }
+    } else if (a.rfind("--bar=",0)==0) {
+      double b = stod(a.substr(6));
+      if (b <= 0) { cerr << "ERROR: --bar must be > 0\n"; return 1; }
+      bar_ns = to_ns(b);
+    } else if (a.rfind("--book=",0)==0) {
+      int v = stoi(a.substr(7));
+      if (v <= 0) { cerr << "ERROR: --book must be > 0\n"; return 1; }
+      book_levels = static_cast<size_t>(v);
+    } else if (a=="--book-reset") {
+      book_gap = GapPolicy::Reset;
+    } else if (a.rfind("--book-at=",0)==0) {
+      book_at_ns = to_ns(stod(a.substr(10)));
+    } else if (a=="--asof") {
+      asof = true;
+    } else if (a.rfind("--grid=",0)==0) {
+      double g = stod(a.substr(7));
+      if (g <= 0) { cerr << "ERROR: --grid must be > 0\n"; return 1; }
+      asof_spec.grid_ns = to_ns(g);
+    } else if (a.rfind("--max-age=",0)==0) {
+      double g = stod(a.substr(10));
+      if (g < 0) { cerr << "ERROR: --max-age must be >= 0\n"; return 1; }
+      asof_spec.max_age_ns = to_ns(g);
+    } else if (a=="--catalog") {
+      catalog = true;
+    } else if (a=="--tsidx") {
+      tsidx = true;
+    } else if (a=="--assume-sorted") {
+      assume_sorted = true;
+    } else if (a.rfind("--threads=",0)==0) {
+      int v = stoi(a.substr(10)); par.workers = v > 0 ? static_cast<unsigned>(v) : 0;
+    } else if (a.rfind("--files-ahead=",0)==0) {
+      int v = stoi(a.substr(14)); par.files_ahead = v > 0 ? static_cast<size_t>(v) : 1;
+    } else if (a.rfind("--budget-mb=",0)==0) {
+      long long v = stoll(a.substr(12)); par.byte_budget = v > 0 ? static_cast<size_t>(v) << 20 : 0;
+    } else if (a.rfind("--io=",0)==0) {
+      string v = a.substr(5);
+      if (v=="buffered") io.mode = IoMode::Buffered;
+      else if (v=="mmap") io.mode = IoMode::Mmap;
+      else if (v=="pread") io.mode = IoMode::Pread;
+      else { cerr << "ERROR: --io must be buffered|mmap|pread\n"; return 1; }
+    } else if (a.rfind("--pread-kb=",0)==0) {
+      long long v = stoll(a.substr(11)); io.read_bytes = v > 0 ? static_cast<size_t>(v) << 10 : 4096;
+    } else if (a.rfind("--cache-dir=",0)==0) {
+      cache.dir = a.substr(12);
+    } else if (a.rfind("--cache-mb=",0)==0) {
+      long long v = stoll(a.substr(11)); cache.max_bytes = v > 0 ? static_cast<uint64_t>(v) << 20 : 0;
     } else if (a.rfind("--idx=",0)==0) {
       string v = a.substr(6);
       if (v=="printed") pcfg.idx_mode = IdxMode::Printed;
       else if (v=="raw") pcfg.idx_mode = IdxMode::Raw;
       else if (v=="none") pcfg.idx_mode = IdxMode::None;
       else { cerr << "ERROR: --idx must be printed|raw|none\n"; return 1; }
+    } else if (a=="--stats-json") {
+      stats_json = "-";
+    } else if (a.rfind("--stats-json=",0)==0) {
+      stats_json = a.substr(13);
+    } else if (a.rfind("--format=",0)==0) {
+      string v = a.substr(9);
+      if (v=="text") out_fmt = OutFormat::Text;
+      else if (v=="arrow") out_fmt = OutFormat::Arrow;
+      else if (v=="npy") out_fmt = OutFormat::Npy;
+      else if (v=="raw") out_fmt = OutFormat::Raw;
+      else { cerr << "ERROR: --format must be text|arrow|npy|raw\n"; return 1; }
+    } else if (a.rfind("--out=",0)==0) {
+      out_path = a.substr(6);
     } else if (a=="--debug") {
       debug = true;
     } else if (a.rfind("--seen_every=",0)==0 || a.rfind("--seen-every=",0)==0
@@ -725,12 +1586,51 @@ int main(int argc, char** argv)
   }
 
   if (end_sec <= start_sec) { cerr << "ERROR: end <= start\n"; return 1; }
+  if (book_at_ns && !book_levels) { cerr << "ERROR: --book-at needs --book=N\n"; return 1; }
+  const bool binary = out_fmt != OutFormat::Text;
+  if (binary && (pcfg.gap_ns || asof)) { cerr << "ERROR: --format=arrow|npy|raw does not combine with --gap/--asof\n"; return 1; }
+  if ((out_fmt == OutFormat::Npy || out_fmt == OutFormat::Raw) && out_path.empty()) {
+    cerr << "ERROR: --format=npy|raw needs --out=DIR\n"; return 1;
+  }
 
   const int64_t start_ns = to_ns(start_sec);
   const int64_t end_ns   = to_ns(end_sec);
 
   ShardedDB::set_debug(debug);
-  ShardedDB::set_prefetch(prefetch);  // no-op if not implemented in your lib
+  ShardedDB::set_prefetch(prefetch);
+  ShardedDB::set_prefetch_config(prefetch_cfg);
+  ShardedDB::set_assume_sorted(assume_sorted);
+  ShardedDB::set_catalog(catalog);
+  ShardedDB::set_time_index(tsidx);
+  ShardedDB::set_parallel(par);
+  ShardedDB::set_io_mode(io);
+  ShardedDB::set_column_cache(cache);
+
+  OutBuf out;   // all row output; flushed on return
+
+  const auto run_t0 = chrono::steady_clock::now();
+  auto report_stats = [&](const char* kind, const ScanStats& st) {
+    if (debug) print_scan_stats(kind, st);
+    if (stats_json) {
+      const auto wall = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - run_t0).count();
+      write_stats_json(*stats_json, kind, st, static_cast<uint64_t>(wall));
+    }
+  };
+  // trade bars: volume is int64 and saturates; say so instead of printing a silent cap
+  auto warn_volume_sat = [&](uint64_t bars) {
+    if (bars) cerr << "WARN: " << bars << " bars with volume beyond int64 (saturated at INT64_MAX)\n";
+  };
+  // --format=arrow|npy|raw: drain a reader into column files instead of text rows
+  auto write_binary = [&](auto next, auto bind, uint64_t every) -> bool {
+    try {
+      auto w = make_column_writer(out_fmt, out_path);
+      write_columns(*w, next, bind, every);
+      return true;
+    } catch (const exception& e) {
+      cerr << "ERROR(format): " << e.what() << "\n";
+      return false;
+    }
+  };
 
   if (debug) {
     cerr << "[debug] root=" << root << " symb=" << symb << " type=" << T.base << "\n";
@@ -743,6 +1643,11 @@ int main(int argc, char** argv)
          << " prec_px=" << pcfg.precision_px << " prec_qty=" << pcfg.precision_qty
          << " print_fn=" << (pcfg.print_fn?"yes":"no")
          << " prefetch=" << (prefetch?"yes":"no")
+         << " catalog=" << (catalog?"yes":"no")
+         << " tsidx=" << (tsidx?"yes":"no")
+         << " threads=" << par.workers
+         << " io=" << (io.mode==IoMode::Mmap?"mmap":io.mode==IoMode::Pread?"pread":"buffered")
+         << " cache=" << (cache.dir.empty()?"off":cache.dir)
          << " idx=" << (pcfg.idx_mode==IdxMode::Printed?"printed":pcfg.idx_mode==IdxMode::Raw?"raw":"none")
          << " header=" << (pcfg.header?"yes":"no")
          << " seen_every=" << seen_every << "\n";
@@ -752,9 +1657,11 @@ int main(int argc, char** argv)
 
   // Fast path: top + px sampling -> read from top_px_{market}/... directly
   if (T.base == "top" && sampling && *sampling == "px") {
+    if (where) { cerr << "ERROR: --where is not supported with --sampling=px\n"; return 1; }
+    if (binary) { cerr << "ERROR: --format=arrow|npy|raw is not supported with --sampling=px\n"; return 1; }
     if (!T.market) { cerr << "ERROR: px sampling requires market-specific type: use top_spot or top_fut\n"; return 1; }
     TopSelect sel{}; if (!columns_csv.empty()) sel = make_top_select_from_csv(columns_csv);
-    return dump_px_direct(root, symb, *T.market, start_ns, end_ns, seen_every, debug, sel, pcfg, prefetch);
+    return dump_px_direct(root, symb, *T.market, start_ns, end_ns, seen_every, debug, sel, pcfg, prefetch, prefetch_cfg, par, out);
   }
 
   // Otherwise delegate to ShardedDB (ticks, time-sampled tops, trades, depth)
@@ -769,12 +1676,138 @@ int main(int argc, char** argv)
 
     TopSelect sel_int = sel;
     if (pcfg.gap_ns && !sel_int.ts) sel_int.ts = true;
+    if (where) sel_int.where = *where;
+
+    // SYMB1,SYMB2,...: one ts-ordered stream, symbol name as first column
+    const vector<string> symbs = split_csv(symb);
+    const bool multi = symbs.size() > 1;
+    if (multi && pcfg.gap_ns) { cerr << "ERROR: --gap needs a single symbol\n"; return 1; }
+
+    if (asof) {
+      if (!multi) { cerr << "ERROR: --asof needs several symbols (SYMB1,SYMB2,...)\n"; return 1; }
+      if (where) { cerr << "ERROR: --where is not supported with --asof\n"; return 1; }
+      auto ar = db.get_top_asof(start_ns, end_ns, symbs, T.market, asof_spec);
+      const bool grid = asof_spec.grid_ns > 0;
+
+      if (pcfg.header) {
+        vector<string> names;
+        if (pcfg.idx_mode != IdxMode::None) names.push_back("idx");
+        names.push_back("ts");
+        if (!grid) names.push_back("src");
+        for (const string& sy : symbs)
+          for (const char* c : {"_ask_px", "_ask_qty", "_bid_px", "_bid_qty"}) names.push_back(sy + c);
+        out << header_from_names(names) << '\n';
+      }
 
-    auto rdr = db.get_top_cols(start_ns, end_ns, symb, T.market, sel_int);
+      TopAsofView av{};
+      uint64_t printed = 0, raw = 0;
+      while (ar->next(av)) {
+        for (size_t i=0;i<av.n;++i) {
+          ++raw;
+          if (raw % seen_every != 0) continue;
+          ++printed;
+          optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed) :
+                                          pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw) : nullopt);
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          print_ts_fmt(out, av.ts[i], pcfg.ts_fmt);
+          if (!grid) out << ';' << symbs[av.trigger[i]];
+          for (size_t k=0;k<av.nsym;++k) {
+            const size_t j = i * av.nsym + k;
+            if (!av.valid[j]) { out << ";;;;"; continue; }
+            out << ';'; print_px_val(out, av.ask_px[j], pcfg);
+            out << ';'; print_qty_val(out, av.ask_qty[j], pcfg);
+            out << ';'; print_px_val(out, av.bid_px[j], pcfg);
+            out << ';'; print_qty_val(out, av.bid_qty[j], pcfg);
+          }
+          out << '\n';
+        }
+      }
+      report_stats("top", ar->stats());
+      return 0;
+    }
+
+    if (bar_ns) {
+      if (multi || pcfg.gap_ns || where) { cerr << "ERROR: --bar needs a single symbol, no --gap/--where\n"; return 1; }
+      auto br = db.get_top_bars(start_ns, end_ns, symb, T.market, bar_ns);
+      if (binary) {
+        TopBarView bv{};
+        const bool ok = write_binary([&]{ return br->next(bv); }, [&](vector<BinCol>& c){
+          const TopColsView& b = bv.top;
+          bin_i64(c, "ts", b.ts);
+          bin_i64(c, "ask_px", b.ask_px); bin_i64(c, "ask_qty", b.ask_qty);
+          bin_i64(c, "bid_px", b.bid_px); bin_i64(c, "bid_qty", b.bid_qty);
+          bin_i64(c, "valu", b.valu);
+          bin_i64(c, "min_bid_px", b.min_bid_px); bin_i64(c, "max_bid_px", b.max_bid_px);
+          bin_i64(c, "min_ask_px", b.min_ask_px); bin_i64(c, "max_ask_px", b.max_ask_px);
+          bin_i64(c, "min_bid_ts", b.min_bid_ts); bin_i64(c, "max_bid_ts", b.max_bid_ts);
+          bin_i64(c, "min_ask_ts", b.min_ask_ts); bin_i64(c, "max_ask_ts", b.max_ask_ts);
+          bin_i64(c, "count", bv.count);
+          return bv.n;
+        }, seen_every);
+        report_stats("top", br->stats());
+        return ok ? 0 : 2;
+      }
+      if (pcfg.header) {
+        vector<string> names;
+        if (pcfg.idx_mode != IdxMode::None) names.push_back("idx");
+        for (const char* c : {"ts","ask_px","ask_qty","bid_px","bid_qty","valu","min_bid_px","max_bid_px",
+                              "min_ask_px","max_ask_px","min_bid_ts","max_bid_ts","min_ask_ts","max_ask_ts","count"})
+          names.push_back(c);
+        out << header_from_names(names) << '\n';
+      }
+      TopBarView bv{};
+      uint64_t printed = 0, raw = 0;
+      while (br->next(bv)) {
+        const TopColsView& b = bv.top;
+        for (size_t i=0;i<bv.n;++i) {
+          ++raw;
+          if (raw % seen_every != 0) continue;
+          ++printed;
+          optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed) :
+                                          pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw) : nullopt);
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          print_ts_fmt(out, b.ts[i], pcfg.ts_fmt);
+          out << ';'; print_px_val(out, b.ask_px[i], pcfg);
+          out << ';'; print_qty_val(out, b.ask_qty[i], pcfg);
+          out << ';'; print_px_val(out, b.bid_px[i], pcfg);
+          out << ';'; print_qty_val(out, b.bid_qty[i], pcfg);
+          out << ';' << b.valu[i];
+          out << ';'; print_px_val(out, b.min_bid_px[i], pcfg);
+          out << ';'; print_px_val(out, b.max_bid_px[i], pcfg);
+          out << ';'; print_px_val(out, b.min_ask_px[i], pcfg);
+          out << ';'; print_px_val(out, b.max_ask_px[i], pcfg);
+          out << ';' << b.min_bid_ts[i] << ';' << b.max_bid_ts[i]
+               << ';' << b.min_ask_ts[i] << ';' << b.max_ask_ts[i]
+               << ';' << bv.count[i] << '\n';
+        }
+      }
+      report_stats("top", br->stats());
+      return 0;
+    }
+
+    if (binary && multi) { cerr << "ERROR: --format=arrow|npy|raw needs a single symbol\n"; return 1; }
+    auto rdr = multi ? nullptr : db.get_top_cols(start_ns, end_ns, symb, T.market, sel_int);
+    if (binary) {
+      TopColsView v{};
+      const bool ok = write_binary([&]{ return rdr->next(v); }, [&](vector<BinCol>& c){
+        if (have_ts_to_print) bin_i64(c, "ts", v.ts);
+        bin_i64(c, "ask_px", v.ask_px); bin_i64(c, "ask_qty", v.ask_qty);
+        bin_i64(c, "bid_px", v.bid_px); bin_i64(c, "bid_qty", v.bid_qty);
+        bin_i64(c, "valu", v.valu);
+        bin_i64(c, "min_bid_px", v.min_bid_px); bin_i64(c, "max_bid_px", v.max_bid_px);
+        bin_i64(c, "min_ask_px", v.min_ask_px); bin_i64(c, "max_ask_px", v.max_ask_px);
+        bin_i64(c, "min_bid_ts", v.min_bid_ts); bin_i64(c, "max_bid_ts", v.max_bid_ts);
+        bin_i64(c, "min_ask_ts", v.min_ask_ts); bin_i64(c, "max_ask_ts", v.max_ask_ts);
+        return v.n;
+      }, seen_every);
+      report_stats("top", rdr->stats());
+      return ok ? 0 : 2;
+    }
 
     if (pcfg.header) {
       vector<string> names;
       if (pcfg.idx_mode != IdxMode::None) names.push_back("idx");
+      if (multi) names.push_back("symb");
       auto add_cols = [&](const string& prefix){
         if (sel.ts && have_ts_to_print) names.push_back(prefix + "ts");
         if (sel.ask_px) names.push_back(prefix + "ask_px");
@@ -793,7 +1826,7 @@ int main(int argc, char** argv)
       };
       if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
       else { add_cols(""); }
-      cout << header_from_names(names) << '\n';
+      out << header_from_names(names) << '\n';
     }
 
     TopColsView v{};
@@ -803,29 +1836,51 @@ int main(int argc, char** argv)
 
     FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
-    auto render_line = [&](size_t i)->string{
-      ostringstream os;
+    auto render_into = [&](auto& os, size_t i){
       bool first = true;
-      auto put_sep=[&]{ if(!first) os<<';'; first=false; };
+      auto put_sep=[&]{ if(!first) os.push_back(';'); first=false; };
 
       if (v.ts && have_ts_to_print) { put_sep(); print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); }
       if (v.ask_px){ put_sep(); print_px_val(os, v.ask_px[i], pcfg); }
       if (v.ask_qty){ put_sep(); print_qty_val(os, v.ask_qty[i], pcfg); }
       if (v.bid_px){ put_sep(); print_px_val(os, v.bid_px[i], pcfg); }
       if (v.bid_qty){ put_sep(); print_qty_val(os, v.bid_qty[i], pcfg); }
-      if (v.valu){ put_sep(); os<<v.valu[i]; }
+      if (v.valu){ put_sep(); put_int(os, v.valu[i]); }
 
       if (v.min_bid_px){ put_sep(); print_px_val(os, v.min_bid_px[i], pcfg); }
       if (v.max_bid_px){ put_sep(); print_px_val(os, v.max_bid_px[i], pcfg); }
       if (v.min_ask_px){ put_sep(); print_px_val(os, v.min_ask_px[i], pcfg); }
       if (v.max_ask_px){ put_sep(); print_px_val(os, v.max_ask_px[i], pcfg); }
 
-      if (v.min_bid_ts){ put_sep(); os<<v.min_bid_ts[i]; }
-      if (v.max_bid_ts){ put_sep(); os<<v.max_bid_ts[i]; }
-      if (v.min_ask_ts){ put_sep(); os<<v.min_ask_ts[i]; }
-      if (v.max_ask_ts){ put_sep(); os<<v.max_ask_ts[i]; }
-      return os.str();
+      if (v.min_bid_ts){ put_sep(); put_int(os, v.min_bid_ts[i]); }
+      if (v.max_bid_ts){ put_sep(); put_int(os, v.max_bid_ts[i]); }
+      if (v.min_ask_ts){ put_sep(); put_int(os, v.min_ask_ts[i]); }
+      if (v.max_ask_ts){ put_sep(); put_int(os, v.max_ask_ts[i]); }
     };
+    auto render_line = [&](size_t i)->string{ string s; render_into(s, i); return s; };
+
+    if (multi) {
+      auto mr = db.get_top_cols_multi(start_ns, end_ns, symbs, T.market, sel_int);
+      TopMultiColsView mv{};
+      uint64_t local_seen = 0;
+      while (mr->next(mv)) {
+        v = mv.top;
+        for (size_t i=0;i<mv.n;++i) {
+          ++raw_idx;
+          ++local_seen;
+          if (local_seen % seen_every != 0) continue;
+          ++printed_idx;
+          optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
+                                          pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx) : nullopt);
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          out << symbs[mv.sym[i]] << ';';
+          render_into(out, i);
+          out << '\n';
+        }
+      }
+      report_stats("top", mr->stats());
+      return 0;
+    }
 
     if (!gap_mode) {
       uint64_t local_seen = 0;
@@ -838,12 +1893,12 @@ int main(int argc, char** argv)
           ++raw_idx;
           ++local_seen;
           if (local_seen % seen_every != 0) continue;
-          string line = render_line(i);
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << line << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          render_into(out, i);
+          out << '\n';
         }
       }
       fnp.finish(raw_idx);
@@ -871,11 +1926,11 @@ int main(int argc, char** argv)
             ++printed_idx;
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
+            out << first_line << ';' << first_line << ';';
+            print_gap_s_ms(out, 0);
+            out << '\n';
 
             have_prev = true; prev_ts = t; prev_i = i; prev_raw_idx = raw_idx;
             prev_str = std::move(first_line); prev_str_ready = true;
@@ -889,11 +1944,11 @@ int main(int argc, char** argv)
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
             optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
+            out << prev_str << ';' << cur << ';';
+            print_gap_s_ms(out, t - prev_ts);
+            out << '\n';
           }
 
           // slide window
@@ -914,15 +1969,17 @@ int main(int argc, char** argv)
         ++printed_idx;
         optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
         optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-        print_prefix(cout, pcfg, nullptr, nullptr,
+        print_prefix(out, pcfg, nullptr, nullptr,
                      printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-        cout << prev_str << ';' << prev_str << ';';
-        print_gap_s_ms(cout, 0);
-        cout << '\n';
+        out << prev_str << ';' << prev_str << ';';
+        print_gap_s_ms(out, 0);
+        out << '\n';
       }
 
       fnp.finish(raw_idx);
     }
+
+    report_stats("top", rdr->stats());
   }
   // ================= TRADE =================
   else if (T.base == "trade")
@@ -932,8 +1989,80 @@ int main(int argc, char** argv)
 
     TradeSelect sel_int = sel;
     if (pcfg.gap_ns && !sel_int.ts) sel_int.ts = true;
+    if (where) sel_int.where = *where;
+
+    if (bar_ns) {
+      if (pcfg.gap_ns || where) { cerr << "ERROR: --bar does not combine with --gap/--where\n"; return 1; }
+      auto br = db.get_trade_bars(start_ns, end_ns, symb, T.market, bar_ns);
+      if (binary) {
+        TradeBarView bv{};
+        uint64_t saturated = 0;
+        const bool ok = write_binary([&]{
+          if (!br->next(bv)) return false;
+          for (size_t i = 0; i < bv.n; ++i) saturated += bv.volume_sat[i];
+          return true;
+        }, [&](vector<BinCol>& c){
+          bin_i64(c, "ts", bv.ts);
+          bin_i64(c, "open", bv.open); bin_i64(c, "high", bv.high);
+          bin_i64(c, "low", bv.low); bin_i64(c, "close", bv.close);
+          bin_i64(c, "vwap", bv.vwap); bin_i64(c, "volume", bv.volume);
+          bin_i64(c, "count", bv.count);
+          bin_i64(c, "high_ts", bv.high_ts); bin_i64(c, "low_ts", bv.low_ts);
+          return bv.n;
+        }, seen_every);
+        warn_volume_sat(saturated);
+        report_stats("trade", br->stats());
+        return ok ? 0 : 2;
+      }
+      if (pcfg.header) {
+        vector<string> names;
+        if (pcfg.idx_mode != IdxMode::None) names.push_back("idx");
+        for (const char* c : {"ts","open","high","low","close","vwap","volume","count","high_ts","low_ts"})
+          names.push_back(c);
+        out << header_from_names(names) << '\n';
+      }
+      TradeBarView bv{};
+      uint64_t printed = 0, raw = 0, saturated = 0;
+      while (br->next(bv)) {
+        for (size_t i=0;i<bv.n;++i) {
+          saturated += bv.volume_sat[i];
+          ++raw;
+          if (raw % seen_every != 0) continue;
+          ++printed;
+          optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed) :
+                                          pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw) : nullopt);
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          print_ts_fmt(out, bv.ts[i], pcfg.ts_fmt);
+          out << ';'; print_px_val(out, bv.open[i], pcfg);
+          out << ';'; print_px_val(out, bv.high[i], pcfg);
+          out << ';'; print_px_val(out, bv.low[i], pcfg);
+          out << ';'; print_px_val(out, bv.close[i], pcfg);
+          out << ';'; print_px_val(out, bv.vwap[i], pcfg);
+          out << ';'; print_qty_val(out, bv.volume[i], pcfg);
+          out << ';' << bv.count[i] << ';' << bv.high_ts[i] << ';' << bv.low_ts[i] << '\n';
+        }
+      }
+      warn_volume_sat(saturated);
+      report_stats("trade", br->stats());
+      return 0;
+    }
 
     auto rdr = db.get_trade_cols(start_ns, end_ns, symb, T.market, sel_int);
+    if (binary) {
+      TradeColsView v{};
+      const bool ok = write_binary([&]{ return rdr->next(v); }, [&](vector<BinCol>& c){
+        if (sel.ts) bin_i64(c, "ts", v.ts);
+        bin_i64(c, "px", v.px); bin_i64(c, "qty", v.qty);
+        bin_i64(c, "tradeId", v.tradeId);
+        bin_i64(c, "buyerOrderId", v.buyerOrderId); bin_i64(c, "sellerOrderId", v.sellerOrderId);
+        bin_i64(c, "tradeTime", v.tradeTime);
+        bin_u8(c, "isMarket", v.isMarket);
+        bin_i64(c, "eventTime", v.eventTime);
+        return v.n;
+      }, seen_every);
+      report_stats("trade", rdr->stats());
+      return ok ? 0 : 2;
+    }
 
     if (pcfg.header) {
       vector<string> names;
@@ -951,7 +2080,7 @@ int main(int argc, char** argv)
       };
       if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
       else { add_cols(""); }
-      cout << header_from_names(names) << '\n';
+      out << header_from_names(names) << '\n';
     }
 
     TradeColsView v{};
@@ -961,21 +2090,20 @@ int main(int argc, char** argv)
 
     FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
-    auto render_line = [&](size_t i)->string{
-      ostringstream os;
+    auto render_into = [&](auto& os, size_t i){
       bool first=true;
-      auto put_sep=[&]{ if(!first) os<<';'; first=false; };
+      auto put_sep=[&]{ if(!first) os.push_back(';'); first=false; };
       if (v.ts && sel.ts)      { put_sep(); print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); }
       if (v.px)                { put_sep(); print_px_val(os, v.px[i], pcfg); }
       if (v.qty)               { put_sep(); print_qty_val(os, v.qty[i], pcfg); }
-      if (v.tradeId)           { put_sep(); os<<v.tradeId[i]; }
-      if (v.buyerOrderId)      { put_sep(); os<<v.buyerOrderId[i]; }
-      if (v.sellerOrderId)     { put_sep(); os<<v.sellerOrderId[i]; }
-      if (v.tradeTime)         { put_sep(); os<<v.tradeTime[i]; }
-      if (v.isMarket)          { put_sep(); os<<int(v.isMarket[i]); }
-      if (v.eventTime)         { put_sep(); os<<v.eventTime[i]; }
-      return os.str();
+      if (v.tradeId)           { put_sep(); put_int(os, v.tradeId[i]); }
+      if (v.buyerOrderId)      { put_sep(); put_int(os, v.buyerOrderId[i]); }
+      if (v.sellerOrderId)     { put_sep(); put_int(os, v.sellerOrderId[i]); }
+      if (v.tradeTime)         { put_sep(); put_int(os, v.tradeTime[i]); }
+      if (v.isMarket)          { put_sep(); os.push_back(v.isMarket[i] ? '1' : '0'); }
+      if (v.eventTime)         { put_sep(); put_int(os, v.eventTime[i]); }
     };
+    auto render_line = [&](size_t i)->string{ string s; render_into(s, i); return s; };
 
     if (!gap_mode) {
       uint64_t local_seen = 0;
@@ -988,12 +2116,12 @@ int main(int argc, char** argv)
           ++raw_idx;
           ++local_seen;
           if (local_seen % seen_every != 0) continue;
-          string line = render_line(i);
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << line << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          render_into(out, i);
+          out << '\n';
         }
       }
       fnp.finish(raw_idx);
@@ -1020,11 +2148,11 @@ int main(int argc, char** argv)
             ++printed_idx;
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
+            out << first_line << ';' << first_line << ';';
+            print_gap_s_ms(out, 0);
+            out << '\n';
 
             have_prev = true; prev_ts = t; prev_i = i; prev_raw_idx = raw_idx;
             prev_str = std::move(first_line); prev_str_ready = true;
@@ -1038,11 +2166,11 @@ int main(int argc, char** argv)
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
             optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
+            out << prev_str << ';' << cur << ';';
+            print_gap_s_ms(out, t - prev_ts);
+            out << '\n';
           }
 
           prev_ts = t;
@@ -1058,25 +2186,110 @@ int main(int argc, char** argv)
         ++printed_idx;
         optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
         optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-        print_prefix(cout, pcfg, nullptr, nullptr,
+        print_prefix(out, pcfg, nullptr, nullptr,
                      printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-        cout << prev_str << ';' << prev_str << ';';
-        print_gap_s_ms(cout, 0);
-        cout << '\n';
+        out << prev_str << ';' << prev_str << ';';
+        print_gap_s_ms(out, 0);
+        out << '\n';
       }
 
       fnp.finish(raw_idx);
     }
+
+    report_stats("trade", rdr->stats());
   }
   // ================= DEPTH =================
   else if (T.base == "depth")
   {
     DeltaSelect sel{};
     if (!columns_csv.empty()) sel = make_depth_select_from_csv(columns_csv);
+    if (where) { cerr << "ERROR: --where supports top and trade only\n"; return 1; }
     DeltaSelect sel_int = sel;
     if (pcfg.gap_ns && !sel_int.ts) sel_int.ts = true;
 
+    // --book=N: ts;lastId;asks;bids with the top N levels (best first) after every event
+    if (book_levels) {
+      if (pcfg.gap_ns || binary) { cerr << "ERROR: --book needs text output without --gap\n"; return 1; }
+      DeltaSelect bsel{};   // ts, ids, both sides
+      bsel.eventTime = false;
+      if (pcfg.header) {
+        vector<string> names;
+        if (pcfg.idx_mode != IdxMode::None) names.push_back("idx");
+        for (const char* c : {"ts","lastId","asks","bids"}) names.push_back(c);
+        out << header_from_names(names) << '\n';
+      }
+      auto put_levels = [&](const vector<BookLevel>& lv) {
+        for (size_t k=0;k<lv.size();++k) {
+          if (k) out.push_back(',');
+          print_px_val(out, lv[k].px, pcfg);
+          out.push_back('(');
+          print_qty_val(out, lv[k].qty, pcfg);
+          out.push_back(')');
+        }
+      };
+      auto put_book = [&](const BookSnapshot& b, optional<uint64_t> idx_print) {
+        print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+        print_ts_fmt(out, b.ts, pcfg.ts_fmt);
+        out << ';'; put_int(out, b.lastId);
+        out << ';'; put_levels(b.asks);
+        out << ';'; put_levels(b.bids);
+        out << '\n';
+      };
+      auto put_book_stats = [&](const OrderBook& book, double sec) {
+        const BookStats& bs = book.stats();
+        cerr << "[debug] book: events=" << bs.events << " set=" << bs.levels_set << " removed=" << bs.levels_removed
+             << " removes_missing=" << bs.removes_missing << " gaps=" << bs.gaps << " ids_missed=" << bs.ids_missed
+             << " stale=" << bs.stale << " resets=" << bs.resets << " crossed=" << bs.crossed
+             << " levels(ask/bid)=" << book.ask_levels() << '/' << book.bid_levels()
+             << " M ev/s=" << (sec > 0 ? bs.events / sec / 1e6 : 0.0) << "\n";
+      };
+      BookSnapshot snap;
+      const auto t0 = chrono::steady_clock::now();
+
+      if (book_at_ns) {
+        auto book = db.book_at(*book_at_ns, symb, T.market, book_gap);
+        if (!book) { cerr << "ERROR: no depth file for " << iso_from_ns(*book_at_ns) << "\n"; return 1; }
+        book->top(book_levels, snap);
+        put_book(snap, pcfg.idx_mode != IdxMode::None ? optional<uint64_t>(1) : nullopt);
+        if (debug) put_book_stats(*book, chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+        return 0;
+      }
+
+      auto rdr = db.get_depth_cols(start_ns, end_ns, symb, T.market, bsel);
+      OrderBook book(book_gap);
+      DeltaColsView v{};
+      uint64_t printed = 0, raw = 0;
+      while (rdr->next(v)) {
+        for (size_t i=0;i<v.n;++i) {
+          if (!book.apply(v, i)) continue;
+          ++raw;
+          if (raw % seen_every != 0) continue;
+          ++printed;
+          book.top(book_levels, snap);
+          put_book(snap, pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed) :
+                         pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw) : nullopt);
+        }
+      }
+      if (debug) put_book_stats(book, chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+      report_stats("depth", rdr->stats());
+      return 0;
+    }
+
     auto rdr = db.get_depth_cols(start_ns, end_ns, symb, T.market, sel_int);
+    if (binary) {
+      // text depth output prints every row, so no seen_every here either
+      DeltaColsView v{};
+      const bool ok = write_binary([&]{ return rdr->next(v); }, [&](vector<BinCol>& c){
+        bin_i64(c, "ts", v.ts);
+        bin_i64(c, "firstId", v.firstId); bin_i64(c, "lastId", v.lastId);
+        bin_i64(c, "eventTime", v.eventTime);
+        bin_list(c, "ask_px", "ask_off", v.ask_off, v.ask_px); bin_list(c, "ask_qty", "ask_off", v.ask_off, v.ask_qty);
+        bin_list(c, "bid_px", "bid_off", v.bid_off, v.bid_px); bin_list(c, "bid_qty", "bid_off", v.bid_off, v.bid_qty);
+        return v.n;
+      }, 1);
+      report_stats("depth", rdr->stats());
+      return ok ? 0 : 2;
+    }
 
     if (pcfg.header) {
       vector<string> names;
@@ -1091,7 +2304,7 @@ int main(int argc, char** argv)
       };
       if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
       else { add_cols(""); }
-      cout << header_from_names(names) << '\n';
+      out << header_from_names(names) << '\n';
     }
 
     DeltaColsView v{};
@@ -1101,41 +2314,40 @@ int main(int argc, char** argv)
 
     FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
-    auto render_line = [&](size_t i)->string{
-      ostringstream os;
-      bool first=true;
-      auto putv=[&](const string& s){ if(!first) os<<';'; os<<s; first=false; };
-
-      if (v.ts) { ostringstream t; print_ts_fmt(t, v.ts[i], pcfg.ts_fmt); putv(t.str()); } else putv("0");
-      if (v.firstId) putv(std::to_string(v.firstId[i])); else putv("0");
-      if (v.lastId)  putv(std::to_string(v.lastId[i]));  else putv("0");
-      if (v.eventTime) putv(std::to_string(v.eventTime[i])); else putv("0");
+    auto render_into = [&](auto& os, size_t i){
+      if (v.ts) print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); else os.push_back('0');
+      os.push_back(';');
+      if (v.firstId) put_int(os, v.firstId[i]); else os.push_back('0');
+      os.push_back(';');
+      if (v.lastId)  put_int(os, v.lastId[i]);  else os.push_back('0');
+      os.push_back(';');
+      if (v.eventTime) put_int(os, v.eventTime[i]); else os.push_back('0');
 
-      os << ';';
+      os.push_back(';');
       if (v.ask_off && (v.ask_px || v.ask_qty)) {
         uint32_t a0=v.ask_off[i], a1=v.ask_off[i+1];
         for (uint32_t k=a0;k<a1;++k) {
-          if (k>a0) os<<',';
+          if (k>a0) os.push_back(',');
           if (v.ask_px) { print_px_val(os, v.ask_px[k], pcfg); }
-          if (v.ask_px && v.ask_qty) os<<'(';
+          if (v.ask_px && v.ask_qty) os.push_back('(');
           if (v.ask_qty) { print_qty_val(os, v.ask_qty[k], pcfg); }
-          if (v.ask_px && v.ask_qty) os<<')';
+          if (v.ask_px && v.ask_qty) os.push_back(')');
         }
       }
 
-      os << ';';
+      os.push_back(';');
       if (v.bid_off && (v.bid_px || v.bid_qty)) {
         uint32_t b0=v.bid_off[i], b1=v.bid_off[i+1];
         for (uint32_t k=b0;k<b1;++k) {
-          if (k>b0) os<<',';
+          if (k>b0) os.push_back(',');
           if (v.bid_px) { print_px_val(os, v.bid_px[k], pcfg); }
-          if (v.bid_px && v.bid_qty) os<<'(';
+          if (v.bid_px && v.bid_qty) os.push_back('(');
           if (v.bid_qty) { print_qty_val(os, v.bid_qty[k], pcfg); }
-          if (v.bid_px && v.bid_qty) os<<')';
+          if (v.bid_px && v.bid_qty) os.push_back(')');
         }
       }
-      return os.str();
     };
+    auto render_line = [&](size_t i)->string{ string s; render_into(s, i); return s; };
 
     if (!gap_mode) {
       while (rdr->next(v)) {
@@ -1148,8 +2360,9 @@ int main(int argc, char** argv)
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << render_line(i) << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          render_into(out, i);
+          out << '\n';
         }
       }
       fnp.finish(raw_idx);
@@ -1176,11 +2389,11 @@ int main(int argc, char** argv)
             ++printed_idx;
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
+            out << first_line << ';' << first_line << ';';
+            print_gap_s_ms(out, 0);
+            out << '\n';
 
             have_prev = true; prev_ts = t; prev_i = i; prev_raw_idx = raw_idx;
             prev_str = std::move(first_line); prev_str_ready = true;
@@ -1194,11 +2407,11 @@ int main(int argc, char** argv)
             optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
             optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
             optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
+            print_prefix(out, pcfg, nullptr, nullptr,
                          printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
+            out << prev_str << ';' << cur << ';';
+            print_gap_s_ms(out, t - prev_ts);
+            out << '\n';
           }
 
           prev_ts = t;
@@ -1214,15 +2427,17 @@ int main(int argc, char** argv)
         ++printed_idx;
         optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
         optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-        print_prefix(cout, pcfg, nullptr, nullptr,
+        print_prefix(out, pcfg, nullptr, nullptr,
                      printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-        cout << prev_str << ';' << prev_str << ';';
-        print_gap_s_ms(cout, 0);
-        cout << '\n';
+        out << prev_str << ';' << prev_str << ';';
+        print_gap_s_ms(out, 0);
+        out << '\n';
       }
 
       fnp.finish(raw_idx);
     }
+
+    report_stats("depth", rdr->stats());
   }
   else {
     cerr << "Internal error: unknown base type\n";
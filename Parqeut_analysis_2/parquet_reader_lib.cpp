@@ -3,27 +3,43 @@
 
 #include "parquet_reader_lib.h"
 
+#include <arrow/io/file.h>
+#include <arrow/io/memory.h>
+#include <arrow/util/key_value_metadata.h>
 #include <parquet/api/reader.h>
+#include <parquet/page_index.h>
 #include <parquet/schema.h>
+#include <parquet/statistics.h>
 
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cassert>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <stdexcept>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 #if defined(__linux__)
   #include <fcntl.h>
+  #include <sys/mman.h>
   #include <sys/stat.h>
   #include <unistd.h>
 #endif
@@ -38,145 +54,371 @@ void ShardedDB::set_debug(bool enabled) { g_debug = enabled; }
 static bool g_prefetch = false;
 void ShardedDB::set_prefetch(bool enabled) { g_prefetch = enabled; }
 
-// Small Linux prefetch helper (no-op elsewhere)
-static inline void prefetch_path(const std::string& path) {
+static PrefetchConfig g_prefetch_cfg{};
+void ShardedDB::set_prefetch_config(const PrefetchConfig& cfg) { g_prefetch_cfg = cfg; }
+
+// Small Linux page-cache warm-up (no-op elsewhere); returns the file size.
+// readahead may block until the whole file is read: run it off the reader thread.
+static uint64_t warm_page_cache(const std::string& path) {
 #if defined(__linux__)
-  if (!g_prefetch) return;
   int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
-  if (fd < 0) return;
+  if (fd < 0) return 0;
   struct stat st{};
+  uint64_t size = 0;
   if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+    size = static_cast<uint64_t>(st.st_size);
     posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
     posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
     readahead(fd, 0, static_cast<size_t>(st.st_size));
   }
   ::close(fd);
+  return size;
 #else
   (void)path;
+  return 0;
 #endif
 }
 
-// ======== Internal low-level batched cursor (used by nested depth path) ========
+// ======== Timing (ScanStats *_ns) ========
+
+using Clock = chrono::steady_clock;
 
-struct Entry
+static inline uint64_t ns_since(Clock::time_point t0)
 {
-  int16_t def = 0;
-  int16_t rep = 0;
-  bool has_value = false;
-  int64_t value = 0;
-  bool valid = false;
+  return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - t0).count());
+}
+
+// Adds the wall time of its scope to a counter
+struct ScopeTimer
+{
+  uint64_t& into;
+  Clock::time_point t0 = Clock::now();
+  ~ScopeTimer() { into += ns_since(t0); }
 };
 
-struct Int64Cursor
+// ======== File I/O mode ========
+static IoConfig g_io{};
+void ShardedDB::set_io_mode(const IoConfig& cfg) { g_io = cfg; }
+
+// Opened input per g_io.mode; a mapping is advised sequential + will-need
+static shared_ptr<arrow::io::RandomAccessFile> open_input(const string& path)
 {
-  shared_ptr<parquet::ColumnReader> holder;
-  parquet::Int64Reader* r = nullptr;
-  int16_t max_def = 0;
-  int16_t max_rep = 0;
-  bool eof = false;
+  if (g_io.mode != IoMode::Mmap)
+  {
+    PARQUET_ASSIGN_OR_THROW(auto f, arrow::io::ReadableFile::Open(path));
+    return f;
+  }
 
-  bool has_pending = false;
-  Entry pending;
+  PARQUET_ASSIGN_OR_THROW(auto mm, arrow::io::MemoryMappedFile::Open(path, arrow::io::FileMode::READ));
+#if defined(__linux__)
+  PARQUET_ASSIGN_OR_THROW(int64_t size, mm->GetSize());
+  if (size > 0)
+  {
+    // offset 0 of the mapping is page aligned; the slice is zero-copy
+    PARQUET_ASSIGN_OR_THROW(auto whole, mm->ReadAt(0, size));
+    void* base = const_cast<uint8_t*>(whole->data());
+    ::madvise(base, static_cast<size_t>(size), MADV_SEQUENTIAL);
+    ::madvise(base, static_cast<size_t>(size), MADV_WILLNEED);
+  }
+#endif
+  return mm;
+}
 
-  static constexpr int64_t BATCH = 65536;
-  vector<int16_t> defbuf;
-  vector<int16_t> repbuf;
-  vector<int64_t> valbuf;
-  int64_t levels_in_buf = 0;
-  int64_t level_idx = 0;
-  int64_t values_in_buf = 0;
-  int64_t value_idx = 0;
+// Pass-through input that counts the bytes parquet fetches (ScanStats::bytes_read)
+class CountedFile : public arrow::io::RandomAccessFile
+{
+public:
+  explicit CountedFile(shared_ptr<arrow::io::RandomAccessFile> in) : in_(move(in)) {}
 
-  Int64Cursor() = default;
+  // bytes fetched since the last call
+  uint64_t take_bytes() { return bytes_.exchange(0, memory_order_relaxed); }
 
-  Int64Cursor(shared_ptr<parquet::ColumnReader> col, const parquet::ColumnDescriptor* descr)
-  :
-    holder(move(col))
-  {
-    r = dynamic_cast<parquet::Int64Reader*>(holder.get());
-    if (!r)
-    {
-      throw runtime_error("Column is not INT64");
-    }
+  using arrow::io::RandomAccessFile::ReadAt;
+
+  arrow::Status Close() override { return in_->Close(); }
+  bool closed() const override { return in_->closed(); }
+  arrow::Result<int64_t> Tell() const override { return in_->Tell(); }
+  arrow::Status Seek(int64_t position) override { return in_->Seek(position); }
+  arrow::Result<int64_t> GetSize() override { return in_->GetSize(); }
+  bool supports_zero_copy() const override { return in_->supports_zero_copy(); }
+  arrow::Status WillNeed(const vector<arrow::io::ReadRange>& ranges) override { return in_->WillNeed(ranges); }
 
-    max_def = descr->max_definition_level();
-    max_rep = descr->max_repetition_level();
+  arrow::Result<int64_t> Read(int64_t nbytes, void* out) override
+  {
+    return count(in_->Read(nbytes, out));
+  }
+  arrow::Result<shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override
+  {
+    return count(in_->Read(nbytes));
+  }
+  arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes, void* out) override
+  {
+    return count(in_->ReadAt(position, nbytes, out));
+  }
+  arrow::Result<shared_ptr<arrow::Buffer>> ReadAt(int64_t position, int64_t nbytes) override
+  {
+    return count(in_->ReadAt(position, nbytes));
+  }
 
-    if (max_def) defbuf.resize(BATCH);
-    if (max_rep) repbuf.resize(BATCH);
-    valbuf.resize(BATCH);
+private:
+  arrow::Result<int64_t> count(arrow::Result<int64_t> r)
+  {
+    if (r.ok()) bytes_.fetch_add(static_cast<uint64_t>(*r), memory_order_relaxed);
+    return r;
+  }
+  arrow::Result<shared_ptr<arrow::Buffer>> count(arrow::Result<shared_ptr<arrow::Buffer>> r)
+  {
+    if (r.ok()) bytes_.fetch_add(static_cast<uint64_t>((*r)->size()), memory_order_relaxed);
+    return r;
   }
 
-  bool refill()
+  shared_ptr<arrow::io::RandomAccessFile> in_;
+  atomic<uint64_t> bytes_{0};
+};
+
+// Parquet reader of one streamer + what opening it cost
+struct OpenedParquet
+{
+  unique_ptr<parquet::ParquetFileReader> reader;
+  shared_ptr<CountedFile> io;
+  uint64_t open_ns = 0;       // open / map the file
+  uint64_t metadata_ns = 0;   // footer read + parse
+};
+
+// input: already opened (e.g. mapped ahead by prefetch), else opened here
+static unique_ptr<parquet::ParquetFileReader> open_parquet(const string& path,
+                                                           shared_ptr<arrow::io::RandomAccessFile> input)
+{
+  if (!input) input = open_input(path);
+
+  parquet::ReaderProperties props = parquet::default_reader_properties();
+  if (g_io.mode == IoMode::Pread)
   {
-    if (eof) return false;
+    props.enable_buffered_stream();
+    props.set_buffer_size(static_cast<int64_t>(max<size_t>(g_io.read_bytes, 4096)));
+  }
+  return parquet::ParquetFileReader::Open(move(input), props);
+}
+
+static OpenedParquet open_counted(const string& path, shared_ptr<arrow::io::RandomAccessFile> input)
+{
+  OpenedParquet r;
+  const Clock::time_point t0 = Clock::now();
+  r.io = make_shared<CountedFile>(input ? move(input) : open_input(path));
+  r.open_ns = ns_since(t0);
+
+  const Clock::time_point t1 = Clock::now();
+  r.reader = open_parquet(path, r.io);
+  r.metadata_ns = ns_since(t1);
+  return r;
+}
 
-    int64_t values_read = 0;
-    levels_in_buf = r->ReadBatch(
-        BATCH,
-        max_def ? defbuf.data() : nullptr,
-        max_rep ? repbuf.data() : nullptr,
-        valbuf.data(),
-        &values_read);
+// ======== Async read-ahead (one I/O thread per serial reader) ========
+
+struct FilePrefetcher::Impl
+{
+  enum class State : uint8_t { Pending, Busy, Done };
+
+  struct Slot
+  {
+    State state = State::Pending;
+    shared_ptr<arrow::io::RandomAccessFile> input;  // owned buffer or mapping (hand_over only)
+    uint64_t bytes = 0;
+  };
+
+  vector<string> paths_;
+  PrefetchConfig cfg_;
+  bool hand_over_;   // keep what was read for take(); else only warm the page cache
+
+  mutex mu_;
+  condition_variable cv_;
+  vector<Slot> slots_;
+  size_t next_  = 1;   // next file to prefetch; the first is opened right away
+  size_t taken_ = 0;   // files the reader has reached
+  uint64_t held_bytes_ = 0;
+  bool stop_ = false;
+  thread worker_;
+
+  Impl(vector<string> paths, const PrefetchConfig& cfg, bool hand_over)
+  : paths_(move(paths)), cfg_(cfg), hand_over_(hand_over), slots_(paths_.size())
+  {
+    worker_ = thread([this]{ run(); });
+  }
 
-    if (levels_in_buf == 0)
+  ~Impl()
+  {
     {
-      eof = true;
-      return false;
+      lock_guard<mutex> lk(mu_);
+      stop_ = true;
     }
-
-    level_idx = 0;
-    value_idx = 0;
-    values_in_buf = values_read;
-    return true;
+    cv_.notify_all();
+    worker_.join();
   }
 
-  bool ensure_pending()
+  // mu_ held; the file right after the reader's is always allowed
+  bool may_start() const
   {
-    if (eof && !has_pending) return false;
-    if (has_pending) return true;
+    return next_ < taken_ + max<size_t>(cfg_.files_ahead, 1)
+        && (held_bytes_ < cfg_.byte_budget || next_ <= taken_);
+  }
 
-    if (level_idx >= levels_in_buf)
+  // Reads (or maps) all of path when handing over, else hints the page cache
+  Slot fetch(const string& path) const
+  {
+    Slot r;
+    if (hand_over_ && cfg_.into_memory)
     {
-      if (!refill()) return false;
+      PARQUET_ASSIGN_OR_THROW(auto f, arrow::io::ReadableFile::Open(path));
+      PARQUET_ASSIGN_OR_THROW(int64_t size, f->GetSize());
+      PARQUET_ASSIGN_OR_THROW(auto buf, f->ReadAt(0, size));
+      r.bytes = static_cast<uint64_t>(buf->size());
+      r.input = make_shared<arrow::io::BufferReader>(move(buf));
     }
+    else if (hand_over_ && g_io.mode == IoMode::Mmap)
+    {
+      r.input = open_input(path);
+      PARQUET_ASSIGN_OR_THROW(int64_t size, r.input->GetSize());
+      r.bytes = static_cast<uint64_t>(size);
+    }
+    else
+    {
+      r.bytes = warm_page_cache(path);
+    }
+    return r;
+  }
+
+  void run()
+  {
+    while (true)
+    {
+      size_t i = 0;
+      {
+        unique_lock<mutex> lk(mu_);
+        cv_.wait(lk, [&]{ return stop_ || next_ >= paths_.size() || may_start(); });
+        if (stop_ || next_ >= paths_.size()) return;
+        i = next_++;
+        slots_[i].state = State::Busy;
+      }
 
-    Entry e{};
-    e.valid = true;
+      Slot r;
+      try
+      {
+        r = fetch(paths_[i]);
+      }
+      catch (const exception&)
+      {
+        // reported by the reader's own open of the file
+        r = Slot{};
+      }
 
-    e.def = max_def ? defbuf[level_idx] : 0;
-    e.rep = max_rep ? repbuf[level_idx] : 0;
+      {
+        lock_guard<mutex> lk(mu_);
+        r.state = State::Done;
+        held_bytes_ += r.bytes;
+        slots_[i] = move(r);
+      }
+      cv_.notify_all();
+    }
+  }
 
-    if (e.def == max_def)
+  // The reader reached file i: what was prefetched for it (nullptr => open it yourself)
+  shared_ptr<arrow::io::RandomAccessFile> take(size_t i, ScanStats& st)
+  {
+    unique_lock<mutex> lk(mu_);
+    taken_ = max(taken_, i + 1);
+    next_  = max(next_, taken_);   // files passed over are never fetched
+    cv_.notify_all();
+
+    if (i == 0 || i >= slots_.size()) return nullptr;
+    Slot& s = slots_[i];
+    if (s.state == State::Pending)
+    {
+      ++st.prefetch_missed;
+      return nullptr;
+    }
+    if (s.state == State::Busy)
     {
-      if (value_idx >= values_in_buf) throw runtime_error("value_idx overflow");
-      e.has_value = true;
-      e.value = valbuf[value_idx++];
+      ++st.prefetch_waits;
+      const Clock::time_point t0 = Clock::now();
+      cv_.wait(lk, [&]{ return s.state == State::Done; });
+      st.prefetch_wait_ns += ns_since(t0);
     }
     else
     {
-      e.has_value = false;
-      e.value = 0;
+      ++st.prefetch_ready;
     }
 
-    ++level_idx;
+    st.prefetch_bytes += s.bytes;
+    held_bytes_ -= s.bytes;
+    s.bytes = 0;
+    cv_.notify_all();
+    return move(s.input);
+  }
+};
 
-    pending = e;
-    has_pending = true;
-    return true;
+FilePrefetcher::FilePrefetcher(vector<string> paths, const PrefetchConfig& cfg)
+: impl_(make_unique<Impl>(move(paths), cfg, /*hand_over=*/false)) {}
+
+FilePrefetcher::~FilePrefetcher() = default;
+
+void FilePrefetcher::reached(size_t i) { impl_->take(i, stats_); }
+
+const ScanStats& FilePrefetcher::stats() const { return stats_; }
+
+// ======== Scratch arena (one per reader / worker, reused across RGs and files) ========
+
+// Levels, values and per-row list offsets of one depth column chunk
+struct LeafBufs
+{
+  vector<int16_t>  def;
+  vector<int16_t>  rep;
+  vector<int64_t>  val;
+  vector<uint32_t> row_off;
+};
+
+// Depth column roles -> fixed LeafBufs slot
+enum LeafSlot { LEAF_TS, LEAF_FID, LEAF_LID, LEAF_EVT, LEAF_APX, LEAF_AQTY, LEAF_BPX, LEAF_BQTY, LEAF_COUNT };
+
+struct ScratchArena
+{
+  vector<int64_t> ts_all;   // unsorted-ts fallback: ts before filtering
+  vector<int64_t> tmp_i64;  // unsorted-ts fallback: column before scatter
+  vector<uint8_t> tmp_u8;
+  LeafBufs leaves[LEAF_COUNT];
+
+  // where-predicate path: leaf columns, masks per AND/OR depth, selected rows
+  vector<vector<int64_t>> where_cols;
+  vector<vector<uint8_t>> where_masks;
+  vector<uint8_t>  where_mask;
+  vector<uint32_t> sel_rows;
+
+  uint64_t allocs = 0;      // real (re)allocations done through fit()/reserve()
+  uint64_t decode_ns = 0;   // time decompressing + decoding column values
+
+  // Size v to n; capacity survives between uses, growth is counted
+  template <class T>
+  void fit(vector<T>& v, size_t n)
+  {
+    if (v.capacity() < n) ++allocs;
+    v.resize(n);
   }
 
-  Entry take()
+  template <class T>
+  void reserve(vector<T>& v, size_t n)
   {
-    if (!ensure_pending()) return Entry{};
-    has_pending = false;
-    return pending;
+    if (v.capacity() < n) { ++allocs; v.reserve(n); }
   }
 
-  const Entry* peek()
+  size_t bytes() const
   {
-    if (!ensure_pending()) return nullptr;
-    return &pending;
+    size_t b = (ts_all.capacity() + tmp_i64.capacity()) * sizeof(int64_t) + tmp_u8.capacity();
+    for (const LeafBufs& l : leaves)
+      b += (l.def.capacity() + l.rep.capacity()) * sizeof(int16_t) + l.val.capacity() * sizeof(int64_t)
+         + l.row_off.capacity() * sizeof(uint32_t);
+    for (const auto& c : where_cols) b += c.capacity() * sizeof(int64_t);
+    for (const auto& m : where_masks) b += m.capacity();
+    b += where_mask.capacity() + sel_rows.capacity() * sizeof(uint32_t);
+    return b;
   }
 };
 
@@ -192,217 +434,1460 @@ static int find_col_idx(const parquet::SchemaDescriptor* schema, const string& n
   return -1;
 }
 
-// Read LIST from a single leaf. Returns count appended.
-static uint32_t append_list_from_leaf_for_row(
-    Int64Cursor& leaf,
-    vector<int64_t>* out_vals)
-{
-  const Entry* p = leaf.peek();
-  if (!p) return 0;
+// ======== Per-schema column plans (resolved once per distinct schema) ========
 
-  bool empty_start = (!p->has_value && p->rep == 0);
-  if (empty_start)
+// Leaf paths + physical types: files with equal fingerprints share one plan
+static string schema_fingerprint(const parquet::SchemaDescriptor* schema)
+{
+  string fp;
+  for (int i = 0; i < schema->num_columns(); ++i)
   {
-    (void)leaf.take();
-    return 0;
+    const parquet::ColumnDescriptor* c = schema->Column(i);
+    fp += c->path()->ToDotString();
+    fp += ':';
+    fp += to_string(static_cast<int>(c->physical_type()));
+    fp += ';';
   }
+  return fp;
+}
 
-  uint32_t count = 0;
-  while (true)
-  {
-    Entry e = leaf.take();
-    if (out_vals) out_vals->push_back(e.value);
-    ++count;
+// Column indices for every column a top reader may select (-1 => absent)
+struct TopPlan
+{
+  int ts, ask_px, ask_qty, bid_px, bid_qty, valu;
+  int min_bid_px, max_bid_px, min_ask_px, max_ask_px;
+  int min_bid_ts, max_bid_ts, min_ask_ts, max_ask_ts;
+
+  explicit TopPlan(const parquet::SchemaDescriptor* s)
+  : ts(find_col_idx(s, "ts")), ask_px(find_col_idx(s, "ask_px")), ask_qty(find_col_idx(s, "ask_qty")),
+    bid_px(find_col_idx(s, "bid_px")), bid_qty(find_col_idx(s, "bid_qty")), valu(find_col_idx(s, "valu")),
+    min_bid_px(find_col_idx(s, "min_bid_px")), max_bid_px(find_col_idx(s, "max_bid_px")),
+    min_ask_px(find_col_idx(s, "min_ask_px")), max_ask_px(find_col_idx(s, "max_ask_px")),
+    min_bid_ts(find_col_idx(s, "min_bid_ts")), max_bid_ts(find_col_idx(s, "max_bid_ts")),
+    min_ask_ts(find_col_idx(s, "min_ask_ts")), max_ask_ts(find_col_idx(s, "max_ask_ts")) {}
+};
 
-    const Entry* n = leaf.peek();
-    if (!n || n->rep == 0) break;
-  }
-  return count;
-}
+struct TradePlan
+{
+  int ts, px, qty, tradeId, buyerOrderId, sellerOrderId, tradeTime, isMarket, eventTime;
 
-// Read LIST pairs (px, qty) per row; returns number of pairs appended.
-static uint32_t append_list_pairs_for_row_typed(
-    Int64Cursor& px, Int64Cursor& qty,
-    vector<int64_t>* out_px,
-    vector<int64_t>* out_qty)
+  explicit TradePlan(const parquet::SchemaDescriptor* s)
+  : ts(find_col_idx(s, "ts")), px(find_col_idx(s, "px")), qty(find_col_idx(s, "qty")),
+    tradeId(find_col_idx(s, "tradeId")), buyerOrderId(find_col_idx(s, "buyerOrderId")),
+    sellerOrderId(find_col_idx(s, "sellerOrderId")), tradeTime(find_col_idx(s, "tradeTime")),
+    isMarket(find_col_idx(s, "isMarket")), eventTime(find_col_idx(s, "eventTime")) {}
+};
+
+struct DeltaPlan
+{
+  int ts, firstId, lastId, eventTime;
+  int ask_px, ask_qty, bid_px, bid_qty;
+
+  explicit DeltaPlan(const parquet::SchemaDescriptor* s)
+  : ts(find_col_idx(s, "ts")), firstId(find_col_idx(s, "firstId")),
+    lastId(find_col_idx(s, "lastId")), eventTime(find_col_idx(s, "eventTime")),
+    ask_px(find_col_idx(s, "ask.list.element.px")), ask_qty(find_col_idx(s, "ask.list.element.qty")),
+    bid_px(find_col_idx(s, "bid.list.element.px")), bid_qty(find_col_idx(s, "bid.list.element.qty")) {}
+};
+
+// Process-wide cache (read-ahead workers open files concurrently)
+template <class Plan>
+static shared_ptr<const Plan> plan_for(const parquet::SchemaDescriptor* schema)
 {
-  const Entry* p_peek = px.peek();
-  const Entry* q_peek = qty.peek();
+  static mutex mu;
+  static unordered_map<string, shared_ptr<const Plan>> cache;
+
+  string fp = schema_fingerprint(schema);
+  lock_guard<mutex> lk(mu);
+  shared_ptr<const Plan>& p = cache[fp];
+  if (!p) p = make_shared<const Plan>(schema);
+  return p;
+}
 
-  if (!p_peek || !q_peek) return 0;
+// ======== Nested depth path: whole-chunk level decoding ========
 
-  bool empty_start = (!p_peek->has_value && p_peek->rep == 0) &&
-                     (!q_peek->has_value && q_peek->rep == 0);
+// Definition level reached once the innermost repeated ancestor has an entry:
+// def >= this => the entry is a list element (possibly a null one).
+static int16_t repeated_def_level(const parquet::ColumnDescriptor* d)
+{
+  vector<const parquet::schema::Node*> chain;
+  for (const parquet::schema::Node* n = d->schema_node().get(); n && n->parent(); n = n->parent())
+    chain.push_back(n);
 
-  if (empty_start)
+  int16_t lvl = 0;
+  int16_t rep_lvl = -1;
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it)
   {
-    (void)px.take();
-    (void)qty.take();
-    return 0;
+    if (!(*it)->is_required()) ++lvl;
+    if ((*it)->is_repeated()) rep_lvl = lvl;
   }
+  return rep_lvl < 0 ? d->max_definition_level() : rep_lvl;
+}
 
-  uint32_t count = 0;
+// Reads every level/value of one column chunk into b (def/rep/val sized to the chunk).
+// Returns the number of level entries; *values_read gets the non-null value count.
+static int64_t read_chunk_levels(parquet::RowGroupReader& rg, int col_idx,
+                                 const parquet::ColumnDescriptor* descr,
+                                 ScratchArena& arena, LeafBufs& b, int64_t* values_read)
+{
+  shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
+  auto* r = dynamic_cast<parquet::Int64Reader*>(col.get());
+  if (!r) throw runtime_error("Column is not INT64");
+
+  const int16_t max_def = descr->max_definition_level();
+  const int16_t max_rep = descr->max_repetition_level();
+  const int64_t n = rg.metadata()->ColumnChunk(col_idx)->num_values();
 
-  while (true)
+  if (max_def) arena.fit(b.def, static_cast<size_t>(n));
+  if (max_rep) arena.fit(b.rep, static_cast<size_t>(n));
+  arena.fit(b.val, static_cast<size_t>(n));
+
+  int64_t lv = 0, vals = 0;
+  while (lv < n)
   {
-    Entry epx = px.take();
-    Entry eqy = qty.take();
+    int64_t got_vals = 0;
+    int64_t got = r->ReadBatch(n - lv,
+                               max_def ? b.def.data() + lv : nullptr,
+                               max_rep ? b.rep.data() + lv : nullptr,
+                               b.val.data() + vals, &got_vals);
+    if (got == 0) break;
+    lv += got;
+    vals += got_vals;
+  }
+  if (lv != n) throw runtime_error("Short read in nested column");
 
-    if (out_px)  out_px->push_back(epx.value);
-    if (out_qty) out_qty->push_back(eqy.value);
-    ++count;
+  *values_read = vals;
+  return n;
+}
 
-    const Entry* npx = px.peek();
-    const Entry* nqy = qty.peek();
+// Flat INT64 column (required or optional) -> one value per row, nulls as 0
+static void read_flat_i64(parquet::RowGroupReader& rg, int col_idx,
+                          const parquet::ColumnDescriptor* descr, int64_t rows,
+                          ScratchArena& arena, LeafBufs& b)
+{
+  ScopeTimer timer{arena.decode_ns};
+  int64_t vals = 0;
+  const int64_t n = read_chunk_levels(rg, col_idx, descr, arena, b, &vals);
+  if (n != rows) throw runtime_error("Flat column level count != rows");
+
+  if (vals == n) return; // no nulls: val[] is already one value per row
+
+  // expand nulls in place, back to front (values are packed at the front)
+  const int16_t max_def = descr->max_definition_level();
+  int64_t v = vals;
+  for (int64_t i = n; i-- > 0;)
+    b.val[i] = (b.def[i] == max_def) ? b.val[--v] : 0;
+}
 
-    if (!npx || !nqy) break;
-    if (npx->rep == 0) break;
-    if (npx->rep != nqy->rep) break;
+// LIST<int64> leaf -> b.row_off (rows + 1 element offsets) and b.val holding
+// exactly row_off[rows] elements (null elements as 0). Row boundaries are the
+// rep == 0 entries; a row whose single entry is below the repeated def level
+// is an empty (or null) list.
+static void read_list_i64(parquet::RowGroupReader& rg, int col_idx,
+                          const parquet::ColumnDescriptor* descr, int64_t rows,
+                          ScratchArena& arena, LeafBufs& b)
+{
+  ScopeTimer timer{arena.decode_ns};
+  int64_t vals = 0;
+  const int64_t n = read_chunk_levels(rg, col_idx, descr, arena, b, &vals);
+  const int16_t max_def = descr->max_definition_level();
+  const int16_t elem_def = repeated_def_level(descr);
+
+  if (descr->max_repetition_level() == 0) throw runtime_error("Column is not a list");
+
+  arena.fit(b.row_off, static_cast<size_t>(rows) + 1);
+  uint32_t* off = b.row_off.data();
+  const int16_t* def = b.def.data();
+  const int16_t* rep = b.rep.data();
+
+  // one pass: element counter, row start on rep == 0
+  int64_t r = 0;
+  uint32_t e = 0;
+  for (int64_t i = 0; i < n; ++i)
+  {
+    if (rep[i] == 0)
+    {
+      if (r >= rows) throw runtime_error("List row count > rows");
+      off[r++] = e;
+    }
+    e += (def[i] >= elem_def);
   }
+  if (r != rows) throw runtime_error("List row count != rows");
+  off[rows] = e;
+
+  if (vals == static_cast<int64_t>(e)) return; // no null elements: val[] is dense
 
-  return count;
+  // rare: null elements inside lists -> expand to 0, back to front
+  int64_t v = vals;
+  uint32_t w = e;
+  for (int64_t i = n; i-- > 0;)
+  {
+    if (def[i] < elem_def) continue;
+    b.val[--w] = (def[i] == max_def) ? b.val[--v] : 0;
+  }
 }
 
-// ======== Date helpers & file mapping (chronological order) ========
+// ======== ts pruning (row-group statistics + page index) ========
 
-struct YMD { int year; int month; int day; };
+// Rows [lo, hi) of a row group that still need decoding.
+struct RowSpan
+{
+  int64_t lo = 0;
+  int64_t hi = 0;
+};
 
-static YMD ymd_utc_from_ns(int64_t ns)
+// False only when the ts column-chunk statistics prove that no row of the
+// row group falls into [start_ns, end_ns). Missing statistics => keep it.
+static bool rg_ts_may_overlap(const parquet::FileMetaData& md, int rg, int ts_i,
+                              int64_t start_ns, int64_t end_ns)
 {
-  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
-  tm tm{};
-  gmtime_r(&s, &tm);
-  return {tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday};
+  auto cc = md.RowGroup(rg)->ColumnChunk(ts_i);
+  if (!cc->is_stats_set()) return true;
+  shared_ptr<parquet::Statistics> st = cc->statistics();
+  auto* i64 = dynamic_cast<parquet::Int64Statistics*>(st.get());
+  if (!i64 || !i64->HasMinMax()) return true;
+  return !(i64->max() < start_ns || i64->min() >= end_ns);
 }
 
-static int64_t floor_day_ns(int64_t ns)
+// Narrow a row group to the pages whose ts [min, max] can overlap the window,
+// using the column/offset index. Falls back to the full row group when the
+// file has no page index. Pages in between are kept (sorted files => contiguous).
+static RowSpan ts_page_span(parquet::ParquetFileReader& reader, int rg, int ts_i,
+                            int64_t rows, int64_t start_ns, int64_t end_ns)
 {
-  int64_t sec = ns / 1'000'000'000LL;
-  int64_t day_sec = sec - (sec % 86400LL);
-  return day_sec * 1'000'000'000LL;
+  RowSpan full{0, rows};
+  try
+  {
+    shared_ptr<parquet::PageIndexReader> pir = reader.GetPageIndexReader();
+    if (!pir) return full;
+    shared_ptr<parquet::RowGroupPageIndexReader> rg_pir = pir->RowGroup(rg);
+    if (!rg_pir) return full;
+
+    shared_ptr<parquet::ColumnIndex> ci = rg_pir->GetColumnIndex(ts_i);
+    shared_ptr<parquet::OffsetIndex> oi = rg_pir->GetOffsetIndex(ts_i);
+    auto* ici = dynamic_cast<parquet::Int64ColumnIndex*>(ci.get());
+    if (!ici || !oi) return full;
+
+    const vector<bool>& nulls = ici->null_pages();
+    const vector<int64_t>& mins = ici->min_values();
+    const vector<int64_t>& maxs = ici->max_values();
+    const vector<parquet::PageLocation>& locs = oi->page_locations();
+    const size_t n = locs.size();
+    if (n == 0 || nulls.size() != n || mins.size() != n || maxs.size() != n) return full;
+
+    size_t first = n, last = n;
+    for (size_t p = 0; p < n; ++p)
+    {
+      if (nulls[p]) continue;
+      if (maxs[p] < start_ns || mins[p] >= end_ns) continue;
+      if (first == n) first = p;
+      last = p;
+    }
+    if (first == n) return RowSpan{0, 0};
+
+    RowSpan sp;
+    sp.lo = locs[first].first_row_index;
+    sp.hi = (last + 1 < n) ? locs[last + 1].first_row_index : rows;
+    if (sp.lo < 0 || sp.hi > rows || sp.lo > sp.hi) return full;
+    return sp;
+  }
+  catch (const exception&)
+  {
+    return full;
+  }
 }
 
-static int64_t ymd_utc_start_ns(int Y, int M, int D)
+// ======== Sorted-ts fast path ========
+
+static bool g_assume_sorted = false;
+void ShardedDB::set_assume_sorted(bool enabled) { g_assume_sorted = enabled; }
+
+// Row group declares ts as its leading ascending sort key
+static bool rg_declares_ts_sorted(const parquet::FileMetaData& md, int rg, int ts_i)
 {
-  tm tm{};
-  tm.tm_year = Y - 1900;
-  tm.tm_mon  = M - 1;
-  tm.tm_mday = D;
-  tm.tm_hour = 0; tm.tm_min = 0; tm.tm_sec = 0;
-  time_t s = timegm(&tm); // GNU extension: UTC mktime
-  if (s == (time_t)-1) return 0;
-  return static_cast<int64_t>(s) * 1'000'000'000LL;
+  vector<parquet::SortingColumn> sc = md.RowGroup(rg)->sorting_columns();
+  return !sc.empty() && sc[0].column_idx == ts_i && !sc[0].descending;
 }
 
-static string iso_from_ns(int64_t ns)
+static bool ts_sorted(const parquet::FileMetaData& md, int rg, int ts_i, const vector<int64_t>& ts)
 {
-  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
-  tm tm{}; gmtime_r(&s, &tm);
-  ostringstream o;
-  o << setfill('0')
-    << setw(4) << (tm.tm_year + 1900) << '-'
-    << setw(2) << (tm.tm_mon + 1) << '-'
-    << setw(2) << tm.tm_mday << 'T'
-    << setw(2) << tm.tm_hour << ':'
-    << setw(2) << tm.tm_min  << ':'
-    << setw(2) << tm.tm_sec  << 'Z';
-  return o.str();
+  if (g_assume_sorted || rg_declares_ts_sorted(md, rg, ts_i)) return true;
+  return is_sorted(ts.begin(), ts.end());
 }
 
-struct Candidate
+// [lo, hi) of sorted ts falling into [start_ns, end_ns)
+static RowSpan sorted_hit(const vector<int64_t>& ts, int64_t start_ns, int64_t end_ns)
 {
-  string  path;
-  int64_t file_start_ns = 0;
-  int64_t file_end_ns   = 0;
+  auto lo = lower_bound(ts.begin(), ts.end(), start_ns);
+  auto hi = lower_bound(lo, ts.end(), end_ns);
+  return RowSpan{lo - ts.begin(), hi - ts.begin()};
+}
+
+// ======== Row predicates (TopSelect / TradeSelect ::where) ========
+
+// Predicate with its column names resolved against one file schema
+struct WhereNode
+{
+  Predicate::Kind kind = Predicate::Kind::All;
+  Predicate::Op op = Predicate::Op::Eq;
+  int a = -1;                   // slot in WherePlan::cols
+  int b = -1;                   // second slot (col2), -1 => plain comparison
+  int64_t value = 0;
+  vector<WhereNode> kids;
 };
 
-static string to_lower(string s) { for (auto& c:s) c=(char)tolower((unsigned char)c); return s; }
+struct WherePlan
+{
+  const Predicate* src = nullptr;  // predicate this plan was compiled from
+  WhereNode root;
+  vector<int> cols;                // leaf column indices, by slot
+  size_t masks = 0;                // AND/OR nesting depth = scratch masks where_eval needs
 
-// Normalize/accept market input
-static optional<string> norm_market(optional<string> m)
+  bool active() const { return root.kind != Predicate::Kind::All; }
+};
+
+static WhereNode where_compile(const Predicate& p, const parquet::SchemaDescriptor* schema, vector<int>& cols)
 {
-  if (!m) return nullopt;
-  string s = to_lower(*m);
-  if (s=="futures") s="fut";
-  if (s=="future")  s="fut";
-  if (s=="spot" || s=="fut") return s;
-  return nullopt;
+  WhereNode n;
+  n.kind  = p.kind;
+  n.op    = p.op;
+  n.value = p.value;
+
+  auto slot = [&](const string& name)
+  {
+    const int idx = find_col_idx(schema, name);
+    if (idx < 0) throw runtime_error("where: missing column " + name);
+    const parquet::Type::type t = schema->Column(idx)->physical_type();
+    if (t != parquet::Type::INT64 && t != parquet::Type::BOOLEAN)
+      throw runtime_error("where: column " + name + " is not int64/bool");
+    auto it = find(cols.begin(), cols.end(), idx);
+    if (it != cols.end()) return static_cast<int>(it - cols.begin());
+    cols.push_back(idx);
+    return static_cast<int>(cols.size() - 1);
+  };
+
+  if (p.kind == Predicate::Kind::Cmp)
+  {
+    n.a = slot(p.col);
+    if (!p.col2.empty()) n.b = slot(p.col2);
+  }
+  else if (p.kind == Predicate::Kind::And || p.kind == Predicate::Kind::Or)
+  {
+    if (p.kids.empty()) throw runtime_error("where: empty AND/OR");
+    for (const Predicate& k : p.kids) n.kids.push_back(where_compile(k, schema, cols));
+  }
+  return n;
 }
 
-static void debug_try_path(const string& p, int64_t s_ns, int64_t e_ns)
+// where_eval uses arena.where_masks[d] for an AND/OR at depth d
+static size_t where_masks_needed(const WhereNode& n, size_t depth)
 {
-  if (!g_debug) return;
-  bool ex = fs::exists(p);
-  cerr << "[debug] try: " << p
-       << " [" << iso_from_ns(s_ns) << " .. " << iso_from_ns(e_ns)
-       << "] " << (ex ? "EXISTS" : "missing") << "\n";
+  if (n.kind != Predicate::Kind::And && n.kind != Predicate::Kind::Or) return 0;
+  size_t need = depth + 1;
+  for (const WhereNode& k : n.kids) need = max(need, where_masks_needed(k, depth + 1));
+  return need;
 }
 
-// STRICT layout only:
-//   <root>/<kind>_<market>/<SYMB>/<Y>/<M>/bn_<kind>_<market>_<SYMB>_<Y>_<M>_<D>.parquet
-// Non-padded month/day (e.g., 2025/9/3)
-// kind: "top" | "trade" | "depth"
-static vector<Candidate> candidate_files_strict(const string& root,
-                                                const string& symb,
-                                                const string& base_type,
-                                                optional<string> market,
-                                                int64_t start_ns,
-                                                int64_t end_ns,
-                                                const optional<string>& sampling)
+// (Re)compile when the streamer sees a different predicate
+static void where_prepare(WherePlan& w, const Predicate& p, const parquet::SchemaDescriptor* schema)
 {
-  vector<Candidate> out;
-  if (start_ns >= end_ns) return out;
+  if (w.src == &p) return;
+  w = WherePlan{};
+  w.root = where_compile(p, schema, w.cols);
+  w.masks = where_masks_needed(w.root, 0);
+  w.src  = &p;
+}
 
-  // sampling not used in strict layout; warn in debug to avoid confusion
-  if (g_debug && sampling.has_value()) {
-    cerr << "[debug] note: --sampling is ignored for strict layout discovery\n";
+// Can some x in [lo, hi] satisfy x <op> v
+static bool where_range_may(Predicate::Op op, __int128 lo, __int128 hi, int64_t v)
+{
+  switch (op)
+  {
+    case Predicate::Op::Lt: return lo <  v;
+    case Predicate::Op::Le: return lo <= v;
+    case Predicate::Op::Gt: return hi >  v;
+    case Predicate::Op::Ge: return hi >= v;
+    case Predicate::Op::Eq: return lo <= v && v <= hi;
+    case Predicate::Op::Ne: return !(lo == v && hi == v);
   }
+  return true;
+}
 
-  vector<string> markets;
-  if (market) {
-    auto nm = norm_market(market);
-    if (!nm) throw runtime_error("market must be 'fut' or 'spot'");
-    markets.push_back(*nm);
-  } else {
-    markets = {"fut","spot"}; // backward-compatible overloads search both
+static bool chunk_minmax(const parquet::FileMetaData& md, int rg, int col, int64_t& lo, int64_t& hi)
+{
+  auto cc = md.RowGroup(rg)->ColumnChunk(col);
+  if (!cc->is_stats_set()) return false;
+  shared_ptr<parquet::Statistics> st = cc->statistics();
+  if (auto* i64 = dynamic_cast<parquet::Int64Statistics*>(st.get()))
+  {
+    if (!i64->HasMinMax()) return false;
+    lo = i64->min(); hi = i64->max();
+    return true;
   }
+  if (auto* b = dynamic_cast<parquet::BoolStatistics*>(st.get()))
+  {
+    if (!b->HasMinMax()) return false;
+    lo = b->min(); hi = b->max();
+    return true;
+  }
+  return false;
+}
 
-  const int64_t day_ns = 86'400'000'000'000LL;
-  int64_t cur = floor_day_ns(start_ns);
-  const int64_t end_floor = floor_day_ns(end_ns - 1);
-
-  for (const string& mkt : markets)
+// false => no row of the row group can match (column-chunk statistics)
+static bool where_rg_may_match(const WhereNode& n, const WherePlan& w, const parquet::FileMetaData& md, int rg)
+{
+  switch (n.kind)
   {
-    while (cur <= end_floor)
+    case Predicate::Kind::All: return true;
+    case Predicate::Kind::And:
+      for (const WhereNode& k : n.kids) if (!where_rg_may_match(k, w, md, rg)) return false;
+      return true;
+    case Predicate::Kind::Or:
+      for (const WhereNode& k : n.kids) if (where_rg_may_match(k, w, md, rg)) return true;
+      return false;
+    case Predicate::Kind::Cmp:
     {
-      auto ymd = ymd_utc_from_ns(cur);
-      const int64_t file_start = ymd_utc_start_ns(ymd.year, ymd.month, ymd.day);
-      const int64_t file_end   = file_start + day_ns;
-
-      // <root>/<kind>_<market>/<SYMB>/<Y>/<M>/bn_<kind>_<market>_<SYMB>_<Y>_<M>_<D>.parquet
-      ostringstream dir;
-      dir << root << '/'
-          << base_type << '_' << mkt << '/'
-          << symb << '/'
-          << ymd.year << '/'
-          << ymd.month << '/'; // non-padded month
-
-      ostringstream file;
-      file << "bn_" << base_type << '_' << mkt << '_' << symb << '_'
-           << ymd.year << '_' << ymd.month << '_' << ymd.day << ".parquet";
+      int64_t alo, ahi;
+      if (!chunk_minmax(md, rg, w.cols[n.a], alo, ahi)) return true;
+      if (n.b < 0) return where_range_may(n.op, alo, ahi, n.value);
+      int64_t blo, bhi;
+      if (!chunk_minmax(md, rg, w.cols[n.b], blo, bhi)) return true;
+      return where_range_may(n.op, __int128(alo) - bhi, __int128(ahi) - blo, n.value);
+    }
+  }
+  return true;
+}
 
-      const string path = dir.str() + file.str();
+// Row ranges (sorted, disjoint) of the pages of one column that may match a
+// plain comparison; {[0, rows)} when the column has no usable page index
+static vector<RowSpan> where_leaf_pages(const WhereNode& n, const WherePlan& w,
+                                        parquet::ParquetFileReader& reader, int rg, int64_t rows)
+{
+  const vector<RowSpan> full{RowSpan{0, rows}};
+  if (n.b >= 0) return full;
+  try
+  {
+    shared_ptr<parquet::PageIndexReader> pir = reader.GetPageIndexReader();
+    if (!pir) return full;
+    shared_ptr<parquet::RowGroupPageIndexReader> rg_pir = pir->RowGroup(rg);
+    if (!rg_pir) return full;
+
+    const int col = w.cols[n.a];
+    shared_ptr<parquet::ColumnIndex> ci = rg_pir->GetColumnIndex(col);
+    shared_ptr<parquet::OffsetIndex> oi = rg_pir->GetOffsetIndex(col);
+    if (!ci || !oi) return full;
+
+    vector<int64_t> mins, maxs;
+    if (auto* i64 = dynamic_cast<parquet::Int64ColumnIndex*>(ci.get()))
+    {
+      mins = i64->min_values();
+      maxs = i64->max_values();
+    }
+    else if (auto* b = dynamic_cast<parquet::BoolColumnIndex*>(ci.get()))
+    {
+      mins.assign(b->min_values().begin(), b->min_values().end());
+      maxs.assign(b->max_values().begin(), b->max_values().end());
+    }
+    else return full;
 
-      debug_try_path(path, file_start, file_end);
-      if (fs::exists(path)) {
-        out.push_back(Candidate{path, file_start, file_end});
-      }
+    const vector<bool>& nulls = ci->null_pages();
+    const vector<parquet::PageLocation>& locs = oi->page_locations();
+    const size_t np = locs.size();
+    if (np == 0 || nulls.size() != np || mins.size() != np || maxs.size() != np) return full;
 
-      cur += day_ns;
+    vector<RowSpan> out;
+    for (size_t p = 0; p < np; ++p)
+    {
+      if (nulls[p] || !where_range_may(n.op, mins[p], maxs[p], n.value)) continue;
+      const int64_t lo = locs[p].first_row_index;
+      const int64_t hi = (p + 1 < np) ? locs[p + 1].first_row_index : rows;
+      if (!out.empty() && out.back().hi == lo) out.back().hi = hi;
+      else out.push_back(RowSpan{lo, hi});
+    }
+    return out;
+  }
+  catch (const exception&)
+  {
+    return full;
+  }
+}
+
+static vector<RowSpan> span_intersect(const vector<RowSpan>& x, const vector<RowSpan>& y)
+{
+  vector<RowSpan> out;
+  size_t i = 0, j = 0;
+  while (i < x.size() && j < y.size())
+  {
+    const int64_t lo = max(x[i].lo, y[j].lo);
+    const int64_t hi = min(x[i].hi, y[j].hi);
+    if (lo < hi) out.push_back(RowSpan{lo, hi});
+    (x[i].hi < y[j].hi) ? ++i : ++j;
+  }
+  return out;
+}
+
+static vector<RowSpan> span_union(const vector<RowSpan>& x, const vector<RowSpan>& y)
+{
+  vector<RowSpan> all(x);
+  all.insert(all.end(), y.begin(), y.end());
+  sort(all.begin(), all.end(), [](const RowSpan& p, const RowSpan& q) { return p.lo < q.lo; });
+  vector<RowSpan> out;
+  for (const RowSpan& s : all)
+  {
+    if (!out.empty() && s.lo <= out.back().hi) out.back().hi = max(out.back().hi, s.hi);
+    else out.push_back(s);
+  }
+  return out;
+}
+
+static vector<RowSpan> where_pages(const WhereNode& n, const WherePlan& w,
+                                   parquet::ParquetFileReader& reader, int rg, int64_t rows)
+{
+  switch (n.kind)
+  {
+    case Predicate::Kind::Cmp: return where_leaf_pages(n, w, reader, rg, rows);
+    case Predicate::Kind::And:
+    case Predicate::Kind::Or:
+    {
+      vector<RowSpan> acc = where_pages(n.kids[0], w, reader, rg, rows);
+      for (size_t k = 1; k < n.kids.size(); ++k)
+      {
+        const vector<RowSpan> nx = where_pages(n.kids[k], w, reader, rg, rows);
+        acc = (n.kind == Predicate::Kind::And) ? span_intersect(acc, nx) : span_union(acc, nx);
+      }
+      return acc;
+    }
+    case Predicate::Kind::All: break;
+  }
+  return {RowSpan{0, rows}};
+}
+
+// Required INT64 or BOOLEAN column over span, widened to int64
+static void read_span_as_i64(parquet::RowGroupReader& rg, int col_idx, const RowSpan& span,
+                             ScratchArena& arena, vector<int64_t>& out)
+{
+  ScopeTimer timer{arena.decode_ns};
+  const int64_t rows = span.hi - span.lo;
+  arena.fit(out, static_cast<size_t>(rows));
+
+  shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
+  auto skip = [&](auto* r)
+  {
+    if (span.lo > 0 && r->Skip(span.lo) != span.lo) throw runtime_error("Short skip in where column");
+  };
+
+  int64_t done = 0;
+  if (auto* r = dynamic_cast<parquet::Int64Reader*>(col.get()))
+  {
+    skip(r);
+    while (done < rows)
+    {
+      int64_t values_read = 0;
+      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr, out.data() + done, &values_read);
+      if (levels == 0 && values_read == 0) break;
+      done += values_read;
+    }
+  }
+  else if (auto* r = dynamic_cast<parquet::BoolReader*>(col.get()))
+  {
+    skip(r);
+    arena.fit(arena.tmp_u8, static_cast<size_t>(rows));
+    while (done < rows)
+    {
+      int64_t values_read = 0;
+      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr,
+                                    reinterpret_cast<bool*>(arena.tmp_u8.data()) + done, &values_read);
+      if (levels == 0 && values_read == 0) break;
+      done += values_read;
+    }
+    for (int64_t i = 0; i < done; ++i) out[i] = arena.tmp_u8[i];
+  }
+  if (done != rows) throw runtime_error("Short read in where column");
+}
+
+template <class F>
+static void where_fill(uint8_t* m, size_t n, F f)
+{
+  for (size_t i = 0; i < n; ++i) m[i] = f(i);
+}
+
+static void where_eval(const WhereNode& nd, size_t n, ScratchArena& arena, size_t depth, uint8_t* m)
+{
+  using Op = Predicate::Op;
+  switch (nd.kind)
+  {
+    case Predicate::Kind::All:
+      memset(m, 1, n);
+      return;
+
+    case Predicate::Kind::Cmp:
+    {
+      const int64_t* a = arena.where_cols[nd.a].data();
+      const int64_t* b = nd.b >= 0 ? arena.where_cols[nd.b].data() : nullptr;
+      const int64_t v = nd.value;
+      // one tight loop per (op, plain|diff)
+      auto run = [&](auto x)
+      {
+        switch (nd.op)
+        {
+          case Op::Lt: where_fill(m, n, [&](size_t i) { return x(i) <  v; }); break;
+          case Op::Le: where_fill(m, n, [&](size_t i) { return x(i) <= v; }); break;
+          case Op::Gt: where_fill(m, n, [&](size_t i) { return x(i) >  v; }); break;
+          case Op::Ge: where_fill(m, n, [&](size_t i) { return x(i) >= v; }); break;
+          case Op::Eq: where_fill(m, n, [&](size_t i) { return x(i) == v; }); break;
+          case Op::Ne: where_fill(m, n, [&](size_t i) { return x(i) != v; }); break;
+        }
+      };
+      if (b) run([&](size_t i) { return __int128(a[i]) - b[i]; });
+      else   run([&](size_t i) { return a[i]; });
+      return;
+    }
+
+    case Predicate::Kind::And:
+    case Predicate::Kind::Or:
+    {
+      // where_masks is sized up front (WherePlan::masks): no reallocation below
+      where_eval(nd.kids[0], n, arena, depth + 1, m);
+      for (size_t k = 1; k < nd.kids.size(); ++k)
+      {
+        vector<uint8_t>& t = arena.where_masks[depth];
+        arena.fit(t, n);
+        where_eval(nd.kids[k], n, arena, depth + 1, t.data());
+        if (nd.kind == Predicate::Kind::And) for (size_t i = 0; i < n; ++i) m[i] &= t[i];
+        else                                 for (size_t i = 0; i < n; ++i) m[i] |= t[i];
+      }
+      return;
+    }
+  }
+}
+
+// arena.sel_rows <- offsets in sub whose ts is in the window and which satisfy w
+static void where_select(parquet::RowGroupReader& rg, const WherePlan& w, const RowSpan& sub,
+                         const int64_t* ts, int64_t start_ns, int64_t end_ns, ScratchArena& arena)
+{
+  const size_t n = static_cast<size_t>(sub.hi - sub.lo);
+  if (arena.where_cols.size() < w.cols.size()) arena.where_cols.resize(w.cols.size());
+  for (size_t k = 0; k < w.cols.size(); ++k) read_span_as_i64(rg, w.cols[k], sub, arena, arena.where_cols[k]);
+
+  arena.fit(arena.where_mask, n);
+  if (arena.where_masks.size() < w.masks) arena.where_masks.resize(w.masks);
+  uint8_t* m = arena.where_mask.data();
+  where_eval(w.root, n, arena, 0, m);
+
+  arena.reserve(arena.sel_rows, n);
+  arena.sel_rows.clear();
+  for (size_t i = 0; i < n; ++i)
+    if (m[i] && ts[i] >= start_ns && ts[i] < end_ns) arena.sel_rows.push_back(static_cast<uint32_t>(i));
+}
+
+// out[k] = src[rows[k]]
+template <class T>
+static void gather_rows(const vector<T>& src, const vector<uint32_t>& rows, vector<T>& out, ScratchArena& arena)
+{
+  arena.fit(out, rows.size());
+  for (size_t k = 0; k < rows.size(); ++k) out[k] = src[rows[k]];
+}
+
+// ======== Date helpers & file mapping (chronological order) ========
+
+struct YMD { int year; int month; int day; };
+
+static YMD ymd_utc_from_ns(int64_t ns)
+{
+  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
+  tm tm{};
+  gmtime_r(&s, &tm);
+  return {tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday};
+}
+
+static int64_t floor_day_ns(int64_t ns)
+{
+  int64_t sec = ns / 1'000'000'000LL;
+  int64_t day_sec = sec - (sec % 86400LL);
+  return day_sec * 1'000'000'000LL;
+}
+
+static int64_t ymd_utc_start_ns(int Y, int M, int D)
+{
+  tm tm{};
+  tm.tm_year = Y - 1900;
+  tm.tm_mon  = M - 1;
+  tm.tm_mday = D;
+  tm.tm_hour = 0; tm.tm_min = 0; tm.tm_sec = 0;
+  time_t s = timegm(&tm); // GNU extension: UTC mktime
+  if (s == (time_t)-1) return 0;
+  return static_cast<int64_t>(s) * 1'000'000'000LL;
+}
+
+static string iso_from_ns(int64_t ns)
+{
+  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
+  tm tm{}; gmtime_r(&s, &tm);
+  ostringstream o;
+  o << setfill('0')
+    << setw(4) << (tm.tm_year + 1900) << '-'
+    << setw(2) << (tm.tm_mon + 1) << '-'
+    << setw(2) << tm.tm_mday << 'T'
+    << setw(2) << tm.tm_hour << ':'
+    << setw(2) << tm.tm_min  << ':'
+    << setw(2) << tm.tm_sec  << 'Z';
+  return o.str();
+}
+
+struct Candidate
+{
+  string  path;
+  int64_t file_start_ns = 0;
+  int64_t file_end_ns   = 0;
+};
+
+static string to_lower(string s) { for (auto& c:s) c=(char)tolower((unsigned char)c); return s; }
+
+// Normalize/accept market input
+static optional<string> norm_market(optional<string> m)
+{
+  if (!m) return nullopt;
+  string s = to_lower(*m);
+  if (s=="futures") s="fut";
+  if (s=="future")  s="fut";
+  if (s=="spot" || s=="fut") return s;
+  return nullopt;
+}
+
+static void debug_try_path(const string& p, int64_t s_ns, int64_t e_ns)
+{
+  if (!g_debug) return;
+  bool ex = fs::exists(p);
+  cerr << "[debug] try: " << p
+       << " [" << iso_from_ns(s_ns) << " .. " << iso_from_ns(e_ns)
+       << "] " << (ex ? "EXISTS" : "missing") << "\n";
+}
+
+static int64_t mtime_stamp(const fs::path& p, error_code& ec)
+{
+  auto t = fs::last_write_time(p, ec);
+  return ec ? 0 : static_cast<int64_t>(t.time_since_epoch().count());
+}
+
+// ======== Compacted month files ========
+// bn_<kind>_<market>_<SYMB>_<Y>_<M>.parquet (parquet_compact) lists the days it
+// merged under "parquet_compact_days" ("1,2,5"); day files of other days, e.g.
+// ones that landed after the merge, are still read next to it.
+
+// Bit d set => day d merged; 0 => not recorded (month file of an older parquet_compact)
+static uint32_t month_file_days(const parquet::FileMetaData& md)
+{
+  auto kv = md.key_value_metadata();
+  if (!kv) return 0;
+  auto v = kv->Get("parquet_compact_days");
+  if (!v.ok()) return 0;
+
+  uint32_t days = 0;
+  istringstream in(*v);
+  string tok;
+  while (getline(in, tok, ','))
+  {
+    const int d = atoi(tok.c_str());
+    if (d >= 1 && d <= 31) days |= 1u << d;
+  }
+  return days;
+}
+
+static uint32_t month_file_days(const string& path)
+{
+  try
+  {
+    unique_ptr<parquet::ParquetFileReader> r = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
+    return month_file_days(*r->metadata());
+  }
+  catch (const exception&)
+  {
+    return 0;   // the reader reports the broken month file itself
+  }
+}
+
+// Day file already inside the month file; without recorded days, any day file
+// not newer than the month file is taken as merged (--keep-days leftovers)
+static bool month_covers(uint32_t days, int64_t month_mtime, int day, int64_t day_mtime)
+{
+  return days ? ((days >> day) & 1u) != 0 : day_mtime <= month_mtime;
+}
+
+// Day at which the month file goes in the candidate order (its first merged day)
+static int month_first_day(uint32_t days)
+{
+  return days ? countr_zero(days) : 1;
+}
+
+// ======== File catalog (optional, per root) ========
+// <root>/.parquet_catalog caches, per month directory, its mtime and the day
+// files in it (size, mtime, rows, ts range from the footer; a compacted month
+// file is day 0 and replaces the day files it merged). A lookup stats the
+// symbol and year directories once and each month directory present once, and
+// stats the cached files of that month (an in-place rewrite keeps the directory
+// mtime); only month directories where either changed are re-listed and only
+// new/changed files get their footer read.
+
+static bool g_catalog = false;
+void ShardedDB::set_catalog(bool enabled) { g_catalog = enabled; }
+
+static const char* const CATALOG_FILE = ".parquet_catalog";
+
+struct CatalogFile
+{
+  int     day      = 0;
+  int64_t size     = 0;
+  int64_t mtime    = 0;
+  int64_t rows     = -1;         // -1 => footer unreadable (kept so the reader reports it)
+  int64_t ts_min   = INT64_MIN;  // unknown range => always a candidate
+  int64_t ts_max   = INT64_MAX;
+  uint32_t days    = 0;          // day 0 only: month_file_days
+};
+
+struct CatalogDir
+{
+  int64_t mtime = 0;
+  vector<CatalogFile> files;     // ascending day
+};
+
+// rows + ts range of one file from its footer (row-group statistics only)
+static void catalog_read_footer(const string& path, CatalogFile& f)
+{
+  try
+  {
+    unique_ptr<parquet::ParquetFileReader> r = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
+    shared_ptr<parquet::FileMetaData> md = r->metadata();
+    f.rows = md->num_rows();
+    if (f.day == 0) f.days = month_file_days(*md);
+
+    const int ts_i = find_col_idx(md->schema(), "ts");
+    if (ts_i < 0 || md->num_row_groups() == 0) return;
+
+    int64_t lo = INT64_MAX, hi = INT64_MIN;
+    for (int rg = 0; rg < md->num_row_groups(); ++rg)
+    {
+      auto cc = md->RowGroup(rg)->ColumnChunk(ts_i);
+      if (!cc->is_stats_set()) return;
+      shared_ptr<parquet::Statistics> st = cc->statistics();
+      auto* i64 = dynamic_cast<parquet::Int64Statistics*>(st.get());
+      if (!i64 || !i64->HasMinMax()) return;
+      lo = min(lo, i64->min());
+      hi = max(hi, i64->max());
+    }
+    f.ts_min = lo;
+    f.ts_max = hi;
+  }
+  catch (const exception&)
+  {
+    f.rows = -1;
+  }
+}
+
+class FileCatalog
+{
+public:
+  explicit FileCatalog(string root)
+  : root_(move(root)), path_(root_ + '/' + CATALOG_FILE) { load(); }
+
+  // Same order and day boundaries as candidate_files_strict; files whose
+  // ts range misses [start_ns, end_ns) are dropped
+  vector<Candidate> lookup(const string& symb, const string& kind, const vector<string>& markets,
+                           int64_t start_ns, int64_t end_ns)
+  {
+    lock_guard<mutex> lk(mu_);
+    vector<Candidate> out;
+
+    const int64_t day_ns = 86'400'000'000'000LL;
+    const YMD first = ymd_utc_from_ns(floor_day_ns(start_ns));
+    const YMD last  = ymd_utc_from_ns(floor_day_ns(end_ns - 1));
+    const int first_day = first.year * 10000 + first.month * 100 + first.day;
+    const int last_day  = last.year * 10000 + last.month * 100 + last.day;
+
+    for (const string& mkt : markets)
+    {
+      const string sym_rel = kind + '_' + mkt + '/' + symb;
+      error_code ec;
+      if (!fs::is_directory(root_ + '/' + sym_rel, ec))
+      {
+        if (g_debug) cerr << "[debug] catalog: " << sym_rel << " missing\n";
+        continue;
+      }
+
+      for (int y = first.year; y <= last.year; ++y)
+      {
+        const string year_rel = sym_rel + '/' + to_string(y);
+        if (!fs::is_directory(root_ + '/' + year_rel, ec)) continue;
+
+        const int m_lo = (y == first.year) ? first.month : 1;
+        const int m_hi = (y == last.year)  ? last.month  : 12;
+        for (int m = m_lo; m <= m_hi; ++m)
+        {
+          const string rel = year_rel + '/' + to_string(m);
+          const CatalogDir* d = month(rel, kind, mkt, symb, y, m);
+          if (!d) continue;
+
+          // day 0: compacted month file, replaces the day files it merged
+          const CatalogFile* mf = d->files.empty() || d->files.front().day != 0 ? nullptr : &d->files.front();
+          bool month_pending = mf && mf->rows != 0 && mf->ts_max >= start_ns && mf->ts_min < end_ns;
+          auto take_month = [&]
+          {
+            const int64_t m_start = ymd_utc_start_ns(y, m, 1);
+            const int64_t m_end   = m == 12 ? ymd_utc_start_ns(y + 1, 1, 1) : ymd_utc_start_ns(y, m + 1, 1);
+            out.push_back(Candidate{root_ + '/' + rel + '/' + month_file(kind, mkt, symb, y, m),
+                                    m_start, m_end});
+            month_pending = false;
+          };
+
+          for (const CatalogFile& f : d->files)
+          {
+            if (f.day == 0) continue;
+            if (month_pending && f.day >= month_first_day(mf->days)) take_month();
+            if (mf && month_covers(mf->days, mf->mtime, f.day, f.mtime)) continue;
+
+            const int key = y * 10000 + m * 100 + f.day;
+            if (key < first_day || key > last_day) continue;
+            if (f.rows == 0) continue;
+            if (f.ts_max < start_ns || f.ts_min >= end_ns) continue;
+
+            const int64_t file_start = ymd_utc_start_ns(y, m, f.day);
+            out.push_back(Candidate{root_ + '/' + rel + '/' + day_file(kind, mkt, symb, y, m, f.day),
+                                    file_start, file_start > INT64_MAX - day_ns ? INT64_MAX : file_start + day_ns});
+          }
+          if (month_pending) take_month();
+        }
+      }
+    }
+
+    if (dirty_) save();
+    return out;
+  }
+
+private:
+  string root_;
+  string path_;
+  mutex mu_;
+  map<string, CatalogDir> dirs_;  // key: <kind>_<market>/<SYMB>/<Y>/<M>
+  bool dirty_ = false;
+
+  static string day_prefix(const string& kind, const string& mkt, const string& symb, int y, int m)
+  {
+    return "bn_" + kind + '_' + mkt + '_' + symb + '_' + to_string(y) + '_' + to_string(m) + '_';
+  }
+
+  static string day_file(const string& kind, const string& mkt, const string& symb, int y, int m, int d)
+  {
+    return day_prefix(kind, mkt, symb, y, m) + to_string(d) + ".parquet";
+  }
+
+  static string month_file(const string& kind, const string& mkt, const string& symb, int y, int m)
+  {
+    return "bn_" + kind + '_' + mkt + '_' + symb + '_' + to_string(y) + '_' + to_string(m) + ".parquet";
+  }
+
+  // Cached entry of one month directory, re-listed when its mtime or a file's size/mtime moved; nullptr if absent
+  const CatalogDir* month(const string& rel, const string& kind, const string& mkt,
+                          const string& symb, int y, int m)
+  {
+    const fs::path dir = root_ + '/' + rel;
+    error_code ec;
+    const int64_t mt = mtime_stamp(dir, ec);
+    if (ec)
+    {
+      if (dirs_.erase(rel)) dirty_ = true;
+      return nullptr;
+    }
+
+    auto it = dirs_.find(rel);
+    if (it != dirs_.end() && it->second.mtime == mt)
+    {
+      // a file rewritten in place leaves the directory mtime alone: check each entry's size + mtime
+      auto same = [&](const CatalogFile& f)
+      {
+        const fs::path p = dir / (f.day == 0 ? month_file(kind, mkt, symb, y, m) : day_file(kind, mkt, symb, y, m, f.day));
+        error_code fec;
+        const auto sz = fs::file_size(p, fec);
+        if (fec || static_cast<int64_t>(sz) != f.size) return false;
+        const int64_t fmt = mtime_stamp(p, fec);
+        return !fec && fmt == f.mtime;
+      };
+      if (all_of(it->second.files.begin(), it->second.files.end(), same))
+      {
+        if (g_debug) cerr << "[debug] catalog: " << rel << " hit (" << it->second.files.size() << " files)\n";
+        return &it->second;
+      }
+      if (g_debug) cerr << "[debug] catalog: " << rel << " file changed in place\n";
+    }
+
+    CatalogDir fresh;
+    fresh.mtime = mt;
+
+    const string prefix = day_prefix(kind, mkt, symb, y, m);
+    const string suffix = ".parquet";
+    const string mname  = month_file(kind, mkt, symb, y, m);
+    for (const fs::directory_entry& e : fs::directory_iterator(dir, ec))
+    {
+      const string name = e.path().filename().string();
+      string dd = "0";   // month file => day 0
+      if (name != mname)
+      {
+        if (name.size() <= prefix.size() + suffix.size()) continue;
+        if (name.compare(0, prefix.size(), prefix) != 0) continue;
+        if (name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) continue;
+
+        dd = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (dd.empty() || dd.size() > 2 || !all_of(dd.begin(), dd.end(), ::isdigit)) continue;
+      }
+
+      error_code fec;
+      if (!e.is_regular_file(fec)) continue;
+
+      CatalogFile f;
+      f.day   = stoi(dd);
+      f.size  = static_cast<int64_t>(e.file_size(fec));
+      f.mtime = mtime_stamp(e.path(), fec);
+
+      // unchanged file: keep its footer summary
+      const CatalogFile* old = nullptr;
+      if (it != dirs_.end())
+        for (const CatalogFile& o : it->second.files)
+          if (o.day == f.day) { old = &o; break; }
+
+      if (old && old->size == f.size && old->mtime == f.mtime && old->rows >= 0)
+        f = *old;
+      else
+        catalog_read_footer(e.path().string(), f);
+
+      fresh.files.push_back(f);
+    }
+
+    sort(fresh.files.begin(), fresh.files.end(),
+         [](const CatalogFile& a, const CatalogFile& b) { return a.day < b.day; });
+
+    if (g_debug) cerr << "[debug] catalog: " << rel << " rescan (" << fresh.files.size() << " files)\n";
+
+    dirty_ = true;
+    CatalogDir& slot = dirs_[rel];
+    slot = move(fresh);
+    return &slot;
+  }
+
+  // "parquet_catalog 2", then per directory: "D <rel> <mtime>" + "F <day> <size> <mtime> <rows> <ts_min> <ts_max> <days>"
+  void load()
+  {
+    ifstream in(path_);
+    if (!in) return;
+
+    string line;
+    if (!getline(in, line) || line != "parquet_catalog 2") return;
+
+    CatalogDir* cur = nullptr;
+    while (getline(in, line))
+    {
+      istringstream ls(line);
+      char tag = 0;
+      ls >> tag;
+      if (tag == 'D')
+      {
+        string rel; int64_t mt = 0;
+        if (!(ls >> rel >> mt)) { dirs_.clear(); return; }
+        cur = &dirs_[rel];
+        cur->mtime = mt;
+      }
+      else if (tag == 'F' && cur)
+      {
+        CatalogFile f;
+        if (!(ls >> f.day >> f.size >> f.mtime >> f.rows >> f.ts_min >> f.ts_max >> f.days)) { dirs_.clear(); return; }
+        cur->files.push_back(f);
+      }
+    }
+  }
+
+  // Best effort (read-only roots keep an in-memory catalog); tmp + rename
+  void save()
+  {
+    const string tmp = path_ + ".tmp";
+    {
+      ofstream out(tmp, ios::trunc);
+      if (!out)
+      {
+        if (g_debug) cerr << "[debug] catalog: cannot write " << tmp << "\n";
+        dirty_ = false;
+        return;
+      }
+      out << "parquet_catalog 2\n";
+      for (const auto& [rel, d] : dirs_)
+      {
+        out << "D " << rel << ' ' << d.mtime << '\n';
+        for (const CatalogFile& f : d.files)
+          out << "F " << f.day << ' ' << f.size << ' ' << f.mtime << ' ' << f.rows
+              << ' ' << f.ts_min << ' ' << f.ts_max << ' ' << f.days << '\n';
+      }
+      if (!out) { dirty_ = false; return; }
+    }
+    error_code ec;
+    fs::rename(tmp, path_, ec);
+    if (ec && g_debug) cerr << "[debug] catalog: cannot replace " << path_ << " : " << ec.message() << "\n";
+    dirty_ = false;
+  }
+};
+
+// ======== Time-range index sidecars (optional, per file) ========
+// <file>.parquet.tsidx: the file's size/mtime, per row group its ts range, first
+// row and byte offset, and for row groups whose ts is sorted a ts sample every
+// sample_rows rows. Readers skip files from the header alone and narrow a row
+// group to the rows between two samples; a stale sidecar is ignored.
+
+static bool g_time_index = false;
+void ShardedDB::set_time_index(bool enabled) { g_time_index = enabled; }
+
+static_assert(endian::native == endian::little, "tsidx sidecars are little-endian records");
+
+static constexpr char TSIDX_MAGIC[8] = {'P', 'Q', 'T', 'S', 'I', 'X', '1', '\0'};
+
+// Sidecar: header, row_groups TsIdxGroup, samples int64 ts
+struct TsIdxHeader
+{
+  char     magic[8];
+  uint64_t src_size;
+  int64_t  src_mtime;
+  int64_t  ts_min;       // over all row groups; INT64_MIN/MAX when unknown
+  int64_t  ts_max;
+  uint64_t rows;
+  uint32_t row_groups;
+  uint32_t sample_rows;
+  uint64_t samples;
+};
+
+struct TsIdxGroup
+{
+  int64_t  ts_min;       // empty row group => INT64_MAX / INT64_MIN
+  int64_t  ts_max;
+  uint64_t first_row;    // in the file
+  int64_t  byte_offset;  // first page of the row group
+  uint64_t rows;
+  uint64_t sample_first; // into the sample array
+  uint64_t samples;      // ts of rows 0, N, 2N, ...; 0 => ts not sorted (or has nulls)
+};
+
+static string tsidx_path(const string& path) { return path + ".tsidx"; }
+
+// Header of a sidecar matching the file's current size and mtime
+static bool tsidx_read_header(const string& path, TsIdxHeader& h, ifstream& in)
+{
+  error_code ec;
+  const uint64_t size = static_cast<uint64_t>(fs::file_size(path, ec));
+  if (ec) return false;
+  const int64_t mtime = mtime_stamp(path, ec);
+  if (ec) return false;
+
+  in.open(tsidx_path(path), ios::binary);
+  if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+  return memcmp(h.magic, TSIDX_MAGIC, sizeof(h.magic)) == 0
+      && h.src_size == size && h.src_mtime == mtime && h.sample_rows > 0;
+}
+
+// File-level skip: a fresh sidecar proves no row falls into [start_ns, end_ns)
+static bool tsidx_file_misses(const string& path, int64_t start_ns, int64_t end_ns)
+{
+  TsIdxHeader h{};
+  ifstream in;
+  if (!tsidx_read_header(path, h, in)) return false;
+  return h.rows == 0 || h.ts_max < start_ns || h.ts_min >= end_ns;
+}
+
+struct TimeIndex
+{
+  uint32_t sample_rows = 0;
+  vector<TsIdxGroup> groups;
+  vector<int64_t> samples;
+
+  bool rg_may_overlap(int rg, int64_t start_ns, int64_t end_ns) const
+  {
+    const TsIdxGroup& g = groups[rg];
+    return !(g.ts_max < start_ns || g.ts_min >= end_ns);
+  }
+
+  // Rows of a sorted row group between the samples bracketing the window
+  RowSpan rg_span(int rg, int64_t start_ns, int64_t end_ns) const
+  {
+    const TsIdxGroup& g = groups[rg];
+    const int64_t rows = static_cast<int64_t>(g.rows);
+    if (g.samples == 0) return RowSpan{0, rows};
+
+    const int64_t* s = samples.data() + g.sample_first;
+    const int64_t* s_end = s + g.samples;
+    const int64_t* k = lower_bound(s, s_end, start_ns);   // ts[(k-1)*N] < start
+    const int64_t* j = lower_bound(k, s_end, end_ns);     // ts[j*N] >= end
+    const int64_t n = sample_rows;
+    RowSpan sp;
+    sp.lo = (k == s) ? 0 : (k - s - 1) * n;
+    sp.hi = (j == s_end) ? rows : min(rows, (j - s) * n);
+    return sp;
+  }
+};
+
+// Sidecar of a file already open as md; null when missing, stale or not matching md
+static shared_ptr<const TimeIndex> load_time_index(const string& path, const parquet::FileMetaData& md)
+{
+  if (!g_time_index) return nullptr;
+
+  TsIdxHeader h{};
+  ifstream in;
+  if (!tsidx_read_header(path, h, in)) return nullptr;
+  if (h.row_groups != static_cast<uint32_t>(md.num_row_groups())
+      || h.rows != static_cast<uint64_t>(md.num_rows()))
+    return nullptr;
+
+  auto ix = make_shared<TimeIndex>();
+  ix->sample_rows = h.sample_rows;
+  ix->groups.resize(h.row_groups);
+  ix->samples.resize(h.samples);
+  in.read(reinterpret_cast<char*>(ix->groups.data()), static_cast<streamsize>(h.row_groups * sizeof(TsIdxGroup)));
+  in.read(reinterpret_cast<char*>(ix->samples.data()), static_cast<streamsize>(h.samples * sizeof(int64_t)));
+  if (!in) return nullptr;
+
+  for (int rg = 0; rg < md.num_row_groups(); ++rg)
+  {
+    const TsIdxGroup& g = ix->groups[rg];
+    if (g.rows != static_cast<uint64_t>(md.RowGroup(rg)->num_rows())
+        || g.sample_first + g.samples > h.samples)
+      return nullptr;
+  }
+  return ix;
+}
+
+bool ShardedDB::build_time_index(const string& parquet_path, uint32_t sample_rows, string* err)
+{
+  const string out_path = tsidx_path(parquet_path);
+  const string tmp = out_path + ".tmp" + to_string(::getpid());
+  try
+  {
+    if (sample_rows == 0) throw runtime_error("sample_rows must be > 0");
+
+    TsIdxHeader h{};
+    memcpy(h.magic, TSIDX_MAGIC, sizeof(h.magic));
+    error_code ec;
+    h.src_size = static_cast<uint64_t>(fs::file_size(parquet_path, ec));
+    if (ec) throw runtime_error(ec.message());
+    h.src_mtime = mtime_stamp(parquet_path, ec);
+    if (ec) throw runtime_error(ec.message());
+
+    unique_ptr<parquet::ParquetFileReader> reader = parquet::ParquetFileReader::OpenFile(parquet_path, /*memory_map=*/false);
+    shared_ptr<parquet::FileMetaData> md = reader->metadata();
+    const int ts_i = find_col_idx(md->schema(), "ts");
+    if (ts_i < 0) throw runtime_error("missing ts");
+    const parquet::ColumnDescriptor* descr = md->schema()->Column(ts_i);
+    if (descr->physical_type() != parquet::Type::INT64 || descr->max_repetition_level() != 0)
+      throw runtime_error("ts is not a flat int64 column");
+
+    h.rows        = static_cast<uint64_t>(md->num_rows());
+    h.row_groups  = static_cast<uint32_t>(md->num_row_groups());
+    h.sample_rows = sample_rows;
+    h.ts_min      = INT64_MAX;
+    h.ts_max      = INT64_MIN;
+
+    vector<TsIdxGroup> groups(h.row_groups);
+    vector<int64_t> samples, ts;
+    vector<int16_t> def;
+    uint64_t first_row = 0;
+
+    for (int rg = 0; rg < md->num_row_groups(); ++rg)
+    {
+      unique_ptr<parquet::RowGroupMetaData> rmd = md->RowGroup(rg);
+      const int64_t rows = rmd->num_rows();
+      TsIdxGroup& g = groups[rg];
+      g.ts_min       = INT64_MAX;
+      g.ts_max       = INT64_MIN;
+      g.first_row    = first_row;
+      g.rows         = static_cast<uint64_t>(rows);
+      g.sample_first = samples.size();
+      g.byte_offset  = rmd->file_offset();
+      if (g.byte_offset <= 0 && rmd->num_columns() > 0)
+      {
+        auto cc = rmd->ColumnChunk(0);
+        g.byte_offset = cc->has_dictionary_page() ? cc->dictionary_page_offset() : cc->data_page_offset();
+      }
+      first_row += g.rows;
+
+      ts.resize(static_cast<size_t>(rows));
+      def.resize(static_cast<size_t>(rows));
+      shared_ptr<parquet::ColumnReader> col = reader->RowGroup(rg)->Column(ts_i);
+      auto* r = static_cast<parquet::Int64Reader*>(col.get());
+      int64_t levels = 0, vals = 0;
+      while (levels < rows)
+      {
+        int64_t got_vals = 0;
+        const int64_t got = r->ReadBatch(rows - levels, def.data() + levels, nullptr, ts.data() + vals, &got_vals);
+        if (got == 0) break;
+        levels += got;
+        vals   += got_vals;
+      }
+      if (levels != rows) throw runtime_error("short read of ts in row group " + to_string(rg));
+
+      if (vals != rows)
+      {
+        // nulls: range and order unknown, never pruned by the sidecar
+        g.ts_min = INT64_MIN;
+        g.ts_max = INT64_MAX;
+      }
+      else if (rows > 0)
+      {
+        const auto [lo, hi] = minmax_element(ts.begin(), ts.end());
+        g.ts_min = *lo;
+        g.ts_max = *hi;
+        if (is_sorted(ts.begin(), ts.end()))
+        {
+          for (int64_t i = 0; i < rows; i += sample_rows) samples.push_back(ts[i]);
+          g.samples = samples.size() - g.sample_first;
+        }
+      }
+      if (rows > 0)
+      {
+        h.ts_min = min(h.ts_min, g.ts_min);
+        h.ts_max = max(h.ts_max, g.ts_max);
+      }
+    }
+    h.samples = samples.size();
+
+    {
+      ofstream out(tmp, ios::binary | ios::trunc);
+      out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+      out.write(reinterpret_cast<const char*>(groups.data()), static_cast<streamsize>(groups.size() * sizeof(TsIdxGroup)));
+      out.write(reinterpret_cast<const char*>(samples.data()), static_cast<streamsize>(samples.size() * sizeof(int64_t)));
+      if (!out) throw runtime_error("write failed: " + tmp);
+    }
+    fs::rename(tmp, out_path);   // readers never see a partial sidecar
+    return true;
+  }
+  catch (const exception& ex)
+  {
+    error_code ec;
+    fs::remove(tmp, ec);
+    if (err) *err = ex.what();
+    return false;
+  }
+}
+
+bool ShardedDB::time_index_fresh(const string& parquet_path)
+{
+  TsIdxHeader h{};
+  ifstream in;
+  return tsidx_read_header(parquet_path, h, in);
+}
+
+// STRICT layout only:
+//   <root>/<kind>_<market>/<SYMB>/<Y>/<M>/bn_<kind>_<market>_<SYMB>_<Y>_<M>_<D>.parquet
+// Non-padded month/day (e.g., 2025/9/3)
+// kind: "top" | "trade" | "depth"
+static vector<Candidate> candidate_files_strict(const string& root,
+                                                const string& symb,
+                                                const string& base_type,
+                                                optional<string> market,
+                                                int64_t start_ns,
+                                                int64_t end_ns,
+                                                const optional<string>& sampling,
+                                                FileCatalog* catalog = nullptr)
+{
+  vector<Candidate> out;
+  if (start_ns >= end_ns) return out;
+
+  // sampling not used in strict layout; warn in debug to avoid confusion
+  if (g_debug && sampling.has_value()) {
+    cerr << "[debug] note: --sampling is ignored for strict layout discovery\n";
+  }
+
+  vector<string> markets;
+  if (market) {
+    auto nm = norm_market(market);
+    if (!nm) throw runtime_error("market must be 'fut' or 'spot'");
+    markets.push_back(*nm);
+  } else {
+    markets = {"fut","spot"}; // backward-compatible overloads search both
+  }
+
+  if (catalog)
+  {
+    out = catalog->lookup(symb, base_type, markets, start_ns, end_ns);
+  }
+  else
+  {
+    const int64_t day_ns = 86'400'000'000'000LL;
+    int64_t cur = floor_day_ns(start_ns);
+    const int64_t end_floor = floor_day_ns(end_ns - 1);
+
+    for (const string& mkt : markets)
+    {
+      int month_key = -1;          // month of the previous day
+      string month_path;           // that month's compacted file
+      bool month_exists  = false;
+      bool month_pending = false;  // month file not yet placed in `out`
+      uint32_t month_days = 0;
+      int64_t month_mtime = 0;
+      int64_t month_start = 0, month_end = 0;
+
+      auto take_month = [&]
+      {
+        debug_try_path(month_path, month_start, month_end);
+        out.push_back(Candidate{month_path, month_start, month_end});
+        month_pending = false;
+      };
+
+      while (cur <= end_floor)
+      {
+        auto ymd = ymd_utc_from_ns(cur);
+        const int64_t file_start = ymd_utc_start_ns(ymd.year, ymd.month, ymd.day);
+        const int64_t file_end   = file_start > INT64_MAX - day_ns ? INT64_MAX : file_start + day_ns;
+
+        // <root>/<kind>_<market>/<SYMB>/<Y>/<M>/bn_<kind>_<market>_<SYMB>_<Y>_<M>_<D>.parquet
+        ostringstream dir;
+        dir << root << '/'
+            << base_type << '_' << mkt << '/'
+            << symb << '/'
+            << ymd.year << '/'
+            << ymd.month << '/'; // non-padded month
+
+        // bn_<kind>_<market>_<SYMB>_<Y>_<M>.parquet (parquet_compact) replaces the day files it merged
+        if (ymd.year * 100 + ymd.month != month_key)
+        {
+          if (month_pending) take_month();
+          month_key = ymd.year * 100 + ymd.month;
+
+          ostringstream mfile;
+          mfile << "bn_" << base_type << '_' << mkt << '_' << symb << '_'
+                << ymd.year << '_' << ymd.month << ".parquet";
+          error_code ec;
+          month_path    = dir.str() + mfile.str();
+          month_mtime   = mtime_stamp(month_path, ec);
+          month_exists  = !ec;
+          month_pending = month_exists;
+          month_days    = month_exists ? month_file_days(month_path) : 0;
+          month_start   = ymd_utc_start_ns(ymd.year, ymd.month, 1);
+          month_end     = ymd.month == 12 ? ymd_utc_start_ns(ymd.year + 1, 1, 1)
+                                          : ymd_utc_start_ns(ymd.year, ymd.month + 1, 1);
+        }
+        if (month_pending && ymd.day >= month_first_day(month_days)) take_month();
+
+        ostringstream file;
+        file << "bn_" << base_type << '_' << mkt << '_' << symb << '_'
+             << ymd.year << '_' << ymd.month << '_' << ymd.day << ".parquet";
+
+        const string path = dir.str() + file.str();
+
+        debug_try_path(path, file_start, file_end);
+        error_code ec;
+        const int64_t day_mtime = mtime_stamp(path, ec);
+        if (!ec && !(month_exists && month_covers(month_days, month_mtime, ymd.day, day_mtime))) {
+          out.push_back(Candidate{path, file_start, file_end});
+        }
+
+        if (end_floor - cur < day_ns) break;   // last day; cur + day_ns would wrap near INT64_MAX
+        cur += day_ns;
+      }
+      if (month_pending) take_month();
+
+      // reset day cursor for next market
+      cur = floor_day_ns(start_ns);
     }
-
-    // reset day cursor for next market
-    cur = floor_day_ns(start_ns);
   }
 
   if (g_debug) {
@@ -416,31 +1901,628 @@ static vector<Candidate> candidate_files_strict(const string& root,
   return out;
 }
 
-// ======== RowGroup -> column vectors (decode once per RG) ========
+// ======== Decoded-column cache (top / trade) ========
+
+static ColumnCache g_cache{};
+static mutex g_cache_mu;   // one store + eviction at a time within the process
+void ShardedDB::set_column_cache(const ColumnCache& cfg) { g_cache = cfg; }
+
+static_assert(endian::native == endian::little, "column cache entries are little-endian arrays");
+
+// Entry file: header, key ("<abs path>\n<column>"), zero pad, rows * elem raw values
+struct CacheHeader
+{
+  char     magic[8];
+  uint64_t src_size;
+  int64_t  src_mtime;
+  uint64_t rows;
+  uint32_t elem;       // bytes per value
+  uint32_t sorted;     // values non-decreasing
+  uint64_t key_len;
+  uint64_t data_off;   // 64-byte aligned
+};
+
+static constexpr char CACHE_MAGIC[8] = {'P', 'Q', 'C', 'O', 'L', '0', '1', '\0'};
+
+// The source file an entry must match
+struct SourceStamp
+{
+  string   path;   // absolute
+  uint64_t size  = 0;
+  int64_t  mtime = 0;
+};
+
+// One column of a whole file: a read-only mapping, or the vector just decoded
+struct CachedColumn
+{
+  shared_ptr<const void> keep;
+  const void* data = nullptr;
+  uint64_t rows = 0;
+  bool sorted = false;
+};
+
+static bool source_stamp(const string& path, SourceStamp& out)
+{
+  error_code ec;
+  out.path = fs::absolute(path, ec).lexically_normal().string();
+  if (ec) return false;
+  out.size = static_cast<uint64_t>(fs::file_size(path, ec));
+  if (ec) return false;
+  out.mtime = mtime_stamp(path, ec);
+  return !ec;
+}
+
+// <dir>/<fnv1a64(key)>.col
+static fs::path cache_entry_path(const string& key)
+{
+  uint64_t h = 1469598103934665603ull;
+  for (unsigned char c : key) { h ^= c; h *= 1099511628211ull; }
+  ostringstream name;
+  name << hex << setw(16) << setfill('0') << h << ".col";
+  return fs::path(g_cache.dir) / name.str();
+}
+
+// Maps a still-valid entry and bumps its mtime (the LRU clock)
+static bool cache_open(const SourceStamp& src, const char* column, uint32_t elem, CachedColumn& out)
+{
+#if defined(__linux__)
+  const string key  = src.path + "\n" + column;
+  const string path = cache_entry_path(key).string();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st{};
+  void* base = MAP_FAILED;
+  size_t len = 0;
+  if (::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(CacheHeader)))
+  {
+    len  = static_cast<size_t>(st.st_size);
+    base = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  if (base != MAP_FAILED) ::futimens(fd, nullptr);
+  ::close(fd);
+  if (base == MAP_FAILED) return false;
+
+  // eviction may unlink the file meanwhile; the mapping stays valid
+  shared_ptr<const void> keep(base, [len](const void* p) { ::munmap(const_cast<void*>(p), len); });
+
+  CacheHeader h;
+  memcpy(&h, base, sizeof(h));
+  const char* bytes = static_cast<const char*>(base);
+  const bool ok = memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) == 0
+               && h.src_size == src.size && h.src_mtime == src.mtime && h.elem == elem
+               && h.key_len == key.size() && sizeof(h) + h.key_len <= h.data_off
+               && h.data_off <= len && h.rows <= (len - h.data_off) / elem
+               && memcmp(bytes + sizeof(h), key.data(), key.size()) == 0;
+  if (!ok) return false;
+
+  ::madvise(base, len, MADV_WILLNEED);
+  out.keep   = move(keep);
+  out.data   = bytes + h.data_off;
+  out.rows   = h.rows;
+  out.sorted = h.sorted != 0;
+  return true;
+#else
+  (void)src; (void)column; (void)elem; (void)out;
+  return false;
+#endif
+}
+
+// Least recently touched entries go until the directory fits max_bytes
+static void cache_evict_locked()
+{
+  struct Entry { fs::file_time_type t; uintmax_t size; fs::path path; };
+  vector<Entry> entries;
+  uintmax_t total = 0;
+
+  for (const auto& de : fs::directory_iterator(g_cache.dir))
+  {
+    if (de.path().extension() != ".col") continue;
+    error_code e1, e2;
+    Entry en{de.last_write_time(e1), de.file_size(e2), de.path()};
+    if (e1 || e2) continue;
+    total += en.size;
+    entries.push_back(move(en));
+  }
+  if (total <= g_cache.max_bytes) return;
+
+  sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.t < b.t; });
+  for (const Entry& en : entries)
+  {
+    if (total <= g_cache.max_bytes) break;
+    error_code ec;
+    if (fs::remove(en.path, ec)) total -= en.size;
+  }
+}
+
+// Best effort: a failed write only leaves the column uncached
+static void cache_store(const SourceStamp& src, const char* column, const CachedColumn& c, uint32_t elem)
+{
+  const string key = src.path + "\n" + column;
+
+  CacheHeader h{};
+  memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+  h.src_size  = src.size;
+  h.src_mtime = src.mtime;
+  h.rows      = c.rows;
+  h.elem      = elem;
+  h.sorted    = c.sorted ? 1 : 0;
+  h.key_len   = key.size();
+  h.data_off  = (sizeof(h) + key.size() + 63) / 64 * 64;
+
+  const fs::path path = cache_entry_path(key);
+  fs::path tmp = path;
+  tmp += ".tmp" + to_string(::getpid());
+
+  lock_guard<mutex> lk(g_cache_mu);
+  try
+  {
+    fs::create_directories(g_cache.dir);
+    {
+      ofstream out(tmp, ios::binary | ios::trunc);
+      const string pad(h.data_off - sizeof(h) - key.size(), '\0');
+      out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+      out.write(key.data(), static_cast<streamsize>(key.size()));
+      out.write(pad.data(), static_cast<streamsize>(pad.size()));
+      out.write(static_cast<const char*>(c.data), static_cast<streamsize>(c.rows * elem));
+      if (!out) throw runtime_error("write failed: " + tmp.string());
+    }
+    fs::rename(tmp, path);   // readers never see a partial entry
+    cache_evict_locked();
+  }
+  catch (const exception& ex)
+  {
+    error_code ec;
+    fs::remove(tmp, ec);
+    if (g_debug) cerr << "[debug] column cache: " << ex.what() << "\n";
+  }
+}
+
+// Mapped entry if valid, else decode(vector<T>&) the whole file's column,
+// store it and serve the decoded vector
+template <class T, class Decode>
+static CachedColumn cached_column(const SourceStamp& src, const char* column, Decode&& decode, ScanStats& st)
+{
+  CachedColumn c;
+  if (cache_open(src, column, sizeof(T), c))
+  {
+    ++st.cache_columns_hit;
+    return c;
+  }
+
+  auto vals = make_shared<vector<T>>();
+  decode(*vals);
+  c.data   = vals->data();
+  c.rows   = vals->size();
+  c.sorted = is_sorted(vals->begin(), vals->end());
+  cache_store(src, column, c, sizeof(T));
+  c.keep = move(vals);
+  ++st.cache_columns_stored;
+  return c;
+}
+
+// What the column-cache path produced for a streamer's next batch
+enum class CacheRead
+{
+  Off,     // not usable for this file: decode row groups instead
+  Batch,   // the file's whole window, viewed from cached columns
+  Done     // already served (or nothing in the window)
+};
+
+// ======== RowGroup -> column vectors (decode once per RG) ========
+
+// One selectable column of a streamer: name (nullptr => not selected), plan index, destination
+template <class T>
+struct SelCol
+{
+  const char* name;
+  int idx;
+  vector<T>* out;
+};
+
+struct FileStreamerTopCols
+{
+  unique_ptr<parquet::ParquetFileReader> reader;
+  shared_ptr<parquet::FileMetaData> md;
+  const parquet::SchemaDescriptor* schema = nullptr;
+  int rg_idx = 0;
+  ScratchArena* arena = nullptr;
+  shared_ptr<CountedFile> io;
+  uint64_t open_ns = 0;
+  uint64_t metadata_ns = 0;
+  shared_ptr<const TopPlan> plan;
+  WherePlan where;
+  string src_path;
+  shared_ptr<const TimeIndex> tix;   // set_time_index and a fresh sidecar
+  bool cache_tried = false;
+  bool cache_served = false;
+
+  FileStreamerTopCols(string path, ScratchArena& scratch,
+                      shared_ptr<arrow::io::RandomAccessFile> input = nullptr)
+  :
+    arena(&scratch), src_path(path)
+  {
+    //cerr << path << endl; // print file when processing
+    OpenedParquet op = open_counted(path, move(input));
+    reader      = move(op.reader);
+    io          = move(op.io);
+    open_ns     = op.open_ns;
+    metadata_ns = op.metadata_ns;
+    md     = reader->metadata();
+    schema = md->schema();
+    plan   = plan_for<TopPlan>(schema);
+    tix    = load_time_index(src_path, *md);
+  }
+
+  // Row-group stats, then sidecar samples and page index: false => nothing in window, skip the RG
+  bool plan_rg(int rg, int ts_i, int64_t start_ns, int64_t end_ns, RowSpan& span, ScanStats& st)
+  {
+    if (!rg_ts_may_overlap(*md, rg, ts_i, start_ns, end_ns)
+        || (tix && !tix->rg_may_overlap(rg, start_ns, end_ns)))
+    {
+      ++st.row_groups_skipped;
+      return false;
+    }
+
+    if (where.active() && !where_rg_may_match(where.root, where, *md, rg))
+    {
+      ++st.row_groups_skipped;
+      return false;
+    }
+
+    const int64_t rows = md->RowGroup(rg)->num_rows();
+    const RowSpan ix = tix ? tix->rg_span(rg, start_ns, end_ns) : RowSpan{0, rows};
+    span = ts_page_span(*reader, rg, ts_i, rows, start_ns, end_ns);
+    span = RowSpan{max(span.lo, ix.lo), min(span.hi, ix.hi)};
+    if (where.active() && span.lo < span.hi)
+    {
+      // decode spans are contiguous: keep the hull of the predicate's pages
+      const vector<RowSpan> pages = where_pages(where.root, where, *reader, rg, rows);
+      if (pages.empty()) span = RowSpan{0, 0};
+      else span = RowSpan{max(span.lo, pages.front().lo), min(span.hi, pages.back().hi)};
+    }
+    if (span.lo >= span.hi)
+    {
+      ++st.row_groups_skipped;
+      return false;
+    }
+
+    ++st.row_groups_decoded;
+    st.rows_skipped_by_index      += static_cast<uint64_t>(rows - (ix.hi - ix.lo));
+    st.rows_skipped_by_page_index += static_cast<uint64_t>((ix.hi - ix.lo) - (span.hi - span.lo));
+    return true;
+  }
+
+  // Rows of span the predicate path decodes: the ts window's [lo, hi) when ts is sorted
+  RowSpan where_sub(int rg, int ts_i, const RowSpan& span, const vector<int64_t>& v_ts,
+                    int64_t start_ns, int64_t end_ns) const
+  {
+    if (!ts_sorted(*md, rg, ts_i, v_ts)) return span;
+    const RowSpan hit = sorted_hit(v_ts, start_ns, end_ns);
+    return RowSpan{span.lo + hit.lo, span.lo + hit.hi};
+  }
+
+  void read_required_i64_column(
+      parquet::RowGroupReader& rg, int col_idx, const RowSpan& span, vector<int64_t>& out)
+  {
+    ScopeTimer timer{arena->decode_ns};
+    const int64_t rows = span.hi - span.lo;
+    arena->fit(out, static_cast<size_t>(rows));
+
+    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
+    auto* r = static_cast<parquet::Int64Reader*>(col.get());
+    if (span.lo > 0 && r->Skip(span.lo) != span.lo) throw runtime_error("Short skip in required column");
+
+    int64_t done = 0;
+    while (done < rows)
+    {
+      int64_t values_read = 0;
+      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr, out.data() + done, &values_read);
+      if (levels == 0 && values_read == 0) break;
+      done += values_read;
+    }
+
+    if (done != rows) throw runtime_error("Short read in required column");
+  }
+
+  // Whole-file [start, end) window as one batch viewed from cached columns.
+  // Off when the cache is disabled, a where predicate is set, or ts is not
+  // sorted across the file.
+  CacheRead from_cache(int64_t start_ns, int64_t end_ns, const TopSelect& sel, TopColsView& v,
+                       vector<shared_ptr<const void>>& keep, size_t& n, ScanStats& st)
+  {
+    if (cache_tried) return cache_served ? CacheRead::Done : CacheRead::Off;
+    cache_tried = true;
+    if (g_cache.dir.empty()) return CacheRead::Off;
+
+    where_prepare(where, sel.where, schema);
+    if (where.active()) return CacheRead::Off;
+
+    SourceStamp src;
+    if (!source_stamp(src_path, src)) return CacheRead::Off;
+
+    auto whole = [this](int idx)
+    {
+      return [this, idx](vector<int64_t>& out)
+      {
+        for (int rg = 0; rg < md->num_row_groups(); ++rg)
+        {
+          read_required_i64_column(*reader->RowGroup(rg), idx,
+                                   RowSpan{0, md->RowGroup(rg)->num_rows()}, arena->tmp_i64);
+          out.insert(out.end(), arena->tmp_i64.begin(), arena->tmp_i64.end());
+        }
+      };
+    };
+    const uint64_t rows = static_cast<uint64_t>(md->num_rows());
+
+    if (plan->ts < 0) throw runtime_error("top: missing ts");
+    const CachedColumn ts = cached_column<int64_t>(src, "ts", whole(plan->ts), st);
+    if (!ts.sorted || ts.rows != rows) return CacheRead::Off;
+
+    const int64_t* t  = static_cast<const int64_t*>(ts.data);
+    const int64_t* lo = lower_bound(t, t + ts.rows, start_ns);
+    const int64_t* hi = lower_bound(lo, t + ts.rows, end_ns);
+    const size_t off  = static_cast<size_t>(lo - t);
+
+    struct Col { const char* name; int idx; const int64_t** out; };
+    const Col cols[] = {
+      {sel.ask_px     ? "ask_px"     : nullptr, plan->ask_px,     &v.ask_px},
+      {sel.ask_qty    ? "ask_qty"    : nullptr, plan->ask_qty,    &v.ask_qty},
+      {sel.bid_px     ? "bid_px"     : nullptr, plan->bid_px,     &v.bid_px},
+      {sel.bid_qty    ? "bid_qty"    : nullptr, plan->bid_qty,    &v.bid_qty},
+      {sel.valu       ? "valu"       : nullptr, plan->valu,       &v.valu},
+      {sel.min_bid_px ? "min_bid_px" : nullptr, plan->min_bid_px, &v.min_bid_px},
+      {sel.max_bid_px ? "max_bid_px" : nullptr, plan->max_bid_px, &v.max_bid_px},
+      {sel.min_ask_px ? "min_ask_px" : nullptr, plan->min_ask_px, &v.min_ask_px},
+      {sel.max_ask_px ? "max_ask_px" : nullptr, plan->max_ask_px, &v.max_ask_px},
+      {sel.min_bid_ts ? "min_bid_ts" : nullptr, plan->min_bid_ts, &v.min_bid_ts},
+      {sel.max_bid_ts ? "max_bid_ts" : nullptr, plan->max_bid_ts, &v.max_bid_ts},
+      {sel.min_ask_ts ? "min_ask_ts" : nullptr, plan->min_ask_ts, &v.min_ask_ts},
+      {sel.max_ask_ts ? "max_ask_ts" : nullptr, plan->max_ask_ts, &v.max_ask_ts},
+    };
+    for (const auto& c : cols)
+      if (c.name && c.idx < 0) throw runtime_error(string("top: missing ") + c.name);
+
+    cache_served = true;
+    if (lo == hi) return CacheRead::Done;
+
+    v = TopColsView{};
+    keep.clear();
+    if (sel.ts) v.ts = lo;
+    keep.push_back(ts.keep);
+    for (const auto& c : cols)
+    {
+      if (!c.name) continue;
+      const CachedColumn col = cached_column<int64_t>(src, c.name, whole(c.idx), st);
+      if (col.rows != rows) throw runtime_error(string("top: cached column length mismatch: ") + c.name);
+      *c.out = static_cast<const int64_t*>(col.data) + off;
+      keep.push_back(col.keep);
+    }
+    n = static_cast<size_t>(hi - lo);
+    return CacheRead::Batch;
+  }
+
+  // Decoded ts lands in v_ts; the batch is v_ts[ts_off, ts_off + n) while the
+  // other selected columns hold exactly n rows.
+  bool next_rg(
+      int64_t start_ns, int64_t end_ns, const TopSelect& sel,
+      vector<int64_t>& v_ts, vector<int64_t>& v_apx, vector<int64_t>& v_aq,
+      vector<int64_t>& v_bpx, vector<int64_t>& v_bq, vector<int64_t>& v_val,
+      // sampled extras
+      vector<int64_t>& v_min_bpx, vector<int64_t>& v_max_bpx,
+      vector<int64_t>& v_min_apx, vector<int64_t>& v_max_apx,
+      vector<int64_t>& v_min_bts, vector<int64_t>& v_max_bts,
+      vector<int64_t>& v_min_ats, vector<int64_t>& v_max_ats,
+      size_t& ts_off, size_t& n,
+      ScanStats& st)
+  {
+    while (true)
+    {
+      if (rg_idx >= md->num_row_groups()) return false;
+
+      const int cur_rg = rg_idx++;
+
+      const int ts_i = plan->ts;
+      if (ts_i < 0) throw runtime_error("top: missing ts");
+      where_prepare(where, sel.where, schema);
+
+      RowSpan span;
+      if (!plan_rg(cur_rg, ts_i, start_ns, end_ns, span, st)) continue;
+
+      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(cur_rg);
+
+      read_required_i64_column(*rg, ts_i, span, v_ts);
+
+      // Selected columns (name == nullptr => not selected)
+      const SelCol<int64_t> cols[] = {
+        {sel.ask_px     ? "ask_px"     : nullptr, plan->ask_px,     &v_apx},
+        {sel.ask_qty    ? "ask_qty"    : nullptr, plan->ask_qty,    &v_aq},
+        {sel.bid_px     ? "bid_px"     : nullptr, plan->bid_px,     &v_bpx},
+        {sel.bid_qty    ? "bid_qty"    : nullptr, plan->bid_qty,    &v_bq},
+        {sel.valu       ? "valu"       : nullptr, plan->valu,       &v_val},
+        {sel.min_bid_px ? "min_bid_px" : nullptr, plan->min_bid_px, &v_min_bpx},
+        {sel.max_bid_px ? "max_bid_px" : nullptr, plan->max_bid_px, &v_max_bpx},
+        {sel.min_ask_px ? "min_ask_px" : nullptr, plan->min_ask_px, &v_min_apx},
+        {sel.max_ask_px ? "max_ask_px" : nullptr, plan->max_ask_px, &v_max_apx},
+        {sel.min_bid_ts ? "min_bid_ts" : nullptr, plan->min_bid_ts, &v_min_bts},
+        {sel.max_bid_ts ? "max_bid_ts" : nullptr, plan->max_bid_ts, &v_max_bts},
+        {sel.min_ask_ts ? "min_ask_ts" : nullptr, plan->min_ask_ts, &v_min_ats},
+        {sel.max_ask_ts ? "max_ask_ts" : nullptr, plan->max_ask_ts, &v_max_ats},
+      };
+      for (const auto& c : cols)
+        if (c.name && c.idx < 0) throw runtime_error(string("top: missing ") + c.name);
+
+      if (where.active())
+      {
+        const RowSpan sub = where_sub(cur_rg, ts_i, span, v_ts, start_ns, end_ns);
+        if (sub.lo == sub.hi) continue;
+
+        where_select(*rg, where, sub, v_ts.data() + (sub.lo - span.lo), start_ns, end_ns, *arena);
+        const vector<uint32_t>& rows = arena->sel_rows;
+        if (rows.empty()) continue;
+
+        const size_t base = static_cast<size_t>(sub.lo - span.lo);
+        for (size_t k = 0; k < rows.size(); ++k) v_ts[k] = v_ts[base + rows[k]];
+        for (const auto& c : cols)
+        {
+          if (!c.name) { c.out->clear(); continue; }
+          read_required_i64_column(*rg, c.idx, sub, arena->tmp_i64);
+          gather_rows(arena->tmp_i64, rows, *c.out, *arena);
+        }
+
+        ts_off = 0;
+        n      = rows.size();
+        return true;
+      }
+
+      // Fast path: sorted ts => one contiguous [lo, hi), decode it in place
+      if (ts_sorted(*md, cur_rg, ts_i, v_ts))
+      {
+        const RowSpan hit = sorted_hit(v_ts, start_ns, end_ns);
+        if (hit.lo == hit.hi) continue;
+
+        ts_off = static_cast<size_t>(hit.lo);
+        n      = static_cast<size_t>(hit.hi - hit.lo);
+
+        const RowSpan sub{span.lo + hit.lo, span.lo + hit.hi};
+        for (const auto& c : cols)
+        {
+          if (c.name) read_required_i64_column(*rg, c.idx, sub, *c.out);
+          else c.out->clear();
+        }
+        return true;
+      }
+
+      // Fallback (unsorted ts): filter + scatter
+      vector<int64_t>& ts_all = arena->ts_all;
+      ts_all.swap(v_ts);
+
+      size_t cnt = 0;
+      for (int64_t t : ts_all) if (t >= start_ns && t < end_ns) ++cnt;
+      if (cnt == 0) continue;
+
+      arena->fit(v_ts, cnt);
+      {
+        size_t w = 0;
+        for (size_t i = 0; i < ts_all.size(); ++i) {
+          int64_t t = ts_all[i];
+          if (t >= start_ns && t < end_ns) v_ts[w++] = t;
+        }
+      }
+
+      vector<int64_t>& tmp = arena->tmp_i64;
+      for (const auto& c : cols)
+      {
+        if (!c.name) { c.out->clear(); continue; }
+        arena->fit(*c.out, cnt);
+        read_required_i64_column(*rg, c.idx, span, tmp);
+
+        size_t w = 0;
+        for (size_t i = 0; i < ts_all.size(); ++i) {
+          int64_t t = ts_all[i];
+          if (t >= start_ns && t < end_ns) (*c.out)[w++] = tmp[i];
+        }
+      }
+
+      ts_off = 0;
+      n      = cnt;
+      return true;
+    }
+  }
+};
+
+struct FileStreamerTradeCols
+{
+  unique_ptr<parquet::ParquetFileReader> reader;
+  shared_ptr<parquet::FileMetaData> md;
+  const parquet::SchemaDescriptor* schema = nullptr;
+  int rg_idx = 0;
+  ScratchArena* arena = nullptr;
+  shared_ptr<CountedFile> io;
+  uint64_t open_ns = 0;
+  uint64_t metadata_ns = 0;
+  shared_ptr<const TradePlan> plan;
+  WherePlan where;
+  string src_path;
+  shared_ptr<const TimeIndex> tix;   // set_time_index and a fresh sidecar
+  bool cache_tried = false;
+  bool cache_served = false;
+
+  FileStreamerTradeCols(string path, ScratchArena& scratch,
+                        shared_ptr<arrow::io::RandomAccessFile> input = nullptr)
+  :
+    arena(&scratch), src_path(path)
+  {
+    //cerr << path << endl;
+    OpenedParquet op = open_counted(path, move(input));
+    reader      = move(op.reader);
+    io          = move(op.io);
+    open_ns     = op.open_ns;
+    metadata_ns = op.metadata_ns;
+    md     = reader->metadata();
+    schema = md->schema();
+    plan   = plan_for<TradePlan>(schema);
+    tix    = load_time_index(src_path, *md);
+  }
+
+  // Row-group stats, then sidecar samples and page index: false => nothing in window, skip the RG
+  bool plan_rg(int rg, int ts_i, int64_t start_ns, int64_t end_ns, RowSpan& span, ScanStats& st)
+  {
+    if (!rg_ts_may_overlap(*md, rg, ts_i, start_ns, end_ns)
+        || (tix && !tix->rg_may_overlap(rg, start_ns, end_ns)))
+    {
+      ++st.row_groups_skipped;
+      return false;
+    }
+
+    if (where.active() && !where_rg_may_match(where.root, where, *md, rg))
+    {
+      ++st.row_groups_skipped;
+      return false;
+    }
+
+    const int64_t rows = md->RowGroup(rg)->num_rows();
+    const RowSpan ix = tix ? tix->rg_span(rg, start_ns, end_ns) : RowSpan{0, rows};
+    span = ts_page_span(*reader, rg, ts_i, rows, start_ns, end_ns);
+    span = RowSpan{max(span.lo, ix.lo), min(span.hi, ix.hi)};
+    if (where.active() && span.lo < span.hi)
+    {
+      // decode spans are contiguous: keep the hull of the predicate's pages
+      const vector<RowSpan> pages = where_pages(where.root, where, *reader, rg, rows);
+      if (pages.empty()) span = RowSpan{0, 0};
+      else span = RowSpan{max(span.lo, pages.front().lo), min(span.hi, pages.back().hi)};
+    }
+    if (span.lo >= span.hi)
+    {
+      ++st.row_groups_skipped;
+      return false;
+    }
 
-struct FileStreamerTopCols
-{
-  unique_ptr<parquet::ParquetFileReader> reader;
-  shared_ptr<parquet::FileMetaData> md;
-  const parquet::SchemaDescriptor* schema = nullptr;
-  int rg_idx = 0;
+    ++st.row_groups_decoded;
+    st.rows_skipped_by_index      += static_cast<uint64_t>(rows - (ix.hi - ix.lo));
+    st.rows_skipped_by_page_index += static_cast<uint64_t>((ix.hi - ix.lo) - (span.hi - span.lo));
+    return true;
+  }
 
-  explicit FileStreamerTopCols(string path)
+  // Rows of span the predicate path decodes: the ts window's [lo, hi) when ts is sorted
+  RowSpan where_sub(int rg, int ts_i, const RowSpan& span, const vector<int64_t>& v_ts,
+                    int64_t start_ns, int64_t end_ns) const
   {
-    //cerr << path << endl; // print file when processing
-    reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
-    md     = reader->metadata();
-    schema = md->schema();
+    if (!ts_sorted(*md, rg, ts_i, v_ts)) return span;
+    const RowSpan hit = sorted_hit(v_ts, start_ns, end_ns);
+    return RowSpan{span.lo + hit.lo, span.lo + hit.hi};
   }
 
-  static void read_required_i64_column(
-      parquet::RowGroupReader& rg, int col_idx, vector<int64_t>& out)
+  void read_required_i64_column(
+      parquet::RowGroupReader& rg, int col_idx, const RowSpan& span, vector<int64_t>& out)
   {
-    const int64_t rows = rg.metadata()->num_rows();
-    out.resize(rows);
+    ScopeTimer timer{arena->decode_ns};
+    const int64_t rows = span.hi - span.lo;
+    arena->fit(out, static_cast<size_t>(rows));
 
     shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
     auto* r = static_cast<parquet::Int64Reader*>(col.get());
+    if (span.lo > 0 && r->Skip(span.lo) != span.lo) throw runtime_error("Short skip in required column");
 
     int64_t done = 0;
     while (done < rows)
@@ -454,48 +2536,216 @@ struct FileStreamerTopCols
     if (done != rows) throw runtime_error("Short read in required column");
   }
 
+  void read_required_bool_column(
+      parquet::RowGroupReader& rg, int col_idx, const RowSpan& span, vector<uint8_t>& out)
+  {
+    ScopeTimer timer{arena->decode_ns};
+    static_assert(sizeof(bool) == 1, "bool must be 1 byte");
+    const int64_t rows = span.hi - span.lo;
+    arena->fit(out, static_cast<size_t>(rows));
+
+    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
+    auto* r = static_cast<parquet::BoolReader*>(col.get());
+    if (span.lo > 0 && r->Skip(span.lo) != span.lo) throw runtime_error("Short skip in required bool column");
+
+    int64_t done = 0;
+    while (done < rows)
+    {
+      int64_t values_read = 0;
+      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr,
+                                    reinterpret_cast<bool*>(out.data()) + done,
+                                    &values_read);
+      if (levels == 0 && values_read == 0) break;
+      done += values_read;
+    }
+
+    if (done != rows) throw runtime_error("Short read in required bool column");
+  }
+
+  // Same contract as FileStreamerTopCols::from_cache (isMarket cached as 1-byte values)
+  CacheRead from_cache(int64_t start_ns, int64_t end_ns, const TradeSelect& sel, TradeColsView& v,
+                       vector<shared_ptr<const void>>& keep, size_t& n, ScanStats& st)
+  {
+    if (cache_tried) return cache_served ? CacheRead::Done : CacheRead::Off;
+    cache_tried = true;
+    if (g_cache.dir.empty()) return CacheRead::Off;
+
+    where_prepare(where, sel.where, schema);
+    if (where.active()) return CacheRead::Off;
+
+    SourceStamp src;
+    if (!source_stamp(src_path, src)) return CacheRead::Off;
+
+    auto whole = [this](int idx)
+    {
+      return [this, idx](vector<int64_t>& out)
+      {
+        for (int rg = 0; rg < md->num_row_groups(); ++rg)
+        {
+          read_required_i64_column(*reader->RowGroup(rg), idx,
+                                   RowSpan{0, md->RowGroup(rg)->num_rows()}, arena->tmp_i64);
+          out.insert(out.end(), arena->tmp_i64.begin(), arena->tmp_i64.end());
+        }
+      };
+    };
+    const uint64_t rows = static_cast<uint64_t>(md->num_rows());
+
+    if (plan->ts < 0) throw runtime_error("trade: missing ts");
+    const CachedColumn ts = cached_column<int64_t>(src, "ts", whole(plan->ts), st);
+    if (!ts.sorted || ts.rows != rows) return CacheRead::Off;
+
+    const int64_t* t  = static_cast<const int64_t*>(ts.data);
+    const int64_t* lo = lower_bound(t, t + ts.rows, start_ns);
+    const int64_t* hi = lower_bound(lo, t + ts.rows, end_ns);
+    const size_t off  = static_cast<size_t>(lo - t);
+
+    struct Col { const char* name; int idx; const int64_t** out; };
+    const Col cols[] = {
+      {sel.px            ? "px"            : nullptr, plan->px,            &v.px},
+      {sel.qty           ? "qty"           : nullptr, plan->qty,           &v.qty},
+      {sel.tradeId       ? "tradeId"       : nullptr, plan->tradeId,       &v.tradeId},
+      {sel.buyerOrderId  ? "buyerOrderId"  : nullptr, plan->buyerOrderId,  &v.buyerOrderId},
+      {sel.sellerOrderId ? "sellerOrderId" : nullptr, plan->sellerOrderId, &v.sellerOrderId},
+      {sel.tradeTime     ? "tradeTime"     : nullptr, plan->tradeTime,     &v.tradeTime},
+      {sel.eventTime     ? "eventTime"     : nullptr, plan->eventTime,     &v.eventTime},
+    };
+    for (const auto& c : cols)
+      if (c.name && c.idx < 0) throw runtime_error(string("trade: missing ") + c.name);
+    if (sel.isMarket && plan->isMarket < 0) throw runtime_error("trade: missing isMarket");
+
+    cache_served = true;
+    if (lo == hi) return CacheRead::Done;
+
+    v = TradeColsView{};
+    keep.clear();
+    if (sel.ts) v.ts = lo;
+    keep.push_back(ts.keep);
+    for (const auto& c : cols)
+    {
+      if (!c.name) continue;
+      const CachedColumn col = cached_column<int64_t>(src, c.name, whole(c.idx), st);
+      if (col.rows != rows) throw runtime_error(string("trade: cached column length mismatch: ") + c.name);
+      *c.out = static_cast<const int64_t*>(col.data) + off;
+      keep.push_back(col.keep);
+    }
+    if (sel.isMarket)
+    {
+      auto whole_bool = [this](vector<uint8_t>& out)
+      {
+        for (int rg = 0; rg < md->num_row_groups(); ++rg)
+        {
+          read_required_bool_column(*reader->RowGroup(rg), plan->isMarket,
+                                    RowSpan{0, md->RowGroup(rg)->num_rows()}, arena->tmp_u8);
+          out.insert(out.end(), arena->tmp_u8.begin(), arena->tmp_u8.end());
+        }
+      };
+      const CachedColumn col = cached_column<uint8_t>(src, "isMarket", whole_bool, st);
+      if (col.rows != rows) throw runtime_error("trade: cached column length mismatch: isMarket");
+      v.isMarket = static_cast<const uint8_t*>(col.data) + off;
+      keep.push_back(col.keep);
+    }
+    n = static_cast<size_t>(hi - lo);
+    return CacheRead::Batch;
+  }
+
+  // Same layout contract as FileStreamerTopCols::next_rg (ts at v_ts[ts_off..])
   bool next_rg(
-      int64_t start_ns, int64_t end_ns, const TopSelect& sel,
-      vector<int64_t>& v_ts, vector<int64_t>& v_apx, vector<int64_t>& v_aq,
-      vector<int64_t>& v_bpx, vector<int64_t>& v_bq, vector<int64_t>& v_val,
-      // sampled extras
-      vector<int64_t>& v_min_bpx, vector<int64_t>& v_max_bpx,
-      vector<int64_t>& v_min_apx, vector<int64_t>& v_max_apx,
-      vector<int64_t>& v_min_bts, vector<int64_t>& v_max_bts,
-      vector<int64_t>& v_min_ats, vector<int64_t>& v_max_ats)
+      int64_t start_ns, int64_t end_ns, const TradeSelect& sel,
+      vector<int64_t>& v_ts, vector<int64_t>& v_px, vector<int64_t>& v_qty,
+      vector<int64_t>& v_tid, vector<int64_t>& v_boid, vector<int64_t>& v_soid,
+      vector<int64_t>& v_ttime, vector<uint8_t>& v_isMkt, vector<int64_t>& v_evt,
+      size_t& ts_off, size_t& n,
+      ScanStats& st)
   {
     while (true)
     {
       if (rg_idx >= md->num_row_groups()) return false;
 
-      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_idx++);
+      const int cur_rg = rg_idx++;
 
-      const int ts_i = find_col_idx(schema, "ts");
-      if (ts_i < 0) throw runtime_error("top: missing ts");
+      const int ts_i = plan->ts;
+      if (ts_i < 0) throw runtime_error("trade: missing ts");
+      where_prepare(where, sel.where, schema);
+
+      RowSpan span;
+      if (!plan_rg(cur_rg, ts_i, start_ns, end_ns, span, st)) continue;
+
+      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(cur_rg);
+
+      read_required_i64_column(*rg, ts_i, span, v_ts);
+
+      // Selected int64 columns (name == nullptr => not selected)
+      const SelCol<int64_t> cols[] = {
+        {sel.px            ? "px"            : nullptr, plan->px,            &v_px},
+        {sel.qty           ? "qty"           : nullptr, plan->qty,           &v_qty},
+        {sel.tradeId       ? "tradeId"       : nullptr, plan->tradeId,       &v_tid},
+        {sel.buyerOrderId  ? "buyerOrderId"  : nullptr, plan->buyerOrderId,  &v_boid},
+        {sel.sellerOrderId ? "sellerOrderId" : nullptr, plan->sellerOrderId, &v_soid},
+        {sel.tradeTime     ? "tradeTime"     : nullptr, plan->tradeTime,     &v_ttime},
+        {sel.eventTime     ? "eventTime"     : nullptr, plan->eventTime,     &v_evt},
+      };
+      for (const auto& c : cols)
+        if (c.name && c.idx < 0) throw runtime_error(string("trade: missing ") + c.name);
+      if (sel.isMarket && plan->isMarket < 0) throw runtime_error("trade: missing isMarket");
+
+      if (where.active())
+      {
+        const RowSpan sub = where_sub(cur_rg, ts_i, span, v_ts, start_ns, end_ns);
+        if (sub.lo == sub.hi) continue;
+
+        where_select(*rg, where, sub, v_ts.data() + (sub.lo - span.lo), start_ns, end_ns, *arena);
+        const vector<uint32_t>& rows = arena->sel_rows;
+        if (rows.empty()) continue;
+
+        const size_t base = static_cast<size_t>(sub.lo - span.lo);
+        for (size_t k = 0; k < rows.size(); ++k) v_ts[k] = v_ts[base + rows[k]];
+        for (const auto& c : cols)
+        {
+          if (!c.name) { c.out->clear(); continue; }
+          read_required_i64_column(*rg, c.idx, sub, arena->tmp_i64);
+          gather_rows(arena->tmp_i64, rows, *c.out, *arena);
+        }
+        if (sel.isMarket)
+        {
+          read_required_bool_column(*rg, plan->isMarket, sub, arena->tmp_u8);
+          gather_rows(arena->tmp_u8, rows, v_isMkt, *arena);
+        }
+        else v_isMkt.clear();
+
+        ts_off = 0;
+        n      = rows.size();
+        return true;
+      }
+
+      // Fast path: sorted ts => one contiguous [lo, hi), decode it in place
+      if (ts_sorted(*md, cur_rg, ts_i, v_ts))
+      {
+        const RowSpan hit = sorted_hit(v_ts, start_ns, end_ns);
+        if (hit.lo == hit.hi) continue;
 
-      vector<int64_t> ts_all;
-      read_required_i64_column(*rg, ts_i, ts_all);
+        ts_off = static_cast<size_t>(hit.lo);
+        n      = static_cast<size_t>(hit.hi - hit.lo);
+
+        const RowSpan sub{span.lo + hit.lo, span.lo + hit.hi};
+        for (const auto& c : cols)
+        {
+          if (c.name) read_required_i64_column(*rg, c.idx, sub, *c.out);
+          else c.out->clear();
+        }
+        if (sel.isMarket) read_required_bool_column(*rg, plan->isMarket, sub, v_isMkt);
+        else v_isMkt.clear();
+        return true;
+      }
+
+      // Fallback (unsorted ts): filter + scatter
+      vector<int64_t>& ts_all = arena->ts_all;
+      ts_all.swap(v_ts);
 
       size_t cnt = 0;
       for (int64_t t : ts_all) if (t >= start_ns && t < end_ns) ++cnt;
       if (cnt == 0) continue;
 
-      v_ts.resize(cnt);
-      if (sel.ask_px)     v_apx.resize(cnt);    else v_apx.clear();
-      if (sel.ask_qty)    v_aq.resize(cnt);     else v_aq.clear();
-      if (sel.bid_px)     v_bpx.resize(cnt);    else v_bpx.clear();
-      if (sel.bid_qty)    v_bq.resize(cnt);     else v_bq.clear();
-      if (sel.valu)       v_val.resize(cnt);    else v_val.clear();
-
-      if (sel.min_bid_px) v_min_bpx.resize(cnt); else v_min_bpx.clear();
-      if (sel.max_bid_px) v_max_bpx.resize(cnt); else v_max_bpx.clear();
-      if (sel.min_ask_px) v_min_apx.resize(cnt); else v_min_apx.clear();
-      if (sel.max_ask_px) v_max_apx.resize(cnt); else v_max_apx.clear();
-      if (sel.min_bid_ts) v_min_bts.resize(cnt); else v_min_bts.clear();
-      if (sel.max_bid_ts) v_max_bts.resize(cnt); else v_max_bts.clear();
-      if (sel.min_ask_ts) v_min_ats.resize(cnt); else v_min_ats.clear();
-      if (sel.max_ask_ts) v_max_ats.resize(cnt); else v_max_ats.clear();
-
+      arena->fit(v_ts, cnt);
       {
         size_t w = 0;
         for (size_t i = 0; i < ts_all.size(); ++i) {
@@ -504,13 +2754,9 @@ struct FileStreamerTopCols
         }
       }
 
-      auto read_and_scatter = [&](const char* name, vector<int64_t>& out_vec)
+      auto scatter = [&](const auto& tmp, auto& out_vec)
       {
-        const int idx = find_col_idx(schema, name);
-        if (idx < 0) throw runtime_error(string("top: missing ") + name);
-        vector<int64_t> tmp;
-        read_required_i64_column(*rg, idx, tmp);
-
+        arena->fit(out_vec, cnt);
         size_t w = 0;
         for (size_t i = 0; i < ts_all.size(); ++i) {
           int64_t t = ts_all[i];
@@ -518,349 +2764,756 @@ struct FileStreamerTopCols
         }
       };
 
-      if (sel.ask_px)     read_and_scatter("ask_px", v_apx);
-      if (sel.ask_qty)    read_and_scatter("ask_qty", v_aq);
-      if (sel.bid_px)     read_and_scatter("bid_px", v_bpx);
-      if (sel.bid_qty)    read_and_scatter("bid_qty", v_bq);
-      if (sel.valu)       read_and_scatter("valu",   v_val);
-
-      if (sel.min_bid_px) read_and_scatter("min_bid_px", v_min_bpx);
-      if (sel.max_bid_px) read_and_scatter("max_bid_px", v_max_bpx);
-      if (sel.min_ask_px) read_and_scatter("min_ask_px", v_min_apx);
-      if (sel.max_ask_px) read_and_scatter("max_ask_px", v_max_apx);
-      if (sel.min_bid_ts) read_and_scatter("min_bid_ts", v_min_bts);
-      if (sel.max_bid_ts) read_and_scatter("max_bid_ts", v_max_bts);
-      if (sel.min_ask_ts) read_and_scatter("min_ask_ts", v_min_ats);
-      if (sel.max_ask_ts) read_and_scatter("max_ask_ts", v_max_ats);
+      for (const auto& c : cols)
+      {
+        if (!c.name) { c.out->clear(); continue; }
+        read_required_i64_column(*rg, c.idx, span, arena->tmp_i64);
+        scatter(arena->tmp_i64, *c.out);
+      }
+      if (sel.isMarket)
+      {
+        read_required_bool_column(*rg, plan->isMarket, span, arena->tmp_u8);
+        scatter(arena->tmp_u8, v_isMkt);
+      }
+      else v_isMkt.clear();
 
+      ts_off = 0;
+      n      = cnt;
       return true;
     }
   }
 };
 
-struct FileStreamerTradeCols
+struct FileStreamerDeltaCols
 {
   unique_ptr<parquet::ParquetFileReader> reader;
   shared_ptr<parquet::FileMetaData> md;
   const parquet::SchemaDescriptor* schema = nullptr;
   int rg_idx = 0;
-
-  explicit FileStreamerTradeCols(string path)
+  ScratchArena* arena = nullptr;
+  shared_ptr<CountedFile> io;
+  uint64_t open_ns = 0;
+  uint64_t metadata_ns = 0;
+  shared_ptr<const DeltaPlan> plan;
+  shared_ptr<const TimeIndex> tix;
+
+  FileStreamerDeltaCols(string path, ScratchArena& scratch,
+                        shared_ptr<arrow::io::RandomAccessFile> input = nullptr)
+  :
+    arena(&scratch)
   {
     //cerr << path << endl;
-    reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
+    OpenedParquet op = open_counted(path, move(input));
+    reader      = move(op.reader);
+    io          = move(op.io);
+    open_ns     = op.open_ns;
+    metadata_ns = op.metadata_ns;
     md     = reader->metadata();
     schema = md->schema();
+    plan   = plan_for<DeltaPlan>(schema);
+    tix    = load_time_index(path, *md);
   }
 
-  static void read_required_i64_column(
-      parquet::RowGroupReader& rg, int col_idx, vector<int64_t>& out)
+  // Bulk-append rows [a, b) of one decoded list leaf
+  static void append_list_run(const LeafBufs& l, int64_t a, int64_t b, vector<int64_t>& out)
   {
-    const int64_t rows = rg.metadata()->num_rows();
-    out.resize(rows);
+    const int64_t* v = l.val.data();
+    out.insert(out.end(), v + l.row_off[a], v + l.row_off[b]);
+  }
 
-    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
-    auto* r = static_cast<parquet::Int64Reader*>(col.get());
+  // Offsets of rows [a, b) of one list side, rebased onto the running element count
+  static void append_off_run(const LeafBufs& l, int64_t a, int64_t b, vector<uint32_t>& off)
+  {
+    const uint32_t base = off.back() - l.row_off[a];
+    for (int64_t r = a; r < b; ++r) off.push_back(l.row_off[r + 1] + base);
+  }
 
-    int64_t done = 0;
-    while (done < rows)
+  // px/qty of one side must describe the same lists
+  static void check_pair(const LeafBufs& px, const LeafBufs& qty, int64_t rows, const char* side)
+  {
+    if (memcmp(px.row_off.data(), qty.row_off.data(), (rows + 1) * sizeof(uint32_t)) != 0)
+      throw runtime_error(string("depth: ") + side + " px/qty list lengths differ");
+  }
+
+  bool next_rg(
+      int64_t start_ns, int64_t end_ns, const DeltaSelect& sel,
+      vector<int64_t>& v_ts, vector<int64_t>& v_fid, vector<int64_t>& v_lid, vector<int64_t>& v_evt,
+      vector<uint32_t>& ask_off, vector<int64_t>& ask_px, vector<int64_t>& ask_qty,
+      vector<uint32_t>& bid_off, vector<int64_t>& bid_px, vector<int64_t>& bid_qty,
+      ScanStats& st)
+  {
+    while (true)
     {
-      int64_t values_read = 0;
-      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr, out.data() + done, &values_read);
-      if (levels == 0 && values_read == 0) break;
-      done += values_read;
+      if (rg_idx >= md->num_row_groups()) return false;
+
+      const int cur_rg = rg_idx++;
+
+      int ts_i = plan->ts;
+      if (ts_i < 0) throw runtime_error("depth: missing ts");
+
+      // Nested list leaves skip by levels, not rows: prune whole row groups only
+      if (!rg_ts_may_overlap(*md, cur_rg, ts_i, start_ns, end_ns)
+          || (tix && !tix->rg_may_overlap(cur_rg, start_ns, end_ns)))
+      {
+        ++st.row_groups_skipped;
+        continue;
+      }
+      ++st.row_groups_decoded;
+
+      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(cur_rg);
+      const int64_t rows = rg->metadata()->num_rows();
+
+      // ts first: an empty window leaves the other columns undecoded
+      LeafBufs& ts = arena->leaves[LEAF_TS];
+      read_flat_i64(*rg, ts_i, schema->Column(ts_i), rows, *arena, ts);
+
+      const bool sorted = ts_sorted(*md, cur_rg, ts_i, ts.val);
+      RowSpan hit{0, rows};
+      if (sorted)
+      {
+        hit = sorted_hit(ts.val, start_ns, end_ns);
+        if (hit.lo == hit.hi) continue;
+      }
+
+      struct Flat { bool on; int idx; const char* what; LeafSlot slot; vector<int64_t>* out; };
+      const Flat flats[] = {
+        {sel.firstId,   plan->firstId,   "depth: missing firstId",   LEAF_FID, &v_fid},
+        {sel.lastId,    plan->lastId,    "depth: missing lastId",    LEAF_LID, &v_lid},
+        {sel.eventTime, plan->eventTime, "depth: missing eventTime", LEAF_EVT, &v_evt},
+      };
+      struct List { bool on; int idx; const char* what; LeafSlot slot; vector<int64_t>* out; };
+      const List lists[] = {
+        {sel.ask_px,  plan->ask_px,  "depth: missing ask px",  LEAF_APX,  &ask_px},
+        {sel.ask_qty, plan->ask_qty, "depth: missing ask qty", LEAF_AQTY, &ask_qty},
+        {sel.bid_px,  plan->bid_px,  "depth: missing bid px",  LEAF_BPX,  &bid_px},
+        {sel.bid_qty, plan->bid_qty, "depth: missing bid qty", LEAF_BQTY, &bid_qty},
+      };
+
+      for (const Flat& f : flats)
+      {
+        if (!f.on) continue;
+        if (f.idx < 0) throw runtime_error(f.what);
+        read_flat_i64(*rg, f.idx, schema->Column(f.idx), rows, *arena, arena->leaves[f.slot]);
+      }
+      for (const List& l : lists)
+      {
+        if (!l.on) continue;
+        if (l.idx < 0) throw runtime_error(l.what);
+        read_list_i64(*rg, l.idx, schema->Column(l.idx), rows, *arena, arena->leaves[l.slot]);
+      }
+
+      const bool need_asks = (sel.ask_px || sel.ask_qty);
+      const bool need_bids = (sel.bid_px || sel.bid_qty);
+      if (sel.ask_px && sel.ask_qty) check_pair(arena->leaves[LEAF_APX], arena->leaves[LEAF_AQTY], rows, "ask");
+      if (sel.bid_px && sel.bid_qty) check_pair(arena->leaves[LEAF_BPX], arena->leaves[LEAF_BQTY], rows, "bid");
+
+      // offsets come from whichever leaf of the side is selected
+      const LeafBufs& ask_l = arena->leaves[sel.ask_px ? LEAF_APX : LEAF_AQTY];
+      const LeafBufs& bid_l = arena->leaves[sel.bid_px ? LEAF_BPX : LEAF_BQTY];
+
+      v_ts.clear();
+      v_fid.clear();
+      v_lid.clear();
+      v_evt.clear();
+      ask_off.clear();
+      ask_px.clear();
+      ask_qty.clear();
+      bid_off.clear();
+      bid_px.clear();
+      bid_qty.clear();
+
+      const int64_t cap = hit.hi - hit.lo;
+      arena->reserve(v_ts, cap);
+      for (const Flat& f : flats)
+        if (f.on) arena->reserve(*f.out, cap);
+      if (need_asks) { arena->reserve(ask_off, cap + 1); ask_off.push_back(0); }
+      if (need_bids) { arena->reserve(bid_off, cap + 1); bid_off.push_back(0); }
+      for (const List& l : lists)
+      {
+        if (!l.on) continue;
+        const LeafBufs& b = arena->leaves[l.slot];
+        arena->reserve(*l.out, b.row_off[hit.hi] - b.row_off[hit.lo]);
+      }
+
+      // Emit maximal in-range row runs (a single run when ts is sorted)
+      auto emit = [&](int64_t a, int64_t b)
+      {
+        v_ts.insert(v_ts.end(), ts.val.data() + a, ts.val.data() + b);
+        for (const Flat& f : flats)
+        {
+          if (!f.on) continue;
+          const int64_t* v = arena->leaves[f.slot].val.data();
+          f.out->insert(f.out->end(), v + a, v + b);
+        }
+        for (const List& l : lists)
+          if (l.on) append_list_run(arena->leaves[l.slot], a, b, *l.out);
+        if (need_asks) append_off_run(ask_l, a, b, ask_off);
+        if (need_bids) append_off_run(bid_l, a, b, bid_off);
+      };
+
+      if (sorted)
+      {
+        emit(hit.lo, hit.hi);
+      }
+      else
+      {
+        const int64_t* t = ts.val.data();
+        int64_t r = 0;
+        while (r < rows)
+        {
+          while (r < rows && !(t[r] >= start_ns && t[r] < end_ns)) ++r;
+          const int64_t a = r;
+          while (r < rows && t[r] >= start_ns && t[r] < end_ns) ++r;
+          if (r > a) emit(a, r);
+        }
+      }
+
+      if (!v_ts.empty()) return true;
     }
+  }
+};
 
-    if (done != rows) throw runtime_error("Short read in required column");
+// ======== Owned batches (one decoded row group, ready to view) ========
+
+struct TopBatch
+{
+  vector<int64_t> ts, apx, aq, bpx, bq, val;
+  // sampled extras
+  vector<int64_t> min_bpx, max_bpx, min_apx, max_apx;
+  vector<int64_t> min_bts, max_bts, min_ats, max_ats;
+
+  // batch = ts[ts_off, ts_off + n); other columns hold n rows
+  size_t ts_off = 0;
+  size_t n = 0;
+
+  // What readers hand out: the vectors above, or cached columns held by keep
+  TopColsView view;
+  vector<shared_ptr<const void>> keep;
+
+  size_t bytes() const
+  {
+    size_t b = 0;
+    for (const auto* v : {&ts, &apx, &aq, &bpx, &bq, &val, &min_bpx, &max_bpx,
+                          &min_apx, &max_apx, &min_bts, &max_bts, &min_ats, &max_ats})
+      b += v->capacity() * sizeof(int64_t);
+    return b;
   }
+};
+
+struct TradeBatch
+{
+  vector<int64_t> ts, px, qty, tid, boid, soid, ttime;
+  vector<uint8_t> isMkt;
+  vector<int64_t> evt;
+
+  size_t ts_off = 0;
+  size_t n = 0;
 
-  static void read_required_bool_column(
-      parquet::RowGroupReader& rg, int col_idx, vector<uint8_t>& out)
+  TradeColsView view;
+  vector<shared_ptr<const void>> keep;
+
+  size_t bytes() const
   {
-    static_assert(sizeof(bool) == 1, "bool must be 1 byte");
-    const int64_t rows = rg.metadata()->num_rows();
-    out.resize(rows);
+    size_t b = isMkt.capacity();
+    for (const auto* v : {&ts, &px, &qty, &tid, &boid, &soid, &ttime, &evt})
+      b += v->capacity() * sizeof(int64_t);
+    return b;
+  }
+};
 
-    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
-    auto* r = static_cast<parquet::BoolReader*>(col.get());
+struct DeltaBatch
+{
+  vector<int64_t> ts, fid, lid, evt;
+  vector<uint32_t> ask_off, bid_off;
+  vector<int64_t> ask_px, ask_qty, bid_px, bid_qty;
 
-    int64_t done = 0;
-    while (done < rows)
+  size_t n = 0;
+
+  size_t bytes() const
+  {
+    size_t b = (ask_off.capacity() + bid_off.capacity()) * sizeof(uint32_t);
+    for (const auto* v : {&ts, &fid, &lid, &evt, &ask_px, &ask_qty, &bid_px, &bid_qty})
+      b += v->capacity() * sizeof(int64_t);
+    return b;
+  }
+};
+
+// Uniform "decode next row group into a batch" entry point per streamer
+static bool read_rg(FileStreamerTopCols& fs, int64_t s, int64_t e, const TopSelect& sel,
+                    TopBatch& b, ScanStats& st)
+{
+  switch (fs.from_cache(s, e, sel, b.view, b.keep, b.n, st))
+  {
+    case CacheRead::Batch: return true;
+    case CacheRead::Done:  return false;
+    case CacheRead::Off:   break;
+  }
+
+  b.keep.clear();
+  if (!fs.next_rg(s, e, sel,
+                  b.ts, b.apx, b.aq, b.bpx, b.bq, b.val,
+                  b.min_bpx, b.max_bpx, b.min_apx, b.max_apx,
+                  b.min_bts, b.max_bts, b.min_ats, b.max_ats,
+                  b.ts_off, b.n, st))
+    return false;
+
+  TopColsView& v = b.view;
+  v.ts        = sel.ts        ? b.ts.data() + b.ts_off : nullptr;
+  v.ask_px    = sel.ask_px    ? b.apx.data()      : nullptr;
+  v.ask_qty   = sel.ask_qty   ? b.aq.data()       : nullptr;
+  v.bid_px    = sel.bid_px    ? b.bpx.data()      : nullptr;
+  v.bid_qty   = sel.bid_qty   ? b.bq.data()       : nullptr;
+  v.valu      = sel.valu      ? b.val.data()      : nullptr;
+
+  v.min_bid_px = sel.min_bid_px ? b.min_bpx.data() : nullptr;
+  v.max_bid_px = sel.max_bid_px ? b.max_bpx.data() : nullptr;
+  v.min_ask_px = sel.min_ask_px ? b.min_apx.data() : nullptr;
+  v.max_ask_px = sel.max_ask_px ? b.max_apx.data() : nullptr;
+  v.min_bid_ts = sel.min_bid_ts ? b.min_bts.data() : nullptr;
+  v.max_bid_ts = sel.max_bid_ts ? b.max_bts.data() : nullptr;
+  v.min_ask_ts = sel.min_ask_ts ? b.min_ats.data() : nullptr;
+  v.max_ask_ts = sel.max_ask_ts ? b.max_ats.data() : nullptr;
+  return true;
+}
+
+static bool read_rg(FileStreamerTradeCols& fs, int64_t s, int64_t e, const TradeSelect& sel,
+                    TradeBatch& b, ScanStats& st)
+{
+  switch (fs.from_cache(s, e, sel, b.view, b.keep, b.n, st))
+  {
+    case CacheRead::Batch: return true;
+    case CacheRead::Done:  return false;
+    case CacheRead::Off:   break;
+  }
+
+  b.keep.clear();
+  if (!fs.next_rg(s, e, sel,
+                  b.ts, b.px, b.qty, b.tid, b.boid, b.soid, b.ttime, b.isMkt, b.evt,
+                  b.ts_off, b.n, st))
+    return false;
+
+  TradeColsView& v = b.view;
+  v.ts            = sel.ts            ? b.ts.data() + b.ts_off : nullptr;
+  v.px            = sel.px            ? b.px.data()     : nullptr;
+  v.qty           = sel.qty           ? b.qty.data()    : nullptr;
+  v.tradeId       = sel.tradeId       ? b.tid.data()    : nullptr;
+  v.buyerOrderId  = sel.buyerOrderId  ? b.boid.data()   : nullptr;
+  v.sellerOrderId = sel.sellerOrderId ? b.soid.data()   : nullptr;
+  v.tradeTime     = sel.tradeTime     ? b.ttime.data()  : nullptr;
+  v.isMarket      = sel.isMarket      ? b.isMkt.data()  : nullptr;
+  v.eventTime     = sel.eventTime     ? b.evt.data()    : nullptr;
+  return true;
+}
+
+static bool read_rg(FileStreamerDeltaCols& fs, int64_t s, int64_t e, const DeltaSelect& sel,
+                    DeltaBatch& b, ScanStats& st)
+{
+  bool ok = fs.next_rg(s, e, sel,
+                       b.ts, b.fid, b.lid, b.evt,
+                       b.ask_off, b.ask_px, b.ask_qty,
+                       b.bid_off, b.bid_px, b.bid_qty, st);
+  b.n = b.ts.size();
+  return ok;
+}
+
+// Opening cost of a just constructed streamer
+template <class Streamer>
+static void add_open_stats(Streamer& fs, ScanStats& st)
+{
+  ++st.files_opened;
+  st.open_ns     += fs.open_ns;
+  st.metadata_ns += fs.metadata_ns;
+  st.bytes_read  += fs.io->take_bytes();
+}
+
+// read_rg + bytes fetched and its time: decode per the arena clock, the rest filter/scatter
+template <class Streamer, class Sel, class Batch>
+static bool read_rg_counted(Streamer& fs, int64_t s, int64_t e, const Sel& sel, Batch& b, ScanStats& st)
+{
+  const uint64_t decode0 = fs.arena->decode_ns;
+  const Clock::time_point t0 = Clock::now();
+  const bool ok = read_rg(fs, s, e, sel, b, st);
+  const uint64_t total  = ns_since(t0);
+  const uint64_t decode = fs.arena->decode_ns - decode0;
+  st.decode_ns  += decode;
+  st.filter_ns  += total > decode ? total - decode : 0;
+  st.bytes_read += fs.io->take_bytes();
+  return ok;
+}
+
+// Sums the file-side counters (buffer and consumer fields are per reader)
+static void add_stats(ScanStats& into, const ScanStats& s)
+{
+  into.row_groups_skipped         += s.row_groups_skipped;
+  into.row_groups_decoded         += s.row_groups_decoded;
+  into.rows_skipped_by_page_index += s.rows_skipped_by_page_index;
+  into.files_skipped_by_index     += s.files_skipped_by_index;
+  into.rows_skipped_by_index      += s.rows_skipped_by_index;
+  into.cache_columns_hit          += s.cache_columns_hit;
+  into.cache_columns_stored       += s.cache_columns_stored;
+  into.prefetch_ready             += s.prefetch_ready;
+  into.prefetch_waits             += s.prefetch_waits;
+  into.prefetch_wait_ns           += s.prefetch_wait_ns;
+  into.prefetch_missed            += s.prefetch_missed;
+  into.prefetch_bytes             += s.prefetch_bytes;
+  into.files_opened               += s.files_opened;
+  into.bytes_read                 += s.bytes_read;
+  into.rows_emitted               += s.rows_emitted;
+  into.open_ns                    += s.open_ns;
+  into.metadata_ns                += s.metadata_ns;
+  into.decode_ns                  += s.decode_ns;
+  into.filter_ns                  += s.filter_ns;
+}
+
+// ======== Parallel read-ahead (whole files decoded by a worker pool) ========
+
+static ParallelScan g_parallel{};
+void ShardedDB::set_parallel(const ParallelScan& cfg) { g_parallel = cfg; }
+
+// All batches of one candidate file + what went wrong (reported in file order)
+template <class Batch>
+struct DecodedFile
+{
+  vector<Batch> batches;
+  ScanStats stats;
+  size_t bytes = 0;
+  bool open_failed = false;
+  string error;   // open or read failure message (empty => ok)
+};
+
+// new_batch() hands out an empty (possibly recycled) Batch for each row group
+template <class Streamer, class Batch, class Sel, class NewBatch>
+static void decode_file(const string& path, int64_t s, int64_t e, const Sel& sel,
+                        ScratchArena& arena, NewBatch&& new_batch,
+                        DecodedFile<Batch>& out, const atomic<bool>& stop)
+{
+  unique_ptr<Streamer> fs;
+  try
+  {
+    fs = make_unique<Streamer>(path, arena);
+    add_open_stats(*fs, out.stats);
+  }
+  catch (const exception& ex)
+  {
+    out.open_failed = true;
+    out.error = ex.what();
+    return;
+  }
+
+  try
+  {
+    Batch b = new_batch();
+    while (!stop.load(memory_order_relaxed) && read_rg_counted(*fs, s, e, sel, b, out.stats))
     {
-      int64_t values_read = 0;
-      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr,
-                                    reinterpret_cast<bool*>(out.data()) + done,
-                                    &values_read);
-      if (levels == 0 && values_read == 0) break;
-      done += values_read;
+      if (b.n == 0) continue;
+      out.bytes += b.bytes();
+      out.batches.push_back(move(b));
+      b = new_batch();
+    }
+  }
+  catch (const exception& ex)
+  {
+    out.error = ex.what();
+  }
+}
+
+// Workers claim files in order, at most files_ahead past the consumer and
+// only while decoded-but-untaken bytes stay under byte_budget (the file the
+// consumer waits for is always allowed, so the pool cannot stall).
+template <class Streamer, class Batch, class Sel>
+class FileScanPool
+{
+public:
+  FileScanPool(const vector<Candidate>& files, int64_t s, int64_t e, Sel sel, const ParallelScan& cfg)
+  : files_(files), start_ns_(s), end_ns_(e), sel_(sel), cfg_(cfg),
+    slots_(files.size()), ready_(files.size(), false)
+  {
+    if (cfg_.files_ahead == 0) cfg_.files_ahead = 1;
+    const unsigned n = static_cast<unsigned>(min<size_t>(cfg_.workers, files_.size()));
+    arena_bytes_.assign(n, 0);
+    for (unsigned i = 0; i < n; ++i) workers_.emplace_back([this, i]{ run(i); });
+  }
+
+  ~FileScanPool()
+  {
+    {
+      lock_guard<mutex> lk(mu_);
+      stop_ = true;
     }
+    stop_flag_.store(true, memory_order_relaxed);
+    cv_work_.notify_all();
+    for (auto& t : workers_) t.join();
+  }
 
-    if (done != rows) throw runtime_error("Short read in required bool column");
+  FileScanPool(const FileScanPool&) = delete;
+  FileScanPool& operator=(const FileScanPool&) = delete;
+
+  // Blocks until file i (taken strictly in order) is decoded.
+  DecodedFile<Batch> take(size_t i)
+  {
+    unique_lock<mutex> lk(mu_);
+    taken_ = i;
+    cv_work_.notify_all();
+    cv_done_.wait(lk, [&]{ return ready_[i]; });
+
+    DecodedFile<Batch> r = move(slots_[i]);
+    in_flight_bytes_ -= r.bytes;
+    taken_ = i + 1;
+    cv_work_.notify_all();
+    return r;
   }
 
-  bool next_rg(
-      int64_t start_ns, int64_t end_ns, const TradeSelect& sel,
-      vector<int64_t>& v_ts, vector<int64_t>& v_px, vector<int64_t>& v_qty,
-      vector<int64_t>& v_tid, vector<int64_t>& v_boid, vector<int64_t>& v_soid,
-      vector<int64_t>& v_ttime, vector<uint8_t>& v_isMkt, vector<int64_t>& v_evt)
+  // Consumer hands back a drained batch; workers refill it instead of allocating
+  void recycle(Batch&& b)
   {
-    while (true)
-    {
-      if (rg_idx >= md->num_row_groups()) return false;
+    lock_guard<mutex> lk(mu_);
+    spare_bytes_ += b.bytes();
+    spare_.push_back(move(b));
+    note_peak();
+  }
 
-      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_idx++);
+  uint64_t allocs() const { lock_guard<mutex> lk(mu_); return allocs_; }
+  uint64_t peak_bytes() const { lock_guard<mutex> lk(mu_); return peak_bytes_; }
 
-      const int ts_i = find_col_idx(schema, "ts");
-      if (ts_i < 0) throw runtime_error("trade: missing ts");
+private:
+  bool may_claim() const
+  {
+    if (next_ >= files_.size()) return true; // nothing left: let the worker exit
+    if (next_ == taken_) return true;
+    return next_ < taken_ + cfg_.files_ahead && in_flight_bytes_ < cfg_.byte_budget;
+  }
 
-      vector<int64_t> ts_all;
-      read_required_i64_column(*rg, ts_i, ts_all);
+  Batch spare_batch()
+  {
+    lock_guard<mutex> lk(mu_);
+    if (spare_.empty()) return Batch{};
+    Batch b = move(spare_.back());
+    spare_.pop_back();
+    spare_bytes_ -= b.bytes();
+    return b;
+  }
 
-      size_t cnt = 0;
-      for (int64_t t : ts_all) if (t >= start_ns && t < end_ns) ++cnt;
-      if (cnt == 0) continue;
+  // mu_ held
+  void note_peak()
+  {
+    size_t total = in_flight_bytes_ + spare_bytes_;
+    for (size_t b : arena_bytes_) total += b;
+    peak_bytes_ = max<uint64_t>(peak_bytes_, total);
+  }
 
-      v_ts.resize(cnt);
-      if (sel.px)            v_px.resize(cnt);     else v_px.clear();
-      if (sel.qty)           v_qty.resize(cnt);    else v_qty.clear();
-      if (sel.tradeId)       v_tid.resize(cnt);    else v_tid.clear();
-      if (sel.buyerOrderId)  v_boid.resize(cnt);   else v_boid.clear();
-      if (sel.sellerOrderId) v_soid.resize(cnt);   else v_soid.clear();
-      if (sel.tradeTime)     v_ttime.resize(cnt);  else v_ttime.clear();
-      if (sel.isMarket)      v_isMkt.resize(cnt);  else v_isMkt.clear();
-      if (sel.eventTime)     v_evt.resize(cnt);    else v_evt.clear();
+  void run(size_t w)
+  {
+    ScratchArena arena;  // per worker, reused across its files
+    uint64_t arena_allocs = 0;
 
+    while (true)
+    {
+      size_t i = 0;
       {
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) v_ts[w++] = t;
-        }
+        unique_lock<mutex> lk(mu_);
+        cv_work_.wait(lk, [&]{ return stop_ || may_claim(); });
+        if (stop_ || next_ >= files_.size()) return;
+        i = next_++;
       }
 
-      auto read_and_scatter_i64 = [&](const char* name, vector<int64_t>& out_vec)
+      DecodedFile<Batch> r;
+      decode_file<Streamer>(files_[i].path, start_ns_, end_ns_, sel_, arena,
+                            [this]{ return spare_batch(); }, r, stop_flag_);
+
       {
-        const int idx = find_col_idx(schema, name);
-        if (idx < 0) throw runtime_error(string("trade: missing ") + name);
-        vector<int64_t> tmp;
-        read_required_i64_column(*rg, idx, tmp);
+        lock_guard<mutex> lk(mu_);
+        in_flight_bytes_ += r.bytes;
+        arena_bytes_[w] = arena.bytes();
+        allocs_ += arena.allocs - arena_allocs;
+        arena_allocs = arena.allocs;
+        note_peak();
+        slots_[i] = move(r);
+        ready_[i] = true;
+      }
+      cv_done_.notify_all();
+    }
+  }
 
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) out_vec[w++] = tmp[i];
-        }
-      };
+  const vector<Candidate>& files_;
+  int64_t start_ns_;
+  int64_t end_ns_;
+  Sel sel_;
+  ParallelScan cfg_;
+
+  mutable mutex mu_;
+  condition_variable cv_work_;
+  condition_variable cv_done_;
+  bool stop_ = false;
+  atomic<bool> stop_flag_{false};  // polled between row groups
+  size_t next_ = 0;                // next file index to claim
+  size_t taken_ = 0;               // next file index the consumer will take
+  size_t in_flight_bytes_ = 0;
+  vector<Batch> spare_;            // drained batches handed back by the consumer
+  size_t spare_bytes_ = 0;
+  vector<size_t> arena_bytes_;     // per worker ScratchArena footprint
+  uint64_t allocs_ = 0;
+  uint64_t peak_bytes_ = 0;
+  vector<DecodedFile<Batch>> slots_;
+  vector<bool> ready_;
+  vector<thread> workers_;
+};
 
-      auto read_and_scatter_bool = [&](const char* name, vector<uint8_t>& out_vec)
-      {
-        const int idx = find_col_idx(schema, name);
-        if (idx < 0) throw runtime_error(string("trade: missing ") + name);
-        vector<uint8_t> tmp;
-        read_required_bool_column(*rg, idx, tmp);
+// Files -> batches, in candidate order: inline on the caller thread, or via
+// FileScanPool when ShardedDB::set_parallel() enabled workers.
+template <class Streamer, class Batch, class Sel>
+struct FileBatchSource
+{
+  vector<Candidate> files_;
+  size_t file_idx_ = 0;
+  int64_t start_ns_;
+  int64_t end_ns_;
+  Sel sel_;
 
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) out_vec[w++] = tmp[i];
-        }
-      };
+  Batch cur_;
+  string cur_file_base_;  // lifetime until next() is called again
+  ScanStats stats_;
 
-      if (sel.px)            read_and_scatter_i64("px", v_px);
-      if (sel.qty)           read_and_scatter_i64("qty", v_qty);
-      if (sel.tradeId)       read_and_scatter_i64("tradeId", v_tid);
-      if (sel.buyerOrderId)  read_and_scatter_i64("buyerOrderId", v_boid);
-      if (sel.sellerOrderId) read_and_scatter_i64("sellerOrderId", v_soid);
-      if (sel.tradeTime)     read_and_scatter_i64("tradeTime", v_ttime);
-      if (sel.isMarket)      read_and_scatter_bool("isMarket", v_isMkt);
-      if (sel.eventTime)     read_and_scatter_i64("eventTime", v_evt);
+  // serial
+  unique_ptr<Streamer> fs_;
+  ScratchArena arena_;
+  unique_ptr<FilePrefetcher::Impl> prefetch_;     // set_prefetch: next files read ahead
 
-      return true;
+  // parallel
+  unique_ptr<FileScanPool<Streamer, Batch, Sel>> pool_;
+  DecodedFile<Batch> pend_;
+  size_t pend_idx_ = 0;
+  string pend_path_;
+
+  FileBatchSource(vector<Candidate> files, int64_t s, int64_t e, Sel sel)
+  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel)
+  {
+    if (g_time_index) skip_indexed_misses();
+    if (g_parallel.workers > 0 && files_.size() > 1)
+      pool_ = make_unique<FileScanPool<Streamer, Batch, Sel>>(files_, s, e, sel, g_parallel);
+    else if (g_prefetch && files_.size() > 1)
+    {
+      vector<string> paths;
+      for (const auto& c : files_) paths.push_back(c.path);
+      prefetch_ = make_unique<FilePrefetcher::Impl>(move(paths), g_prefetch_cfg, /*hand_over=*/true);
     }
   }
-};
 
-struct FileStreamerDeltaCols
-{
-  unique_ptr<parquet::ParquetFileReader> reader;
-  shared_ptr<parquet::FileMetaData> md;
-  const parquet::SchemaDescriptor* schema = nullptr;
-  int rg_idx = 0;
+  // Drops candidates a fresh sidecar header rules out (their footer is never read)
+  void skip_indexed_misses()
+  {
+    ScopeTimer timer{stats_.filter_ns};
+    auto miss = [&](const Candidate& c)
+    {
+      if (!tsidx_file_misses(c.path, start_ns_, end_ns_)) return false;
+      if (g_debug) cerr << "[debug] tsidx: skip " << c.path << "\n";
+      ++stats_.files_skipped_by_index;
+      return true;
+    };
+    erase_if(files_, miss);
+  }
+
+  Clock::time_point returned_{};   // end of the previous next(): caller time starts
+  bool started_ = false;
 
-  explicit FileStreamerDeltaCols(string path)
+  bool next()
   {
-    //cerr << path << endl;
-    reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
-    md     = reader->metadata();
-    schema = md->schema();
+    if (started_) stats_.consumer_ns += ns_since(returned_);
+    started_ = true;
+
+    const bool ok = pool_ ? next_parallel() : next_serial();
+    if (ok) stats_.rows_emitted += cur_.n;
+    returned_ = Clock::now();
+    return ok;
   }
 
-  bool next_rg(
-      int64_t start_ns, int64_t end_ns, const DeltaSelect& sel,
-      vector<int64_t>& v_ts, vector<int64_t>& v_fid, vector<int64_t>& v_lid, vector<int64_t>& v_evt,
-      vector<uint32_t>& ask_off, vector<int64_t>& ask_px, vector<int64_t>& ask_qty,
-      vector<uint32_t>& bid_off, vector<int64_t>& bid_px, vector<int64_t>& bid_qty)
+  bool next_serial()
   {
     while (true)
     {
-      if (rg_idx >= md->num_row_groups()) return false;
+      if (!fs_)
+      {
+        if (file_idx_ >= files_.size()) return false;
 
-      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_idx++);
-      auto rmd = rg->metadata();
-      int64_t rows = rmd->num_rows();
+        // owned buffer / mapping when prefetched in those modes
+        shared_ptr<arrow::io::RandomAccessFile> input;
+        if (prefetch_) input = prefetch_->take(file_idx_, stats_);
 
-      int ts_i = find_col_idx(schema, "ts");
-      if (ts_i < 0) throw runtime_error("depth: missing ts");
-      Int64Cursor ts(rg->Column(ts_i), schema->Column(ts_i));
+        try
+        {
+          fs_ = make_unique<Streamer>(files_[file_idx_].path, arena_, move(input));
+          add_open_stats(*fs_, stats_);
+          cur_file_base_ = fs::path(files_[file_idx_].path).filename().string();
+        }
+        catch (const exception& e)
+        {
+          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
+          ++file_idx_;
+          continue;
+        }
+      }
 
-      optional<Int64Cursor> fid;
-      optional<Int64Cursor> lid;
-      optional<Int64Cursor> evt;
+      bool ok = false;
 
-      if (sel.firstId)
+      try
       {
-        int fid_i = find_col_idx(schema, "firstId");
-        if (fid_i < 0) throw runtime_error("depth: missing firstId");
-        fid.emplace(rg->Column(fid_i), schema->Column(fid_i));
+        ok = read_rg_counted(*fs_, start_ns_, end_ns_, sel_, cur_, stats_);
       }
-      if (sel.lastId)
+      catch (const exception& e)
       {
-        int lid_i = find_col_idx(schema, "lastId");
-        if (lid_i < 0) throw runtime_error("depth: missing lastId");
-        lid.emplace(rg->Column(lid_i), schema->Column(lid_i));
+        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
+        ok = false;
       }
-      if (sel.eventTime)
+
+      if (!ok)
       {
-        int evt_i = find_col_idx(schema, "eventTime");
-        if (evt_i < 0) throw runtime_error("depth: missing eventTime");
-        evt.emplace(rg->Column(evt_i), schema->Column(evt_i));
+        fs_.reset();
+        ++file_idx_;
+        continue;
       }
 
-      bool need_asks = (sel.ask_px || sel.ask_qty);
-      bool need_bids = (sel.bid_px || sel.bid_qty);
+      stats_.buffer_allocs     = arena_.allocs;
+      stats_.buffer_peak_bytes = max<uint64_t>(stats_.buffer_peak_bytes, arena_.bytes() + cur_.bytes());
 
-      optional<Int64Cursor> apx;
-      optional<Int64Cursor> aqty;
-      optional<Int64Cursor> bpx;
-      optional<Int64Cursor> bqty;
+      if (cur_.n == 0) continue;
+      return true;
+    }
+  }
 
-      if (need_asks)
+  bool next_parallel()
+  {
+    while (true)
+    {
+      if (pend_idx_ < pend_.batches.size())
       {
-        if (sel.ask_px)
-        {
-          int apx_i = find_col_idx(schema, "ask.list.element.px");
-          if (apx_i < 0) throw runtime_error("depth: missing ask px");
-          apx.emplace(rg->Column(apx_i), schema->Column(apx_i));
-        }
-        if (sel.ask_qty)
-        {
-          int aqty_i = find_col_idx(schema, "ask.list.element.qty");
-          if (aqty_i < 0) throw runtime_error("depth: missing ask qty");
-          aqty.emplace(rg->Column(aqty_i), schema->Column(aqty_i));
-        }
+        pool_->recycle(move(cur_));
+        cur_ = move(pend_.batches[pend_idx_++]);
+        return true;
       }
 
-      if (need_bids)
+      // drained: report a mid-file read failure after its good batches
+      if (!pend_.error.empty())
       {
-        if (sel.bid_px)
-        {
-          int bpx_i = find_col_idx(schema, "bid.list.element.px");
-          if (bpx_i < 0) throw runtime_error("depth: missing bid px");
-          bpx.emplace(rg->Column(bpx_i), schema->Column(bpx_i));
-        }
-        if (sel.bid_qty)
-        {
-          int bqty_i = find_col_idx(schema, "bid.list.element.qty");
-          if (bqty_i < 0) throw runtime_error("depth: missing bid qty");
-          bqty.emplace(rg->Column(bqty_i), schema->Column(bqty_i));
-        }
+        cerr << "WARN: read failed: " << pend_path_ << " : " << pend_.error << "\n";
+        pend_.error.clear();
       }
 
-      v_ts.clear();
-      v_fid.clear();
-      v_lid.clear();
-      v_evt.clear();
-      ask_off.clear();
-      ask_px.clear();
-      ask_qty.clear();
-      bid_off.clear();
-      bid_px.clear();
-      bid_qty.clear();
+      if (file_idx_ >= files_.size()) return false;
 
-      v_ts.reserve(rows);
-      if (sel.firstId)   v_fid.reserve(rows);
-      if (sel.lastId)    v_lid.reserve(rows);
-      if (sel.eventTime) v_evt.reserve(rows);
-      if (need_asks) { ask_off.reserve(rows + 1); ask_off.push_back(0); }
-      if (need_bids) { bid_off.reserve(rows + 1); bid_off.push_back(0); }
+      pend_ = pool_->take(file_idx_);
+      pend_idx_ = 0;
+      pend_path_ = files_[file_idx_].path;
+      ++file_idx_;
+      add_stats(stats_, pend_.stats);
+      stats_.buffer_allocs     = pool_->allocs();
+      stats_.buffer_peak_bytes = pool_->peak_bytes();
 
-      for (int64_t r = 0; r < rows; ++r)
+      if (pend_.open_failed)
       {
-        Entry e_ts = ts.take();
-
-        Entry e_fid{};
-        Entry e_lid{};
-        Entry e_evt{};
-        if (sel.firstId)   e_fid = fid->take();
-        if (sel.lastId)    e_lid = lid->take();
-        if (sel.eventTime) e_evt = evt->take();
-
-        bool in_range = (e_ts.value >= start_ns && e_ts.value < end_ns);
-
-        uint32_t asks_added = 0;
-        uint32_t bids_added = 0;
-
-        if (need_asks)
-        {
-          if (sel.ask_px && sel.ask_qty)
-          {
-            asks_added = append_list_pairs_for_row_typed(
-                *apx, *aqty,
-                in_range ? &ask_px : nullptr,
-                in_range ? &ask_qty : nullptr);
-          }
-          else if (sel.ask_px)
-          {
-            asks_added = append_list_from_leaf_for_row(*apx, in_range ? &ask_px : nullptr);
-          }
-          else if (sel.ask_qty)
-          {
-            asks_added = append_list_from_leaf_for_row(*aqty, in_range ? &ask_qty : nullptr);
-          }
-        }
-
-        if (need_bids)
-        {
-          if (sel.bid_px && sel.bid_qty)
-          {
-            bids_added = append_list_pairs_for_row_typed(
-                *bpx, *bqty,
-                in_range ? &bid_px : nullptr,
-                in_range ? &bid_qty : nullptr);
-          }
-          else if (sel.bid_px)
-          {
-            bids_added = append_list_from_leaf_for_row(*bpx, in_range ? &bid_px : nullptr);
-          }
-          else if (sel.bid_qty)
-          {
-            bids_added = append_list_from_leaf_for_row(*bqty, in_range ? &bid_qty : nullptr);
-          }
-        }
-
-        if (in_range)
-        {
-          v_ts.push_back(e_ts.value);
-          if (sel.firstId)   v_fid.push_back(e_fid.value);
-          if (sel.lastId)    v_lid.push_back(e_lid.value);
-          if (sel.eventTime) v_evt.push_back(e_evt.value);
-
-          if (need_asks) ask_off.push_back(ask_off.back() + asks_added);
-          if (need_bids) bid_off.push_back(bid_off.back() + bids_added);
-        }
+        cerr << "WARN: open failed: " << pend_path_ << " : " << pend_.error << "\n";
+        pend_ = DecodedFile<Batch>{};
+        continue;
       }
-
-      if (!v_ts.empty()) return true;
+      cur_file_base_ = fs::path(pend_path_).filename().string();
     }
   }
 };
@@ -872,321 +3525,589 @@ struct ShardedDB::Impl
   string root_;
   optional<string> sampling_;
 
+  // created on first lookup while ShardedDB::set_catalog(true)
+  mutable mutex catalog_mu_;
+  mutable unique_ptr<FileCatalog> catalog_;
+
   Impl(string root, optional<string> sampling)
   : root_(move(root)), sampling_(move(sampling)) {}
 
+  FileCatalog* catalog() const
+  {
+    if (!g_catalog) return nullptr;
+    lock_guard<mutex> lk(catalog_mu_);
+    if (!catalog_) catalog_ = make_unique<FileCatalog>(root_);
+    return catalog_.get();
+  }
+
   unique_ptr<TopBatchReader>   get_top  (int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const;
   unique_ptr<TradeBatchReader> get_trade(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel) const;
   unique_ptr<DeltaBatchReader> get_depth(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const;
 };
 
+static void debug_candidates(const char* kind, const vector<Candidate>& files)
+{
+  if (!g_debug) return;
+  cerr << "[debug] " << kind << ": " << files.size() << " candidate files\n";
+  for (const auto& c : files) {
+    cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
+         << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
+  }
+}
+
 struct ShardedDB::TopBatchReader::Impl
 {
-  vector<Candidate> files_;
-  size_t file_idx_ = 0;
-  unique_ptr<FileStreamerTopCols> fs_;
-  int64_t start_ns_;
-  int64_t end_ns_;
+  FileBatchSource<FileStreamerTopCols, TopBatch, TopSelect> src_;
   TopSelect sel_;
 
-  // batch buffers
-  vector<int64_t> ts_;
-  vector<int64_t> apx_;
-  vector<int64_t> aq_;
-  vector<int64_t> bpx_;
-  vector<int64_t> bq_;
-  vector<int64_t> val_;
-  // sampled extras
-  vector<int64_t> min_bpx_, max_bpx_, min_apx_, max_apx_;
-  vector<int64_t> min_bts_, max_bts_, min_ats_, max_ats_;
+  Impl(vector<Candidate> files, int64_t s, int64_t e, TopSelect sel)
+  : src_(move(files), s, e, sel), sel_(sel)
+  {
+    debug_candidates("top", src_.files_);
+  }
 
-  // current file basename (lifetime until next() is called again)
-  string cur_file_base_;
+  const ScanStats& stats() const { return src_.stats_; }
 
-  Impl(vector<Candidate> files, int64_t s, int64_t e, TopSelect sel)
-  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel)
+  bool next(TopColsView& out)
   {
-    if (g_debug) {
-      cerr << "[debug] top: " << files_.size() << " candidate files\n";
-      for (const auto& c : files_) {
-        cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
-             << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
-      }
+    if (!src_.next()) return false;
+    out = src_.cur_.view;
+    out.file = src_.cur_file_base_.c_str();
+    out.n    = src_.cur_.n;
+    return true;
+  }
+};
+
+struct ShardedDB::TradeBatchReader::Impl
+{
+  FileBatchSource<FileStreamerTradeCols, TradeBatch, TradeSelect> src_;
+  TradeSelect sel_;
+
+  Impl(vector<Candidate> files, int64_t s, int64_t e, TradeSelect sel)
+  : src_(move(files), s, e, sel), sel_(sel)
+  {
+    debug_candidates("trade", src_.files_);
+  }
+
+  const ScanStats& stats() const { return src_.stats_; }
+
+  bool next(TradeColsView& out)
+  {
+    if (!src_.next()) return false;
+    out = src_.cur_.view;
+    out.file = src_.cur_file_base_.c_str();
+    out.n    = src_.cur_.n;
+    return true;
+  }
+};
+
+struct ShardedDB::DeltaBatchReader::Impl
+{
+  FileBatchSource<FileStreamerDeltaCols, DeltaBatch, DeltaSelect> src_;
+  DeltaSelect sel_;
+
+  Impl(vector<Candidate> files, int64_t s, int64_t e, DeltaSelect sel)
+  : src_(move(files), s, e, sel), sel_(sel)
+  {
+    debug_candidates("depth", src_.files_);
+  }
+
+  const ScanStats& stats() const { return src_.stats_; }
+
+  bool next(DeltaColsView& out)
+  {
+    if (!src_.next()) return false;
+    const DeltaBatch& b = src_.cur_;
+
+    out.ts        = sel_.ts        ? b.ts.data()  : nullptr;
+    out.firstId   = sel_.firstId   ? b.fid.data() : nullptr;
+    out.lastId    = sel_.lastId    ? b.lid.data() : nullptr;
+    out.eventTime = sel_.eventTime ? b.evt.data() : nullptr;
+
+    bool have_asks = sel_.ask_px || sel_.ask_qty;
+    bool have_bids = sel_.bid_px || sel_.bid_qty;
+
+    out.ask_off = have_asks ? b.ask_off.data() : nullptr;
+    out.ask_px  = sel_.ask_px ? b.ask_px.data() : nullptr;
+    out.ask_qty = sel_.ask_qty ? b.ask_qty.data() : nullptr;
+
+    out.bid_off = have_bids ? b.bid_off.data() : nullptr;
+    out.bid_px  = sel_.bid_px ? b.bid_px.data() : nullptr;
+    out.bid_qty = sel_.bid_qty ? b.bid_qty.data() : nullptr;
+
+    out.file = src_.cur_file_base_.c_str();
+    out.n    = b.n;
+    return true;
+  }
+};
+
+// Min-heap of per-symbol cursors over their current batch. The smallest head
+// copies its whole run below the next head in one go, so interleaved symbols
+// cost one heap step per run, not per row.
+struct ShardedDB::TopMultiReader::Impl
+{
+  // Columns copied per row run (pointer-to-member into TopColsView)
+  static constexpr const int64_t* TopColsView::* COLS[] = {
+    &TopColsView::ts, &TopColsView::ask_px, &TopColsView::ask_qty, &TopColsView::bid_px,
+    &TopColsView::bid_qty, &TopColsView::valu,
+    &TopColsView::min_bid_px, &TopColsView::max_bid_px, &TopColsView::min_ask_px, &TopColsView::max_ask_px,
+    &TopColsView::min_bid_ts, &TopColsView::max_bid_ts, &TopColsView::min_ask_ts, &TopColsView::max_ask_ts,
+  };
+  static constexpr size_t NCOLS = sizeof(COLS) / sizeof(COLS[0]);
+
+  struct Cursor
+  {
+    unique_ptr<TopBatchReader> rdr;
+    TopColsView v{};
+    size_t pos = 0;
+  };
+
+  vector<Cursor> cur_;
+  vector<uint32_t> heap_;        // symbol ids, smallest (ts, id) at front
+  size_t batch_rows_;
+  bool started_ = false;
+
+  vector<int64_t> out_[NCOLS];
+  vector<uint32_t> sym_;
+  ScanStats stats_;
+  Clock::time_point returned_{};
+  uint64_t consumer_ns_ = 0;
+
+  Impl(vector<unique_ptr<TopBatchReader>> rdrs, size_t batch_rows)
+  : batch_rows_(max<size_t>(batch_rows, 1))
+  {
+    cur_.resize(rdrs.size());
+    for (size_t i = 0; i < rdrs.size(); ++i) cur_[i].rdr = move(rdrs[i]);
+  }
+
+  int64_t head_ts(uint32_t i) const { return cur_[i].v.ts[cur_[i].pos]; }
+
+  // min-heap order for std::*_heap (which builds max-heaps)
+  bool later(uint32_t a, uint32_t b) const
+  {
+    const int64_t ta = head_ts(a), tb = head_ts(b);
+    return ta != tb ? ta > tb : a > b;
+  }
+
+  // Next non-empty batch of symbol i; false once the symbol is exhausted
+  bool refill(uint32_t i)
+  {
+    Cursor& c = cur_[i];
+    while (c.rdr->next(c.v))
+    {
+      c.pos = 0;
+      if (c.v.n > 0) return true;
     }
+    c.v.n = 0;
+    return false;
   }
 
-  bool next(TopColsView& out)
+  const ScanStats& stats()
   {
-    while (true)
+    stats_ = ScanStats{};
+    for (const Cursor& c : cur_)
     {
-      if (!fs_)
-      {
-        if (file_idx_ >= files_.size()) return false;
+      const ScanStats& s = c.rdr->stats();
+      add_stats(stats_, s);
+      stats_.buffer_allocs     += s.buffer_allocs;
+      stats_.buffer_peak_bytes += s.buffer_peak_bytes;
+    }
+    stats_.consumer_ns = consumer_ns_;
+    return stats_;
+  }
 
-        // Prefetch next file (if any)
-        if (file_idx_ + 1 < files_.size()) prefetch_path(files_[file_idx_ + 1].path);
+  bool next(TopMultiColsView& out)
+  {
+    auto cmp = [this](uint32_t a, uint32_t b) { return later(a, b); };
 
-        try
-        {
-          fs_ = make_unique<FileStreamerTopCols>(files_[file_idx_].path);
-          cur_file_base_ = fs::path(files_[file_idx_].path).filename().string();
-        }
-        catch (const exception& e)
-        {
-          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-          ++file_idx_;
-          continue;
-        }
-      }
+    if (started_) consumer_ns_ += ns_since(returned_);
+    if (!started_)
+    {
+      started_ = true;
+      for (uint32_t i = 0; i < cur_.size(); ++i)
+        if (refill(i)) heap_.push_back(i);
+      make_heap(heap_.begin(), heap_.end(), cmp);
+    }
 
-      bool ok = false;
+    for (auto& o : out_) o.clear();
+    sym_.clear();
 
-      try
-      {
-        ok = fs_->next_rg(
-            start_ns_, end_ns_, sel_,
-            ts_, apx_, aq_, bpx_, bq_, val_,
-            min_bpx_, max_bpx_, min_apx_, max_apx_,
-            min_bts_, max_bts_, min_ats_, max_ats_);
-      }
-      catch (const exception& e)
+    // which view columns are present (same for every symbol: one TopSelect)
+    bool have[NCOLS] = {};
+    if (!heap_.empty())
+      for (size_t k = 0; k < NCOLS; ++k) have[k] = cur_[heap_.front()].v.*COLS[k] != nullptr;
+
+    while (!heap_.empty() && sym_.size() < batch_rows_)
+    {
+      pop_heap(heap_.begin(), heap_.end(), cmp);
+      const uint32_t i = heap_.back();
+      heap_.pop_back();
+
+      Cursor& c = cur_[i];
+      const int64_t* ts = c.v.ts;
+
+      // rows of i that precede the next head (ts, id)
+      size_t end = c.pos + min(c.v.n - c.pos, batch_rows_ - sym_.size());
+      if (!heap_.empty())
       {
-        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-        ok = false;
+        const uint32_t j = heap_.front();
+        const int64_t bound = head_ts(j);
+        size_t p = c.pos + 1;
+        while (p < end && (ts[p] < bound || (ts[p] == bound && i < j))) ++p;
+        end = p;
       }
 
-      if (!ok)
+      for (size_t k = 0; k < NCOLS; ++k)
+        if (have[k])
+        {
+          const int64_t* col = c.v.*COLS[k];
+          out_[k].insert(out_[k].end(), col + c.pos, col + end);
+        }
+      sym_.insert(sym_.end(), end - c.pos, i);
+
+      c.pos = end;
+      if (c.pos < c.v.n || refill(i))
       {
-        fs_.reset();
-        ++file_idx_;
-        continue;
+        heap_.push_back(i);
+        push_heap(heap_.begin(), heap_.end(), cmp);
       }
-
-      if (ts_.empty()) continue;
-
-      out.ts        = sel_.ts        ? ts_.data()       : nullptr;
-      out.ask_px    = sel_.ask_px    ? apx_.data()      : nullptr;
-      out.ask_qty   = sel_.ask_qty   ? aq_.data()       : nullptr;
-      out.bid_px    = sel_.bid_px    ? bpx_.data()      : nullptr;
-      out.bid_qty   = sel_.bid_qty   ? bq_.data()       : nullptr;
-      out.valu      = sel_.valu      ? val_.data()      : nullptr;
-
-      out.min_bid_px = sel_.min_bid_px ? min_bpx_.data() : nullptr;
-      out.max_bid_px = sel_.max_bid_px ? max_bpx_.data() : nullptr;
-      out.min_ask_px = sel_.min_ask_px ? min_apx_.data() : nullptr;
-      out.max_ask_px = sel_.max_ask_px ? max_apx_.data() : nullptr;
-      out.min_bid_ts = sel_.min_bid_ts ? min_bts_.data() : nullptr;
-      out.max_bid_ts = sel_.max_bid_ts ? max_bts_.data() : nullptr;
-      out.min_ask_ts = sel_.min_ask_ts ? min_ats_.data() : nullptr;
-      out.max_ask_ts = sel_.max_ask_ts ? max_ats_.data() : nullptr;
-
-      out.file = cur_file_base_.c_str();
-      out.n = ts_.size();
-      return true;
     }
+
+    returned_ = Clock::now();
+    if (sym_.empty()) return false;
+
+    out = TopMultiColsView{};
+    for (size_t k = 0; k < NCOLS; ++k)
+      if (have[k]) out.top.*COLS[k] = out_[k].data();
+    out.top.n = sym_.size();
+    out.sym   = sym_.data();
+    out.n     = sym_.size();
+    return true;
   }
 };
 
-struct ShardedDB::TradeBatchReader::Impl
+// Carries each symbol's last quote forward over the merged stream and emits a
+// snapshot row per event, or per grid point once every event up to it is applied.
+struct ShardedDB::TopAsofReader::Impl
 {
-  vector<Candidate> files_;
-  size_t file_idx_ = 0;
-  unique_ptr<FileStreamerTradeCols> fs_;
-  int64_t start_ns_;
-  int64_t end_ns_;
-  TradeSelect sel_;
-
-  vector<int64_t> ts_;
-  vector<int64_t> px_;
-  vector<int64_t> qty_;
-  vector<int64_t> tid_;
-  vector<int64_t> boid_;
-  vector<int64_t> soid_;
-  vector<int64_t> ttime_;
-  vector<uint8_t> isMkt_;
-  vector<int64_t> evt_;
+  struct Quote
+  {
+    int64_t ts = 0, ask_px = 0, ask_qty = 0, bid_px = 0, bid_qty = 0;
+    bool seen = false;
+  };
+
+  unique_ptr<TopMultiReader> src_;
+  AsofSpec spec_;
+  size_t nsym_;
+  vector<Quote> last_;
+
+  TopMultiColsView in_{};
+  size_t in_pos_ = 0;
+  int64_t last_event_ts_ = 0;
+  int64_t next_grid_ = 0;
+  bool grid_started_ = false;
+
+  vector<int64_t> ts_, ask_px_, ask_qty_, bid_px_, bid_qty_, quote_ts_;
+  vector<uint32_t> trigger_;
+  vector<uint8_t> valid_;
+
+  Impl(unique_ptr<TopMultiReader> src, size_t nsym, AsofSpec spec)
+  : src_(move(src)), spec_(spec), nsym_(nsym), last_(nsym)
+  {
+    spec_.batch_rows = max<size_t>(spec_.batch_rows, 1);
+  }
 
-  string cur_file_base_;
+  const ScanStats& stats() const { return src_->stats(); }
 
-  Impl(vector<Candidate> files, int64_t s, int64_t e, TradeSelect sel)
-  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel)
+  // true while an unapplied input row exists (at in_[in_pos_])
+  bool peek()
   {
-    if (g_debug) {
-      cerr << "[debug] trade: " << files_.size() << " candidate files\n";
-      for (const auto& c : files_) {
-        cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
-             << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
-      }
+    while (in_pos_ >= in_.n)
+    {
+      if (!src_->next(in_)) { in_.n = 0; return false; }
+      in_pos_ = 0;
     }
+    return true;
   }
 
-  bool next(TradeColsView& out)
+  uint32_t apply()
   {
-    while (true)
-    {
-      if (!fs_)
-      {
-        if (file_idx_ >= files_.size()) return false;
-
-        // Prefetch next file (if any)
-        if (file_idx_ + 1 < files_.size()) prefetch_path(files_[file_idx_ + 1].path);
+    const size_t i = in_pos_++;
+    const uint32_t s = in_.sym[i];
+    Quote& q = last_[s];
+    q.ts      = in_.top.ts[i];
+    q.ask_px  = in_.top.ask_px[i];
+    q.ask_qty = in_.top.ask_qty[i];
+    q.bid_px  = in_.top.bid_px[i];
+    q.bid_qty = in_.top.bid_qty[i];
+    q.seen    = true;
+    last_event_ts_ = q.ts;
+    return s;
+  }
 
-        try
-        {
-          fs_ = make_unique<FileStreamerTradeCols>(files_[file_idx_].path);
-          cur_file_base_ = fs::path(files_[file_idx_].path).filename().string();
-        }
-        catch (const exception& e)
-        {
-          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-          ++file_idx_;
-          continue;
-        }
-      }
+  void emit(int64_t t)
+  {
+    ts_.push_back(t);
+    for (const Quote& q : last_)
+    {
+      ask_px_.push_back(q.ask_px);
+      ask_qty_.push_back(q.ask_qty);
+      bid_px_.push_back(q.bid_px);
+      bid_qty_.push_back(q.bid_qty);
+      quote_ts_.push_back(q.ts);
+      valid_.push_back(q.seen && (spec_.max_age_ns <= 0 || t - q.ts <= spec_.max_age_ns));
+    }
+  }
 
-      bool ok = false;
+  bool next(TopAsofView& out)
+  {
+    for (auto* v : {&ts_, &ask_px_, &ask_qty_, &bid_px_, &bid_qty_, &quote_ts_}) v->clear();
+    trigger_.clear();
+    valid_.clear();
 
-      try
+    const bool grid = spec_.grid_ns > 0;
+    if (!grid)
+    {
+      while (ts_.size() < spec_.batch_rows && peek())
       {
-        ok = fs_->next_rg(
-            start_ns_, end_ns_, sel_,
-            ts_, px_, qty_, tid_, boid_, soid_, ttime_, isMkt_, evt_);
+        trigger_.push_back(apply());
+        emit(last_event_ts_);
       }
-      catch (const exception& e)
+    }
+    else
+    {
+      if (!grid_started_)
       {
-        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-        ok = false;
+        if (!peek()) return false;
+        const int64_t g = spec_.grid_ns;
+        const int64_t t0 = in_.top.ts[in_pos_];
+        next_grid_ = (t0 / g + (t0 % g != 0)) * g;  // first grid point >= first event
+        grid_started_ = true;
       }
 
-      if (!ok)
+      while (ts_.size() < spec_.batch_rows)
       {
-        fs_.reset();
-        ++file_idx_;
-        continue;
+        while (peek() && in_.top.ts[in_pos_] <= next_grid_) apply();
+        if (!peek() && next_grid_ > last_event_ts_) break;
+        emit(next_grid_);
+        next_grid_ += spec_.grid_ns;
       }
-
-      if (ts_.empty()) continue;
-
-      out.ts            = sel_.ts            ? ts_.data()     : nullptr;
-      out.px            = sel_.px            ? px_.data()     : nullptr;
-      out.qty           = sel_.qty           ? qty_.data()    : nullptr;
-      out.tradeId       = sel_.tradeId       ? tid_.data()    : nullptr;
-      out.buyerOrderId  = sel_.buyerOrderId  ? boid_.data()   : nullptr;
-      out.sellerOrderId = sel_.sellerOrderId ? soid_.data()   : nullptr;
-      out.tradeTime     = sel_.tradeTime     ? ttime_.data()  : nullptr;
-      out.isMarket      = sel_.isMarket      ? isMkt_.data()  : nullptr;
-      out.eventTime     = sel_.eventTime     ? evt_.data()    : nullptr;
-
-      out.file = cur_file_base_.c_str();
-      out.n    = ts_.size();
-      return true;
     }
+
+    if (ts_.empty()) return false;
+
+    out = TopAsofView{};
+    out.ts       = ts_.data();
+    out.trigger  = grid ? nullptr : trigger_.data();
+    out.nsym     = nsym_;
+    out.ask_px   = ask_px_.data();
+    out.ask_qty  = ask_qty_.data();
+    out.bid_px   = bid_px_.data();
+    out.bid_qty  = bid_qty_.data();
+    out.quote_ts = quote_ts_.data();
+    out.valid    = valid_.data();
+    out.n        = ts_.size();
+    return true;
   }
 };
 
-struct ShardedDB::DeltaBatchReader::Impl
+// ======== Time bars (streaming aggregation over top / trade readers) ========
+
+static int64_t bar_start(int64_t ts, int64_t step)
 {
-  vector<Candidate> files_;
-  size_t file_idx_ = 0;
-  unique_ptr<FileStreamerDeltaCols> fs_;
-  int64_t start_ns_;
-  int64_t end_ns_;
-  DeltaSelect sel_;
+  const int64_t r = ts % step;
+  return ts - (r < 0 ? r + step : r);
+}
+
+// Sampled-file columns per bar: last quote, min/max px with the first ts reaching them
+struct ShardedDB::TopBarReader::Impl
+{
+  struct Bar
+  {
+    int64_t ts = 0, count = 0;
+    int64_t apx = 0, aq = 0, bpx = 0, bq = 0, valu = 0;
+    int64_t min_bpx = 0, max_bpx = 0, min_apx = 0, max_apx = 0;
+    int64_t min_bts = 0, max_bts = 0, min_ats = 0, max_ats = 0;
+  };
 
-  vector<int64_t> ts_;
-  vector<int64_t> fid_;
-  vector<int64_t> lid_;
-  vector<int64_t> evt_;
-  vector<uint32_t> ask_off_;
-  vector<uint32_t> bid_off_;
-  vector<int64_t>  ask_px_;
-  vector<int64_t>  ask_qty_;
-  vector<int64_t>  bid_px_;
-  vector<int64_t>  bid_qty_;
+  unique_ptr<TopBatchReader> src_;
+  int64_t step_;
+  size_t batch_rows_;
+  Bar cur_{};
+  bool open_ = false;
+  bool eof_ = false;
 
-  string cur_file_base_;
+  vector<int64_t> ts_, apx_, aq_, bpx_, bq_, valu_, count_;
+  vector<int64_t> min_bpx_, max_bpx_, min_apx_, max_apx_, min_bts_, max_bts_, min_ats_, max_ats_;
 
-  Impl(vector<Candidate> files, int64_t s, int64_t e, DeltaSelect sel)
-  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel)
+  Impl(unique_ptr<TopBatchReader> src, int64_t step, size_t batch_rows)
+  : src_(move(src)), step_(step), batch_rows_(max<size_t>(batch_rows, 1)) {}
+
+  const ScanStats& stats() const { return src_->stats(); }
+
+  void flush()
   {
-    if (g_debug) {
-      cerr << "[debug] depth: " << files_.size() << " candidate files\n";
-      for (const auto& c : files_) {
-        cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
-             << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
-      }
-    }
+    const Bar& b = cur_;
+    ts_.push_back(b.ts);   count_.push_back(b.count);
+    apx_.push_back(b.apx); aq_.push_back(b.aq); bpx_.push_back(b.bpx); bq_.push_back(b.bq);
+    valu_.push_back(b.valu);
+    min_bpx_.push_back(b.min_bpx); max_bpx_.push_back(b.max_bpx);
+    min_apx_.push_back(b.min_apx); max_apx_.push_back(b.max_apx);
+    min_bts_.push_back(b.min_bts); max_bts_.push_back(b.max_bts);
+    min_ats_.push_back(b.min_ats); max_ats_.push_back(b.max_ats);
+    open_ = false;
   }
 
-  bool next(DeltaColsView& out)
+  void add(const TopColsView& v, size_t i)
   {
-    while (true)
+    const int64_t t = v.ts[i];
+    const int64_t a = v.ask_px[i], b = v.bid_px[i];
+    Bar& r = cur_;
+    if (!open_)
     {
-      if (!fs_)
-      {
-        if (file_idx_ >= files_.size()) return false;
+      r = Bar{};
+      r.ts = bar_start(t, step_);
+      r.min_bpx = r.max_bpx = b; r.min_bts = r.max_bts = t;
+      r.min_apx = r.max_apx = a; r.min_ats = r.max_ats = t;
+      open_ = true;
+    }
+    else
+    {
+      if (b < r.min_bpx) { r.min_bpx = b; r.min_bts = t; }
+      if (b > r.max_bpx) { r.max_bpx = b; r.max_bts = t; }
+      if (a < r.min_apx) { r.min_apx = a; r.min_ats = t; }
+      if (a > r.max_apx) { r.max_apx = a; r.max_ats = t; }
+    }
+    r.apx = a; r.aq = v.ask_qty[i]; r.bpx = b; r.bq = v.bid_qty[i];
+    r.valu = v.valu ? v.valu[i] : 0;
+    ++r.count;
+  }
 
-        // Prefetch next file (if any)
-        if (file_idx_ + 1 < files_.size()) prefetch_path(files_[file_idx_ + 1].path);
+  bool next(TopBarView& out)
+  {
+    for (auto* v : {&ts_, &apx_, &aq_, &bpx_, &bq_, &valu_, &count_, &min_bpx_, &max_bpx_, &min_apx_,
+                    &max_apx_, &min_bts_, &max_bts_, &min_ats_, &max_ats_})
+      v->clear();
 
-        try
-        {
-          fs_ = make_unique<FileStreamerDeltaCols>(files_[file_idx_].path);
-          cur_file_base_ = fs::path(files_[file_idx_].path).filename().string();
-        }
-        catch (const exception& e)
-        {
-          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-          ++file_idx_;
-          continue;
-        }
+    TopColsView v{};
+    while (!eof_ && ts_.size() < batch_rows_)
+    {
+      if (!src_->next(v)) { eof_ = true; break; }
+      for (size_t i = 0; i < v.n; ++i)
+      {
+        if (open_ && v.ts[i] >= cur_.ts + step_) flush();
+        add(v, i);
       }
+    }
+    if (eof_ && open_) flush();
+    if (ts_.empty()) return false;
+
+    out = TopBarView{};
+    TopColsView& o = out.top;
+    o.ts = ts_.data();
+    o.ask_px = apx_.data(); o.ask_qty = aq_.data(); o.bid_px = bpx_.data(); o.bid_qty = bq_.data();
+    o.valu = valu_.data();
+    o.min_bid_px = min_bpx_.data(); o.max_bid_px = max_bpx_.data();
+    o.min_ask_px = min_apx_.data(); o.max_ask_px = max_apx_.data();
+    o.min_bid_ts = min_bts_.data(); o.max_bid_ts = max_bts_.data();
+    o.min_ask_ts = min_ats_.data(); o.max_ask_ts = max_ats_.data();
+    o.n = ts_.size();
+    out.count = count_.data();
+    out.n = ts_.size();
+    return true;
+  }
+};
 
-      bool ok = false;
+struct ShardedDB::TradeBarReader::Impl
+{
+  struct Bar
+  {
+    int64_t ts = 0, count = 0;
+    int64_t open = 0, high = 0, low = 0, close = 0, high_ts = 0, low_ts = 0;
+    __int128 volume = 0;    // sum(qty): a busy hour of a high-unit symbol overflows int64
+    __int128 notional = 0;  // sum(px * qty): 1e8-scaled px times 1e8-scaled qty overflows int64
+  };
 
-      try
-      {
-        ok = fs_->next_rg(
-            start_ns_, end_ns_, sel_,
-            ts_, fid_, lid_, evt_,
-            ask_off_, ask_px_, ask_qty_,
-            bid_off_, bid_px_, bid_qty_);
-      }
-      catch (const exception& e)
-      {
-        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-        ok = false;
-      }
+  unique_ptr<TradeBatchReader> src_;
+  int64_t step_;
+  size_t batch_rows_;
+  Bar cur_{};
+  bool open_ = false;
+  bool eof_ = false;
 
-      if (!ok)
-      {
-        fs_.reset();
-        ++file_idx_;
-        continue;
-      }
+  vector<int64_t> ts_, open_px_, high_, low_, close_, high_ts_, low_ts_, vwap_, volume_, count_;
+  vector<uint8_t> volume_sat_;
 
-      if (ts_.empty()) continue;
+  Impl(unique_ptr<TradeBatchReader> src, int64_t step, size_t batch_rows)
+  : src_(move(src)), step_(step), batch_rows_(max<size_t>(batch_rows, 1)) {}
 
-      out.ts        = sel_.ts        ? ts_.data()  : nullptr;
-      out.firstId   = sel_.firstId   ? fid_.data() : nullptr;
-      out.lastId    = sel_.lastId    ? lid_.data() : nullptr;
-      out.eventTime = sel_.eventTime ? evt_.data() : nullptr;
+  const ScanStats& stats() const { return src_->stats(); }
 
-      bool have_asks = sel_.ask_px || sel_.ask_qty;
-      bool have_bids = sel_.bid_px || sel_.bid_qty;
+  void flush()
+  {
+    const Bar& b = cur_;
+    int64_t vwap = b.close;
+    if (b.volume > 0) vwap = static_cast<int64_t>((b.notional + b.volume / 2) / b.volume);
+
+    ts_.push_back(b.ts);
+    open_px_.push_back(b.open); high_.push_back(b.high); low_.push_back(b.low); close_.push_back(b.close);
+    high_ts_.push_back(b.high_ts); low_ts_.push_back(b.low_ts);
+    const bool sat = b.volume > INT64_MAX;
+    vwap_.push_back(vwap); volume_.push_back(sat ? INT64_MAX : static_cast<int64_t>(b.volume));
+    volume_sat_.push_back(sat);
+    count_.push_back(b.count);
+    open_ = false;
+  }
 
-      out.ask_off = have_asks ? ask_off_.data() : nullptr;
-      out.ask_px  = sel_.ask_px ? ask_px_.data() : nullptr;
-      out.ask_qty = sel_.ask_qty ? ask_qty_.data() : nullptr;
+  void add(int64_t t, int64_t px, int64_t qty)
+  {
+    Bar& r = cur_;
+    if (!open_)
+    {
+      r = Bar{};
+      r.ts = bar_start(t, step_);
+      r.open = r.high = r.low = px;
+      r.high_ts = r.low_ts = t;
+      open_ = true;
+    }
+    else
+    {
+      if (px > r.high) { r.high = px; r.high_ts = t; }
+      if (px < r.low)  { r.low = px;  r.low_ts = t; }
+    }
+    r.close = px;
+    r.volume += qty;
+    r.notional += __int128(px) * qty;
+    ++r.count;
+  }
 
-      out.bid_off = have_bids ? bid_off_.data() : nullptr;
-      out.bid_px  = sel_.bid_px ? bid_px_.data() : nullptr;
-      out.bid_qty = sel_.bid_qty ? bid_qty_.data() : nullptr;
+  bool next(TradeBarView& out)
+  {
+    for (auto* v : {&ts_, &open_px_, &high_, &low_, &close_, &high_ts_, &low_ts_, &vwap_, &volume_, &count_})
+      v->clear();
+    volume_sat_.clear();
 
-      out.file = cur_file_base_.c_str();
-      out.n    = ts_.size();
-      return true;
+    TradeColsView v{};
+    while (!eof_ && ts_.size() < batch_rows_)
+    {
+      if (!src_->next(v)) { eof_ = true; break; }
+      for (size_t i = 0; i < v.n; ++i)
+      {
+        if (open_ && v.ts[i] >= cur_.ts + step_) flush();
+        add(v.ts[i], v.px[i], v.qty[i]);
+      }
     }
+    if (eof_ && open_) flush();
+    if (ts_.empty()) return false;
+
+    out = TradeBarView{};
+    out.ts = ts_.data();
+    out.open = open_px_.data(); out.high = high_.data(); out.low = low_.data(); out.close = close_.data();
+    out.high_ts = high_ts_.data(); out.low_ts = low_ts_.data();
+    out.vwap = vwap_.data(); out.volume = volume_.data(); out.volume_sat = volume_sat_.data();
+    out.count = count_.data();
+    out.n = ts_.size();
+    return true;
   }
 };
 
@@ -1204,35 +4125,66 @@ ShardedDB::TopBatchReader::TopBatchReader(TopBatchReader&&) noexcept = default;
 ShardedDB::TopBatchReader& ShardedDB::TopBatchReader::operator=(TopBatchReader&&) noexcept = default;
 ShardedDB::TopBatchReader::~TopBatchReader() = default;
 bool ShardedDB::TopBatchReader::next(TopColsView& out) { return impl_->next(out); }
+const ScanStats& ShardedDB::TopBatchReader::stats() const { return impl_->stats(); }
 
 ShardedDB::TradeBatchReader::TradeBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
 ShardedDB::TradeBatchReader::TradeBatchReader(TradeBatchReader&&) noexcept = default;
 ShardedDB::TradeBatchReader& ShardedDB::TradeBatchReader::operator=(TradeBatchReader&&) noexcept = default;
 ShardedDB::TradeBatchReader::~TradeBatchReader() = default;
 bool ShardedDB::TradeBatchReader::next(TradeColsView& out) { return impl_->next(out); }
+const ScanStats& ShardedDB::TradeBatchReader::stats() const { return impl_->stats(); }
 
 ShardedDB::DeltaBatchReader::DeltaBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
 ShardedDB::DeltaBatchReader::DeltaBatchReader(DeltaBatchReader&&) noexcept = default;
 ShardedDB::DeltaBatchReader& ShardedDB::DeltaBatchReader::operator=(DeltaBatchReader&&) noexcept = default;
 ShardedDB::DeltaBatchReader::~DeltaBatchReader() = default;
 bool ShardedDB::DeltaBatchReader::next(DeltaColsView& out) { return impl_->next(out); }
+const ScanStats& ShardedDB::DeltaBatchReader::stats() const { return impl_->stats(); }
+
+ShardedDB::TopMultiReader::TopMultiReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TopMultiReader::TopMultiReader(TopMultiReader&&) noexcept = default;
+ShardedDB::TopMultiReader& ShardedDB::TopMultiReader::operator=(TopMultiReader&&) noexcept = default;
+ShardedDB::TopMultiReader::~TopMultiReader() = default;
+bool ShardedDB::TopMultiReader::next(TopMultiColsView& out) { return impl_->next(out); }
+const ScanStats& ShardedDB::TopMultiReader::stats() const { return impl_->stats(); }
+
+ShardedDB::TopAsofReader::TopAsofReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TopAsofReader::TopAsofReader(TopAsofReader&&) noexcept = default;
+ShardedDB::TopAsofReader& ShardedDB::TopAsofReader::operator=(TopAsofReader&&) noexcept = default;
+ShardedDB::TopAsofReader::~TopAsofReader() = default;
+bool ShardedDB::TopAsofReader::next(TopAsofView& out) { return impl_->next(out); }
+const ScanStats& ShardedDB::TopAsofReader::stats() const { return impl_->stats(); }
+
+ShardedDB::TopBarReader::TopBarReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TopBarReader::TopBarReader(TopBarReader&&) noexcept = default;
+ShardedDB::TopBarReader& ShardedDB::TopBarReader::operator=(TopBarReader&&) noexcept = default;
+ShardedDB::TopBarReader::~TopBarReader() = default;
+bool ShardedDB::TopBarReader::next(TopBarView& out) { return impl_->next(out); }
+const ScanStats& ShardedDB::TopBarReader::stats() const { return impl_->stats(); }
+
+ShardedDB::TradeBarReader::TradeBarReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TradeBarReader::TradeBarReader(TradeBarReader&&) noexcept = default;
+ShardedDB::TradeBarReader& ShardedDB::TradeBarReader::operator=(TradeBarReader&&) noexcept = default;
+ShardedDB::TradeBarReader::~TradeBarReader() = default;
+bool ShardedDB::TradeBarReader::next(TradeBarView& out) { return impl_->next(out); }
+const ScanStats& ShardedDB::TradeBarReader::stats() const { return impl_->stats(); }
 
 // Market-aware
 unique_ptr<ShardedDB::TopBatchReader> ShardedDB::Impl::get_top(int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const
 {
-  auto files = candidate_files_strict(root_, symb, "top", market, s, e, sampling_);
+  auto files = candidate_files_strict(root_, symb, "top", market, s, e, sampling_, catalog());
   auto impl = make_unique<TopBatchReader::Impl>(move(files), s, e, sel);
   return make_unique<TopBatchReader>(move(impl));
 }
 unique_ptr<ShardedDB::TradeBatchReader> ShardedDB::Impl::get_trade(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel) const
 {
-  auto files = candidate_files_strict(root_, symb, "trade", market, s, e, nullopt);
+  auto files = candidate_files_strict(root_, symb, "trade", market, s, e, nullopt, catalog());
   auto impl = make_unique<TradeBatchReader::Impl>(move(files), s, e, sel);
   return make_unique<TradeBatchReader>(move(impl));
 }
 unique_ptr<ShardedDB::DeltaBatchReader> ShardedDB::Impl::get_depth(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const
 {
-  auto files = candidate_files_strict(root_, symb, "depth", market, s, e, nullopt);
+  auto files = candidate_files_strict(root_, symb, "depth", market, s, e, nullopt, catalog());
   auto impl = make_unique<DeltaBatchReader::Impl>(move(files), s, e, sel);
   return make_unique<DeltaBatchReader>(move(impl));
 }
@@ -1259,4 +4211,390 @@ unique_ptr<ShardedDB::TopBatchReader>   ShardedDB::get_top_cols  (int64_t s, int
 unique_ptr<ShardedDB::TradeBatchReader> ShardedDB::get_trade_cols(int64_t s, int64_t e, const string& symb, TradeSelect sel) const { return impl_->get_trade(s, e, symb, nullopt, sel); }
 unique_ptr<ShardedDB::DeltaBatchReader> ShardedDB::get_depth_cols(int64_t s, int64_t e, const string& symb, DeltaSelect sel) const { return impl_->get_depth(s, e, symb, nullopt, sel); }
 
+// Multi-symbol merge: one top reader per symbol, same window/market/selection
+unique_ptr<ShardedDB::TopMultiReader>
+ShardedDB::get_top_cols_multi(int64_t s, int64_t e, const vector<string>& symbs,
+                              optional<string> market, TopSelect sel, size_t batch_rows) const
+{
+  sel.ts = true;  // merge key
+  vector<unique_ptr<TopBatchReader>> rdrs;
+  rdrs.reserve(symbs.size());
+  for (const string& symb : symbs) rdrs.push_back(impl_->get_top(s, e, symb, market, sel));
+  return make_unique<TopMultiReader>(make_unique<TopMultiReader::Impl>(move(rdrs), batch_rows));
+}
+unique_ptr<ShardedDB::TopMultiReader>
+ShardedDB::get_top_cols_multi(int64_t s, int64_t e, const vector<string>& symbs, TopSelect sel) const
+{
+  return get_top_cols_multi(s, e, symbs, nullopt, sel);
+}
+
+// As-of join: ask/bid of every symbol carried forward over their ts-merged union
+unique_ptr<ShardedDB::TopAsofReader>
+ShardedDB::get_top_asof(int64_t s, int64_t e, const vector<string>& symbs,
+                        optional<string> market, AsofSpec spec) const
+{
+  TopSelect sel{};
+  sel.valu = false;
+  auto merged = get_top_cols_multi(s, e, symbs, move(market), sel, spec.batch_rows);
+  return make_unique<TopAsofReader>(make_unique<TopAsofReader::Impl>(move(merged), symbs.size(), spec));
+}
+
+// Time bars: raw ticks through the plain readers, aggregated on the fly
+unique_ptr<ShardedDB::TopBarReader>
+ShardedDB::get_top_bars(int64_t s, int64_t e, const string& symb, optional<string> market,
+                        int64_t step_ns, size_t batch_rows) const
+{
+  if (step_ns <= 0) throw runtime_error("get_top_bars: step_ns must be > 0");
+  TopSelect sel{};  // ts, ask/bid px+qty, valu
+  auto rdr = impl_->get_top(s, e, symb, move(market), sel);
+  return make_unique<TopBarReader>(make_unique<TopBarReader::Impl>(move(rdr), step_ns, batch_rows));
+}
+unique_ptr<ShardedDB::TradeBarReader>
+ShardedDB::get_trade_bars(int64_t s, int64_t e, const string& symb, optional<string> market,
+                          int64_t step_ns, size_t batch_rows) const
+{
+  if (step_ns <= 0) throw runtime_error("get_trade_bars: step_ns must be > 0");
+  TradeSelect sel{};
+  sel.tradeId = sel.buyerOrderId = sel.sellerOrderId = sel.tradeTime = sel.isMarket = sel.eventTime = false;
+  auto rdr = impl_->get_trade(s, e, symb, move(market), sel);
+  return make_unique<TradeBarReader>(make_unique<TradeBarReader::Impl>(move(rdr), step_ns, batch_rows));
+}
+
+// ======== L2 order book ========
+
+// One side: keys ascending with the best level last (bids: key = px, asks:
+// key = -px), qty parallel to it
+struct BookSide
+{
+  vector<int64_t> key;
+  vector<int64_t> qty;
+
+  // First index with key >= k: a short walk down from the top, then binary search
+  size_t find(int64_t k) const
+  {
+    const int64_t* d = key.data();
+    size_t lo = key.size();
+    for (int s = 0; s < 8 && lo > 0 && d[lo - 1] >= k; ++s) --lo;
+    if (lo > 0 && d[lo - 1] >= k) lo = static_cast<size_t>(lower_bound(d, d + lo, k) - d);
+    return lo;
+  }
+
+  void update(int64_t k, int64_t q, BookStats& st)
+  {
+    const size_t i = find(k);
+    const bool hit = i < key.size() && key[i] == k;
+    if (q == 0)
+    {
+      if (!hit) { ++st.removes_missing; return; }
+      key.erase(key.begin() + static_cast<ptrdiff_t>(i));
+      qty.erase(qty.begin() + static_cast<ptrdiff_t>(i));
+      ++st.levels_removed;
+      return;
+    }
+    ++st.levels_set;
+    if (hit) { qty[i] = q; return; }
+    key.insert(key.begin() + static_cast<ptrdiff_t>(i), k);
+    qty.insert(qty.begin() + static_cast<ptrdiff_t>(i), q);
+  }
+
+  void clear() { key.clear(); qty.clear(); }
+};
+
+struct OrderBook::Impl
+{
+  GapPolicy on_gap;
+  BookSide asks, bids;
+  BookStats st;
+  bool have_last = false;
+  int64_t last_id = 0;
+  int64_t last_ts = 0;
+
+  explicit Impl(GapPolicy g) : on_gap(g) {}
+
+  bool apply(const DeltaColsView& v, size_t i)
+  {
+    if (v.firstId && v.lastId)
+    {
+      const int64_t fid = v.firstId[i], lid = v.lastId[i];
+      if (have_last)
+      {
+        if (lid <= last_id) { ++st.stale; return false; }
+        if (fid > last_id + 1)
+        {
+          ++st.gaps;
+          st.ids_missed += static_cast<uint64_t>(fid - last_id - 1);
+          if (on_gap == GapPolicy::Reset) { asks.clear(); bids.clear(); ++st.resets; }
+        }
+      }
+      have_last = true;
+      last_id = lid;
+    }
+    if (v.ts) last_ts = v.ts[i];
+
+    if (v.ask_off)
+      for (uint32_t e = v.ask_off[i]; e < v.ask_off[i + 1]; ++e) asks.update(-v.ask_px[e], v.ask_qty[e], st);
+    if (v.bid_off)
+      for (uint32_t e = v.bid_off[i]; e < v.bid_off[i + 1]; ++e) bids.update(v.bid_px[e], v.bid_qty[e], st);
+
+    ++st.events;
+    if (!asks.key.empty() && !bids.key.empty() && bids.key.back() >= -asks.key.back()) ++st.crossed;
+    return true;
+  }
+};
+
+OrderBook::OrderBook(GapPolicy on_gap) : impl_(make_unique<Impl>(on_gap)) {}
+OrderBook::~OrderBook() = default;
+OrderBook::OrderBook(OrderBook&&) noexcept = default;
+OrderBook& OrderBook::operator=(OrderBook&&) noexcept = default;
+
+bool OrderBook::apply(const DeltaColsView& v, size_t i) { return impl_->apply(v, i); }
+
+size_t OrderBook::apply(const DeltaColsView& v)
+{
+  size_t n = 0;
+  for (size_t i = 0; i < v.n; ++i) n += impl_->apply(v, i);
+  return n;
+}
+
+void OrderBook::top(size_t n, BookSnapshot& out) const
+{
+  out.ts = impl_->last_ts;
+  out.lastId = impl_->last_id;
+  auto side = [n](const BookSide& s, bool ask, vector<BookLevel>& lv)
+  {
+    lv.clear();
+    for (size_t i = s.key.size(); i-- > 0 && lv.size() < n;)
+      lv.push_back(BookLevel{ask ? -s.key[i] : s.key[i], s.qty[i]});
+  };
+  side(impl_->asks, true, out.asks);
+  side(impl_->bids, false, out.bids);
+}
+
+size_t OrderBook::ask_levels() const { return impl_->asks.key.size(); }
+size_t OrderBook::bid_levels() const { return impl_->bids.key.size(); }
+
+void OrderBook::clear()
+{
+  impl_->asks.clear();
+  impl_->bids.clear();
+  impl_->have_last = false;
+}
+
+void OrderBook::restore(const BookSnapshot& s)
+{
+  auto side = [](BookSide& d, const vector<BookLevel>& lv, bool ask)
+  {
+    d.clear();
+    for (size_t i = lv.size(); i-- > 0;)   // best first -> best last
+    {
+      d.key.push_back(ask ? -lv[i].px : lv[i].px);
+      d.qty.push_back(lv[i].qty);
+    }
+  };
+  side(impl_->asks, s.asks, true);
+  side(impl_->bids, s.bids, false);
+  impl_->have_last = s.lastId != 0;
+  impl_->last_id = s.lastId;
+  impl_->last_ts = s.ts;
+}
+
+const BookStats& OrderBook::stats() const { return impl_->st; }
+
+// ======== Book checkpoints (<depth file>.book sidecars) ========
+// A checkpoint is the full book after the last row of one ts, so the rows
+// still to replay are exactly those with a larger ts: an ordinary ts window.
+
+static constexpr char BOOK_MAGIC[8] = {'P', 'Q', 'B', 'O', 'O', 'K', '1', '\0'};
+
+// Sidecar: header, count BookCkptEntry (ascending ts), levels BookLevel
+struct BookCkptHeader
+{
+  char     magic[8];
+  uint64_t src_size;
+  int64_t  src_mtime;
+  int64_t  every_ns;
+  uint64_t every_events;
+  uint32_t gap_policy;
+  uint32_t count;
+  uint64_t levels;
+};
+
+struct BookCkptEntry
+{
+  int64_t  ts;           // book after every row with ts <= this
+  int64_t  last_id;
+  uint64_t level_first;  // asks (best first), then bids (best first)
+  uint32_t asks;
+  uint32_t bids;
+};
+
+static string book_sidecar_path(const string& path) { return path + ".book"; }
+
+static bool book_read_header(const string& path, BookCkptHeader& h, ifstream& in)
+{
+  SourceStamp src;
+  if (!source_stamp(path, src)) return false;
+  in.open(book_sidecar_path(path), ios::binary);
+  if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+  return memcmp(h.magic, BOOK_MAGIC, sizeof(h.magic)) == 0
+      && h.src_size == src.size && h.src_mtime == src.mtime;
+}
+
+// Rows of one depth file with ts in [s, e), in file order, through the regular reader
+template <class Fn>
+static uint64_t replay_depth_file(const string& path, int64_t s, int64_t e, Fn&& on_batch)
+{
+  DeltaSelect sel{};
+  sel.eventTime = false;
+  ShardedDB::DeltaBatchReader rdr(make_unique<ShardedDB::DeltaBatchReader::Impl>(
+      vector<Candidate>{Candidate{path, s, e}}, s, e, sel));
+  DeltaColsView v{};
+  uint64_t rows = 0;
+  while (rdr.next(v))
+  {
+    on_batch(v);
+    rows += v.n;
+  }
+  return rows;
+}
+
+bool ShardedDB::build_book_checkpoints(const string& path, const BookCheckpoints& spec, string* err)
+{
+  const string out_path = book_sidecar_path(path);
+  const string tmp = out_path + ".tmp" + to_string(::getpid());
+  try
+  {
+    if (spec.every_ns <= 0 && spec.every_events == 0) throw runtime_error("every_ns or every_events must be set");
+    SourceStamp src;
+    if (!source_stamp(path, src)) throw runtime_error("cannot stat");
+    const int64_t rows = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false)->metadata()->num_rows();
+
+    OrderBook book(spec.on_gap);
+    BookSnapshot snap;
+    vector<BookCkptEntry> entries;
+    vector<BookLevel> levels;
+    int64_t prev_ts = 0, anchor = 0;
+    uint64_t seen = 0, since = 0;
+
+    auto checkpoint = [&]
+    {
+      book.top(SIZE_MAX, snap);
+      entries.push_back(BookCkptEntry{prev_ts, snap.lastId, levels.size(),
+                                      static_cast<uint32_t>(snap.asks.size()), static_cast<uint32_t>(snap.bids.size())});
+      levels.insert(levels.end(), snap.asks.begin(), snap.asks.end());
+      levels.insert(levels.end(), snap.bids.begin(), snap.bids.end());
+      anchor = prev_ts;
+      since = 0;
+    };
+
+    const uint64_t read = replay_depth_file(path, INT64_MIN, INT64_MAX, [&](const DeltaColsView& v)
+    {
+      if (!v.ts) throw runtime_error("depth: missing ts");
+      for (size_t i = 0; i < v.n; ++i)
+      {
+        const int64_t t = v.ts[i];
+        if (seen == 0) anchor = t;
+        else if (t < prev_ts) throw runtime_error("ts not sorted");
+        else if (t > prev_ts && ((spec.every_ns > 0 && t - anchor >= spec.every_ns)
+                                 || (spec.every_events > 0 && since >= spec.every_events)))
+          checkpoint();
+        book.apply(v, i);
+        ++seen;
+        ++since;
+        prev_ts = t;
+      }
+    });
+    if (read != static_cast<uint64_t>(rows))
+      throw runtime_error("read " + to_string(read) + " of " + to_string(rows) + " rows");
+
+    BookCkptHeader h{};
+    memcpy(h.magic, BOOK_MAGIC, sizeof(h.magic));
+    h.src_size     = src.size;
+    h.src_mtime    = src.mtime;
+    h.every_ns     = spec.every_ns;
+    h.every_events = spec.every_events;
+    h.gap_policy   = static_cast<uint32_t>(spec.on_gap);
+    h.count        = static_cast<uint32_t>(entries.size());
+    h.levels       = levels.size();
+    {
+      ofstream out(tmp, ios::binary | ios::trunc);
+      out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+      out.write(reinterpret_cast<const char*>(entries.data()), static_cast<streamsize>(entries.size() * sizeof(BookCkptEntry)));
+      out.write(reinterpret_cast<const char*>(levels.data()), static_cast<streamsize>(levels.size() * sizeof(BookLevel)));
+      if (!out) throw runtime_error("write failed: " + tmp);
+    }
+    fs::rename(tmp, out_path);
+    return true;
+  }
+  catch (const exception& ex)
+  {
+    error_code ec;
+    fs::remove(tmp, ec);
+    if (err) *err = ex.what();
+    return false;
+  }
+}
+
+bool ShardedDB::book_checkpoints_fresh(const string& path)
+{
+  BookCkptHeader h{};
+  ifstream in;
+  return book_read_header(path, h, in);
+}
+
+// Latest checkpoint with ts <= t_ns of a fresh sidecar built with on_gap
+static bool book_load_checkpoint(const string& path, int64_t t_ns, GapPolicy on_gap, BookSnapshot& out)
+{
+  BookCkptHeader h{};
+  ifstream in;
+  if (!book_read_header(path, h, in) || h.gap_policy != static_cast<uint32_t>(on_gap)) return false;
+
+  vector<BookCkptEntry> entries(h.count);
+  if (!in.read(reinterpret_cast<char*>(entries.data()), static_cast<streamsize>(entries.size() * sizeof(BookCkptEntry))))
+    return false;
+  auto it = upper_bound(entries.begin(), entries.end(), t_ns,
+                        [](int64_t t, const BookCkptEntry& e) { return t < e.ts; });
+  if (it == entries.begin()) return false;
+  const BookCkptEntry& e = *--it;
+  if (e.level_first + e.asks + e.bids > h.levels) return false;
+
+  vector<BookLevel> lv(e.asks + e.bids);
+  in.seekg(static_cast<streamoff>(sizeof(h) + entries.size() * sizeof(BookCkptEntry) + e.level_first * sizeof(BookLevel)));
+  if (!in.read(reinterpret_cast<char*>(lv.data()), static_cast<streamsize>(lv.size() * sizeof(BookLevel)))) return false;
+
+  out.ts = e.ts;
+  out.lastId = e.last_id;
+  out.asks.assign(lv.begin(), lv.begin() + e.asks);
+  out.bids.assign(lv.begin() + e.asks, lv.end());
+  return true;
+}
+
+unique_ptr<OrderBook> ShardedDB::book_at_file(const string& path, int64_t t_ns, GapPolicy on_gap, bool use_checkpoints)
+{
+  auto book = make_unique<OrderBook>(on_gap);
+  int64_t from = INT64_MIN;
+  BookSnapshot ck;
+  if (use_checkpoints && book_load_checkpoint(path, t_ns, on_gap, ck))
+  {
+    book->restore(ck);
+    from = ck.ts + 1;
+  }
+  if (t_ns == INT64_MAX || from <= t_ns)
+    replay_depth_file(path, from, t_ns == INT64_MAX ? t_ns : t_ns + 1, [&](const DeltaColsView& v) { book->apply(v); });
+
+  if (g_debug)
+    cerr << "[debug] book_at " << path << ": "
+         << (from == INT64_MIN ? string("from first row") : "checkpoint " + iso_from_ns(ck.ts))
+         << ", replayed " << book->stats().events << " events\n";
+  return book;
+}
 
+unique_ptr<OrderBook> ShardedDB::book_at(int64_t t_ns, const string& symb, optional<string> market, GapPolicy on_gap) const
+{
+  // same lookup as get_depth: with --catalog the footer ts ranges pick the file
+  const int64_t end = t_ns == INT64_MAX ? t_ns : t_ns + 1;
+  auto files = candidate_files_strict(impl_->root_, symb, "depth", move(market), floor_day_ns(t_ns), end, nullopt,
+                                      impl_->catalog());
+  if (files.empty()) return nullptr;
+  return book_at_file(files.front().path, t_ns, on_gap);
+}
@@ -35,6 +35,57 @@ struct TopColsView
   size_t n = 0;
 };
 
+// Time-ordered union of several symbols' top rows (get_top_cols_multi)
+struct TopMultiColsView
+{
+  TopColsView     top;            // merged columns; top.file is nullptr
+  const uint32_t* sym = nullptr;  // per row: index into the symbols passed in
+  size_t n = 0;
+};
+
+// As-of snapshot of every symbol's last quote (get_top_asof). Per-symbol
+// columns are row-major: value of symbol s at row i is at [i * nsym + s].
+struct TopAsofView
+{
+  const int64_t*  ts       = nullptr;  // emission time: event ts or grid point
+  const uint32_t* trigger  = nullptr;  // event mode: symbol whose quote arrived; grid mode: nullptr
+  size_t nsym = 0;
+
+  const int64_t*  ask_px   = nullptr;
+  const int64_t*  ask_qty  = nullptr;
+  const int64_t*  bid_px   = nullptr;
+  const int64_t*  bid_qty  = nullptr;
+  const int64_t*  quote_ts = nullptr;  // ts of the carried quote (0 before the first one)
+  const uint8_t*  valid    = nullptr;  // 1: quote seen and not older than max_age_ns
+  size_t n = 0;
+};
+
+// Time bars built from raw ticks (get_top_bars / get_trade_bars). A bar starts at
+// a multiple of step_ns (UTC epoch aligned); bars without ticks are not emitted.
+struct TopBarView
+{
+  TopColsView    top;              // sampled-file layout: ts = bar start, ask/bid/valu = last
+                                   // tick, min/max px + first ts reaching them; top.file = nullptr
+  const int64_t* count = nullptr;  // ticks in the bar
+  size_t n = 0;
+};
+
+struct TradeBarView
+{
+  const int64_t* ts         = nullptr;  // bar start
+  const int64_t* open       = nullptr;
+  const int64_t* high       = nullptr;
+  const int64_t* low        = nullptr;
+  const int64_t* close      = nullptr;
+  const int64_t* high_ts    = nullptr;  // first trade at the high / low
+  const int64_t* low_ts     = nullptr;
+  const int64_t* vwap       = nullptr;  // sum(px * qty) / sum(qty), rounded; close when volume == 0
+  const int64_t* volume     = nullptr;  // sum(qty), saturated at INT64_MAX (~9.22e10 units at 1e8 scale)
+  const uint8_t* volume_sat = nullptr;  // 1 => sum(qty) exceeded int64 and volume is INT64_MAX
+  const int64_t* count      = nullptr;  // trades in the bar
+  size_t n = 0;
+};
+
 struct DeltaColsView
 {
   const int64_t* ts        = nullptr;
@@ -70,6 +121,40 @@ struct TradeColsView
   size_t n = 0;
 };
 
+// ======== Row predicates (evaluated while decoding) ========
+// Values are compared as stored: int64 columns raw (px/qty scaled 1e8), bool as 0/1.
+
+struct Predicate
+{
+  enum class Op   { Lt, Le, Gt, Ge, Eq, Ne };
+  enum class Kind { All, Cmp, And, Or };
+
+  Kind kind = Kind::All;        // All => every row
+  std::string col;              // Cmp: col <op> value, or (col - col2) <op> value
+  std::string col2;
+  Op op = Op::Eq;
+  int64_t value = 0;
+  std::vector<Predicate> kids;  // And / Or
+
+  static Predicate cmp(std::string c, Op o, int64_t v)
+  {
+    Predicate p; p.kind = Kind::Cmp; p.col = std::move(c); p.op = o; p.value = v; return p;
+  }
+  static Predicate diff(std::string a, std::string b, Op o, int64_t v)
+  {
+    Predicate p = cmp(std::move(a), o, v); p.col2 = std::move(b); return p;
+  }
+};
+
+inline Predicate operator&&(Predicate a, Predicate b)
+{
+  Predicate p; p.kind = Predicate::Kind::And; p.kids = {std::move(a), std::move(b)}; return p;
+}
+inline Predicate operator||(Predicate a, Predicate b)
+{
+  Predicate p; p.kind = Predicate::Kind::Or; p.kids = {std::move(a), std::move(b)}; return p;
+}
+
 // ======== Column selection ========
 
 struct TopSelect
@@ -90,6 +175,8 @@ struct TopSelect
   bool max_bid_ts = false;
   bool min_ask_ts = false;
   bool max_ask_ts = false;
+
+  Predicate where;  // rows to keep (any file column; need not be selected)
 };
 
 struct DeltaSelect
@@ -116,6 +203,192 @@ struct TradeSelect
   bool tradeTime     = true;
   bool isMarket      = true;
   bool eventTime     = true;
+
+  Predicate where;  // rows to keep (any file column; need not be selected)
+};
+
+// ======== Scan counters (cumulative per batch reader) ========
+
+struct ScanStats
+{
+  uint64_t files_opened = 0;
+  uint64_t bytes_read = 0;                  // bytes fetched from parquet files (footer, indexes, pages)
+  uint64_t rows_emitted = 0;                // rows handed out by next()
+  uint64_t row_groups_skipped = 0;          // pruned by ts statistics / page index
+  uint64_t row_groups_decoded = 0;          // ts (and selected columns) decoded
+  uint64_t rows_skipped_by_page_index = 0;  // rows of decoded RGs never decoded
+  uint64_t files_skipped_by_index = 0;      // dropped from a .tsidx header, never opened
+  uint64_t rows_skipped_by_index = 0;       // rows of decoded RGs outside the .tsidx sample span
+  uint64_t buffer_allocs = 0;               // batch/scratch buffer (re)allocations
+  uint64_t buffer_peak_bytes = 0;           // peak bytes held by reader buffers
+  uint64_t cache_columns_hit = 0;           // (file, column) pairs mapped from the column cache
+  uint64_t cache_columns_stored = 0;        // (file, column) pairs decoded whole and cached
+
+  // Read-ahead (set_prefetch), counted per file after the first
+  uint64_t prefetch_ready = 0;              // already prefetched when the reader reached it
+  uint64_t prefetch_waits = 0;              // still being prefetched: the reader blocked on it
+  uint64_t prefetch_wait_ns = 0;            // total time blocked in those waits
+  uint64_t prefetch_missed = 0;             // prefetch had not started: the reader did the I/O itself
+  uint64_t prefetch_bytes = 0;              // bytes of the files prefetched and taken
+
+  // Wall time (ns). File-side times are summed over workers when parallel.
+  uint64_t open_ns = 0;                     // opening / mapping files
+  uint64_t metadata_ns = 0;                 // footer read + parse
+  uint64_t decode_ns = 0;                   // decompression + decoding of column values
+  uint64_t filter_ns = 0;                   // pruning, ts window search, predicates, scatter/gather
+  uint64_t consumer_ns = 0;                 // caller's time between next() calls
+};
+
+// ======== Parallel scan (whole files decoded ahead by a worker pool) ========
+
+struct ParallelScan
+{
+  unsigned workers     = 0;          // 0 => serial, decode on the calling thread
+  size_t   files_ahead = 4;          // max files decoded ahead of next()
+  size_t   byte_budget = 512u << 20; // soft cap on decoded-but-not-taken bytes
+};
+
+// ======== As-of join (last value carried forward across symbols) ========
+
+struct AsofSpec
+{
+  int64_t grid_ns    = 0;       // 0 => a row per input event; else a row per grid point in [first, last event]
+  int64_t max_age_ns = 0;       // 0 => quotes never go stale
+  size_t  batch_rows = 65536;   // max rows per next()
+};
+
+// ======== File I/O mode (how readers open parquet files) ========
+
+enum class IoMode
+{
+  Buffered, // plain file reads, default parquet reader properties
+  Mmap,     // memory map + madvise(SEQUENTIAL, WILLNEED)
+  Pread     // positional reads through a buffered stream of read_bytes
+};
+
+struct IoConfig
+{
+  IoMode mode       = IoMode::Buffered;
+  size_t read_bytes = 1u << 20;       // Pread only: bytes per column-chunk read
+};
+
+// ======== Read-ahead prefetch (background I/O thread) ========
+
+struct PrefetchConfig
+{
+  size_t files_ahead = 2;           // files prefetched ahead of the one being read
+  size_t byte_budget = 256u << 20;  // cap on prefetched bytes the reader has not reached yet
+  bool   into_memory = false;       // read whole files into owned buffers (else warm the page cache)
+};
+
+// Prefetches paths[1..] in order on a background thread, staying within
+// PrefetchConfig's window of the last path reached (page cache only).
+class FilePrefetcher
+{
+public:
+  FilePrefetcher(std::vector<std::string> paths, const PrefetchConfig& cfg);
+  ~FilePrefetcher();
+  FilePrefetcher(const FilePrefetcher&) = delete;
+  FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+
+  // About to open paths[i]: blocks while it is still being prefetched
+  void reached(size_t i);
+  const ScanStats& stats() const;
+
+  struct Impl;
+
+private:
+  std::unique_ptr<Impl> impl_;
+  ScanStats stats_;
+};
+
+// ======== Decoded-column cache (top / trade, opt-in) ========
+
+// One file per (parquet file, column): raw little-endian values, mmap'd on a
+// hit and served zero-copy; stale when the source's size or mtime changes.
+struct ColumnCache
+{
+  std::string dir;                    // empty => off
+  uint64_t    max_bytes = 4ull << 30;  // least recently used entries evicted above this
+};
+
+// ======== L2 order book (depth deltas applied in update-id order) ========
+
+struct BookLevel
+{
+  int64_t px  = 0;
+  int64_t qty = 0;
+};
+
+// Top of the book after the last applied event
+struct BookSnapshot
+{
+  int64_t ts     = 0;
+  int64_t lastId = 0;
+  std::vector<BookLevel> asks;  // best (lowest px) first
+  std::vector<BookLevel> bids;  // best (highest px) first
+};
+
+struct BookStats
+{
+  uint64_t events = 0;           // delta rows applied
+  uint64_t levels_set = 0;       // qty > 0: level inserted or replaced
+  uint64_t levels_removed = 0;   // qty == 0 of a level in the book
+  uint64_t removes_missing = 0;  // qty == 0 of a price not in the book
+  uint64_t gaps = 0;             // firstId > previous lastId + 1
+  uint64_t ids_missed = 0;       // update ids skipped by those gaps
+  uint64_t stale = 0;            // lastId <= previous lastId: dropped
+  uint64_t resets = 0;           // book cleared on a gap (GapPolicy::Reset)
+  uint64_t crossed = 0;          // events leaving best bid >= best ask
+};
+
+enum class GapPolicy
+{
+  Continue,  // keep the levels and apply the event (they may be stale)
+  Reset      // clear both sides, then apply the event
+};
+
+// Price levels as sorted flat arrays, best price last (updates cluster near
+// the top, so inserts and erases move few elements). Rows missing firstId or
+// lastId skip the sequence check.
+class OrderBook
+{
+public:
+  explicit OrderBook(GapPolicy on_gap = GapPolicy::Continue);
+  ~OrderBook();
+  OrderBook(OrderBook&&) noexcept;
+  OrderBook& operator=(OrderBook&&) noexcept;
+  OrderBook(const OrderBook&) = delete;
+  OrderBook& operator=(const OrderBook&) = delete;
+
+  // Row i of a depth batch; false => stale (lastId not past the book's), dropped
+  bool apply(const DeltaColsView& v, size_t i);
+  // Rows [0, v.n) in order; returns the rows applied
+  size_t apply(const DeltaColsView& v);
+
+  // Best n levels per side (fewer when the side is shorter)
+  void top(size_t n, BookSnapshot& out) const;
+  size_t ask_levels() const;
+  size_t bid_levels() const;
+  // Empty book; the next event starts a new sequence
+  void clear();
+  // Book = s's levels; the sequence continues after s.lastId (0 => not started)
+  void restore(const BookSnapshot& s);
+  const BookStats& stats() const;
+
+  struct Impl;
+
+private:
+  std::unique_ptr<Impl> impl_;
+};
+
+// Full-book checkpoints of one depth file (<file>.parquet.book), taken
+// between distinct ts values of a replay from the file's first row
+struct BookCheckpoints
+{
+  int64_t   every_ns     = 60'000'000'000;  // 0 => by events only
+  uint64_t  every_events = 0;               // 0 => by time only
+  GapPolicy on_gap       = GapPolicy::Continue;
 };
 
 // ======== Public DB + columnar-batch readers ========
@@ -132,8 +405,38 @@ public:
 
   // Enable/disable verbose debug printing (file discovery + processing)
   static void set_debug(bool enabled);
-  // Enable/disable Linux prefetch (posix_fadvise/readahead)
+  // Enable/disable read-ahead of the next files on a background thread (serial readers)
   static void set_prefetch(bool enabled);
+  // Read-ahead window and mode used while prefetch is enabled
+  static void set_prefetch_config(const PrefetchConfig& cfg);
+  // Trust ts to be non-decreasing in every file (skip the is_sorted check)
+  static void set_assume_sorted(bool enabled);
+  // Read-ahead worker pool for readers created afterwards (batches keep file order)
+  static void set_parallel(const ParallelScan& cfg);
+  // Discover files through <root>/.parquet_catalog (refreshed by directory mtime and per-file size/mtime)
+  static void set_catalog(bool enabled);
+  // How readers created afterwards open files (prefetch maps the next file in Mmap mode)
+  static void set_io_mode(const IoConfig& cfg);
+  // Decoded-column cache for top/trade readers created afterwards
+  static void set_column_cache(const ColumnCache& cfg);
+  // Skip files and row groups through fresh <file>.tsidx sidecars (readers created afterwards)
+  static void set_time_index(bool enabled);
+  // Write <parquet_path>.tsidx: per row group ts range, first row and byte offset,
+  // plus a ts sample every sample_rows rows of sorted row groups
+  static bool build_time_index(const std::string& parquet_path, uint32_t sample_rows = 4096,
+                               std::string* err = nullptr);
+  // <parquet_path>.tsidx exists and matches the file's size and mtime
+  static bool time_index_fresh(const std::string& parquet_path);
+  // Write <depth_parquet>.book (file must be ts-sorted)
+  static bool build_book_checkpoints(const std::string& depth_parquet, const BookCheckpoints& spec = {},
+                                     std::string* err = nullptr);
+  // <depth_parquet>.book exists and matches the file's size and mtime
+  static bool book_checkpoints_fresh(const std::string& depth_parquet);
+  // Book after every event of the file with ts <= t_ns, replayed from its first row
+  // (from the nearest earlier checkpoint of a fresh sidecar built with on_gap)
+  static std::unique_ptr<OrderBook> book_at_file(const std::string& depth_parquet, int64_t t_ns,
+                                                 GapPolicy on_gap = GapPolicy::Continue,
+                                                 bool use_checkpoints = true);
 
   struct TopBatchReader
   {
@@ -146,6 +449,7 @@ public:
     explicit TopBatchReader(std::unique_ptr<Impl> impl);
 
     bool next(TopColsView& out);
+    const ScanStats& stats() const;
 
   private:
     std::unique_ptr<Impl> impl_;
@@ -164,6 +468,7 @@ public:
     explicit TradeBatchReader(std::unique_ptr<Impl> impl);
 
     bool next(TradeColsView& out);
+    const ScanStats& stats() const;
 
   private:
     std::unique_ptr<Impl> impl_;
@@ -182,6 +487,7 @@ public:
     explicit DeltaBatchReader(std::unique_ptr<Impl> impl);
 
     bool next(DeltaColsView& out);
+    const ScanStats& stats() const;
 
   private:
     std::unique_ptr<Impl> impl_;
@@ -189,6 +495,85 @@ public:
     DeltaBatchReader& operator=(DeltaBatchReader&) = delete;
   };
 
+  // k-way merge of per-symbol top readers: rows ascending by ts (ties by symbol index)
+  struct TopMultiReader
+  {
+    struct Impl;
+
+    TopMultiReader(TopMultiReader&&) noexcept;
+    TopMultiReader& operator=(TopMultiReader&&) noexcept;
+    ~TopMultiReader();
+
+    explicit TopMultiReader(std::unique_ptr<Impl> impl);
+
+    bool next(TopMultiColsView& out);
+    const ScanStats& stats() const;  // summed over symbols
+
+  private:
+    std::unique_ptr<Impl> impl_;
+    TopMultiReader(const TopMultiReader&) = delete;
+    TopMultiReader& operator=(const TopMultiReader&) = delete;
+  };
+
+  // As-of snapshots over a ts-merged multi-symbol top stream
+  struct TopAsofReader
+  {
+    struct Impl;
+
+    TopAsofReader(TopAsofReader&&) noexcept;
+    TopAsofReader& operator=(TopAsofReader&&) noexcept;
+    ~TopAsofReader();
+
+    explicit TopAsofReader(std::unique_ptr<Impl> impl);
+
+    bool next(TopAsofView& out);
+    const ScanStats& stats() const;  // summed over symbols
+
+  private:
+    std::unique_ptr<Impl> impl_;
+    TopAsofReader(const TopAsofReader&) = delete;
+    TopAsofReader& operator=(const TopAsofReader&) = delete;
+  };
+
+  // Streaming time-bar aggregation over a top or trade reader
+  struct TopBarReader
+  {
+    struct Impl;
+
+    TopBarReader(TopBarReader&&) noexcept;
+    TopBarReader& operator=(TopBarReader&&) noexcept;
+    ~TopBarReader();
+
+    explicit TopBarReader(std::unique_ptr<Impl> impl);
+
+    bool next(TopBarView& out);
+    const ScanStats& stats() const;
+
+  private:
+    std::unique_ptr<Impl> impl_;
+    TopBarReader(const TopBarReader&) = delete;
+    TopBarReader& operator=(const TopBarReader&) = delete;
+  };
+
+  struct TradeBarReader
+  {
+    struct Impl;
+
+    TradeBarReader(TradeBarReader&&) noexcept;
+    TradeBarReader& operator=(TradeBarReader&&) noexcept;
+    ~TradeBarReader();
+
+    explicit TradeBarReader(std::unique_ptr<Impl> impl);
+
+    bool next(TradeBarView& out);
+    const ScanStats& stats() const;
+
+  private:
+    std::unique_ptr<Impl> impl_;
+    TradeBarReader(const TradeBarReader&) = delete;
+    TradeBarReader& operator=(const TradeBarReader&) = delete;
+  };
+
   // New overloads (market-aware): market = "fut" | "spot"
   std::unique_ptr<TopBatchReader>   get_top_cols  (int64_t start_ns, int64_t end_ns, const std::string& symb, std::optional<std::string> market, TopSelect sel = {}) const;
   std::unique_ptr<TradeBatchReader> get_trade_cols(int64_t start_ns, int64_t end_ns, const std::string& symb, std::optional<std::string> market, TradeSelect sel = {}) const;
@@ -199,6 +584,31 @@ public:
   std::unique_ptr<TradeBatchReader> get_trade_cols(int64_t start_ns, int64_t end_ns, const std::string& symb, TradeSelect sel = {}) const;
   std::unique_ptr<DeltaBatchReader> get_depth_cols(int64_t start_ns, int64_t end_ns, const std::string& symb, DeltaSelect sel = {}) const;
 
+  // book_at_file on the depth file holding t_ns's day (or month); nullptr if none.
+  // Without a market, the first file found (fut, then spot); with set_catalog(true),
+  // the first whose footer ts range starts at or before t_ns.
+  std::unique_ptr<OrderBook> book_at(int64_t t_ns, const std::string& symb, std::optional<std::string> market,
+                                     GapPolicy on_gap = GapPolicy::Continue) const;
+
+  // Several symbols merged by ts; ts is always read. batch_rows caps rows per next()
+  std::unique_ptr<TopMultiReader> get_top_cols_multi(int64_t start_ns, int64_t end_ns, const std::vector<std::string>& symbs,
+                                                     std::optional<std::string> market, TopSelect sel = {},
+                                                     size_t batch_rows = 65536) const;
+  std::unique_ptr<TopMultiReader> get_top_cols_multi(int64_t start_ns, int64_t end_ns, const std::vector<std::string>& symbs,
+                                                     TopSelect sel = {}) const;
+
+  // Bars of step_ns from raw ticks (ts assumed non-decreasing); batch_rows: soft cap on bars per next()
+  std::unique_ptr<TopBarReader>   get_top_bars  (int64_t start_ns, int64_t end_ns, const std::string& symb,
+                                                 std::optional<std::string> market, int64_t step_ns,
+                                                 size_t batch_rows = 65536) const;
+  std::unique_ptr<TradeBarReader> get_trade_bars(int64_t start_ns, int64_t end_ns, const std::string& symb,
+                                                 std::optional<std::string> market, int64_t step_ns,
+                                                 size_t batch_rows = 65536) const;
+
+  // Latest ask/bid of every symbol at each event (or grid point) of any of them
+  std::unique_ptr<TopAsofReader> get_top_asof(int64_t start_ns, int64_t end_ns, const std::vector<std::string>& symbs,
+                                              std::optional<std::string> market, AsofSpec spec = {}) const;
+
 private:
   struct Impl;
   std::unique_ptr<Impl> impl_;
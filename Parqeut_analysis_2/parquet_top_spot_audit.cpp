@@ -1,12 +1,21 @@
 // parquet_trade_spot_audit.cpp
 // Scan top_spot parquet files and detect anomalies.
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_trade_spot_audit.cpp -lparquet -larrow -lzstd -o parquet_trade_spot_audit
+//   g++ -std=gnu++23 -O3 parquet_trade_spot_audit.cpp -lparquet -larrow -lzstd -pthread -o parquet_trade_spot_audit
 //
 // Usage:
-//   ./parquet_trade_spot_audit /path/to/parquets output.ndjson [--all]
+//   ./parquet_trade_spot_audit /path/to/parquets output.ndjson [--all] [--threads=N] [--cache=FILE [--cache-hash]] [--fast]
 //
 // Produces NDJSON; by default writes only files that have anomalies. Use --all to emit all files.
+// Files are analyzed on --threads workers (default: all cores); output order does not depend on N.
+// --cache=FILE reuses the metrics of files unchanged since the last run (path+size+mtime, + content
+// hash with --cache-hash); outliers and NDJSON are recomputed from all metrics.
+// --fast reads only footers: files whose row counts, null counts and column statistics look clean
+// are reported from those ("footer_only":true; their gap, order, average, cross-book and
+// duplicate-snapshot fields are null); those rules and the outlier tests need a decode and are
+// evaluated for the remaining (decoded) files only.
+
+#include "parquet_audit_pool.h"
 
 #include <parquet/api/reader.h>
 
@@ -20,6 +29,7 @@
 #include <cstdint>
 #include <cmath>
 #include <iomanip>
+#include <stdexcept>
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -47,20 +57,6 @@ static void read_i64_column(parquet::RowGroupReader& rg, int col_idx, vector<int
 }
 
 // Simple Welford accumulator for mean/stddev if needed later
-struct Welford {
-    long double mean = 0.0L, m2 = 0.0L;
-    uint64_t n = 0;
-    void add(long double x) {
-        ++n;
-        long double delta = x - mean;
-        mean += delta / (long double)n;
-        long double delta2 = x - mean;
-        m2 += delta * delta2;
-    }
-    long double variance() const { return (n > 1) ? (m2 / (long double)(n - 1)) : 0.0L; }
-    long double stddev() const { return sqrt((double)variance()); }
-};
-
 struct FileMetric {
     string path;
     int64_t meta_rows = 0;
@@ -91,8 +87,64 @@ struct FileMetric {
     uint64_t cross_book_count = 0; // bid_px > ask_px
     uint64_t repeated_ts_count = 0; // same ts repeated (not necessarily bad)
     long double valu_avg = 0.0L; uint64_t valu_count = 0; int64_t valu_min = numeric_limits<int64_t>::max(), valu_max = numeric_limits<int64_t>::min();
+
+    // --fast (not cached)
+    bool footer_only = false;   // filled by footer_top_file, nothing decoded
+    string escalated;           // why the footer did not clear the file
 };
 
+// Fields kept by --cache (path is the key); keep in step with FileMetric
+template <class F>
+static void audit_fields(FileMetric& m, F&& f) {
+    f(m.meta_rows, m.rows_scanned, m.row_groups,
+      m.has_ts, m.ts_min, m.ts_max, m.max_gap_ns, m.gaps_gt_100ms, m.gaps_gt_1s, m.non_monotonic_ts,
+      m.has_bid_px, m.has_bid_qty, m.has_ask_px, m.has_ask_qty, m.has_valu,
+      m.bid_px_min, m.bid_px_max, m.bid_px_avg, m.bid_px_zero, m.bid_px_count,
+      m.ask_px_min, m.ask_px_max, m.ask_px_avg, m.ask_px_zero, m.ask_px_count,
+      m.bid_qty_min, m.bid_qty_max, m.bid_qty_avg, m.bid_qty_zero, m.bid_qty_count,
+      m.ask_qty_min, m.ask_qty_max, m.ask_qty_avg, m.ask_qty_zero, m.ask_qty_count,
+      m.null_ts, m.null_bid_px, m.null_bid_qty, m.null_ask_px, m.null_ask_qty, m.null_valu,
+      m.duplicate_snapshot_count, m.cross_book_count, m.repeated_ts_count,
+      m.valu_avg, m.valu_count, m.valu_min, m.valu_max);
+}
+
+// --fast: fills `out` from the footer and column statistics alone when they show
+// nothing suspect; otherwise returns false with the reason in `why`. Zero counts
+// are exact (every min > 0); gaps, averages, cross-book and duplicates are not
+// evaluated (null in the NDJSON).
+static bool footer_top_file(const string& path, FileMetric& out, string& why) {
+    out = FileMetric();
+    out.path = path;
+    FooterScan ft;
+    try {
+        audit_footer(path, {{"ts"}, {"bid_px", "bidprice", "bid.price"}, {"bid_qty", "bidqty"},
+                            {"ask_px", "askprice", "ask.price"}, {"ask_qty", "askqty"}, {"valu", "value"}},
+                     0, 100, ft);
+    } catch (const exception& e) {
+        why = e.what();
+        return false;
+    }
+    const FooterColumn &ts = ft.cols[0], &bp = ft.cols[1], &bq = ft.cols[2], &ap = ft.cols[3], &aq = ft.cols[4], &va = ft.cols[5];
+    if (ft.suspects.empty()) {
+        if (bp.min <= 0 || ap.min <= 0) ft.suspects.push_back("px min <= 0");
+        if (bq.min <= 0 || aq.min <= 0) ft.suspects.push_back("qty min <= 0");
+    }
+    if (!ft.suspects.empty()) { why = ft.suspects.front(); return false; }
+
+    const uint64_t n = (uint64_t)ft.meta_rows;
+    out.footer_only = true;
+    out.meta_rows = out.rows_scanned = ft.meta_rows;
+    out.row_groups = ft.row_groups;
+    out.has_ts = out.has_bid_px = out.has_bid_qty = out.has_ask_px = out.has_ask_qty = out.has_valu = true;
+    out.ts_min = ts.min; out.ts_max = ts.max;
+    out.bid_px_min = bp.min; out.bid_px_max = bp.max; out.bid_px_count = n;
+    out.bid_qty_min = bq.min; out.bid_qty_max = bq.max; out.bid_qty_count = n;
+    out.ask_px_min = ap.min; out.ask_px_max = ap.max; out.ask_px_count = n;
+    out.ask_qty_min = aq.min; out.ask_qty_max = aq.max; out.ask_qty_count = n;
+    out.valu_min = va.min; out.valu_max = va.max; out.valu_count = n;
+    return true;
+}
+
 static bool analyze_top_file(const string& path, FileMetric& out, string* err_out=nullptr) {
     out = FileMetric();
     out.path = path;
@@ -269,9 +321,29 @@ static string esc(const string &s) {
     return r;
 }
 
+// Per-worker accumulators of the cross-file statistics, combined with Welford::merge
+struct GlobalStats {
+    Welford rows_ratio, px_avg, qty_avg, max_gap;
+
+    void add(const FileMetric& m) {
+        if (m.footer_only) return;   // --fast: no averages/gaps to compare
+        long double ratio = (m.meta_rows>0) ? ((long double)m.rows_scanned / (long double)m.meta_rows) : 0.0L;
+        rows_ratio.add(ratio);
+        if (m.bid_px_count>0) px_avg.add((long double)m.bid_px_avg);
+        if (m.bid_qty_count>0) qty_avg.add((long double)m.bid_qty_avg);
+        max_gap.add((long double)m.max_gap_ns);
+    }
+    void merge(const GlobalStats& o) {
+        rows_ratio.merge(o.rows_ratio);
+        px_avg.merge(o.px_avg);
+        qty_avg.merge(o.qty_avg);
+        max_gap.merge(o.max_gap);
+    }
+};
+
 int main(int argc, char** argv) {
     if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " /path/to/parquets output.ndjson [--all]\n";
+        cerr << "Usage: " << argv[0] << " /path/to/parquets output.ndjson [--all] [--threads=N] [--cache=FILE [--cache-hash]] [--fast]\n";
         return 1;
     }
 
@@ -291,7 +363,20 @@ int main(int argc, char** argv) {
     string dir = argv[1];
     string out_path = argv[2];
     bool write_all = false;
-    if (argc >= 4 && string(argv[3]) == "--all") write_all = true;
+    unsigned threads = 0;
+    string cache_path;
+    bool cache_hash = false;
+    bool fast = false;
+    for (int i = 3; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--all") write_all = true;
+        else if (a.rfind("--threads=", 0) == 0) threads = (unsigned)stoul(a.substr(10));
+        else if (a.rfind("--cache=", 0) == 0) cache_path = a.substr(8);
+        else if (a == "--cache-hash") cache_hash = true;
+        else if (a == "--fast") fast = true;
+        else { cerr << "Unknown option " << a << "\n"; return 1; }
+    }
+    threads = audit_threads(threads);
 
     vector<string> files;
     for (auto &p : fs::directory_iterator(dir)) {
@@ -307,34 +392,49 @@ int main(int argc, char** argv) {
     if (!fout.is_open()) { cerr << "Failed to open output " << out_path << "\n"; return 1; }
 
     // First pass: analyze all files; write error entries for files that failed to read
-    cerr << "Scanning " << files.size() << " files...\n";
-    for (size_t i=0;i<files.size();++i) {
-        const string &f = files[i];
-        cerr << "[" << (i+1) << "/" << files.size() << "] " << f << " ... " << flush;
-        FileMetric fm;
+    cerr << "Scanning " << files.size() << " files on " << threads << " threads...\n";
+    AuditStore<FileMetric> store(cache_path, "parquet_top_spot_audit", cache_hash);
+    store.stamp(files, threads);
+    size_t footer_only = 0;
+    audit_files<FileMetric>(files, threads,
+        [&](const string& f, FileMetric& fm) {
+            if (store.get(f, fm)) { fm.path = f; return true; }
+            string why, err;
+            if (fast && footer_top_file(f, fm, why)) return true;
+            if (!analyze_top_file(f, fm, &err)) throw runtime_error(err);
+            fm.escalated = why;
+            return true;
+        },
+        [&](size_t i, FileMetric& fm, bool ok, const string& err) {
+            const string &f = files[i];
+            cerr << "[" << (i+1) << "/" << files.size() << "] " << f << " ... ";
+            if (!ok) {
+                cerr << "ERROR: " << err << "\n";
+                // write JSON for failed file (so it is included in NDJSON)
+                ostringstream j;
+                j << "{\"file\":\"" << esc(f) << "\",\"error\":\"" << esc(err) << "\",\"anomalies\":[\"open_read_failed\"]}\n";
+                fout << j.str();
+                return;
+            }
+            cerr << "ok (rows=" << fm.rows_scanned << ")";
+            if (fm.footer_only) cerr << " footer only";
+            else if (!fm.escalated.empty()) cerr << " escalated: " << fm.escalated;
+            cerr << "\n";
+            if (fm.footer_only) ++footer_only;
+            else store.put(f, fm);
+            metrics.push_back(std::move(fm));
+        });
+
+    if (store.enabled()) {
         string err;
-        bool ok = analyze_top_file(f, fm, &err);
-        if (!ok) {
-            cerr << "ERROR: " << err << "\n";
-            // write JSON for failed file (so it is included in NDJSON)
-            ostringstream j;
-            j << "{\"file\":\"" << esc(f) << "\",\"error\":\"" << esc(err) << "\",\"anomalies\":[\"open_read_failed\"]}\n";
-            fout << j.str();
-            continue;
-        }
-        cerr << "ok (rows=" << fm.rows_scanned << ")\n";
-        metrics.push_back(std::move(fm));
+        if (!store.save(&err)) cerr << "WARN: cache " << cache_path << " not saved: " << err << "\n";
+        cerr << "Cache: " << store.hits() << "/" << files.size() << " files reused from " << cache_path << "\n";
     }
+    if (fast) cerr << "Fast: " << footer_only << "/" << files.size() << " files cleared from footers, the rest decoded\n";
 
     // compute global statistics (for z-score outliers)
-    Welford w_rows_ratio, w_px_avg, w_qty_avg, w_max_gap;
-    for (auto &m : metrics) {
-        long double ratio = (m.meta_rows>0) ? ((long double)m.rows_scanned / (long double)m.meta_rows) : 0.0L;
-        w_rows_ratio.add(ratio);
-        if (m.bid_px_count>0) w_px_avg.add((long double)m.bid_px_avg);
-        if (m.bid_qty_count>0) w_qty_avg.add((long double)m.bid_qty_avg);
-        w_max_gap.add((long double)m.max_gap_ns);
-    }
+    const GlobalStats g = audit_reduce<GlobalStats>(metrics.size(), threads,
+        [&](GlobalStats& acc, size_t i) { acc.add(metrics[i]); });
     auto zscore = [&](const Welford &w, long double v)->long double {
         long double sd = w.stddev();
         if (sd <= 0.0L) return 0.0L;
@@ -370,20 +470,22 @@ int main(int argc, char** argv) {
 
         if (m.meta_rows > 0 && m.meta_rows < MIN_META_ROWS) anomalies.push_back("meta_rows < 100 (small file)");
 
-        // statistical outliers (z-score)
-        long double z_rows = (m.meta_rows>0) ? zscore(w_rows_ratio, ((long double)m.rows_scanned / (long double)m.meta_rows)) : 0.0L;
-        if (z_rows > Z_THRESH) anomalies.push_back("rows_ratio statistical_outlier");
-
-        if (m.bid_px_count>0) {
-            long double z_px = zscore(w_px_avg, (long double)m.bid_px_avg);
-            if (z_px > Z_THRESH) anomalies.push_back("px_avg statistical_outlier");
-        }
-        if (m.bid_qty_count>0) {
-            long double z_qty = zscore(w_qty_avg, (long double)m.bid_qty_avg);
-            if (z_qty > Z_THRESH) anomalies.push_back("qty_avg statistical_outlier");
+        // statistical outliers (z-score); footer_only files have no decoded averages/gaps
+        if (!m.footer_only) {
+            long double z_rows = (m.meta_rows>0) ? zscore(g.rows_ratio, ((long double)m.rows_scanned / (long double)m.meta_rows)) : 0.0L;
+            if (z_rows > Z_THRESH) anomalies.push_back("rows_ratio statistical_outlier");
+
+            if (m.bid_px_count>0) {
+                long double z_px = zscore(g.px_avg, (long double)m.bid_px_avg);
+                if (z_px > Z_THRESH) anomalies.push_back("px_avg statistical_outlier");
+            }
+            if (m.bid_qty_count>0) {
+                long double z_qty = zscore(g.qty_avg, (long double)m.bid_qty_avg);
+                if (z_qty > Z_THRESH) anomalies.push_back("qty_avg statistical_outlier");
+            }
+            long double z_gap = zscore(g.max_gap, (long double)m.max_gap_ns);
+            if (z_gap > Z_THRESH) anomalies.push_back("max_gap_ns statistical_outlier");
         }
-        long double z_gap = zscore(w_max_gap, (long double)m.max_gap_ns);
-        if (z_gap > Z_THRESH) anomalies.push_back("max_gap_ns statistical_outlier");
 
         if (anomalies.empty() && !write_all) continue;
 
@@ -394,28 +496,37 @@ int main(int argc, char** argv) {
         o << ",\"meta_rows\":" << m.meta_rows;
         o << ",\"rows_scanned\":" << m.rows_scanned;
         o << ",\"row_groups\":" << m.row_groups;
+        if (m.footer_only) o << ",\"footer_only\":true";
+        // footer_only: row order, gaps, averages, cross-book and duplicates are not evaluated => null
+        auto unk = [&](const auto& v) { if (m.footer_only) o << "null"; else o << v; };
         if (m.has_ts) {
-            o << ",\"ts_min\":" << m.ts_min << ",\"ts_max\":" << m.ts_max << ",\"max_gap_ns\":" << m.max_gap_ns;
-            o << ",\"gaps_gt_100ms\":" << m.gaps_gt_100ms << ",\"gaps_gt_1s\":" << m.gaps_gt_1s << ",\"non_monotonic_ts\":" << m.non_monotonic_ts;
-            o << ",\"repeated_ts\":" << m.repeated_ts_count;
+            o << ",\"ts_min\":" << m.ts_min << ",\"ts_max\":" << m.ts_max << ",\"max_gap_ns\":"; unk(m.max_gap_ns);
+            o << ",\"gaps_gt_100ms\":"; unk(m.gaps_gt_100ms);
+            o << ",\"gaps_gt_1s\":"; unk(m.gaps_gt_1s);
+            o << ",\"non_monotonic_ts\":"; unk(m.non_monotonic_ts);
+            o << ",\"repeated_ts\":"; unk(m.repeated_ts_count);
         } else o << ",\"ts_present\":false";
 
         if (m.has_bid_px) {
-            o << ",\"bid_px_min\":" << m.bid_px_min << ",\"bid_px_max\":" << m.bid_px_max << ",\"bid_px_avg\":" << fixed << setprecision(6) << (double)m.bid_px_avg << ",\"bid_px_zero\":" << m.bid_px_zero << ",\"bid_px_count\":" << m.bid_px_count;
+            o << ",\"bid_px_min\":" << m.bid_px_min << ",\"bid_px_max\":" << m.bid_px_max << ",\"bid_px_avg\":" << fixed << setprecision(6); unk((double)m.bid_px_avg);
+            o << ",\"bid_px_zero\":" << m.bid_px_zero << ",\"bid_px_count\":" << m.bid_px_count;
         } else o << ",\"bid_px_present\":false";
         if (m.has_ask_px) {
-            o << ",\"ask_px_min\":" << m.ask_px_min << ",\"ask_px_max\":" << m.ask_px_max << ",\"ask_px_avg\":" << fixed << setprecision(6) << (double)m.ask_px_avg << ",\"ask_px_zero\":" << m.ask_px_zero << ",\"ask_px_count\":" << m.ask_px_count;
+            o << ",\"ask_px_min\":" << m.ask_px_min << ",\"ask_px_max\":" << m.ask_px_max << ",\"ask_px_avg\":" << fixed << setprecision(6); unk((double)m.ask_px_avg);
+            o << ",\"ask_px_zero\":" << m.ask_px_zero << ",\"ask_px_count\":" << m.ask_px_count;
         } else o << ",\"ask_px_present\":false";
 
         if (m.has_bid_qty) {
-            o << ",\"bid_qty_min\":" << m.bid_qty_min << ",\"bid_qty_max\":" << m.bid_qty_max << ",\"bid_qty_avg\":" << fixed << setprecision(6) << (double)m.bid_qty_avg << ",\"bid_qty_zero\":" << m.bid_qty_zero << ",\"bid_qty_count\":" << m.bid_qty_count;
+            o << ",\"bid_qty_min\":" << m.bid_qty_min << ",\"bid_qty_max\":" << m.bid_qty_max << ",\"bid_qty_avg\":" << fixed << setprecision(6); unk((double)m.bid_qty_avg);
+            o << ",\"bid_qty_zero\":" << m.bid_qty_zero << ",\"bid_qty_count\":" << m.bid_qty_count;
         } else o << ",\"bid_qty_present\":false";
         if (m.has_ask_qty) {
-            o << ",\"ask_qty_min\":" << m.ask_qty_min << ",\"ask_qty_max\":" << m.ask_qty_max << ",\"ask_qty_avg\":" << fixed << setprecision(6) << (double)m.ask_qty_avg << ",\"ask_qty_zero\":" << m.ask_qty_zero << ",\"ask_qty_count\":" << m.ask_qty_count;
+            o << ",\"ask_qty_min\":" << m.ask_qty_min << ",\"ask_qty_max\":" << m.ask_qty_max << ",\"ask_qty_avg\":" << fixed << setprecision(6); unk((double)m.ask_qty_avg);
+            o << ",\"ask_qty_zero\":" << m.ask_qty_zero << ",\"ask_qty_count\":" << m.ask_qty_count;
         } else o << ",\"ask_qty_present\":false";
 
-        o << ",\"duplicate_snapshot_count\":" << m.duplicate_snapshot_count;
-        o << ",\"cross_book_count\":" << m.cross_book_count;
+        o << ",\"duplicate_snapshot_count\":"; unk(m.duplicate_snapshot_count);
+        o << ",\"cross_book_count\":"; unk(m.cross_book_count);
 
         o << ",\"null_counts\":{";
         bool first_nc = true;
@@ -4,11 +4,19 @@
 // Use optional flag --all to write all files.
 //
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_bulk_audit_filtered.cpp -lparquet -larrow -lzstd -o parquet_bulk_audit
+//   g++ -std=gnu++23 -O3 parquet_bulk_audit_filtered.cpp -lparquet -larrow -lzstd -pthread -o parquet_bulk_audit
 //
 // Usage:
 //   ./parquet_bulk_audit /path/to/parquet_dir anomalies.ndjson        # only anomalous files
 //   ./parquet_bulk_audit /path/to/parquet_dir anomalies_all.ndjson --all  # all files
+//   [--threads=N]  analyze files on N workers (default: all cores); output order does not depend on N
+//   [--cache=FILE [--cache-hash]]  reuse metrics of unchanged files (path+size+mtime, + content hash);
+//                  outliers and NDJSON are recomputed from all metrics
+//   [--fast]       footer-only pre-check: files whose row counts, null counts and column statistics
+//                  look clean are reported from the footer ("footer_only":true; gap, order, average
+//                  and dup_tradeid fields are null, no outlier tests); only suspect files are decoded
+
+#include "parquet_audit_pool.h"
 
 #include <parquet/api/reader.h>
 
@@ -16,6 +24,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <unordered_set>
@@ -51,21 +60,6 @@ static void read_i64_column(parquet::RowGroupReader& rg, int col_idx, vector<int
     if (done != rows) out.resize(done);
 }
 
-struct Welford {
-    long double mean = 0.0L;
-    long double m2 = 0.0L;
-    uint64_t n = 0;
-    void add(long double x) {
-        ++n;
-        long double delta = x - mean;
-        mean += delta / (long double)n;
-        long double delta2 = x - mean;
-        m2 += delta * delta2;
-    }
-    long double variance() const { return (n > 1) ? (m2 / (long double)(n - 1)) : 0.0L; }
-    long double stddev() const { return sqrt((double)variance()); }
-};
-
 struct FileMetric {
     string path;
     int64_t meta_rows = 0;
@@ -104,8 +98,61 @@ struct FileMetric {
 
     uint64_t ts_samples = 0;
     long double gap_mean = 0.0L;
+
+    // --fast (not cached)
+    bool footer_only = false;   // filled by footer_file, nothing decoded
+    string escalated;           // why the footer did not clear the file
 };
 
+// Fields kept by --cache (path is the key); keep in step with FileMetric
+template <class F>
+static void audit_fields(FileMetric& m, F&& f)
+{
+    f(m.meta_rows, m.rows_scanned, m.row_groups,
+      m.has_ts, m.ts_min, m.ts_max, m.max_gap_ns, m.gaps_gt_100ms, m.gaps_gt_1s, m.non_monotonic_ts,
+      m.has_px, m.px_min, m.px_max, m.px_avg, m.px_zero_count,
+      m.has_qty, m.qty_min, m.qty_max, m.qty_avg, m.qty_zero_count,
+      m.has_tradeId, m.dup_tradeid, m.tradeid_min, m.tradeid_max,
+      m.null_ts, m.null_px, m.null_qty, m.null_tradeId,
+      m.ts_samples, m.gap_mean);
+}
+
+// --fast: fills `out` from the footer and column statistics alone (nothing is
+// decoded) when they show nothing suspect; otherwise returns false with the
+// reason in `why` and the caller runs analyze_file. Gap, order, average and
+// duplicate fields are not evaluated for such files (null in the NDJSON).
+static bool footer_file(const string& path, FileMetric& out, string& why)
+{
+    out = FileMetric();
+    out.path = path;
+    FooterScan ft;
+    try {
+        audit_footer(path, {{"ts"}, {"px"}, {"qty"}, {"tradeId"}}, 0, 100, ft);
+    } catch (const exception& e) {
+        why = e.what();
+        return false;
+    }
+    const FooterColumn &ts = ft.cols[0], &px = ft.cols[1], &qty = ft.cols[2], &tid = ft.cols[3];
+    if (ft.suspects.empty()) {
+        // span != rows => a gap or a duplicate; span == rows does not rule out a duplicate paired
+        // with a gap (1,2,2,4), so dup_tradeid stays unknown for footer-only files
+        if ((uint64_t)(tid.max - tid.min) + 1 != (uint64_t)ft.meta_rows) ft.suspects.push_back("tradeId span != rows");
+        if (px.min <= 0) ft.suspects.push_back("px min <= 0");
+        if (qty.min <= 0) ft.suspects.push_back("qty min <= 0");
+    }
+    if (!ft.suspects.empty()) { why = ft.suspects.front(); return false; }
+
+    out.footer_only = true;
+    out.meta_rows = out.rows_scanned = ft.meta_rows;
+    out.row_groups = ft.row_groups;
+    out.has_ts = out.has_px = out.has_qty = out.has_tradeId = true;
+    out.ts_min = ts.min; out.ts_max = ts.max; out.ts_samples = (uint64_t)ft.meta_rows;
+    out.px_min = px.min; out.px_max = px.max;
+    out.qty_min = qty.min; out.qty_max = qty.max;
+    out.tradeid_min = (uint64_t)tid.min; out.tradeid_max = (uint64_t)tid.max;
+    return true;
+}
+
 static bool analyze_file(const string& path, FileMetric& out)
 {
     out = FileMetric();
@@ -224,15 +271,39 @@ static bool analyze_file(const string& path, FileMetric& out)
 
         return true;
     } catch (const exception& e) {
-        cerr << "ERROR: open/read failed for " << path << " : " << e.what() << "\n";
-        return false;
+        // printed by the done callback, in file order
+        throw runtime_error("open/read failed for " + path + " : " + e.what());
     }
 }
 
+// Per-worker accumulators of the cross-file statistics, combined with Welford::merge
+struct GlobalStats {
+    Welford rows_ratio, max_gap, gap_mean, px_avg, qty_avg, gaps_gt1s;
+
+    void add(const FileMetric& m) {
+        if (m.footer_only) return;   // --fast: no gaps/averages to compare
+        long double ratio = (m.meta_rows > 0) ? ((long double)m.rows_scanned / (long double)m.meta_rows) : 0.0L;
+        rows_ratio.add(ratio);
+        max_gap.add((long double)m.max_gap_ns);
+        gap_mean.add((long double)m.gap_mean);
+        px_avg.add((long double)m.px_avg);
+        qty_avg.add((long double)m.qty_avg);
+        gaps_gt1s.add((long double)m.gaps_gt_1s);
+    }
+    void merge(const GlobalStats& o) {
+        rows_ratio.merge(o.rows_ratio);
+        max_gap.merge(o.max_gap);
+        gap_mean.merge(o.gap_mean);
+        px_avg.merge(o.px_avg);
+        qty_avg.merge(o.qty_avg);
+        gaps_gt1s.merge(o.gaps_gt1s);
+    }
+};
+
 int main(int argc, char** argv)
 {
     if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " /path/to/parquet_dir output.ndjson [--all]\n";
+        cerr << "Usage: " << argv[0] << " /path/to/parquet_dir output.ndjson [--all] [--threads=N] [--cache=FILE [--cache-hash]] [--fast]\n";
         return 1;
     }
 
@@ -250,7 +321,20 @@ int main(int argc, char** argv)
     string dir = argv[1];
     string out_path = argv[2];
     bool write_all = false;
-    if (argc >= 4 && string(argv[3]) == "--all") write_all = true;
+    unsigned threads = 0;
+    string cache_path;
+    bool cache_hash = false;
+    bool fast = false;
+    for (int i = 3; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--all") write_all = true;
+        else if (a.rfind("--threads=", 0) == 0) threads = (unsigned)stoul(a.substr(10));
+        else if (a.rfind("--cache=", 0) == 0) cache_path = a.substr(8);
+        else if (a == "--cache-hash") cache_hash = true;
+        else if (a == "--fast") fast = true;
+        else { cerr << "Unknown option " << a << "\n"; return 1; }
+    }
+    threads = audit_threads(threads);
 
     vector<string> files;
     for (auto &p : fs::directory_iterator(dir)) {
@@ -264,32 +348,46 @@ int main(int argc, char** argv)
 
     vector<FileMetric> metrics;
     metrics.reserve(files.size());
-    cerr << "Scanning " << files.size() << " files...\n";
-    uint64_t idx = 0;
-    for (auto &f : files) {
-        ++idx;
-        cerr << "[" << idx << "/" << files.size() << "] " << f << " ... " << flush;
-        FileMetric fm;
-        bool ok = analyze_file(f, fm);
-        if (ok) {
-            metrics.push_back(std::move(fm));
-            cerr << "ok (rows=" << metrics.back().rows_scanned << ")\n";
-        } else {
-            cerr << "failed\n";
-        }
+    cerr << "Scanning " << files.size() << " files on " << threads << " threads...\n";
+    AuditStore<FileMetric> store(cache_path, "parquet_trade_spot_audit", cache_hash);
+    store.stamp(files, threads);
+    size_t footer_only = 0;
+    audit_files<FileMetric>(files, threads,
+        [&](const string& f, FileMetric& fm) {
+            if (store.get(f, fm)) { fm.path = f; return true; }
+            string why;
+            if (fast && footer_file(f, fm, why)) return true;
+            const bool ok = analyze_file(f, fm);
+            fm.escalated = why;
+            return ok;
+        },
+        [&](size_t i, FileMetric& fm, bool ok, const string& err) {
+            cerr << "[" << (i + 1) << "/" << files.size() << "] " << files[i] << " ... ";
+            if (ok) {
+                if (fm.footer_only) ++footer_only;
+                else store.put(files[i], fm);
+                metrics.push_back(std::move(fm));
+                const FileMetric& m = metrics.back();
+                cerr << "ok (rows=" << m.rows_scanned << ")";
+                if (m.footer_only) cerr << " footer only";
+                else if (!m.escalated.empty()) cerr << " escalated: " << m.escalated;
+                cerr << "\n";
+            } else {
+                if (!err.empty()) cerr << "ERROR: " << err << "\n";
+                cerr << "failed\n";
+            }
+        });
+
+    if (store.enabled()) {
+        string err;
+        if (!store.save(&err)) cerr << "WARN: cache " << cache_path << " not saved: " << err << "\n";
+        cerr << "Cache: " << store.hits() << "/" << files.size() << " files reused from " << cache_path << "\n";
     }
+    if (fast) cerr << "Fast: " << footer_only << "/" << files.size() << " files cleared from footers, the rest decoded\n";
 
     // global statistics
-    Welford w_rows_ratio, w_max_gap, w_gap_mean, w_px_avg, w_qty_avg, w_gaps_gt1s;
-    for (auto &m : metrics) {
-        long double ratio = (m.meta_rows > 0) ? ((long double)m.rows_scanned / (long double)m.meta_rows) : 0.0L;
-        w_rows_ratio.add(ratio);
-        w_max_gap.add((long double)m.max_gap_ns);
-        w_gap_mean.add((long double)m.gap_mean);
-        w_px_avg.add((long double)m.px_avg);
-        w_qty_avg.add((long double)m.qty_avg);
-        w_gaps_gt1s.add((long double)m.gaps_gt_1s);
-    }
+    const GlobalStats g = audit_reduce<GlobalStats>(metrics.size(), threads,
+        [&](GlobalStats& acc, size_t i) { acc.add(metrics[i]); });
 
     const long double Z_THRESH = 3.0L;
 
@@ -313,23 +411,23 @@ int main(int argc, char** argv)
 
         auto zscore = [&](const Welford &w, long double val) -> long double {
             long double sd = w.stddev();
-            if (sd <= 0.0L) return 0.0L;
+            if (sd <= 0.0L || m.footer_only) return 0.0L;
             return fabsl((val - w.mean) / sd);
         };
 
-        long double z_rows = (m.meta_rows>0) ? zscore(w_rows_ratio, ((long double)m.rows_scanned/(long double)m.meta_rows)) : 0.0L;
+        long double z_rows = (m.meta_rows>0) ? zscore(g.rows_ratio, ((long double)m.rows_scanned/(long double)m.meta_rows)) : 0.0L;
         if (z_rows > Z_THRESH) anomalies.push_back("rows_ratio statistical_outlier");
 
-        long double z_gap = zscore(w_max_gap, (long double)m.max_gap_ns);
+        long double z_gap = zscore(g.max_gap, (long double)m.max_gap_ns);
         if (z_gap > Z_THRESH) anomalies.push_back("max_gap_ns statistical_outlier");
 
-        long double z_gapmean = zscore(w_gap_mean, (long double)m.gap_mean);
+        long double z_gapmean = zscore(g.gap_mean, (long double)m.gap_mean);
         if (z_gapmean > Z_THRESH) anomalies.push_back("gap_mean statistical_outlier");
 
-        long double z_px = zscore(w_px_avg, (long double)m.px_avg);
+        long double z_px = zscore(g.px_avg, (long double)m.px_avg);
         if (m.has_px && z_px > Z_THRESH) anomalies.push_back("px_avg statistical_outlier");
 
-        long double z_qty = zscore(w_qty_avg, (long double)m.qty_avg);
+        long double z_qty = zscore(g.qty_avg, (long double)m.qty_avg);
         if (m.has_qty && z_qty > Z_THRESH) anomalies.push_back("qty_avg statistical_outlier");
 
         // If no anomalies and not asked to write all -> skip
@@ -342,27 +440,33 @@ int main(int argc, char** argv)
         o << ",\"meta_rows\":" << m.meta_rows;
         o << ",\"rows_scanned\":" << m.rows_scanned;
         o << ",\"row_groups\":" << m.row_groups;
+        if (m.footer_only) o << ",\"footer_only\":true";
+        // footer_only: row order, gaps, averages and duplicates are not evaluated => null
+        auto unk = [&](const auto& v) { if (m.footer_only) o << "null"; else o << v; };
         if (m.has_ts) {
             o << ",\"ts_min\":" << m.ts_min << ",\"ts_max\":" << m.ts_max;
-            o << ",\"max_gap_ns\":" << m.max_gap_ns;
-            o << ",\"gap_mean\":" << fixed << setprecision(3) << (double)m.gap_mean;
-            o << ",\"gaps_gt_100ms\":" << m.gaps_gt_100ms << ",\"gaps_gt_1s\":" << m.gaps_gt_1s;
-            o << ",\"non_monotonic_ts\":" << m.non_monotonic_ts;
+            o << ",\"max_gap_ns\":"; unk(m.max_gap_ns);
+            o << ",\"gap_mean\":" << fixed << setprecision(3); unk((double)m.gap_mean);
+            o << ",\"gaps_gt_100ms\":"; unk(m.gaps_gt_100ms);
+            o << ",\"gaps_gt_1s\":"; unk(m.gaps_gt_1s);
+            o << ",\"non_monotonic_ts\":"; unk(m.non_monotonic_ts);
         } else {
             o << ",\"ts_present\":false";
         }
         if (m.has_px) {
-            o << ",\"px_min\":" << m.px_min << ",\"px_max\":" << m.px_max << ",\"px_avg\":" << fixed << setprecision(6) << (double)m.px_avg << ",\"px_zero_count\":" << m.px_zero_count;
+            o << ",\"px_min\":" << m.px_min << ",\"px_max\":" << m.px_max << ",\"px_avg\":" << fixed << setprecision(6); unk((double)m.px_avg);
+            o << ",\"px_zero_count\":" << m.px_zero_count;   // footer: px min > 0 => 0
         } else {
             o << ",\"px_present\":false";
         }
         if (m.has_qty) {
-            o << ",\"qty_min\":" << m.qty_min << ",\"qty_max\":" << m.qty_max << ",\"qty_avg\":" << fixed << setprecision(6) << (double)m.qty_avg << ",\"qty_zero_count\":" << m.qty_zero_count;
+            o << ",\"qty_min\":" << m.qty_min << ",\"qty_max\":" << m.qty_max << ",\"qty_avg\":" << fixed << setprecision(6); unk((double)m.qty_avg);
+            o << ",\"qty_zero_count\":" << m.qty_zero_count;   // footer: qty min > 0 => 0
         } else {
             o << ",\"qty_present\":false";
         }
         if (m.has_tradeId) {
-            o << ",\"tradeId_min\":" << (m.tradeid_min==numeric_limits<uint64_t>::max()?0:m.tradeid_min) << ",\"tradeId_max\":" << m.tradeid_max << ",\"dup_tradeid\":" << m.dup_tradeid;
+            o << ",\"tradeId_min\":" << (m.tradeid_min==numeric_limits<uint64_t>::max()?0:m.tradeid_min) << ",\"tradeId_max\":" << m.tradeid_max << ",\"dup_tradeid\":"; unk(m.dup_tradeid);
         } else {
             o << ",\"tradeId_present\":false";
         }
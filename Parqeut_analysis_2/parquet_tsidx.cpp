@@ -0,0 +1,91 @@
+// parquet_tsidx.cpp
+// Build / refresh <file>.parquet.tsidx time-range sidecars used by
+// parquet_reader --tsidx (ShardedDB::set_time_index).
+// Build:
+//   g++ -std=gnu++23 -O3 parquet_tsidx.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_tsidx
+//
+// Usage:
+//   ./parquet_tsidx <root | file.parquet>... [--sample-rows=N] [--force] [--debug]
+// Directories are walked recursively; sidecars already matching their file's
+// size and mtime are kept unless --force.
+
+#include "parquet_reader_lib.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+  vector<string> inputs;
+  uint32_t sample_rows = 4096;
+  bool force = false, debug = false;
+
+  for (int i = 1; i < argc; ++i) {
+    const string a = argv[i];
+    if (a.rfind("--sample-rows=",0)==0) {
+      const long v = stol(a.substr(14));
+      if (v <= 0 || v > UINT32_MAX) { cerr << "ERROR: --sample-rows must be in 1.." << UINT32_MAX << "\n"; return 1; }
+      sample_rows = static_cast<uint32_t>(v);
+    } else if (a=="--force") {
+      force = true;
+    } else if (a=="--debug") {
+      debug = true;
+    } else if (a.rfind("--",0)==0) {
+      cerr << "ERROR: unknown option " << a << "\n"; return 1;
+    } else {
+      inputs.push_back(a);
+    }
+  }
+  if (inputs.empty()) {
+    cerr << "Usage: " << argv[0] << " <root | file.parquet>... [--sample-rows=N] [--force] [--debug]\n"
+         << "        [--sample-rows=N]  (default: 4096; ts sample every N rows of sorted row groups)\n"
+         << "        [--force]          (rebuild sidecars that are still fresh)\n"
+         << "        [--debug]          (one line per file)\n";
+    return 1;
+  }
+
+  // ---------- collect parquet files ----------
+  vector<string> files;
+  for (const string& in : inputs) {
+    error_code ec;
+    if (fs::is_directory(in, ec)) {
+      for (fs::recursive_directory_iterator it(in, fs::directory_options::skip_permission_denied, ec), end;
+           !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().extension() == ".parquet") files.push_back(it->path().string());
+      }
+      if (ec) cerr << "WARN: walk " << in << " : " << ec.message() << "\n";
+    } else if (fs::is_regular_file(in, ec)) {
+      files.push_back(in);
+    } else {
+      cerr << "WARN: not found: " << in << "\n";
+    }
+  }
+
+  // ---------- build ----------
+  uint64_t built = 0, fresh = 0, failed = 0;
+  for (const string& f : files) {
+    if (!force && ShardedDB::time_index_fresh(f)) {
+      ++fresh;
+      if (debug) cerr << "[debug] fresh " << f << "\n";
+      continue;
+    }
+    string err;
+    if (ShardedDB::build_time_index(f, sample_rows, &err)) {
+      ++built;
+      if (debug) cerr << "[debug] built " << f << "\n";
+    } else {
+      ++failed;
+      cerr << "WARN: " << f << " : " << err << "\n";
+    }
+  }
+
+  cerr << "tsidx: files=" << files.size() << " built=" << built << " fresh=" << fresh
+       << " failed=" << failed << "\n";
+  return failed ? 2 : 0;
+}